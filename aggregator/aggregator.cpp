@@ -0,0 +1,792 @@
+/*
+ * Multi-Node Aggregator (native build)
+ * Merges the binary streams (`o binary`, docs/binary_protocol.md) of
+ * several scanner nodes into one device table with per-node RSSI and
+ * writes one live feed to stdout, one JSON object per line.
+ *
+ *   pio run -e aggregator
+ *   .pio/build/aggregator/program [options] [name=]input[@offset_ms] ...
+ *
+ * An input is a serial port (/dev/ttyACM0, switched to raw mode), a FIFO,
+ * `-` for stdin, or a capture file. Live inputs are aligned to the host
+ * clock: a node's offset is the smallest (host arrival - node millis())
+ * seen, allowed to creep by 100 ppm for crystal drift and re-anchored
+ * when the node resets. Capture files keep their own timestamps plus
+ * offset_ms (default 0), so captures made together can be lined up.
+ *
+ * Threads: one reader per input (framing, decoding, alignment); a merger
+ * that releases reports in aligned time order across all inputs, waiting
+ * at most the hold time for a quiet live node; shard workers that each own
+ * the devices whose address hashes to them; and the writer, which puts the
+ * shards' events back into merge order.
+ *
+ * Options:
+ *   -S <shards>    device table shards, one worker thread each (default: CPU count)
+ *   -H <ms>        how long the merge waits for a quiet live node (default 250)
+ *   -w <ms>        node RSSI older than this is left out (default 10000)
+ *   -m <dB>        the nearest node changes when another is this much stronger (default 4)
+ *   -u <ms>        per-device update with the node RSSI at most this often (default 5000, 0 = off)
+ *   -t <seconds>   forget devices unheard this long (default 300, 0 = never)
+ *   -i <seconds>   status to stderr this often (default 10, 0 = off)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "binary_record.h"
+
+#define AGG_MAX_SHARDS      32
+#define AGG_INPUT_QUEUE     4096    // decoded reports waiting per input (readers block beyond)
+#define AGG_SHARD_QUEUE     8192
+#define AGG_DRIFT_PPM       100     // node crystal drift the alignment follows
+#define AGG_RESET_MS        1000    // node clock going back further than this: the node reset
+#define AGG_SWEEP_MS        1000    // shards look for devices to forget this often
+
+struct Options {
+  unsigned shards = 0;
+  int64_t holdMs = 250;
+  int64_t windowMs = 10000;
+  int marginDb = 4;
+  int64_t updateMs = 5000;
+  int64_t ttlMs = 300000;
+  unsigned statusSeconds = 10;
+};
+
+static Options g_opt;
+static std::atomic<bool> g_stop{false};
+
+static int64_t hostMs() {
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// ============================================================================
+// Channels: mutex + condition variable queues between the stages
+// ============================================================================
+
+template <typename T>
+class Channel {
+private:
+  std::mutex m;
+  std::condition_variable readable;
+  std::condition_variable writable;
+  std::deque<T> items;
+  size_t capacity;
+  bool closed = false;
+
+public:
+  explicit Channel(size_t cap = SIZE_MAX) : capacity(cap) {}
+
+  // Blocks while full; false once closed
+  bool push(T&& item) {
+    std::unique_lock<std::mutex> lock(m);
+    writable.wait(lock, [&] { return items.size() < capacity || closed; });
+    if (closed) return false;
+    items.push_back(std::move(item));
+    readable.notify_one();
+    return true;
+  }
+
+  // Moves everything queued into out; waits up to timeoutMs for the first
+  // item. False when closed and drained.
+  bool popAll(std::deque<T>& out, int64_t timeoutMs) {
+    std::unique_lock<std::mutex> lock(m);
+    if (items.empty() && !closed && timeoutMs > 0) {
+      readable.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                        [&] { return !items.empty() || closed; });
+    }
+    if (items.empty()) return !closed;
+    if (out.empty()) out.swap(items);
+    else while (!items.empty()) {
+      out.push_back(std::move(items.front()));
+      items.pop_front();
+    }
+    writable.notify_all();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(m);
+    closed = true;
+    readable.notify_all();
+    writable.notify_all();
+  }
+};
+
+// The merger sleeps on this until any reader has news
+struct Wakeup {
+  std::mutex m;
+  std::condition_variable cv;
+  bool pending = false;
+
+  void notify() {
+    {
+      std::lock_guard<std::mutex> lock(m);
+      pending = true;
+    }
+    cv.notify_one();
+  }
+
+  void wait(int64_t timeoutMs) {
+    std::unique_lock<std::mutex> lock(m);
+    cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&] { return pending; });
+    pending = false;
+  }
+};
+
+static Wakeup g_mergeWakeup;
+
+// ============================================================================
+// Inputs: one reader thread per node stream
+// ============================================================================
+
+// One decoded report with its aligned time
+struct Observation {
+  uint64_t seq;          // merge order, set by the merger
+  int64_t t;             // aligned time, ms (Unix time for live inputs)
+  uint16_t node;
+  uint8_t addr[6];
+  uint8_t addrType;
+  int8_t rssi;
+  uint8_t flags;
+  uint8_t len;
+  uint8_t data[BIN_MAX_AD_DATA];
+};
+
+struct Input {
+  std::string name;
+  std::string path;
+  int64_t fileOffset = 0;
+  bool live = false;       // aligned to the host clock
+  int fd = -1;
+  uint16_t id = 0;
+
+  Channel<Observation> queue{AGG_INPUT_QUEUE};
+  std::atomic<bool> finished{false};
+  std::atomic<int64_t> lastArrival{0};   // host ms of the last decoded frame
+
+  // Alignment (reader thread only)
+  bool anchored = false;
+  double offset = 0;       // aligned - node time, ms
+  int64_t lastAdjust = 0;
+  uint32_t lastRaw = 0;
+  int64_t rawBase = 0;     // added to the 32-bit node time (wraps, file resets)
+  bool haveRaw = false;
+
+  // Statistics, read by the status printer
+  std::atomic<uint64_t> frames{0};
+  std::atomic<uint64_t> badFrames{0};
+  std::atomic<uint32_t> resets{0};
+  std::atomic<int64_t> offsetMs{0};
+};
+
+static std::vector<Input*> g_inputs;
+
+// Parse "[name=]path[@offset_ms]"
+static bool parseInput(const char* spec, Input& in) {
+  std::string s(spec);
+  size_t eq = s.find('=');
+  if (eq != std::string::npos) {
+    in.name = s.substr(0, eq);
+    s = s.substr(eq + 1);
+  }
+  size_t at = s.rfind('@');
+  if (at != std::string::npos) {
+    char* end = nullptr;
+    in.fileOffset = strtoll(s.c_str() + at + 1, &end, 0);
+    if (end == nullptr || *end != 0) return false;
+    s = s.substr(0, at);
+  }
+  if (s.empty()) return false;
+  in.path = s;
+  if (in.name.empty()) {
+    size_t slash = s.rfind('/');
+    in.name = slash == std::string::npos ? s : s.substr(slash + 1);
+  }
+  return true;
+}
+
+static bool openInput(Input& in) {
+  in.fd = in.path == "-" ? STDIN_FILENO : open(in.path.c_str(), O_RDONLY | O_NOCTTY);
+  if (in.fd < 0) {
+    fprintf(stderr, "[ERROR] Cannot open %s: %s\n", in.path.c_str(), strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(in.fd, &st) != 0) return false;
+  in.live = !S_ISREG(st.st_mode);
+
+  // A serial port: raw bytes, no echo or line editing (USB CDC ignores the speed)
+  if (isatty(in.fd)) {
+    struct termios tio;
+    if (tcgetattr(in.fd, &tio) == 0) {
+      cfmakeraw(&tio);
+      cfsetspeed(&tio, B115200);
+      tio.c_cflag |= CLOCAL | CREAD;
+      tio.c_cc[VMIN] = 1;
+      tio.c_cc[VTIME] = 0;
+      tcsetattr(in.fd, TCSANOW, &tio);
+    }
+  }
+  return true;
+}
+
+// Node millis() to aligned time. Live: the smallest arrival - node time
+// seen is the offset (the least delayed frame), creeping by the drift
+// allowance so a slow node clock is followed. A clock that goes back is a
+// node reset: live inputs re-anchor, files continue where they were.
+static int64_t alignTime(Input& in, uint32_t raw, int64_t arrival) {
+  if (in.haveRaw && raw < in.lastRaw) {
+    bool wrapped = in.lastRaw > 0xC0000000u && raw < 0x40000000u;
+    if (wrapped) {
+      in.rawBase += 0x100000000LL;
+    } else if (in.lastRaw - raw > AGG_RESET_MS) {
+      in.resets++;
+      if (in.live) {
+        in.rawBase = 0;
+        in.anchored = false;
+      } else {
+        in.rawBase += (int64_t)in.lastRaw - raw + 1;
+      }
+    }
+  }
+  in.lastRaw = raw;
+  in.haveRaw = true;
+  int64_t nodeMs = in.rawBase + raw;
+
+  if (!in.live) return nodeMs + in.fileOffset;
+
+  double sample = (double)(arrival - nodeMs);
+  if (!in.anchored) {
+    in.offset = sample;
+    in.anchored = true;
+  } else {
+    in.offset += (double)(arrival - in.lastAdjust) * AGG_DRIFT_PPM / 1e6;
+    if (sample < in.offset) in.offset = sample;
+  }
+  in.lastAdjust = arrival;
+  in.offsetMs = llround(in.offset);
+  return nodeMs + llround(in.offset);
+}
+
+static bool decodeFrame(const uint8_t* frame, size_t len, BinaryReport& r, uint8_t* rec) {
+  if (len == 0 || len > BIN_MAX_FRAME) return false;
+  size_t n = cobsDecode(frame, len, rec, BIN_MAX_RECORD);
+  return n > 0 && binDecodeReport(rec, n, r);
+}
+
+static void handleFrame(Input& in, const uint8_t* frame, size_t len, int64_t arrival) {
+  uint8_t rec[BIN_MAX_RECORD];
+  BinaryReport r;
+  bool ok = decodeFrame(frame, len, r, rec);
+  // Text printed by the node has no delimiter of its own, so a frame right
+  // after a text line arrives behind it: retry after each line end
+  for (size_t i = 0; !ok && i + 1 < len; i++) {
+    if (frame[i] == '\n') ok = decodeFrame(frame + i + 1, len - i - 1, r, rec);
+  }
+  if (!ok) {
+    in.badFrames++;
+    return;
+  }
+
+  Observation o;
+  o.seq = 0;
+  o.t = alignTime(in, r.timestamp, arrival);
+  o.node = in.id;
+  memcpy(o.addr, r.addr, sizeof(o.addr));
+  o.addrType = r.addrType;
+  o.rssi = r.rssi;
+  o.flags = r.flags;
+  o.len = r.len;
+  memcpy(o.data, r.data, r.len);
+  in.frames++;
+  in.lastArrival = arrival;
+  in.queue.push(std::move(o));
+  g_mergeWakeup.notify();
+}
+
+static void readerThread(Input* input) {
+  Input& in = *input;
+  std::vector<uint8_t> frame;
+  frame.reserve(1024);
+  uint8_t buf[4096];
+
+  while (!g_stop) {
+    if (in.live) {
+      struct pollfd p = { in.fd, POLLIN, 0 };
+      int ready = poll(&p, 1, 200);
+      if (ready == 0) continue;   // check g_stop now and then
+      if (ready < 0 && errno == EINTR) continue;
+      if (ready < 0) {
+        fprintf(stderr, "[ERROR] %s: %s\n", in.name.c_str(), strerror(errno));
+        break;
+      }
+    }
+    ssize_t n = read(in.fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      if (n < 0) fprintf(stderr, "[ERROR] %s: %s\n", in.name.c_str(), strerror(errno));
+      break;
+    }
+    int64_t arrival = hostMs();
+    for (ssize_t i = 0; i < n; i++) {
+      if (buf[i] != 0) {
+        // Longer than any frame: text or noise, kept only up to a bound
+        if (frame.size() < 4 * BIN_MAX_FRAME) frame.push_back(buf[i]);
+        continue;
+      }
+      if (!frame.empty()) handleFrame(in, frame.data(), frame.size(), arrival);
+      frame.clear();
+    }
+  }
+
+  if (in.fd != STDIN_FILENO) close(in.fd);
+  in.finished = true;
+  in.queue.close();
+  g_mergeWakeup.notify();
+}
+
+// ============================================================================
+// Shards: each worker owns the devices whose key hashes to it
+// ============================================================================
+
+struct NodeSignal {
+  uint16_t node;
+  int16_t rssi16;          // smoothed RSSI in 1/16 dB, alpha 1/8 as on the scanner
+  int64_t lastSeen;
+  uint32_t reports;
+};
+
+struct Device {
+  uint8_t addr[6];
+  uint8_t addrType;
+  uint32_t adHash = 0;
+  int64_t firstSeen = 0;
+  int64_t lastSeen = 0;
+  int64_t lastEmit = 0;
+  int nearest = -1;        // index into nodes
+  std::vector<NodeSignal> nodes;
+};
+
+// Work for a shard: a report, or a marker promising that every report
+// before seq has been dispatched
+struct ShardItem {
+  bool marker;
+  uint64_t seq;
+  Observation obs;
+};
+
+// Feed line or marker from a shard to the writer
+struct FeedItem {
+  unsigned shard;
+  bool marker;
+  uint64_t seq;
+  std::string line;
+};
+
+static Channel<FeedItem> g_feed;
+
+static uint64_t deviceKey(const uint8_t* addr, uint8_t addrType) {
+  uint64_t key = addrType;
+  for (int i = 0; i < 6; i++) key = (key << 8) | addr[i];
+  return key;
+}
+
+static unsigned shardOf(uint64_t key, unsigned shards) {
+  key ^= key >> 33;
+  key *= 0xFF51AFD7ED558CCDull;
+  key ^= key >> 33;
+  return (unsigned)(key % shards);
+}
+
+static uint32_t payloadHash(const uint8_t* data, uint8_t len) {
+  uint32_t h = 2166136261u;   // FNV-1a
+  for (uint8_t i = 0; i < len; i++) h = (h ^ data[i]) * 16777619u;
+  return h;
+}
+
+class Shard {
+private:
+  unsigned index;
+  Channel<ShardItem> queue{AGG_SHARD_QUEUE};
+  std::unordered_map<uint64_t, Device> devices;
+  int64_t lastSweep = 0;
+
+  // Strongest node heard within the window, keeping the current one
+  // unless another beats it by the margin
+  int pickNearest(const Device& dev, int64_t now) const {
+    int best = -1;
+    for (size_t i = 0; i < dev.nodes.size(); i++) {
+      if (now - dev.nodes[i].lastSeen > g_opt.windowMs) continue;
+      if (best < 0 || dev.nodes[i].rssi16 > dev.nodes[best].rssi16) best = (int)i;
+    }
+    int current = dev.nearest;
+    if (best < 0 || current < 0 || best == current) return best;
+    if (now - dev.nodes[current].lastSeen > g_opt.windowMs) return best;
+    return dev.nodes[best].rssi16 - dev.nodes[current].rssi16 >= g_opt.marginDb * 16 ? best : current;
+  }
+
+  void emit(const char* event, const Device& dev, const Observation& o, bool withData) {
+    char text[1024];
+    int n = snprintf(text, sizeof(text),
+                     "{\"t\":%lld,\"event\":\"%s\",\"addr\":\"%02X:%02X:%02X:%02X:%02X:%02X\","
+                     "\"addr_type\":%u,\"node\":\"%s\",\"rssi\":%d,\"nearest\":",
+                     (long long)o.t, event, dev.addr[5], dev.addr[4], dev.addr[3],
+                     dev.addr[2], dev.addr[1], dev.addr[0], (unsigned)dev.addrType,
+                     g_inputs[o.node]->name.c_str(), (int)o.rssi);
+    std::string line(text, n < (int)sizeof(text) ? n : (int)sizeof(text) - 1);
+    if (dev.nearest >= 0) {
+      line += '"';
+      line += g_inputs[dev.nodes[dev.nearest].node]->name;
+      line += '"';
+    } else {
+      line += "null";
+    }
+
+    // Per-node RSSI for coarse localization: nodes heard within the window
+    line += ",\"nodes\":{";
+    bool first = true;
+    for (const NodeSignal& s : dev.nodes) {
+      if (o.t - s.lastSeen > g_opt.windowMs) continue;
+      n = snprintf(text, sizeof(text), "%s\"%s\":{\"rssi\":%.1f,\"age\":%lld,\"reports\":%u}",
+                   first ? "" : ",", g_inputs[s.node]->name.c_str(), s.rssi16 / 16.0,
+                   (long long)(o.t - s.lastSeen), (unsigned)s.reports);
+      line.append(text, n < (int)sizeof(text) ? n : (int)sizeof(text) - 1);
+      first = false;
+    }
+    line += '}';
+
+    if (withData) {
+      line += ",\"flags\":";
+      line += std::to_string(o.flags);
+      line += ",\"data\":\"";
+      static const char digits[] = "0123456789ABCDEF";
+      for (uint8_t i = 0; i < o.len; i++) {
+        line += digits[o.data[i] >> 4];
+        line += digits[o.data[i] & 0x0F];
+      }
+      line += '"';
+    }
+    line += "}\n";
+    g_feed.push(FeedItem{index, false, o.seq, std::move(line)});
+  }
+
+  void process(const Observation& o) {
+    uint64_t key = deviceKey(o.addr, o.addrType);
+    auto found = devices.find(key);
+    bool isNew = found == devices.end();
+    Device& dev = isNew ? devices[key] : found->second;
+    uint32_t hash = payloadHash(o.data, o.len);
+    if (isNew) {
+      memcpy(dev.addr, o.addr, sizeof(dev.addr));
+      dev.addrType = o.addrType;
+      dev.firstSeen = o.t;
+    }
+    dev.lastSeen = o.t;
+
+    NodeSignal* s = nullptr;
+    for (NodeSignal& n : dev.nodes) {
+      if (n.node == o.node) s = &n;
+    }
+    if (s == nullptr) {
+      dev.nodes.push_back(NodeSignal{o.node, (int16_t)(o.rssi * 16), o.t, 0});
+      s = &dev.nodes.back();
+    } else {
+      s->rssi16 += (int16_t)((o.rssi * 16 - s->rssi16) / 8);
+      s->lastSeen = o.t;
+    }
+    s->reports++;
+
+    int nearest = pickNearest(dev, o.t);
+    bool moved = !isNew && nearest != dev.nearest;
+    dev.nearest = nearest;
+    bool changed = !isNew && hash != dev.adHash;
+    dev.adHash = hash;
+
+    const char* event = nullptr;
+    if (isNew) event = "new";
+    else if (changed) event = "changed";
+    else if (moved) event = "moved";
+    else if (g_opt.updateMs > 0 && o.t - dev.lastEmit >= g_opt.updateMs) event = "update";
+    if (event == nullptr) return;
+    dev.lastEmit = o.t;
+    emit(event, dev, o, isNew || changed);
+  }
+
+  void sweep(int64_t now) {
+    if (g_opt.ttlMs == 0 || now - lastSweep < AGG_SWEEP_MS) return;
+    lastSweep = now;
+    for (auto it = devices.begin(); it != devices.end();) {
+      if (now - it->second.lastSeen > g_opt.ttlMs) {
+        it = devices.erase(it);
+        forgotten++;
+      } else {
+        ++it;
+      }
+    }
+    deviceCount = devices.size();
+  }
+
+public:
+  std::atomic<size_t> deviceCount{0};
+  std::atomic<uint64_t> forgotten{0};
+
+  explicit Shard(unsigned i) : index(i) {}
+
+  void push(ShardItem&& item) { queue.push(std::move(item)); }
+  void close() { queue.close(); }
+
+  void run() {
+    std::deque<ShardItem> batch;
+    while (queue.popAll(batch, 1000)) {
+      for (const ShardItem& item : batch) {
+        if (item.marker) {
+          g_feed.push(FeedItem{index, true, item.seq, std::string()});
+          continue;
+        }
+        process(item.obs);
+        sweep(item.obs.t);
+      }
+      batch.clear();
+      deviceCount = devices.size();
+    }
+    g_feed.push(FeedItem{index, true, UINT64_MAX, std::string()});
+  }
+};
+
+static std::vector<Shard*> g_shards;
+static std::atomic<uint64_t> g_merged{0};
+
+// ============================================================================
+// Merger: releases reports in aligned time order across the inputs
+// ============================================================================
+
+// An input without a report waiting holds the merge back, unless it has
+// ended, or it is live and has been quiet for the hold time (it may have
+// nothing to say; its late reports are then merged as they come)
+static bool mayPass(const Input& in, bool drained, int64_t now) {
+  return drained || (in.live && now - in.lastArrival > g_opt.holdMs);
+}
+
+static void mergerThread() {
+  size_t count = g_inputs.size();
+  std::vector<std::deque<Observation>> heads(count);
+  std::vector<bool> drained(count, false);   // ended, and everything taken
+  uint64_t seq = 0;
+
+  while (true) {
+    // Refill only inputs with nothing waiting, so the bounded input queues
+    // keep readers from running far ahead
+    bool open = false;
+    for (size_t i = 0; i < count; i++) {
+      if (heads[i].empty() && !drained[i]) drained[i] = !g_inputs[i]->queue.popAll(heads[i], 0);
+      if (!heads[i].empty() || !drained[i]) open = true;
+    }
+
+    uint64_t released = 0;
+    int64_t now = hostMs();
+    while (true) {
+      int next = -1;
+      for (size_t i = 0; i < count; i++) {
+        if (!heads[i].empty() && (next < 0 || heads[i].front().t < heads[next].front().t)) {
+          next = (int)i;
+        }
+      }
+      if (next < 0) break;
+      bool blocked = false;
+      for (size_t i = 0; i < count && !blocked; i++) {
+        if (heads[i].empty() && !mayPass(*g_inputs[i], drained[i], now)) blocked = true;
+      }
+      if (blocked) break;
+
+      ShardItem item;
+      item.marker = false;
+      item.obs = heads[next].front();
+      heads[next].pop_front();
+      item.seq = item.obs.seq = seq++;
+      g_shards[shardOf(deviceKey(item.obs.addr, item.obs.addrType), g_shards.size())]
+          ->push(std::move(item));
+      released++;
+      if (heads[next].empty()) break;   // refill it before comparing again
+    }
+
+    if (released > 0) {
+      g_merged += released;
+      for (Shard* s : g_shards) s->push(ShardItem{true, seq, Observation()});
+    } else if (!open) {
+      break;
+    } else {
+      g_mergeWakeup.wait(g_opt.holdMs / 4 + 1);
+    }
+  }
+
+  for (Shard* s : g_shards) s->close();
+}
+
+// ============================================================================
+// Writer: the shards' events back in merge order
+// ============================================================================
+
+struct FeedLater {
+  bool operator()(const FeedItem* a, const FeedItem* b) const { return a->seq > b->seq; }
+};
+
+static std::atomic<uint64_t> g_events{0};
+
+static void writerThread() {
+  std::vector<uint64_t> watermark(g_shards.size(), 0);
+  std::priority_queue<FeedItem*, std::vector<FeedItem*>, FeedLater> pending;
+  std::deque<FeedItem> batch;
+  bool running = true;
+
+  while (running) {
+    g_feed.popAll(batch, 100);
+    for (FeedItem& item : batch) {
+      if (item.marker) watermark[item.shard] = item.seq;
+      else pending.push(new FeedItem(std::move(item)));
+    }
+    batch.clear();
+
+    // Every shard has handled everything before its last marker
+    uint64_t safe = UINT64_MAX;
+    for (uint64_t w : watermark) safe = w < safe ? w : safe;
+    bool wrote = false;
+    while (!pending.empty() && pending.top()->seq < safe) {
+      FeedItem* item = pending.top();
+      pending.pop();
+      fwrite(item->line.data(), 1, item->line.size(), stdout);
+      delete item;
+      g_events++;
+      wrote = true;
+    }
+    if (wrote) fflush(stdout);
+    running = safe != UINT64_MAX || !pending.empty();
+  }
+}
+
+// ============================================================================
+// Status and startup
+// ============================================================================
+
+static void printStatus(const char* heading) {
+  size_t devices = 0;
+  uint64_t forgotten = 0;
+  for (Shard* s : g_shards) {
+    devices += s->deviceCount;
+    forgotten += s->forgotten;
+  }
+  fprintf(stderr, "\n[SUMMARY] %s\n", heading);
+  fprintf(stderr, "  Devices:  %zu (%llu forgotten), %llu reports merged, %llu events\n",
+          devices, (unsigned long long)forgotten, (unsigned long long)g_merged.load(),
+          (unsigned long long)g_events.load());
+  for (Input* in : g_inputs) {
+    fprintf(stderr, "  %-12s %10llu frames %8llu bad  %3u resets  %s",
+            in->name.c_str(), (unsigned long long)in->frames.load(),
+            (unsigned long long)in->badFrames.load(), (unsigned)in->resets.load(),
+            in->finished ? "ended" : in->live ? "live" : "reading");
+    if (in->live && in->frames > 0) {
+      fprintf(stderr, ", offset %lld ms", (long long)in->offsetMs.load());
+    }
+    fprintf(stderr, "\n");
+  }
+}
+
+static void onSignal(int) { g_stop = true; }
+
+static int64_t argValue(int argc, char** argv, int& i) {
+  if (i + 1 >= argc) {
+    fprintf(stderr, "[ERROR] %s needs a value\n", argv[i]);
+    exit(2);
+  }
+  return strtoll(argv[++i], nullptr, 0);
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    const char* a = argv[i];
+    if (!strcmp(a, "-S")) g_opt.shards = (unsigned)argValue(argc, argv, i);
+    else if (!strcmp(a, "-H")) g_opt.holdMs = argValue(argc, argv, i);
+    else if (!strcmp(a, "-w")) g_opt.windowMs = argValue(argc, argv, i);
+    else if (!strcmp(a, "-m")) g_opt.marginDb = (int)argValue(argc, argv, i);
+    else if (!strcmp(a, "-u")) g_opt.updateMs = argValue(argc, argv, i);
+    else if (!strcmp(a, "-t")) g_opt.ttlMs = argValue(argc, argv, i) * 1000;
+    else if (!strcmp(a, "-i")) g_opt.statusSeconds = (unsigned)argValue(argc, argv, i);
+    else if (a[0] == '-' && a[1] != 0) {
+      fprintf(stderr, "[ERROR] Unknown option %s (see aggregator/aggregator.cpp)\n", a);
+      return 2;
+    } else {
+      Input* in = new Input();
+      if (!parseInput(a, *in)) {
+        fprintf(stderr, "[ERROR] Invalid input '%s' (expected [name=]path[@offset_ms])\n", a);
+        return 2;
+      }
+      in->id = (uint16_t)g_inputs.size();
+      g_inputs.push_back(in);
+    }
+  }
+  if (g_inputs.empty()) {
+    fprintf(stderr, "[ERROR] No inputs (e.g. east=/dev/ttyACM0 west=/dev/ttyACM1)\n");
+    return 2;
+  }
+  if (g_opt.holdMs <= 0 || g_opt.windowMs <= 0) {
+    fprintf(stderr, "[ERROR] -H and -w must be at least 1\n");
+    return 2;
+  }
+  if (g_opt.shards == 0) g_opt.shards = std::thread::hardware_concurrency();
+  if (g_opt.shards == 0) g_opt.shards = 1;
+  if (g_opt.shards > AGG_MAX_SHARDS) g_opt.shards = AGG_MAX_SHARDS;
+
+  for (Input* in : g_inputs) {
+    if (!openInput(*in)) return 1;
+  }
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  fprintf(stderr, "[AGG] %zu inputs, %u shards, hold %lld ms, RSSI window %lld ms\n",
+          g_inputs.size(), g_opt.shards, (long long)g_opt.holdMs, (long long)g_opt.windowMs);
+
+  for (unsigned i = 0; i < g_opt.shards; i++) g_shards.push_back(new Shard(i));
+  std::vector<std::thread> threads;
+  for (Shard* s : g_shards) threads.emplace_back(&Shard::run, s);
+  std::thread writer(writerThread);
+  std::thread merger(mergerThread);
+  for (Input* in : g_inputs) threads.emplace_back(readerThread, in);
+
+  // Status until every input has ended (or Ctrl-C)
+  int64_t lastStatus = hostMs();
+  while (true) {
+    bool all = true;
+    for (Input* in : g_inputs) all = all && in->finished;
+    if (all) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (g_opt.statusSeconds > 0 && hostMs() - lastStatus >= g_opt.statusSeconds * 1000LL) {
+      lastStatus = hostMs();
+      printStatus("Running");
+    }
+  }
+
+  merger.join();
+  for (std::thread& t : threads) t.join();
+  writer.join();
+  printStatus(g_stop ? "Stopped" : "All inputs ended");
+  return 0;
+}
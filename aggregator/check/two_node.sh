@@ -0,0 +1,67 @@
+#!/bin/sh
+# Two-node capture check for the aggregator (README "Multi-Node Aggregator").
+# Builds the aggregator and synth_capture with the host compiler, writes two
+# captures whose node clocks differ by 4 s, merges them with the offset that
+# lines them up, and checks the feed:
+#   - event times never go back (merge order across nodes and shards)
+#   - all 50 devices appear, and device 7's payload change is reported
+#   - every device ends up nearest to the node it was placed at
+#   - no frame was lost to the interleaved console text
+#
+#   aggregator/check/two_node.sh [reports per node, default 200000]
+set -e
+
+root=$(cd "$(dirname "$0")/../.." && pwd)
+reports=${1:-200000}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+CXX=${CXX:-g++}
+$CXX -std=gnu++17 -O2 -Wall -Wextra -pthread -I"$root/include" \
+  "$root/aggregator/aggregator.cpp" -o "$work/aggregator"
+$CXX -std=gnu++17 -O2 -Wall -Wextra -I"$root/include" \
+  "$root/aggregator/check/synth_capture.cpp" -o "$work/synth_capture"
+
+"$work/synth_capture" 0 1000 "$reports" "$work/a.bin"
+"$work/synth_capture" 1 5000 "$reports" "$work/b.bin"
+
+start=$(date +%s%N)
+"$work/aggregator" -S 4 -i 0 a="$work/a.bin" b="$work/b.bin@-4000" \
+  > "$work/feed.jsonl" 2> "$work/status.txt"
+end=$(date +%s%N)
+
+status=0
+fail() {
+  echo "FAIL: $*"
+  status=1
+}
+
+awk -F'"t":' 'NF > 1 { split($2, v, ","); t = v[1] + 0
+                       if (NR > 1 && t < last) { print NR; exit }
+                       last = t }' "$work/feed.jsonl" > "$work/order.txt"
+[ -s "$work/order.txt" ] && fail "feed goes back in time at line $(cat "$work/order.txt")"
+
+new=$(grep -c '"event":"new"' "$work/feed.jsonl" || true)
+[ "$new" -eq 50 ] || fail "$new new devices, expected 50"
+grep -q '"event":"changed","addr":"0C:0B:0A:09:08:07"' "$work/feed.jsonl" ||
+  fail "payload change of device 7 not reported"
+
+# Last nearest node per device; the address ends in the device number
+sed -n 's/.*"addr":"\([0-9A-F:]*\)".*"nearest":"\([ab]\)".*/\1 \2/p' "$work/feed.jsonl" |
+  awk '{ near[$1] = $2 }
+       END { for (a in near) {
+               hi = index("0123456789ABCDEF", substr(a, 16, 1)) - 1
+               dev = 16 * hi + index("0123456789ABCDEF", substr(a, 17, 1)) - 1
+               want = dev % 2 == 0 ? "a" : "b"
+               if (near[a] != want) print a, near[a]
+             } }' > "$work/misplaced.txt"
+[ -s "$work/misplaced.txt" ] && fail "nearest node wrong for: $(tr '\n' ' ' < "$work/misplaced.txt")"
+
+for node in a b; do
+  grep -Eq "^  $node +$reports frames +0 bad" "$work/status.txt" ||
+    fail "node $node: $(grep "^  $node " "$work/status.txt")"
+done
+
+echo "$(wc -l < "$work/feed.jsonl") events from 2 x $reports reports in $(( (end - start) / 1000000 )) ms"
+[ $status -eq 0 ] && echo "PASS"
+exit $status
@@ -0,0 +1,695 @@
+/*
+ * Pipeline Benchmark (native build)
+ * Replays advertising reports through the parser, filters and
+ * deduplication exactly as the consumer task runs them - without the
+ * SoftDevice, tasks or output rendering - and reports time, heap
+ * allocations and heap high-water per report. Run it before flashing to
+ * catch regressions from filter data growth or dedup changes.
+ *
+ * Input is one or more binary captures (the serial output of `o binary`
+ * with deduplication off, see docs/binary_protocol.md) or, without any,
+ * a synthetic crowded venue.
+ *
+ *   pio run -e native -t exec                    # 1M synthetic reports
+ *   .pio/build/native/program [options] [capture.bin ...]
+ *
+ * Options:
+ *   -n <reports>   synthetic reports (default 1000000)
+ *   -D <devices>   synthetic devices present at a time (default 3000)
+ *   -r <rate>      synthetic reports per second (default 2000)
+ *   -s <seed>      synthetic generator seed (default 1)
+ *   -R <runs>      timed runs, best one is reported (default 3)
+ *   -g <entries>   add this many extra blacklist OUIs, names and payloads
+ *   -t <seconds>   device TTL (default 0 = off)
+ *   -m <seconds>   synthetic random address rotation period (default 900)
+ *   -F             no filters (skip the built-in lists)
+ *   -d             deduplication off
+ *   -p             no scan response pairing
+ *   -E             no early reject (every report is parsed before filtering)
+ */
+
+#include <Arduino.h>
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <cmath>
+#include <new>
+#include <cstddef>
+#include <chrono>
+#include "ble_filter_config_builtin.h"
+#include "seen_devices.h"
+#include "rotation_linker.h"
+#include "scan_pairing.h"
+#include "binary_record.h"
+
+// ============================================================================
+// Heap accounting: every C++ allocation (std::vector, String) goes through
+// these, so the counts cover everything the filters and tables allocate
+// ============================================================================
+
+struct HeapStats {
+  uint64_t allocs = 0;
+  uint64_t bytes = 0;
+  size_t live = 0;
+  size_t peak = 0;
+};
+
+static HeapStats g_heap;
+static const size_t HEAP_HEADER = alignof(std::max_align_t);  // keeps the block size
+
+void* operator new(size_t n) {
+  uint8_t* p = (uint8_t*)malloc(n + HEAP_HEADER);
+  if (p == nullptr) throw std::bad_alloc();
+  memcpy(p, &n, sizeof(n));
+  g_heap.allocs++;
+  g_heap.bytes += n;
+  g_heap.live += n;
+  if (g_heap.live > g_heap.peak) g_heap.peak = g_heap.live;
+  return p + HEAP_HEADER;
+}
+
+void operator delete(void* ptr) noexcept {
+  if (ptr == nullptr) return;
+  uint8_t* p = (uint8_t*)ptr - HEAP_HEADER;
+  size_t n;
+  memcpy(&n, p, sizeof(n));
+  g_heap.live -= n;
+  free(p);
+}
+
+void* operator new[](size_t n) { return operator new(n); }
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+// ============================================================================
+// Report storage: packed (fixed header + payload bytes), so a million
+// reports take tens of MB. Each one is copied into an AdvReport before
+// processing, as the ring hands one to the consumer.
+// ============================================================================
+
+static const size_t REPORT_HEAD = offsetof(AdvReport, data);
+
+class ReportSet {
+private:
+  std::vector<uint8_t> bytes;
+  std::vector<size_t> offsets;
+
+public:
+  void add(const AdvReport& r) {
+    offsets.push_back(bytes.size());
+    const uint8_t* p = (const uint8_t*)&r;
+    bytes.insert(bytes.end(), p, p + REPORT_HEAD + r.len);
+  }
+
+  void get(size_t i, AdvReport& r) const {
+    const uint8_t* p = &bytes[offsets[i]];
+    memcpy(&r, p, REPORT_HEAD);
+    memcpy(r.data, p + REPORT_HEAD, r.len);
+  }
+
+  size_t size() const { return offsets.size(); }
+  uint32_t lastTimestamp() const {
+    if (offsets.empty()) return 0;
+    uint32_t t;
+    memcpy(&t, &bytes[offsets.back()] + offsetof(AdvReport, timestamp), sizeof(t));
+    return t;
+  }
+};
+
+// Append the reports of one binary capture. Frames that do not decode
+// (interleaved text, line noise) are counted and skipped. Timestamps are
+// shifted to follow the previous capture.
+static bool loadCapture(const char* path, ReportSet& set, uint32_t& skipped) {
+  FILE* f = fopen(path, "rb");
+  if (f == nullptr) {
+    fprintf(stderr, "[ERROR] Cannot open %s\n", path);
+    return false;
+  }
+  std::vector<uint8_t> file;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) file.insert(file.end(), chunk, chunk + n);
+  fclose(f);
+
+  uint32_t shift = set.size() > 0 ? set.lastTimestamp() + 1 : 0;
+  uint32_t first = 0;
+  bool haveFirst = false;
+  size_t start = 0;
+  for (size_t i = 0; i < file.size(); i++) {
+    if (file[i] != 0) continue;
+    uint8_t rec[BIN_MAX_RECORD];
+    size_t len = i - start <= BIN_MAX_FRAME ? cobsDecode(&file[start], i - start, rec, sizeof(rec)) : 0;
+    BinaryReport b;
+    if (len > 0 && binDecodeReport(rec, len, b)) {
+      if (!haveFirst) {
+        first = b.timestamp;
+        haveFirst = true;
+      }
+      AdvReport r = {};
+      r.timestamp = b.timestamp - first + shift;
+      memcpy(r.addr, b.addr, sizeof(r.addr));
+      r.addrType = b.addrType;
+      r.rssi = b.rssi;
+      r.txPower = b.txPower;
+      r.flags = b.flags;
+      r.primaryPhy = r.secondaryPhy = 1;  // not in the record
+      r.len = b.len;
+      memcpy(r.data, b.data, b.len);
+      set.add(r);
+    } else if (i > start) {
+      skipped++;
+    }
+    start = i + 1;
+  }
+  return true;
+}
+
+// ============================================================================
+// Synthetic crowd: phones (Apple Continuity with rotating status bytes and
+// addresses, Google Fast Pair, Microsoft CDP), wearables that answer scan
+// requests, iBeacons and Eddystone TLM beacons. Deterministic per seed.
+//
+// Every device advertises on its own fixed interval plus the 0-10 ms
+// advertising delay, and the scanner hears SYNTH_HEARD_PCT of the events.
+// People arrive and leave independently of each other, about once a
+// second each; a rotation is the same device, on the same schedule, under
+// a new address. Each device has a serial number behind all its
+// addresses, so the bench can tell true rotation links from false ones.
+// ============================================================================
+
+enum SynthKind { SYNTH_APPLE, SYNTH_FASTPAIR, SYNTH_MICROSOFT, SYNTH_WEARABLE,
+                 SYNTH_IBEACON, SYNTH_EDDYSTONE };
+
+// Cumulative share of the crowd, percent
+static const uint8_t SYNTH_MIX[] = { 40, 55, 65, 80, 90, 100 };
+
+struct SynthDevice {
+  uint8_t addr[6];
+  uint8_t addrType;
+  uint8_t kind;
+  int8_t rssi;         // mean RSSI
+  uint8_t state[5];    // payload bytes that change now and then
+  uint32_t counter;
+  uint32_t rotateAt;   // ms; random addresses rotate every g_rotateMs, give or take a third
+  bool scanResponse;   // next report of a wearable is its scan response
+  uint32_t serial;     // the device behind its addresses
+  uint32_t intervalUs; // advertising interval
+  bool present;
+};
+
+#define SYNTH_HEARD_PCT  85        // advertising events the scanner hears
+#define SYNTH_CHURN_MS   1000      // mean time between arrivals, and between departures
+
+static uint32_t g_rng = 1;
+static uint32_t g_rotateMs = 900000;
+static uint32_t g_rotations = 0;   // address changes of devices that stayed
+static uint32_t g_arrivals = 0;
+static uint32_t g_departures = 0;
+static uint32_t g_serials = 0;
+static uint32_t g_meanIntervalUs = 1500000;
+
+// Device serial of every synthetic address, for checking rotation links
+static std::unordered_map<uint64_t, uint32_t> g_addrOwner;
+
+static uint64_t addrOwnerKey(const uint8_t* addr, uint8_t addrType) {
+  uint64_t key = addrType;
+  for (int i = 0; i < 6; i++) key = (key << 8) | addr[i];
+  return key;
+}
+
+static uint32_t rnd() {
+  g_rng ^= g_rng << 13;
+  g_rng ^= g_rng >> 17;
+  g_rng ^= g_rng << 5;
+  return g_rng;
+}
+
+static void newIdentity(SynthDevice& d, uint32_t now) {
+  for (int i = 0; i < 6; i++) d.addr[i] = (uint8_t)rnd();
+  d.rotateAt = now + g_rotateMs * 2 / 3 + rnd() % (g_rotateMs * 2 / 3 + 1);
+  switch (d.addrType) {
+    case 2:   // resolvable private: top bits 01
+      d.addr[5] = (d.addr[5] & 0x3F) | 0x40;
+      break;
+    case 3:   // non-resolvable private: top bits 00
+      d.addr[5] &= 0x3F;
+      break;
+    case 1:   // random static: top bits 11, never rotates
+      d.addr[5] |= 0xC0;
+      d.rotateAt = UINT32_MAX;
+      break;
+    default:  // public: a fifth from the built-in blacklist OUIs, if any
+      d.rotateAt = UINT32_MAX;
+      if (BUILTIN_BLACKLIST.ouiCount > 0 && rnd() % 5 == 0) {
+        uint32_t oui = BUILTIN_BLACKLIST.ouis[rnd() % BUILTIN_BLACKLIST.ouiCount];
+        d.addr[5] = (uint8_t)(oui >> 16);
+        d.addr[4] = (uint8_t)(oui >> 8);
+        d.addr[3] = (uint8_t)oui;
+      } else {
+        d.addr[5] &= 0xFC;   // unicast, globally administered
+      }
+  }
+  g_addrOwner[addrOwnerKey(d.addr, d.addrType)] = d.serial;
+}
+
+// Exponentially distributed wait with the given mean
+static uint64_t randomWaitUs(uint64_t meanUs) {
+  double u = (rnd() % 1000000 + 1) / 1000000.0;
+  return (uint64_t)(-std::log(u) * (double)meanUs);
+}
+
+static void newDevice(SynthDevice& d, uint32_t now) {
+  uint8_t pick = rnd() % 100;
+  d.kind = 0;
+  while (pick >= SYNTH_MIX[d.kind]) d.kind++;
+  static const uint8_t ADDR_TYPES[] = { 2, 2, 3, 0, 1, 1 };
+  d.addrType = ADDR_TYPES[d.kind];
+  d.rssi = (int8_t)(-95 + rnd() % 55);
+  for (uint8_t& b : d.state) b = (uint8_t)rnd();
+  d.counter = rnd();
+  d.scanResponse = false;
+  d.serial = ++g_serials;
+  d.intervalUs = g_meanIntervalUs / 2 + rnd() % (g_meanIntervalUs + 1);
+  d.present = true;
+  newIdentity(d, now);
+}
+
+// Append one AD structure
+static void putAd(AdvReport& r, uint8_t type, const uint8_t* data, uint8_t len) {
+  r.data[r.len++] = len + 1;
+  r.data[r.len++] = type;
+  memcpy(r.data + r.len, data, len);
+  r.len += len;
+}
+
+static void synthReport(SynthDevice& d, uint32_t now, AdvReport& r) {
+  if (now >= d.rotateAt) {
+    newIdentity(d, now);
+    g_rotations++;
+  }
+
+  r.timestamp = now;
+  memcpy(r.addr, d.addr, sizeof(r.addr));
+  r.addrType = d.addrType;
+  r.rssi = (int8_t)(d.rssi + (int)(rnd() % 9) - 4);
+  r.txPower = BIN_TX_POWER_NONE;
+  r.flags = ADV_FLAG_CONNECTABLE | ADV_FLAG_SCANNABLE;
+  r.primaryPhy = r.secondaryPhy = 1;
+  r.len = 0;
+  r.rspOffset = 0;
+
+  static const uint8_t FLAGS_LE[] = { 0x1A };
+  static const uint8_t FLAGS_BR[] = { 0x06 };
+  switch (d.kind) {
+    case SYNTH_APPLE: {
+      // Continuity Nearby Info: status and auth tag change every few reports
+      if (rnd() % 8 == 0) for (uint8_t& b : d.state) b = (uint8_t)rnd();
+      uint8_t mfg[9] = { 0x4C, 0x00, 0x10, 0x05 };
+      memcpy(mfg + 4, d.state, 5);
+      putAd(r, 0x01, FLAGS_LE, 1);
+      putAd(r, 0xFF, mfg, sizeof(mfg));
+      break;
+    }
+    case SYNTH_FASTPAIR: {
+      if (rnd() % 64 == 0) d.state[0] = (uint8_t)rnd();
+      uint8_t uuids[] = { 0x2C, 0xFE };
+      uint8_t service[] = { 0x2C, 0xFE, d.state[0], d.state[1], d.state[2] };
+      putAd(r, 0x01, FLAGS_BR, 1);
+      putAd(r, 0x03, uuids, sizeof(uuids));
+      putAd(r, 0x16, service, sizeof(service));
+      break;
+    }
+    case SYNTH_MICROSOFT: {
+      // CDP beacon: salt and hash rotate with the address
+      r.flags = 0;
+      uint8_t mfg[29] = { 0x06, 0x00, 0x01, 0x09, 0x20, 0x02 };
+      for (int i = 6; i < (int)sizeof(mfg); i++) mfg[i] = d.addr[i % 6] ^ (uint8_t)i;
+      putAd(r, 0xFF, mfg, sizeof(mfg));
+      break;
+    }
+    case SYNTH_WEARABLE: {
+      if (d.scanResponse) {
+        char name[12];
+        int n = snprintf(name, sizeof(name), "Band-%02X%02X", d.addr[1], d.addr[0]);
+        r.flags |= ADV_FLAG_SCAN_RESPONSE;
+        putAd(r, 0x09, (const uint8_t*)name, (uint8_t)n);
+      } else {
+        uint8_t uuids[] = { 0x0D, 0x18, 0x0F, 0x18 };
+        uint8_t tx[] = { 0x04 };
+        putAd(r, 0x01, FLAGS_BR, 1);
+        putAd(r, 0x03, uuids, sizeof(uuids));
+        putAd(r, 0x0A, tx, sizeof(tx));
+        r.txPower = 4;
+      }
+      d.scanResponse = !d.scanResponse;
+      break;
+    }
+    case SYNTH_IBEACON: {
+      r.flags = 0;
+      uint8_t mfg[25] = { 0x4C, 0x00, 0x02, 0x15 };
+      for (int i = 0; i < 16; i++) mfg[4 + i] = (uint8_t)(0xA0 + i);
+      mfg[20] = d.state[0];
+      mfg[21] = d.state[1];
+      mfg[22] = d.state[2];
+      mfg[23] = d.state[3];
+      mfg[24] = 0xC5;
+      putAd(r, 0x01, FLAGS_BR, 1);
+      putAd(r, 0xFF, mfg, sizeof(mfg));
+      break;
+    }
+    case SYNTH_EDDYSTONE: {
+      // TLM: advertising and uptime counters change on every report
+      r.flags = 0;
+      d.counter++;
+      uint8_t uuids[] = { 0xAA, 0xFE };
+      uint8_t tlm[16] = { 0xAA, 0xFE, 0x20, 0x00, 0x0B, 0xB8, 0x16, 0x80 };
+      for (int i = 0; i < 4; i++) {
+        tlm[8 + i] = (uint8_t)(d.counter >> (24 - 8 * i));
+        tlm[12 + i] = (uint8_t)((d.counter / 10) >> (24 - 8 * i));
+      }
+      putAd(r, 0x03, uuids, sizeof(uuids));
+      putAd(r, 0x16, tlm, sizeof(tlm));
+      break;
+    }
+  }
+}
+
+static void synthesize(ReportSet& set, uint32_t reports, uint32_t devices, uint32_t rate,
+                       uint32_t seed) {
+  g_rng = seed ? seed : 1;
+  // Intervals average out to the requested report rate
+  g_meanIntervalUs = (uint32_t)((uint64_t)devices * 1000000 * SYNTH_HEARD_PCT / 100 / rate);
+  if (g_meanIntervalUs < 2 * SIGNAL_GAP_MIN_MS * 1000) g_meanIntervalUs = 2 * SIGNAL_GAP_MIN_MS * 1000;
+
+  // Next advertising event of each device, earliest first
+  typedef std::pair<uint64_t, uint32_t> Event;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+  std::vector<SynthDevice> crowd(devices);
+  for (uint32_t i = 0; i < devices; i++) {
+    newDevice(crowd[i], 0);
+    events.push(Event(rnd() % crowd[i].intervalUs, i));
+  }
+  uint64_t nextArrival = randomWaitUs(SYNTH_CHURN_MS * 1000);
+  uint64_t nextDeparture = randomWaitUs(SYNTH_CHURN_MS * 1000);
+  uint32_t present = devices;
+
+  AdvReport r;
+  for (uint32_t i = 0; i < reports && !events.empty(); ) {
+    Event e = events.top();
+    events.pop();
+    uint64_t us = e.first;
+
+    // People come and go
+    while (nextArrival <= us) {
+      uint32_t now = (uint32_t)(nextArrival / 1000);
+      crowd.push_back(SynthDevice());
+      newDevice(crowd.back(), now);
+      events.push(Event(nextArrival + rnd() % crowd.back().intervalUs, (uint32_t)(crowd.size() - 1)));
+      nextArrival += randomWaitUs(SYNTH_CHURN_MS * 1000);
+      g_arrivals++;
+      present++;
+    }
+    while (nextDeparture <= us) {
+      if (present > 1) {
+        uint32_t leaving;
+        do leaving = rnd() % crowd.size(); while (!crowd[leaving].present);
+        crowd[leaving].present = false;
+        present--;
+        g_departures++;
+      }
+      nextDeparture += randomWaitUs(SYNTH_CHURN_MS * 1000);
+    }
+
+    SynthDevice& d = crowd[e.second];
+    if (!d.present) continue;
+    events.push(Event(us + d.intervalUs + rnd() % 10001, e.second));
+    if (rnd() % 100 >= SYNTH_HEARD_PCT) continue;
+
+    uint32_t now = (uint32_t)(us / 1000);
+    synthReport(d, now, r);
+    set.add(r);
+    i++;
+    // A wearable's scan response follows right away, when it is heard
+    if (d.kind == SYNTH_WEARABLE && d.scanResponse) {
+      if (rnd() % 4 != 0 && i < reports) {
+        synthReport(d, now, r);
+        set.add(r);
+        i++;
+      } else {
+        d.scanResponse = false;
+      }
+    }
+  }
+}
+
+// ============================================================================
+// Pipeline
+// ============================================================================
+
+// Cumulative passes, so the cost of each stage is the difference
+enum BenchStage { BENCH_PARSE, BENCH_FILTER, BENCH_DEDUP, BENCH_STAGE_COUNT };
+static const char* const BENCH_STAGE_NAMES[BENCH_STAGE_COUNT] = { "parse", "+ filter", "+ dedup" };
+
+static BLEFilter g_filter;
+static ChangeMasks g_changeMasks;
+static ChangePolicy g_changePolicy;
+static DeviceTable<SeenDevice, DEVICE_TABLE_CAPACITY> g_seenDevices;
+static RotationLinker<DEVICE_TABLE_CAPACITY> g_linker;
+static ScanPairer g_pairer;
+
+struct RunResult {
+  uint64_t ns = 0;
+  uint64_t allocs = 0;
+  size_t heapGrowth = 0;   // peak live heap above the level at the start
+  uint32_t counts[TRACK_HELD + 1] = {};
+  uint32_t filtered = 0;
+  uint32_t rejectedEarly = 0;
+  uint32_t expired = 0;
+  uint32_t linked = 0;
+  uint32_t falseLinks = 0;  // linked addresses of different synthetic devices
+  uint32_t ambiguous = 0;
+  uint32_t unconfirmed = 0;
+  uint32_t processed = 0;  // reports after pairing
+  uint32_t paired = 0;
+};
+
+static volatile uint32_t g_sink;  // keeps parse-only passes from being optimized out
+
+// State of the run in progress, for processReport()
+static BenchStage g_stage;
+static const TrackOptions* g_opt;
+static RunResult* g_result;
+static uint32_t g_fieldSum;
+
+// What the consumer does with a report (or a paired report)
+static void processReport(const AdvReport& report) {
+  RunResult& result = *g_result;
+  result.processed++;
+
+  AdView view;
+  parseAdvertisement(report.data, report.len, view);
+  g_fieldSum += view.fieldCount;
+  if (g_stage == BENCH_PARSE) return;
+
+  if (!g_filter.shouldShow(report.addr, view, report.flags & ADV_FLAG_CHECKED)) {
+    result.filtered++;
+    return;
+  }
+  if (g_stage == BENCH_FILTER) return;
+
+  uint16_t idx;
+  bool expired;
+  result.counts[trackReport(g_seenDevices, report, view, *g_opt, idx, expired)]++;
+  if (expired) result.expired++;
+  if (RotationLinker<DEVICE_TABLE_CAPACITY>::rotates(report.addrType) &&
+      g_linker.track(g_seenDevices, idx, report.timestamp) != DEVICE_NONE) {
+    result.linked++;
+    const DeviceKey& earlier = g_linker.lastLinkedKey();
+    auto from = g_addrOwner.find(addrOwnerKey(earlier.addr, earlier.addrType));
+    auto to = g_addrOwner.find(addrOwnerKey(report.addr, report.addrType));
+    if (from != g_addrOwner.end() && to != g_addrOwner.end() && from->second != to->second) {
+      result.falseLinks++;
+    }
+  }
+}
+
+static RunResult runPipeline(const ReportSet& reports, BenchStage stage, const TrackOptions& opt,
+                             bool pairing, bool early) {
+  RunResult result;
+  g_stage = stage;
+  g_opt = &opt;
+  g_result = &result;
+  g_fieldSum = 0;
+  g_seenDevices.clear();
+  g_linker.clear();
+  uint32_t ambiguousBefore = g_linker.ambiguous();
+  uint32_t unconfirmedBefore = g_linker.rejected();
+  uint32_t pairedBefore = g_pairer.pairedCount();
+  uint64_t allocsBefore = g_heap.allocs;
+  size_t liveBefore = g_heap.live;
+  g_heap.peak = g_heap.live;
+
+  AdvReport report;
+  auto started = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < reports.size(); i++) {
+    reports.get(i, report);
+    // The scan callback's fast path, see queueReport()
+    if (early && stage != BENCH_PARSE) {
+      bool paired = pairing && (report.flags & (ADV_FLAG_SCANNABLE | ADV_FLAG_SCAN_RESPONSE));
+      uint8_t early = g_filter.earlyCheck(report.addr, true, report.data, report.len, !paired);
+      if (early & EARLY_REJECT) {
+        result.rejectedEarly++;
+        continue;
+      }
+      report.flags |= early & ADV_FLAG_CHECKED;
+    }
+    if (!pairing) {
+      processReport(report);
+      continue;
+    }
+    g_pairer.push(report, processReport);
+    if (!g_pairer.empty()) g_pairer.expire(report.timestamp, processReport);
+  }
+  g_pairer.flush(processReport);
+  auto elapsed = std::chrono::steady_clock::now() - started;
+  g_sink = g_fieldSum;
+  result.paired = g_pairer.pairedCount() - pairedBefore;
+
+  result.ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  result.allocs = g_heap.allocs - allocsBefore;
+  result.heapGrowth = g_heap.peak - liveBefore;
+  result.ambiguous = g_linker.ambiguous() - ambiguousBefore;
+  result.unconfirmed = g_linker.rejected() - unconfirmedBefore;
+  return result;
+}
+
+// Extra blacklist entries that never match the synthetic crowd, to see how
+// lookups scale with list size
+static void growFilters(uint32_t entries) {
+  g_filter.beginEdit();
+  for (uint32_t i = 0; i < entries; i++) {
+    char text[24];
+    snprintf(text, sizeof(text), "02%02X%02X", (unsigned)(i >> 8) & 0xFF, (unsigned)i & 0xFF);
+    g_filter.addBlacklistOUI(String(text));
+    snprintf(text, sizeof(text), "bench-name-%u", (unsigned)i);
+    g_filter.addBlacklistName(String(text));
+    snprintf(text, sizeof(text), "DEAD%08X", (unsigned)i);
+    g_filter.addBlacklistPayload(String(text));
+  }
+  g_filter.commitEdit();
+}
+
+static uint32_t argValue(int argc, char** argv, int& i) {
+  if (i + 1 >= argc) {
+    fprintf(stderr, "[ERROR] %s needs a value\n", argv[i]);
+    exit(2);
+  }
+  return (uint32_t)strtoul(argv[++i], nullptr, 0);
+}
+
+int main(int argc, char** argv) {
+  uint32_t reports = 1000000, devices = 3000, rate = 2000, seed = 1, runs = 3, grow = 0, ttl = 0;
+  bool filters = true, dedup = true, pairing = true, early = true;
+  std::vector<const char*> captures;
+
+  for (int i = 1; i < argc; i++) {
+    const char* a = argv[i];
+    if (!strcmp(a, "-n")) reports = argValue(argc, argv, i);
+    else if (!strcmp(a, "-D")) devices = argValue(argc, argv, i);
+    else if (!strcmp(a, "-r")) rate = argValue(argc, argv, i);
+    else if (!strcmp(a, "-s")) seed = argValue(argc, argv, i);
+    else if (!strcmp(a, "-R")) runs = argValue(argc, argv, i);
+    else if (!strcmp(a, "-g")) grow = argValue(argc, argv, i);
+    else if (!strcmp(a, "-t")) ttl = argValue(argc, argv, i);
+    else if (!strcmp(a, "-m")) g_rotateMs = argValue(argc, argv, i) * 1000;
+    else if (!strcmp(a, "-F")) filters = false;
+    else if (!strcmp(a, "-d")) dedup = false;
+    else if (!strcmp(a, "-p")) pairing = false;
+    else if (!strcmp(a, "-E")) early = false;
+    else if (a[0] == '-') {
+      fprintf(stderr, "[ERROR] Unknown option %s (see bench/bench_pipeline.cpp)\n", a);
+      return 2;
+    } else captures.push_back(a);
+  }
+  if (devices == 0 || rate == 0 || runs == 0 || g_rotateMs == 0) {
+    fprintf(stderr, "[ERROR] -D, -r, -R and -m must be at least 1\n");
+    return 2;
+  }
+
+  // Reports first, so their storage is not counted against the filters
+  ReportSet set;
+  if (captures.empty()) {
+    synthesize(set, reports, devices, rate, seed);
+    printf("[BENCH] %zu synthetic reports: %u devices, %u reports/s, seed %u\n",
+           set.size(), (unsigned)devices, (unsigned)rate, (unsigned)seed);
+    printf("[BENCH] %u address rotations (period %u s), %u arrivals, %u departures\n",
+           (unsigned)g_rotations, (unsigned)(g_rotateMs / 1000), (unsigned)g_arrivals,
+           (unsigned)g_departures);
+  } else {
+    uint32_t skipped = 0;
+    for (const char* path : captures) {
+      if (!loadCapture(path, set, skipped)) return 1;
+    }
+    printf("[BENCH] %zu reports from %zu capture(s), %u undecodable frames skipped\n",
+           set.size(), captures.size(), (unsigned)skipped);
+  }
+  if (set.size() == 0) {
+    fprintf(stderr, "[ERROR] No reports to replay\n");
+    return 1;
+  }
+
+  size_t heapBefore = g_heap.live;
+  uint64_t allocsBefore = g_heap.allocs;
+  if (filters) g_filter.begin();
+  if (grow > 0) growFilters(grow);
+  printf("[BENCH] Filters: %zu bytes of heap in %llu allocations%s\n",
+         g_heap.live - heapBefore, (unsigned long long)(g_heap.allocs - allocsBefore),
+         filters ? "" : " (built-ins skipped)");
+  if (grow > 0) printf("[BENCH] Filters: %u extra blacklist OUIs, names and payloads\n", (unsigned)grow);
+  FilterArena& arena = filterArena();
+  printf("[BENCH] Filter arena: %u of %u bytes used (peak %u, largest free %u, %u overflows to heap)\n",
+         (unsigned)arena.used(), (unsigned)arena.size(), (unsigned)arena.peakUsed(),
+         (unsigned)arena.largestFree(), (unsigned)arena.overflowCount());
+  printf("[BENCH] Device table: %zu bytes static, %u records\n",
+         sizeof(g_seenDevices), (unsigned)g_seenDevices.capacity());
+
+  TrackOptions opt = { &g_changeMasks, &g_changePolicy, dedup, ttl * 1000 };
+
+  // Best of the runs per stage: the least disturbed by the rest of the host
+  RunResult best[BENCH_STAGE_COUNT];
+  for (uint32_t run = 0; run < runs; run++) {
+    for (int s = 0; s < BENCH_STAGE_COUNT; s++) {
+      RunResult r = runPipeline(set, (BenchStage)s, opt, pairing, early);
+      if (run == 0 || r.ns < best[s].ns) best[s] = r;
+    }
+  }
+
+  double n = (double)set.size();
+  printf("\n[BENCH] Best of %u runs, %zu reports\n", (unsigned)runs, set.size());
+  printf("  Stage        ns/report  stage ns  allocs/report  heap growth\n");
+  double previous = 0;
+  for (int s = 0; s < BENCH_STAGE_COUNT; s++) {
+    double ns = best[s].ns / n;
+    printf("  %-10s %11.1f %9.1f %14.4f %10zu B\n", BENCH_STAGE_NAMES[s], ns, ns - previous,
+           best[s].allocs / n, best[s].heapGrowth);
+    previous = ns;
+  }
+
+  const RunResult& full = best[BENCH_DEDUP];
+  printf("  Reports/s at this cost: %.0f\n", n * 1e9 / (double)full.ns);
+  printf("  Rejected early %u%s, filtered %u, new %u, changed %u, repeat %u, duplicate %u, held %u, expired %u\n",
+         (unsigned)full.rejectedEarly, early ? "" : " (off)",
+         (unsigned)full.filtered, (unsigned)full.counts[TRACK_NEW],
+         (unsigned)full.counts[TRACK_CHANGED], (unsigned)full.counts[TRACK_REPEAT],
+         (unsigned)full.counts[TRACK_DUPLICATE], (unsigned)full.counts[TRACK_HELD],
+         (unsigned)full.expired);
+  printf("  Tracked %u devices, %lu evicted\n", (unsigned)g_seenDevices.size(),
+         (unsigned long)g_seenDevices.evictions());
+  printf("  Rotations linked %u", (unsigned)full.linked);
+  if (captures.empty()) printf(" (%u false)", (unsigned)full.falseLinks);
+  printf(", ambiguous %u, unconfirmed %u\n", (unsigned)full.ambiguous, (unsigned)full.unconfirmed);
+  printf("  Scan responses paired %u (%u reports processed%s)\n", (unsigned)full.paired,
+         (unsigned)full.processed, pairing ? "" : ", pairing off");
+  return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * Host Arduino Shim
+ * The few Arduino core pieces the portable headers use (Print, Serial,
+ * String, millis, delay), for the native benchmark build only. Serial
+ * writes to stdout.
+ */
+
+#ifndef BENCH_HOST_ARDUINO_H
+#define BENCH_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t n) {
+    for (size_t i = 0; i < n; i++) write(buf[i]);
+    return n;
+  }
+  size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t write(char c) { return write((uint8_t)c); }
+
+  size_t print(const char* s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t println() { return write("\r\n"); }
+  size_t println(const char* s) { return print(s) + println(); }
+
+  size_t printf(const char* format, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (n <= 0) return 0;
+    return write((const uint8_t*)buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+  }
+};
+
+class HostSerial : public Print {
+public:
+  using Print::write;
+  size_t write(uint8_t c) override { return fputc(c, stdout) == EOF ? 0 : 1; }
+  size_t write(const uint8_t* buf, size_t n) override { return fwrite(buf, 1, n, stdout); }
+};
+
+static HostSerial Serial;
+
+class String {
+private:
+  std::string text;
+public:
+  String(const char* s = "") : text(s) {}
+  const char* c_str() const { return text.c_str(); }
+  unsigned int length() const { return (unsigned int)text.size(); }
+  bool reserve(unsigned int n) { text.reserve(n); return true; }
+  String& operator+=(char c) { text += c; return *this; }
+  bool operator==(const String& other) const { return text == other.text; }
+};
+
+static inline uint32_t millis() {
+  static const auto started = std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - started).count();
+}
+
+static inline void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+#endif // BENCH_HOST_ARDUINO_H
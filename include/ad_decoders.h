@@ -0,0 +1,341 @@
+/*
+ * AD Decoders
+ * Table-driven decoders for well-known manufacturer and service data:
+ * iBeacon, Eddystone (UID/URL/TLM/EID), Apple Continuity Nearby Info,
+ * Find My and Exposure Notification (GAEN). Each decoder is a fixed field
+ * layout over one AD structure, with byte offsets counted like change
+ * rules (from the first byte after the AD type, so the company ID / UUID
+ * is at 0-1). Lookup is O(1): a small hash on (kind, ID) picks the
+ * decoders for that ID, and an optional byte (frame or message type)
+ * picks one of them.
+ *
+ * Decoded fields point into the payload; nothing is copied. Output modes
+ * print them through adFormatValue(), change masks resolve "proto.field"
+ * names to byte ranges (see change_mask.h). Leave a protocol out by
+ * defining its AD_DECODE_* to 0.
+ */
+
+#ifndef AD_DECODERS_H
+#define AD_DECODERS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ad_parser.h"
+
+#ifndef AD_DECODE_IBEACON
+#define AD_DECODE_IBEACON    1
+#endif
+#ifndef AD_DECODE_EDDYSTONE
+#define AD_DECODE_EDDYSTONE  1
+#endif
+#ifndef AD_DECODE_CONTINUITY
+#define AD_DECODE_CONTINUITY 1
+#endif
+#ifndef AD_DECODE_FINDMY
+#define AD_DECODE_FINDMY     1
+#endif
+#ifndef AD_DECODE_GAEN
+#define AD_DECODE_GAEN       1
+#endif
+
+// Same values as CHANGE_RULE_COMPANY / CHANGE_RULE_SERVICE
+#define AD_DECODE_COMPANY 0   // manufacturer data with this company ID
+#define AD_DECODE_SERVICE 1   // 16-bit service data with this UUID
+
+#define AD_DECODE_ANY     0xFF   // no selector byte
+#define AD_FIELD_TO_END   0      // field length: the rest of the structure
+
+#define AD_DECODE_SLOTS   16     // power of two, more than the distinct IDs
+
+// How a field's bytes are shown
+enum AdValueFormat {
+  AD_VALUE_HEX,          // raw bytes
+  AD_VALUE_UINT,         // big-endian unsigned, 1-4 bytes
+  AD_VALUE_DBM,          // signed byte, dBm
+  AD_VALUE_UUID,         // 16 bytes, most significant first, with dashes
+  AD_VALUE_TEMP_88,      // signed 8.8 fixed point, degrees C (0x8000 = not supported)
+  AD_VALUE_DECISECONDS,  // big-endian 32-bit count of 0.1 s
+  AD_VALUE_URL,          // Eddystone-URL scheme byte and encoded URL
+  AD_VALUE_BATTERY,      // Find My status byte, battery level in the top two bits
+};
+
+struct AdDecoderField {
+  const char* name;
+  uint8_t start;
+  uint8_t len;           // AD_FIELD_TO_END for the rest
+  uint8_t format;        // AdValueFormat
+  bool rotating;         // changes on its own (identifiers, counters, keys)
+};
+
+struct AdDecoder {
+  const char* name;          // protocol name for output and change rules
+  uint8_t kind;              // AD_DECODE_COMPANY or AD_DECODE_SERVICE
+  uint16_t id;
+  uint8_t selectOffset;      // byte that tells frame types apart, or AD_DECODE_ANY
+  uint8_t selectValue;
+  uint8_t minLen;            // structure length (after the AD type) needed
+  const AdDecoderField* fields;
+  uint8_t fieldCount;
+};
+
+#define AD_FIELDS(f) f, (uint8_t)(sizeof(f) / sizeof(f[0]))
+
+#if AD_DECODE_IBEACON
+// Apple iBeacon: 4C 00 02 15 <UUID 16> <major 2> <minor 2> <TX at 1 m>
+static const AdDecoderField IBEACON_FIELDS[] = {
+  { "uuid",  4, 16, AD_VALUE_UUID, false },
+  { "major", 20, 2, AD_VALUE_UINT, false },
+  { "minor", 22, 2, AD_VALUE_UINT, false },
+  { "tx",    24, 1, AD_VALUE_DBM,  false },
+};
+#endif
+
+#if AD_DECODE_CONTINUITY
+// Continuity Nearby Info (first message): status/action, flags, auth tag
+static const AdDecoderField NEARBY_FIELDS[] = {
+  { "status", 4, 1, AD_VALUE_HEX, true },
+  { "flags",  5, 1, AD_VALUE_HEX, true },
+  { "auth",   6, 3, AD_VALUE_HEX, true },
+};
+#endif
+
+#if AD_DECODE_FINDMY
+// Find My offline finding: status, 22 bytes of the rotating public key,
+// the key's top bits and a hint byte
+static const AdDecoderField FINDMY_FIELDS[] = {
+  { "battery", 4, 1,  AD_VALUE_BATTERY, false },
+  { "key",     5, 22, AD_VALUE_HEX,     true },
+  { "keybits", 27, 1, AD_VALUE_HEX,     true },
+  { "hint",    28, 1, AD_VALUE_HEX,     true },
+};
+#endif
+
+#if AD_DECODE_EDDYSTONE
+// Eddystone service data: AA FE <frame type> ...
+static const AdDecoderField EDDYSTONE_UID_FIELDS[] = {
+  { "tx",        3, 1,  AD_VALUE_DBM, false },
+  { "namespace", 4, 10, AD_VALUE_HEX, false },
+  { "instance",  14, 6, AD_VALUE_HEX, false },
+};
+
+static const AdDecoderField EDDYSTONE_URL_FIELDS[] = {
+  { "tx",  3, 1,               AD_VALUE_DBM, false },
+  { "url", 4, AD_FIELD_TO_END, AD_VALUE_URL, false },
+};
+
+static const AdDecoderField EDDYSTONE_TLM_FIELDS[] = {
+  { "version", 3, 1,  AD_VALUE_UINT,        false },
+  { "battery", 4, 2,  AD_VALUE_UINT,        true },   // mV
+  { "temp",    6, 2,  AD_VALUE_TEMP_88,     true },
+  { "count",   8, 4,  AD_VALUE_UINT,        true },
+  { "uptime",  12, 4, AD_VALUE_DECISECONDS, true },
+};
+
+static const AdDecoderField EDDYSTONE_EID_FIELDS[] = {
+  { "tx",  3, 1, AD_VALUE_DBM, false },
+  { "eid", 4, 8, AD_VALUE_HEX, true },
+};
+#endif
+
+#if AD_DECODE_GAEN
+// Exposure Notification: Rolling Proximity Identifier and the encrypted
+// metadata (version and TX power), both rotating with the address
+static const AdDecoderField GAEN_FIELDS[] = {
+  { "rpi", 2, 16, AD_VALUE_HEX, true },
+  { "aem", 18, 4, AD_VALUE_HEX, true },
+};
+#endif
+
+// Decoders for one ID must be next to each other
+static const AdDecoder AD_DECODERS[] = {
+#if AD_DECODE_IBEACON
+  { "ibeacon",        AD_DECODE_COMPANY, 0x004C, 2, 0x02, 25, AD_FIELDS(IBEACON_FIELDS) },
+#endif
+#if AD_DECODE_CONTINUITY
+  { "nearby",         AD_DECODE_COMPANY, 0x004C, 2, 0x10, 9,  AD_FIELDS(NEARBY_FIELDS) },
+#endif
+#if AD_DECODE_FINDMY
+  { "findmy",         AD_DECODE_COMPANY, 0x004C, 2, 0x12, 29, AD_FIELDS(FINDMY_FIELDS) },
+#endif
+#if AD_DECODE_EDDYSTONE
+  { "eddystone-uid",  AD_DECODE_SERVICE, 0xFEAA, 2, 0x00, 20, AD_FIELDS(EDDYSTONE_UID_FIELDS) },
+  { "eddystone-url",  AD_DECODE_SERVICE, 0xFEAA, 2, 0x10, 5,  AD_FIELDS(EDDYSTONE_URL_FIELDS) },
+  { "eddystone-tlm",  AD_DECODE_SERVICE, 0xFEAA, 2, 0x20, 16, AD_FIELDS(EDDYSTONE_TLM_FIELDS) },
+  { "eddystone-eid",  AD_DECODE_SERVICE, 0xFEAA, 2, 0x30, 12, AD_FIELDS(EDDYSTONE_EID_FIELDS) },
+#endif
+#if AD_DECODE_GAEN
+  { "gaen",           AD_DECODE_SERVICE, 0xFD6F, AD_DECODE_ANY, 0, 22, AD_FIELDS(GAEN_FIELDS) },
+#endif
+};
+
+static const uint8_t AD_DECODER_COUNT = (uint8_t)(sizeof(AD_DECODERS) / sizeof(AD_DECODERS[0]));
+
+static_assert(sizeof(AD_DECODERS) / sizeof(AD_DECODERS[0]) < AD_NONE, "decoder index must fit a uint8_t");
+static_assert((AD_DECODE_SLOTS & (AD_DECODE_SLOTS - 1)) == 0, "AD_DECODE_SLOTS must be a power of two");
+
+static inline uint32_t adDecodeSlot(uint8_t kind, uint16_t id) {
+  return ((((uint32_t)kind << 16) | id) * 2654435761u >> 16) & (AD_DECODE_SLOTS - 1);
+}
+
+// First decoder for each (kind, ID), open addressing; built on first use
+struct AdDecoderIndex {
+  uint8_t slots[AD_DECODE_SLOTS];
+
+  AdDecoderIndex() {
+    memset(slots, AD_NONE, sizeof(slots));
+    for (uint8_t i = 0; i < AD_DECODER_COUNT; i++) {
+      const AdDecoder& d = AD_DECODERS[i];
+      if (i > 0 && AD_DECODERS[i - 1].kind == d.kind && AD_DECODERS[i - 1].id == d.id) continue;
+      uint32_t s = adDecodeSlot(d.kind, d.id);
+      while (slots[s] != AD_NONE) s = (s + 1) & (AD_DECODE_SLOTS - 1);
+      slots[s] = i;
+    }
+  }
+};
+
+static inline const AdDecoderIndex& adDecoderIndex() {
+  static const AdDecoderIndex index;
+  return index;
+}
+
+// Decoder for one AD structure (data after the type byte), or nullptr
+static inline const AdDecoder* adFindDecoder(uint8_t adType, const uint8_t* d, uint8_t len) {
+  uint8_t kind;
+  if (adType == AD_TYPE_MANUFACTURER_DATA) kind = AD_DECODE_COMPANY;
+  else if (adType == AD_TYPE_SERVICE_DATA_16BIT) kind = AD_DECODE_SERVICE;
+  else return nullptr;
+  if (len < 2) return nullptr;
+  uint16_t id = adRead16(d);
+
+  const AdDecoderIndex& index = adDecoderIndex();
+  uint32_t s = adDecodeSlot(kind, id);
+  while (index.slots[s] != AD_NONE) {
+    uint8_t i = index.slots[s];
+    if (AD_DECODERS[i].kind == kind && AD_DECODERS[i].id == id) {
+      for (; i < AD_DECODER_COUNT && AD_DECODERS[i].kind == kind && AD_DECODERS[i].id == id; i++) {
+        const AdDecoder& dec = AD_DECODERS[i];
+        if (len < dec.minLen) continue;
+        if (dec.selectOffset == AD_DECODE_ANY || d[dec.selectOffset] == dec.selectValue) return &dec;
+      }
+      return nullptr;
+    }
+    s = (s + 1) & (AD_DECODE_SLOTS - 1);
+  }
+  return nullptr;
+}
+
+// Length of a field in a structure of len bytes (0 if the structure is too short)
+static inline uint8_t adFieldLen(const AdDecoderField& f, uint8_t len) {
+  if (f.start >= len) return 0;
+  if (f.len == AD_FIELD_TO_END) return len - f.start;
+  return f.start + f.len <= len ? f.len : 0;
+}
+
+// Shown without quotes in JSON
+static inline bool adValueIsNumber(uint8_t format) {
+  return format == AD_VALUE_UINT || format == AD_VALUE_DBM || format == AD_VALUE_DECISECONDS;
+}
+
+// Text of one field value (NUL-terminated, truncated to size). Returns the
+// length written.
+static inline size_t adFormatValue(const AdDecoderField& f, const uint8_t* v, uint8_t n,
+                                   char* out, size_t size) {
+  static const char digits[] = "0123456789ABCDEF";
+  size_t pos = 0;
+  int w = 0;
+  switch (f.format) {
+    case AD_VALUE_UINT: {
+      uint32_t x = 0;
+      for (uint8_t i = 0; i < n && i < 4; i++) x = (x << 8) | v[i];
+      w = snprintf(out, size, "%lu", (unsigned long)x);
+      break;
+    }
+    case AD_VALUE_DBM:
+      w = snprintf(out, size, "%d", (int8_t)v[0]);
+      break;
+    case AD_VALUE_TEMP_88: {
+      int16_t t = (int16_t)((v[0] << 8) | v[1]);
+      if ((uint16_t)t == 0x8000) w = snprintf(out, size, "n/a");
+      else w = snprintf(out, size, "%s%d.%02d", t < 0 ? "-" : "", abs(t) >> 8, (abs(t) & 0xFF) * 100 / 256);
+      break;
+    }
+    case AD_VALUE_DECISECONDS: {
+      uint32_t x = ((uint32_t)v[0] << 24) | ((uint32_t)v[1] << 16) | ((uint32_t)v[2] << 8) | v[3];
+      w = snprintf(out, size, "%lu.%lu", (unsigned long)(x / 10), (unsigned long)(x % 10));
+      break;
+    }
+    case AD_VALUE_BATTERY: {
+      static const char* const LEVELS[] = { "full", "medium", "low", "critical" };
+      w = snprintf(out, size, "%s", LEVELS[v[0] >> 6]);
+      break;
+    }
+    case AD_VALUE_URL: {
+      static const char* const SCHEMES[] = { "http://www.", "https://www.", "http://", "https://" };
+      static const char* const EXPANSIONS[] = {
+        ".com/", ".org/", ".edu/", ".net/", ".info/", ".biz/", ".gov/",
+        ".com", ".org", ".edu", ".net", ".info", ".biz", ".gov",
+      };
+      if (size == 0) return 0;
+      out[0] = 0;
+      if (v[0] < 4) pos = snprintf(out, size, "%s", SCHEMES[v[0]]);
+      for (uint8_t i = 1; i < n && pos + 1 < size; i++) {
+        if (v[i] < sizeof(EXPANSIONS) / sizeof(EXPANSIONS[0])) {
+          pos += snprintf(out + pos, size - pos, "%s", EXPANSIONS[v[i]]);
+        } else {
+          out[pos++] = (v[i] > 0x20 && v[i] < 0x7F) ? (char)v[i] : '?';
+        }
+      }
+      if (pos >= size) pos = size - 1;
+      out[pos] = 0;
+      return pos;
+    }
+    case AD_VALUE_UUID:
+    case AD_VALUE_HEX:
+    default:
+      for (uint8_t i = 0; i < n && pos + 3 < size; i++) {
+        if (f.format == AD_VALUE_UUID && (i == 4 || i == 6 || i == 8 || i == 10)) out[pos++] = '-';
+        out[pos++] = digits[v[i] >> 4];
+        out[pos++] = digits[v[i] & 0x0F];
+      }
+      if (size > 0) out[pos] = 0;
+      return pos;
+  }
+  if (w < 0) w = 0;
+  return (size_t)w < size ? (size_t)w : (size > 0 ? size - 1 : 0);
+}
+
+// Decoder and field for "proto.field" (change rules), false if unknown
+static inline bool adFindField(const char* name, const AdDecoder*& decoder,
+                               const AdDecoderField*& field) {
+  const char* dot = strchr(name, '.');
+  if (dot == nullptr) return false;
+  size_t protoLen = (size_t)(dot - name);
+  for (uint8_t i = 0; i < AD_DECODER_COUNT; i++) {
+    const AdDecoder& d = AD_DECODERS[i];
+    if (strlen(d.name) != protoLen || strncmp(d.name, name, protoLen) != 0) continue;
+    for (uint8_t j = 0; j < d.fieldCount; j++) {
+      if (strcmp(d.fields[j].name, dot + 1) == 0) {
+        decoder = &d;
+        field = &d.fields[j];
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Company names for the human output
+static inline const char* adCompanyName(uint16_t id) {
+  switch (id) {
+    case 0x004C: return "Apple";
+    case 0x0075: return "Samsung";
+    case 0x00E0: return "Google";
+    case 0x0006: return "Microsoft";
+    case 0x0059: return "Nordic Semi";
+    default:     return nullptr;
+  }
+}
+
+#endif // AD_DECODERS_H
@@ -0,0 +1,212 @@
+/*
+ * AD Structure Parser
+ * Single pass over an advertising payload into a fixed-size, stack
+ * allocated view (offsets/lengths only - no copies, no heap)
+ */
+
+#ifndef AD_PARSER_H
+#define AD_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// BLE AD Type codes (from Bluetooth specification)
+#define AD_TYPE_FLAGS                    0x01
+#define AD_TYPE_16BIT_SERVICE_UUIDS_PART 0x02
+#define AD_TYPE_16BIT_SERVICE_UUIDS      0x03
+#define AD_TYPE_32BIT_SERVICE_UUIDS_PART 0x04
+#define AD_TYPE_32BIT_SERVICE_UUIDS      0x05
+#define AD_TYPE_128BIT_SERVICE_UUIDS_PART 0x06
+#define AD_TYPE_128BIT_SERVICE_UUIDS     0x07
+#define AD_TYPE_SHORT_LOCAL_NAME         0x08
+#define AD_TYPE_COMPLETE_LOCAL_NAME      0x09
+#define AD_TYPE_TX_POWER                 0x0A
+#define AD_TYPE_SERVICE_DATA_16BIT       0x16
+#define AD_TYPE_SERVICE_DATA_32BIT       0x20
+#define AD_TYPE_SERVICE_DATA_128BIT      0x21
+#define AD_TYPE_BROADCAST_NAME           0x30  // Auracast / extended advertising
+#define AD_TYPE_MANUFACTURER_DATA        0xFF
+
+// View limits (a legacy 31-byte payload holds at most 15 structures)
+#ifndef AD_MAX_FIELDS
+#define AD_MAX_FIELDS 24
+#endif
+#define AD_MAX_UUID16   12
+#define AD_MAX_UUID32   4
+#define AD_MAX_UUID128  4
+
+#define AD_NONE 0xFF
+
+struct AdField {
+  uint8_t type;
+  uint8_t offset;   // start of the field data (after the type byte)
+  uint8_t len;      // data length (AD length minus the type byte)
+};
+
+struct AdView {
+  const uint8_t* data = nullptr;
+  uint8_t len = 0;
+  bool malformed = false;   // stopped early on a bad length byte
+
+  uint8_t fieldCount = 0;
+  AdField fields[AD_MAX_FIELDS];
+
+  // Field indexes of interest, AD_NONE if absent
+  uint8_t flagsField = AD_NONE;
+  uint8_t nameField = AD_NONE;     // complete > shortened > broadcast name
+  uint8_t txPowerField = AD_NONE;
+  uint8_t mfgField = AD_NONE;      // first manufacturer data structure
+
+  // Every service UUID in the UUID lists and service data headers
+  uint8_t uuid16Count = 0;
+  uint16_t uuid16[AD_MAX_UUID16];
+  uint8_t uuid32Count = 0;
+  uint32_t uuid32[AD_MAX_UUID32];
+  uint8_t uuid128Count = 0;
+  uint8_t uuid128[AD_MAX_UUID128];  // offsets of 16-byte little-endian UUIDs
+
+  const uint8_t* fieldData(uint8_t i) const { return data + fields[i].offset; }
+
+  const uint8_t* name() const { return nameField == AD_NONE ? nullptr : fieldData(nameField); }
+  uint8_t nameLen() const { return nameField == AD_NONE ? 0 : fields[nameField].len; }
+
+  bool hasTxPower() const { return txPowerField != AD_NONE && fields[txPowerField].len >= 1; }
+  int8_t txPower() const { return (int8_t)fieldData(txPowerField)[0]; }
+
+  bool hasCompanyId() const { return mfgField != AD_NONE && fields[mfgField].len >= 2; }
+  uint16_t companyId() const {
+    const uint8_t* d = fieldData(mfgField);
+    return d[0] | (d[1] << 8);
+  }
+
+  const uint8_t* uuid128At(uint8_t i) const { return data + uuid128[i]; }
+};
+
+static inline uint16_t adRead16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t adRead32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void adAddUuid16(AdView& v, uint16_t uuid) {
+  for (uint8_t i = 0; i < v.uuid16Count; i++) {
+    if (v.uuid16[i] == uuid) return;
+  }
+  if (v.uuid16Count < AD_MAX_UUID16) v.uuid16[v.uuid16Count++] = uuid;
+}
+
+static inline void adAddUuid32(AdView& v, uint32_t uuid) {
+  if (v.uuid32Count < AD_MAX_UUID32) v.uuid32[v.uuid32Count++] = uuid;
+}
+
+static inline void adAddUuid128(AdView& v, uint8_t offset) {
+  if (v.uuid128Count < AD_MAX_UUID128) v.uuid128[v.uuid128Count++] = offset;
+}
+
+// Parse payload into view. Returns false if the payload was malformed
+// (the view still holds every structure before the bad one).
+static inline bool parseAdvertisement(const uint8_t* payload, uint8_t len, AdView& view) {
+  view = AdView();
+  view.data = payload;
+  view.len = len;
+
+  size_t offset = 0;
+  while (offset < len) {
+    if (len - offset < 2) break;
+
+    uint8_t adLen = payload[offset];
+    if (adLen == 0) break;                       // early terminator / padding
+    if (offset + adLen + 1 > len) {
+      view.malformed = true;
+      break;
+    }
+
+    if (view.fieldCount == AD_MAX_FIELDS) break;
+
+    uint8_t idx = view.fieldCount++;
+    AdField& f = view.fields[idx];
+    f.type = payload[offset + 1];
+    f.offset = (uint8_t)(offset + 2);
+    f.len = adLen - 1;
+    const uint8_t* d = payload + f.offset;
+
+    switch (f.type) {
+      case AD_TYPE_FLAGS:
+        if (view.flagsField == AD_NONE) view.flagsField = idx;
+        break;
+
+      case AD_TYPE_COMPLETE_LOCAL_NAME:
+        view.nameField = idx;
+        break;
+
+      case AD_TYPE_SHORT_LOCAL_NAME:
+        if (view.nameField == AD_NONE ||
+            view.fields[view.nameField].type == AD_TYPE_BROADCAST_NAME) {
+          view.nameField = idx;
+        }
+        break;
+
+      case AD_TYPE_BROADCAST_NAME:
+        if (view.nameField == AD_NONE) view.nameField = idx;
+        break;
+
+      case AD_TYPE_TX_POWER:
+        if (view.txPowerField == AD_NONE) view.txPowerField = idx;
+        break;
+
+      case AD_TYPE_MANUFACTURER_DATA:
+        if (view.mfgField == AD_NONE) view.mfgField = idx;
+        break;
+
+      case AD_TYPE_16BIT_SERVICE_UUIDS:
+      case AD_TYPE_16BIT_SERVICE_UUIDS_PART:
+        for (uint8_t i = 0; i + 1 < f.len; i += 2) adAddUuid16(view, adRead16(d + i));
+        break;
+
+      case AD_TYPE_32BIT_SERVICE_UUIDS:
+      case AD_TYPE_32BIT_SERVICE_UUIDS_PART:
+        for (uint8_t i = 0; i + 3 < f.len; i += 4) adAddUuid32(view, adRead32(d + i));
+        break;
+
+      case AD_TYPE_128BIT_SERVICE_UUIDS:
+      case AD_TYPE_128BIT_SERVICE_UUIDS_PART:
+        for (uint8_t i = 0; i + 15 < f.len; i += 16) adAddUuid128(view, (uint8_t)(f.offset + i));
+        break;
+
+      case AD_TYPE_SERVICE_DATA_16BIT:
+        if (f.len >= 2) adAddUuid16(view, adRead16(d));
+        break;
+
+      case AD_TYPE_SERVICE_DATA_32BIT:
+        if (f.len >= 4) adAddUuid32(view, adRead32(d));
+        break;
+
+      case AD_TYPE_SERVICE_DATA_128BIT:
+        if (f.len >= 16) adAddUuid128(view, f.offset);
+        break;
+    }
+
+    offset += adLen + 1;
+  }
+
+  return !view.malformed;
+}
+
+// 32-bit fingerprint of raw AD bytes (FNV-1a) for change detection
+#define AD_HASH_INIT 2166136261u
+
+static inline uint32_t adHashUpdate(uint32_t h, const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    h ^= data[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static inline uint32_t adHash32(const uint8_t* data, size_t len) {
+  return adHashUpdate(AD_HASH_INIT, data, len);
+}
+
+#endif // AD_PARSER_H
@@ -0,0 +1,99 @@
+/*
+ * Extended Advertising Reassembly
+ * Joins the fragments of a chained extended advertisement (AUX_CHAIN_IND)
+ * delivered as several scan reports with "more data" status. Runs in the
+ * scan callback, so it is fixed-size and only ever copies bytes.
+ */
+
+#ifndef ADV_REASSEMBLY_H
+#define ADV_REASSEMBLY_H
+
+#include <stdint.h>
+#include <string.h>
+#include "adv_report_ring.h"
+
+// Chains that can be in flight at once (interleaved advertisers)
+#ifndef ADV_REASSEMBLY_SLOTS
+#define ADV_REASSEMBLY_SLOTS 4
+#endif
+
+struct AdvChain {
+  bool     used;
+  bool     overflow;     // fragments beyond ADV_REPORT_MAX_DATA were cut
+  uint8_t  addr[6];
+  uint8_t  addrType;
+  uint8_t  setId;
+  uint16_t dataId;
+  uint32_t started;
+  uint8_t  len;
+  uint8_t  data[ADV_REPORT_MAX_DATA];
+};
+
+class AdvReassembler {
+private:
+  AdvChain chains[ADV_REASSEMBLY_SLOTS];
+  uint32_t abandoned = 0;   // chains evicted before their last fragment
+
+  bool same(const AdvChain& c, const uint8_t* addr, uint8_t addrType,
+            uint8_t setId, uint16_t dataId) const {
+    return c.used && c.addrType == addrType && c.setId == setId &&
+           c.dataId == dataId && memcmp(c.addr, addr, 6) == 0;
+  }
+
+public:
+  AdvReassembler() { clear(); }
+
+  // Chain already collecting fragments for this advertiser, or NULL
+  AdvChain* find(const uint8_t* addr, uint8_t addrType, uint8_t setId, uint16_t dataId) {
+    for (int i = 0; i < ADV_REASSEMBLY_SLOTS; i++) {
+      if (same(chains[i], addr, addrType, setId, dataId)) return &chains[i];
+    }
+    return NULL;
+  }
+
+  // Start a chain; when all slots are busy the oldest one is abandoned
+  AdvChain* open(const uint8_t* addr, uint8_t addrType, uint8_t setId, uint16_t dataId,
+                 uint32_t now) {
+    AdvChain* slot = NULL;
+    for (int i = 0; i < ADV_REASSEMBLY_SLOTS && slot == NULL; i++) {
+      if (!chains[i].used) slot = &chains[i];
+    }
+    if (slot == NULL) {
+      slot = &chains[0];
+      for (int i = 1; i < ADV_REASSEMBLY_SLOTS; i++) {
+        if ((int32_t)(chains[i].started - slot->started) < 0) slot = &chains[i];
+      }
+      abandoned++;
+    }
+
+    slot->used = true;
+    slot->overflow = false;
+    memcpy(slot->addr, addr, 6);
+    slot->addrType = addrType;
+    slot->setId = setId;
+    slot->dataId = dataId;
+    slot->started = now;
+    slot->len = 0;
+    return slot;
+  }
+
+  static void append(AdvChain* chain, const uint8_t* data, uint16_t len) {
+    uint16_t room = ADV_REPORT_MAX_DATA - chain->len;
+    if (len > room) {
+      len = room;
+      chain->overflow = true;
+    }
+    memcpy(&chain->data[chain->len], data, len);
+    chain->len += len;
+  }
+
+  static void release(AdvChain* chain) { chain->used = false; }
+
+  void clear() {
+    for (int i = 0; i < ADV_REASSEMBLY_SLOTS; i++) chains[i].used = false;
+  }
+
+  uint32_t abandonedCount() const { return abandoned; }
+};
+
+#endif // ADV_REASSEMBLY_H
@@ -0,0 +1,118 @@
+/*
+ * Advertisement Report Ring
+ * Lock-free single-producer/single-consumer queue between the SoftDevice
+ * scan callback (producer) and the report consumer task
+ */
+
+#ifndef ADV_REPORT_RING_H
+#define ADV_REPORT_RING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+// Number of report slots (must be a power of two)
+#ifndef ADV_RING_SLOTS
+#define ADV_RING_SLOTS 32
+#endif
+
+// Largest advertisement payload kept per report. 255 holds a reassembled
+// extended advertisement; 31 is enough for legacy advertising only.
+#ifndef ADV_REPORT_MAX_DATA
+#define ADV_REPORT_MAX_DATA 255
+#endif
+
+static_assert((ADV_RING_SLOTS & (ADV_RING_SLOTS - 1)) == 0,
+              "ADV_RING_SLOTS must be a power of two");
+static_assert(ADV_REPORT_MAX_DATA <= 255, "report length is stored in a uint8_t");
+
+// Report flag bits (copied from ble_gap_adv_report_type_t)
+#define ADV_FLAG_CONNECTABLE   0x01
+#define ADV_FLAG_SCANNABLE     0x02
+#define ADV_FLAG_DIRECTED      0x04
+#define ADV_FLAG_SCAN_RESPONSE 0x08  // a scan response, or an advertisement paired with one
+#define ADV_FLAG_EXTENDED      0x10
+#define ADV_FLAG_TRUNCATED     0x20  // payload did not fit, or chain fragments were lost
+// Filter parts the scan callback already checked (EARLY_*_CHECKED), not recorded
+#define ADV_FLAG_ADDR_CHECKED    0x40
+#define ADV_FLAG_PAYLOAD_CHECKED 0x80
+#define ADV_FLAG_CHECKED         (ADV_FLAG_ADDR_CHECKED | ADV_FLAG_PAYLOAD_CHECKED)
+
+// Raw copy of one ble_gap_evt_adv_report_t, owned by the ring
+struct AdvReport {
+  uint32_t timestamp;   // millis() when the callback ran
+  uint8_t  addr[6];     // little-endian, as delivered by the SoftDevice
+  uint8_t  addrType;    // BLE_GAP_ADDR_TYPE_*
+  int8_t   rssi;
+  int8_t   txPower;     // 127 = not available
+  uint8_t  flags;       // ADV_FLAG_*
+  uint8_t  primaryPhy;  // BLE_GAP_PHY_* (extended reports; 1M for legacy)
+  uint8_t  secondaryPhy;
+  uint8_t  len;
+  uint8_t  rspOffset;   // with ADV_FLAG_SCAN_RESPONSE: where the scan response starts in data
+  uint8_t  data[ADV_REPORT_MAX_DATA];
+};
+
+class AdvReportRing {
+private:
+  AdvReport slots[ADV_RING_SLOTS];
+  std::atomic<uint32_t> head{0};   // next slot to fill (producer only)
+  std::atomic<uint32_t> tail{0};   // next slot to drain (consumer only)
+  std::atomic<uint32_t> dropped{0};
+  uint32_t highWater = 0;
+
+public:
+  // Producer: returns a free slot, or nullptr (and counts a drop) when full
+  AdvReport* reserve() {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    uint32_t t = tail.load(std::memory_order_acquire);
+    if (h - t >= ADV_RING_SLOTS) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return &slots[h & (ADV_RING_SLOTS - 1)];
+  }
+
+  // Producer: publish the slot handed out by reserve()
+  void commit() {
+    uint32_t h = head.load(std::memory_order_relaxed) + 1;
+    head.store(h, std::memory_order_release);
+    uint32_t used = h - tail.load(std::memory_order_relaxed);
+    if (used > highWater) highWater = used;
+  }
+
+  // Consumer: oldest pending report, or nullptr when empty
+  const AdvReport* peek() {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return nullptr;
+    return &slots[t & (ADV_RING_SLOTS - 1)];
+  }
+
+  // Consumer: hand the slot returned by peek() back to the producer
+  void release() {
+    tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  bool empty() const {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+  }
+
+  uint32_t depth() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+
+  uint32_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+  uint32_t peakDepth() const { return highWater; }
+
+  // Only call while the producer is idle (scanner stopped)
+  void resetStats() {
+    dropped.store(0, std::memory_order_relaxed);
+    highWater = 0;
+  }
+
+  // Start a new peak measurement while scanning continues (a racing
+  // producer update can be lost, which only under-reports the peak)
+  void resetPeak() { highWater = 0; }
+};
+
+#endif // ADV_REPORT_RING_H
@@ -0,0 +1,157 @@
+/*
+ * Binary Report Records
+ * Compact framed encoding of one advertising report for host-side
+ * ingestion: fixed header + raw AD bytes + CRC-16, COBS-framed with a
+ * 0x00 delimiter. See docs/binary_protocol.md for the wire format.
+ *
+ * Encoder and decoder are plain C++ so host tools can share this file.
+ */
+
+#ifndef BINARY_RECORD_H
+#define BINARY_RECORD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define BIN_RECORD_VERSION     1
+#define BIN_RECORD_ADV_REPORT  0x01
+
+#define BIN_EVENT_REPORT   0   // deduplication off
+#define BIN_EVENT_NEW      1
+#define BIN_EVENT_CHANGED  2
+
+#define BIN_TX_POWER_NONE  127
+
+#define BIN_HEADER_SIZE    17
+#define BIN_MAX_AD_DATA    255
+#define BIN_MAX_RECORD     (BIN_HEADER_SIZE + BIN_MAX_AD_DATA + 2)
+// COBS adds one byte per 254 plus the leading code byte; +1 for the delimiter
+#define BIN_MAX_FRAME      (BIN_MAX_RECORD + BIN_MAX_RECORD / 254 + 2)
+
+struct BinaryReport {
+  uint32_t timestamp;    // device millis()
+  uint8_t  addr[6];      // little-endian
+  uint8_t  addrType;
+  int8_t   rssi;
+  int8_t   txPower;      // BIN_TX_POWER_NONE if not advertised
+  uint8_t  flags;        // ADV_FLAG_* from adv_report_ring.h
+  uint8_t  event;        // BIN_EVENT_*
+  uint8_t  len;
+  const uint8_t* data;   // raw AD bytes
+};
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), nibble table.
+// binCrc16Update continues a CRC over data delivered in pieces.
+#define BIN_CRC16_INIT 0xFFFF
+
+static inline uint16_t binCrc16Update(uint16_t crc, const uint8_t* data, size_t len) {
+  static const uint16_t table[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+  };
+  for (size_t i = 0; i < len; i++) {
+    crc = (uint16_t)((crc << 4) ^ table[((crc >> 12) ^ (data[i] >> 4)) & 0x0F]);
+    crc = (uint16_t)((crc << 4) ^ table[((crc >> 12) ^ (data[i] & 0x0F)) & 0x0F]);
+  }
+  return crc;
+}
+
+static inline uint16_t binCrc16(const uint8_t* data, size_t len) {
+  return binCrc16Update(BIN_CRC16_INIT, data, len);
+}
+
+// COBS encode; out must hold len + len / 254 + 1 bytes. No delimiter added.
+static inline size_t cobsEncode(const uint8_t* in, size_t len, uint8_t* out) {
+  size_t codeIdx = 0;
+  size_t o = 1;
+  uint8_t code = 1;
+  for (size_t i = 0; i < len; i++) {
+    if (in[i] == 0) {
+      out[codeIdx] = code;
+      codeIdx = o++;
+      code = 1;
+    } else {
+      out[o++] = in[i];
+      if (++code == 0xFF) {
+        out[codeIdx] = code;
+        codeIdx = o++;
+        code = 1;
+      }
+    }
+  }
+  out[codeIdx] = code;
+  return o;
+}
+
+// COBS decode (frame without the delimiter). Returns decoded length,
+// or 0 if the frame is malformed or does not fit.
+static inline size_t cobsDecode(const uint8_t* in, size_t len, uint8_t* out, size_t maxOut) {
+  size_t i = 0, o = 0;
+  while (i < len) {
+    uint8_t code = in[i++];
+    if (code == 0) return 0;
+    for (uint8_t k = 1; k < code; k++) {
+      if (i >= len || o >= maxOut) return 0;
+      out[o++] = in[i++];
+    }
+    if (code != 0xFF && i < len) {
+      if (o >= maxOut) return 0;
+      out[o++] = 0;
+    }
+  }
+  return o;
+}
+
+// Serialize r into a complete frame (including the 0x00 delimiter).
+// frame must hold BIN_MAX_FRAME bytes. Returns the frame length.
+static inline size_t binEncodeReport(const BinaryReport& r, uint8_t* frame) {
+  uint8_t rec[BIN_MAX_RECORD];
+  rec[0]  = BIN_RECORD_ADV_REPORT;
+  rec[1]  = BIN_RECORD_VERSION;
+  rec[2]  = (uint8_t)(r.timestamp);
+  rec[3]  = (uint8_t)(r.timestamp >> 8);
+  rec[4]  = (uint8_t)(r.timestamp >> 16);
+  rec[5]  = (uint8_t)(r.timestamp >> 24);
+  memcpy(&rec[6], r.addr, 6);
+  rec[12] = r.addrType;
+  rec[13] = (uint8_t)r.rssi;
+  rec[14] = (uint8_t)r.txPower;
+  rec[15] = (uint8_t)((r.flags & 0x3F) | (r.event << 6));
+  rec[16] = r.len;
+  memcpy(&rec[BIN_HEADER_SIZE], r.data, r.len);
+
+  size_t n = BIN_HEADER_SIZE + r.len;
+  uint16_t crc = binCrc16(rec, n);
+  rec[n++] = (uint8_t)crc;
+  rec[n++] = (uint8_t)(crc >> 8);
+
+  size_t f = cobsEncode(rec, n, frame);
+  frame[f++] = 0x00;
+  return f;
+}
+
+// Parse a decoded (un-COBSed) record. data points into rec.
+// Returns false on a bad length, type, version or CRC.
+static inline bool binDecodeReport(const uint8_t* rec, size_t n, BinaryReport& r) {
+  if (n < BIN_HEADER_SIZE + 2) return false;
+  if (rec[0] != BIN_RECORD_ADV_REPORT || rec[1] != BIN_RECORD_VERSION) return false;
+  if (n != (size_t)BIN_HEADER_SIZE + rec[16] + 2) return false;
+
+  uint16_t crc = (uint16_t)(rec[n - 2] | (rec[n - 1] << 8));
+  if (binCrc16(rec, n - 2) != crc) return false;
+
+  r.timestamp = (uint32_t)rec[2] | ((uint32_t)rec[3] << 8) |
+                ((uint32_t)rec[4] << 16) | ((uint32_t)rec[5] << 24);
+  memcpy(r.addr, &rec[6], 6);
+  r.addrType = rec[12];
+  r.rssi = (int8_t)rec[13];
+  r.txPower = (int8_t)rec[14];
+  r.flags = rec[15] & 0x3F;
+  r.event = rec[15] >> 6;
+  r.len = rec[16];
+  r.data = &rec[BIN_HEADER_SIZE];
+  return true;
+}
+
+#endif // BINARY_RECORD_H
@@ -1,13 +1,34 @@
 /*
  * BLE Filter Config with Built-in Apple/Google Blacklist
- * No filesystem needed - filters compiled into code
+ * The built-in lists come from the data/ text files via
+ * scripts/gen_filter_tables.py and are the first-boot default;
+ * filter_store.h keeps the compiled filters (including runtime edits) in
+ * internal flash
+ *
+ * Concurrency: lookups read an immutable FilterSnapshot and never lock.
+ * Edits are applied to a standby copy that is published with one atomic
+ * pointer swap; the writer then waits out a grace period (readers that
+ * may still hold the old snapshot, tracked per epoch) before that copy is
+ * reused. Any number of tasks may read, one task at a time may edit.
+ *
+ * All tables of both snapshots live in the filter arena (filter_arena.h),
+ * not on the heap.
  */
 
 #ifndef BLE_FILTER_CONFIG_BUILTIN_H
 #define BLE_FILTER_CONFIG_BUILTIN_H
 
 #include <Arduino.h>
-#include <vector>
+#include <atomic>
+#include "filter_arena.h"
+#include "mac_prefix_table.h"
+#include "pattern_matcher.h"
+#include "uuid_set.h"
+#include "ad_parser.h"
+#include "ble_filter_tables_generated.h"
+
+// Longest payload pattern accepted, in bytes
+#define FILTER_MAX_PAYLOAD_PATTERN 31
 
 // Filter types
 enum FilterMode {
@@ -18,342 +39,604 @@ enum FilterMode {
 
 struct FilterConfig {
   FilterMode mode = FILTER_OFF;
-  std::vector<String> ouiList;
-  std::vector<String> nameList;
-  std::vector<String> uuidList;
-  std::vector<String> payloadList;
+  MacPrefixTable ouiTable;   // OUIs and full MACs, packed and sorted
+  bool builtinOuis = false;  // generated OUI/MAC tables attached to ouiTable
+  ArenaTextList nameList;
+  ArenaTextList uuidList;
+  ArenaTextList payloadList;
+  
+  // Compiled from nameList / uuidList / payloadList as entries are added
+  PatternMatcher nameMatcher{true};       // case-folded
+  PatternMatcher payloadMatcher{false};   // raw bytes
+  UuidSet uuidSet;
 };
 
-class BLEFilter {
-private:
+// FilterSnapshot::earlyCheck() result bits
+#define EARLY_REJECT          0x01  // hidden whatever the parsed payload says
+#define EARLY_ADDR_CHECKED    0x40  // the address does not match
+#define EARLY_PAYLOAD_CHECKED 0x80  // the raw payload does not match
+
+// One complete, compiled filter set. Published snapshots are never
+// modified; BLEFilter edits a copy.
+struct FilterSnapshot {
   FilterConfig whitelist;
   FilterConfig blacklist;
   bool initialized = false;
+  uint32_t edits = 0;   // bumped by every published change, so callers know when to persist
+
+  static bool matchesOUI(const uint8_t* addr, const MacPrefixTable& ouiTable) {
+    return !ouiTable.empty() && ouiTable.matches(addr);
+  }
+
+  static bool matchesName(const uint8_t* name, size_t nameLen, const PatternMatcher& matcher) {
+    return nameLen > 0 && matcher.matches(name, nameLen);
+  }
+
+  static bool matchesUUID(const AdView& view, const UuidSet& uuidSet) {
+    return uuidSet.matches(view);
+  }
+
+  static bool matchesPayload(const uint8_t* payload, size_t len, const PatternMatcher& matcher) {
+    return len > 0 && matcher.matches(payload, len);
+  }
+
+  static bool matchesAny(const FilterConfig& config, const uint8_t* addr, const AdView& view,
+                         uint8_t checked = 0) {
+    return (!(checked & EARLY_ADDR_CHECKED) && matchesOUI(addr, config.ouiTable)) ||
+           matchesName(view.name(), view.nameLen(), config.nameMatcher) ||
+           matchesUUID(view, config.uuidSet) ||
+           (!(checked & EARLY_PAYLOAD_CHECKED) && matchesPayload(view.data, view.len, config.payloadMatcher));
+  }
 
-  bool matchesOUI(const String& mac, const std::vector<String>& ouiList) {
-    if (ouiList.empty()) return false;
-    String macUpper = mac;
-    macUpper.toUpperCase();
+  // checked: EARLY_*_CHECKED bits from earlyCheck(), parts that need no
+  // second look
+  bool shouldShow(const uint8_t* addr, const AdView& view, uint8_t checked = 0) const {
+    if (!initialized) return true;
     
-    for (const auto& pattern : ouiList) {
-      String patternUpper = pattern;
-      patternUpper.toUpperCase();
-      
-      // Check if pattern is a full MAC (17 chars with colons) or OUI (8 chars)
-      if (patternUpper.length() >= 17) {
-        // Full MAC - exact match
-        if (macUpper == patternUpper) return true;
-      } else {
-        // OUI or partial MAC - prefix match
-        // Extract just the prefix part we want to compare
-        int compareLen = min(patternUpper.length(), macUpper.length());
-        if (macUpper.substring(0, compareLen) == patternUpper.substring(0, compareLen)) {
-          return true;
-        }
-      }
+    // Whitelist takes priority
+    if (whitelist.mode == FILTER_WHITELIST) {
+      return matchesAny(whitelist, addr, view, checked);
     }
-    return false;
+    
+    // Blacklist - hide matching devices
+    if (blacklist.mode == FILTER_BLACKLIST) {
+      return !matchesAny(blacklist, addr, view, checked);
+    }
+    
+    return true;
   }
 
-  bool matchesName(const String& name, const std::vector<String>& nameList) {
-    if (nameList.empty() || name.length() == 0) return false;
-    String nameUpper = name;
-    nameUpper.toUpperCase();
-    
-    for (const auto& pattern : nameList) {
-      if (nameUpper.indexOf(pattern) >= 0) return true;
+  // Scan callback fast path: the address and the raw payload against the
+  // active list, before any parsing. addrFinal is false when the address
+  // may still be replaced by a resolved identity; usePayload is false
+  // when the payload is only part of what shouldShow() will see (a half
+  // of a scan response pair). Returns EARLY_* bits.
+  uint8_t earlyCheck(const uint8_t* addr, bool addrFinal,
+                     const uint8_t* data, size_t len, bool usePayload) const {
+    if (!initialized) return 0;
+    bool white = whitelist.mode == FILTER_WHITELIST;
+    if (!white && blacklist.mode != FILTER_BLACKLIST) return 0;
+    const FilterConfig& config = white ? whitelist : blacklist;
+
+    uint8_t checked = 0;
+    bool hit = false;
+    if (addrFinal) {
+      if (matchesOUI(addr, config.ouiTable)) hit = true;
+      else checked |= EARLY_ADDR_CHECKED;
+    }
+    if (!hit && usePayload) {
+      if (matchesPayload(data, len, config.payloadMatcher)) hit = true;
+      else checked |= EARLY_PAYLOAD_CHECKED;
     }
-    return false;
+
+    if (!white) return hit ? EARLY_REJECT : checked;
+    if (hit) return 0;   // shown; the consumer checks again
+    bool rawOnly = config.nameList.empty() && config.uuidList.empty();
+    return rawOnly && checked == (EARLY_ADDR_CHECKED | EARLY_PAYLOAD_CHECKED) ? EARLY_REJECT : checked;
   }
 
-  bool matchesUUID(const String& uuid, const std::vector<String>& uuidList) {
-    if (uuidList.empty()) return false;
-    String uuidUpper = uuid;
-    uuidUpper.toUpperCase();
-    
-    for (const auto& pattern : uuidList) {
-      if (uuidUpper.indexOf(pattern) >= 0) return true;
+  // Only whitelisted devices are shown
+  bool whitelistActive() const {
+    return initialized && whitelist.mode == FILTER_WHITELIST;
+  }
+
+  // Whitelist mode with nothing but full MACs, at most max of them: the
+  // controller can do the filtering. Fills macs (packed, see
+  // MacPrefixTable::packAddress) and returns the count, 0 if not possible.
+  size_t acceptList(uint64_t* macs, size_t max) const {
+    if (!initialized || whitelist.mode != FILTER_WHITELIST) return 0;
+    const FilterConfig& config = whitelist;
+    size_t count = config.ouiTable.fullMacCount();
+    if (count == 0 || count > max || count != config.ouiTable.size() ||
+        !config.nameList.empty() || !config.uuidList.empty() || !config.payloadList.empty()) {
+      return 0;
     }
-    return false;
+    for (size_t i = 0; i < count; i++) macs[i] = config.ouiTable.fullMac(i);
+    return count;
   }
+};
 
-  bool matchesPayload(const String& payload, const std::vector<String>& payloadList) {
-    if (payloadList.empty() || payload.length() == 0) return false;
-    String payloadUpper = payload;
-    payloadUpper.toUpperCase();
-    
-    for (const auto& pattern : payloadList) {
-      String patternUpper = pattern;
-      patternUpper.toUpperCase();
-      
-      // Check if pattern appears anywhere in payload (substring match)
-      if (payloadUpper.indexOf(patternUpper) >= 0) {
-        return true;
-      }
+class BLEFilter {
+private:
+  FilterSnapshot snapshots[2];
+  std::atomic<FilterSnapshot*> live{&snapshots[0]};
+  FilterSnapshot* draft = nullptr;   // standby copy while an edit is open
+  bool grouped = false;              // draft opened by beginEdit()
+
+  // Readers announce themselves in the counter of the epoch they started
+  // in; a writer flips the epoch after publishing and waits for the old
+  // epoch's counter to drain
+  mutable std::atomic<uint32_t> epoch{0};
+  mutable std::atomic<uint32_t> readers[2] = {{0}, {0}};
+
+  uint32_t enterRead() const {
+    while (true) {
+      uint32_t e = epoch.load();
+      readers[e & 1].fetch_add(1);
+      if (epoch.load() == e) return e;
+      readers[e & 1].fetch_sub(1);   // raced with a flip - count in the new epoch
     }
-    return false;
   }
 
-  void loadBuiltinFilters() {
-    Serial.println("[FILTER] Loading built-in Apple/Google blacklist...");
-    
-    // Apple OUIs (most common ones to save memory)
-    const char* appleOUIs[] = {
-      "A4:CF:12", "4C:57:CA", "00:00:00", "A8:88:08", "04:0C:CE",
-      "98:01:A7", "3C:E0:72", "00:CD:FE", "A4:D1:8C", "78:A3:E4",
-      "DC:2B:2A", "00:26:BB", "F0:DB:E2", "68:96:7B", "8C:85:90",
-      "80:E6:50", "00:1F:F3", "00:23:12", "00:25:00", "00:25:BC",
-      "34:15:9E", "00:88:65", "00:F4:B9", "84:38:35", "C8:2A:14",
-      "F0:D1:A9", "70:73:CB", "F4:F1:5A", "D4:90:9C", "98:B8:E3",
-      "AC:3C:0B", "00:3E:E1", "DC:86:D8", "3C:07:54", "60:03:08",
-      "B0:65:BD", "F0:DC:E2", "94:F6:A3", "98:FE:94", "E0:C7:67",
-      "70:CD:60", "BC:4C:C4", "48:43:7C", "34:C0:59", "E8:80:2E",
-      "90:84:0D", "D8:30:62", "18:E7:F4", "18:20:32", "00:F7:6F"
-    };
-    
-    // Google/Nest OUIs
-    const char* googleOUIs[] = {
-      "F4:F5:E8", "D0:E7:82", "2C:F0:A2", "5C:F8:A1", "7C:2F:80",
-      "1C:F2:9A", "00:1A:11", "00:26:B7", "00:17:C9", "00:19:07",
-      "00:21:6A", "00:21:91", "00:23:4D", "00:25:9C", "34:FC:EF",
-      "3C:5A:B4", "40:B4:CD", "54:60:09", "58:CB:52", "6C:AD:F8",
-      "74:E5:43", "78:D6:F0", "7C:BB:8A", "88:75:56", "90:E7:C4"
-    };
-    
-    // Device names to block
-    const char* blockedNames[] = {
-      "IPHONE", "IPAD", "MACBOOK", "AIRPODS", "APPLE", "WATCH",
-      "PIXEL", "GOOGLE", "NEST", "CHROMECAST", "ANDROID"
-    };
-    
-    // Payload signatures
-    const char* blockedPayloads[] = {
-      "4C00",  // Apple manufacturer data
-      "E000"   // Google manufacturer data
-    };
-    
-    // Load into blacklist
-    for (const auto& oui : appleOUIs) {
-      blacklist.ouiList.push_back(String(oui));
+  void exitRead(uint32_t e) const {
+    readers[e & 1].fetch_sub(1);
+  }
+
+  // Lookup scope: the snapshot stays valid until the guard is destroyed
+  class ReadGuard {
+  private:
+    const BLEFilter& filter;
+    uint32_t e;
+  public:
+    explicit ReadGuard(const BLEFilter& f) : filter(f), e(f.enterRead()) {}
+    ~ReadGuard() { filter.exitRead(e); }
+    const FilterSnapshot& operator*() const { return *filter.live.load(); }
+    const FilterSnapshot* operator->() const { return filter.live.load(); }
+  };
+
+  FilterSnapshot* openDraft() {
+    FilterSnapshot* current = live.load();
+    draft = current == &snapshots[0] ? &snapshots[1] : &snapshots[0];
+    *draft = *current;   // the grace period of the last publish freed it
+    return draft;
+  }
+
+  // Swap the draft in, then wait until no reader can still see the old one
+  void publish() {
+    draft->edits++;
+    live.store(draft);
+    draft = nullptr;
+    uint32_t old = epoch.fetch_add(1);
+    while (readers[old & 1].load() != 0) delay(1);
+  }
+
+  // One change: joins an edit opened with beginEdit(), otherwise opens its
+  // own and publishes it on commit(). Not committed = discarded.
+  class Edit {
+  private:
+    BLEFilter& filter;
+    bool owner;
+  public:
+    explicit Edit(BLEFilter& f) : filter(f), owner(f.draft == nullptr) {
+      if (owner) f.openDraft();
     }
-    
-    for (const auto& oui : googleOUIs) {
-      blacklist.ouiList.push_back(String(oui));
+    ~Edit() { if (owner) filter.draft = nullptr; }
+    FilterSnapshot* operator->() const { return filter.draft; }
+    FilterSnapshot& operator*() const { return *filter.draft; }
+    void commit() { if (owner) filter.publish(); }
+  };
+
+  static bool addName(FilterConfig& config, const char* name) {
+    if (!config.nameMatcher.add(name)) return false;
+    config.nameList.push_back(name);
+    return true;
+  }
+
+  static bool addUUID(FilterConfig& config, const char* uuid) {
+    if (!config.uuidSet.add(uuid)) return false;
+    config.uuidList.push_back(uuid);
+    return true;
+  }
+
+  // Payload patterns are hex text, matched as raw bytes on byte boundaries
+  static bool addPayload(FilterConfig& config, const char* payload) {
+    uint8_t bytes[FILTER_MAX_PAYLOAD_PATTERN];
+    size_t len = parseHexPattern(payload, bytes, sizeof(bytes));
+    if (len == 0 || !config.payloadMatcher.add(bytes, len)) return false;
+    config.payloadList.push_back(payload);
+    return true;
+  }
+
+  template <typename Out>
+  static void saveStrings(Out& out, const ArenaTextList& list) {
+    uint16_t n = (uint16_t)list.size();
+    out.put(&n, sizeof(n));
+    for (size_t i = 0; i < n; i++) {
+      size_t textLen = strlen(list[i]);
+      uint8_t len = (uint8_t)(textLen > 255 ? 255 : textLen);
+      out.put(&len, sizeof(len));
+      out.put(list[i], len);
     }
-    
-    for (const auto& name : blockedNames) {
-      blacklist.nameList.push_back(String(name));
+  }
+
+  template <typename In>
+  static bool loadStrings(In& in, ArenaTextList& list) {
+    uint16_t n;
+    if (!in.get(&n, sizeof(n)) || n > in.remaining()) return false;
+    list.clear();
+    list.reserve(n, 0);
+    for (uint16_t i = 0; i < n; i++) {
+      uint8_t len;
+      char text[256];
+      if (!in.get(&len, sizeof(len)) || !in.get(text, len)) return false;
+      list.push_back(text, len);
     }
-    
-    for (const auto& payload : blockedPayloads) {
-      blacklist.payloadList.push_back(String(payload));
+    return true;
+  }
+
+  // Attach the generated OUI/MAC tables of one list (searched in flash)
+  static void attachBuiltinOuis(FilterConfig& config, const BuiltinFilterTable& table) {
+    config.ouiTable.attachBuiltin(table.ouis, table.ouiCount, table.macs, table.macCount);
+    config.builtinOuis = true;
+  }
+
+  // The generated tables are referenced by a flag, not copied into the image
+  template <typename Out>
+  static void saveConfig(Out& out, const FilterConfig& config) {
+    uint8_t mode = (uint8_t)config.mode;
+    uint8_t builtin = config.builtinOuis ? 1 : 0;
+    out.put(&mode, sizeof(mode));
+    out.put(&builtin, sizeof(builtin));
+    config.ouiTable.save(out);
+    saveStrings(out, config.nameList);
+    saveStrings(out, config.uuidList);
+    saveStrings(out, config.payloadList);
+    config.nameMatcher.save(out);
+    config.payloadMatcher.save(out);
+    config.uuidSet.save(out);
+  }
+
+  template <typename In>
+  static bool loadConfig(In& in, FilterConfig& config, const BuiltinFilterTable& table) {
+    uint8_t mode, builtin;
+    if (!in.get(&mode, sizeof(mode)) || mode > FILTER_BLACKLIST) return false;
+    if (!in.get(&builtin, sizeof(builtin))) return false;
+    config.mode = (FilterMode)mode;
+    if (builtin) attachBuiltinOuis(config, table);
+    return config.ouiTable.load(in) &&
+           loadStrings(in, config.nameList) &&
+           loadStrings(in, config.uuidList) &&
+           loadStrings(in, config.payloadList) &&
+           config.nameMatcher.load(in) &&
+           config.payloadMatcher.load(in) &&
+           config.uuidSet.load(in);
+  }
+
+  // Generated tables: OUIs/MACs are used in place, the few names, UUIDs,
+  // payloads and odd-length prefixes are compiled into the matchers
+  static void loadBuiltinList(FilterConfig& config, const BuiltinFilterTable& table) {
+    attachBuiltinOuis(config, table);
+    for (uint16_t i = 0; i < table.prefixCount; i++) {
+      config.ouiTable.add(table.prefixes[i]);
+    }
+    for (uint16_t i = 0; i < table.nameCount; i++) {
+      addName(config, table.names[i]);
+    }
+    for (uint16_t i = 0; i < table.uuidCount; i++) {
+      addUUID(config, table.uuids[i]);
     }
+    for (uint16_t i = 0; i < table.payloadCount; i++) {
+      addPayload(config, table.payloads[i]);
+    }
+  }
+
+  static void loadBuiltinFilters(FilterConfig& blacklist, FilterConfig& whitelist, Print& out) {
+    out.println("[FILTER] Loading built-in filters (data/blacklist.txt, data/whitelist.txt)...");
+    loadBuiltinList(blacklist, BUILTIN_BLACKLIST);
+    loadBuiltinList(whitelist, BUILTIN_WHITELIST);
     
-    Serial.printf("[FILTER] Loaded %d OUIs, %d names, %d payloads\n",
-                  blacklist.ouiList.size(),
-                  blacklist.nameList.size(),
-                  blacklist.payloadList.size());
+    out.printf("[FILTER] Loaded %d OUIs (%d in flash), %d names, %d UUIDs, %d payloads\n",
+               blacklist.ouiTable.size() + whitelist.ouiTable.size(),
+               blacklist.ouiTable.builtinCount() + whitelist.ouiTable.builtinCount(),
+               blacklist.nameList.size() + whitelist.nameList.size(),
+               blacklist.uuidList.size() + whitelist.uuidList.size(),
+               blacklist.payloadList.size() + whitelist.payloadList.size());
   }
 
 public:
-  bool begin() {
-    initialized = true;
+  // Group several changes (e.g. clear + begin) into one published snapshot
+  void beginEdit() {
+    if (draft != nullptr) return;
+    openDraft();
+    grouped = true;
+  }
+
+  void commitEdit() {
+    if (!grouped) return;
+    grouped = false;
+    publish();
+  }
+
+  bool begin(Print& out = Serial) {
+    Edit edit(*this);
+    FilterConfig& blacklist = edit->blacklist;
+    FilterConfig& whitelist = edit->whitelist;
+    edit->initialized = true;
     
     // Load built-in filters
-    loadBuiltinFilters();
+    loadBuiltinFilters(blacklist, whitelist, out);
     
     // Enable blacklist if we have filters
-    if (!blacklist.ouiList.empty() || !blacklist.nameList.empty() || 
-        !blacklist.payloadList.empty()) {
+    if (!blacklist.ouiTable.empty() || !blacklist.nameList.empty() || 
+        !blacklist.uuidList.empty() || !blacklist.payloadList.empty()) {
       blacklist.mode = FILTER_BLACKLIST;
-      Serial.println("[FILTER] Blacklist mode ENABLED (built-in filters)");
+      out.println("[FILTER] Blacklist mode ENABLED (built-in filters)");
     }
     
+    // A non-empty data/whitelist.txt takes effect the same way
+    if (!whitelist.ouiTable.empty() || !whitelist.nameList.empty() ||
+        !whitelist.uuidList.empty() || !whitelist.payloadList.empty()) {
+      whitelist.mode = FILTER_WHITELIST;
+      out.println("[FILTER] Whitelist mode ENABLED (built-in filters)");
+    }
+    
+    edit.commit();
     return true;
   }
 
-  bool shouldShow(const String& mac, const String& name, 
-                  const String& uuid, const String& payload) {
-    if (!initialized) return true;
-    
-    // Whitelist takes priority
-    if (whitelist.mode == FILTER_WHITELIST) {
-      bool matches = matchesOUI(mac, whitelist.ouiList) ||
-                     matchesName(name, whitelist.nameList) ||
-                     matchesUUID(uuid, whitelist.uuidList) ||
-                     matchesPayload(payload, whitelist.payloadList);
-      return matches;
-    }
-    
-    // Blacklist - hide matching devices
-    if (blacklist.mode == FILTER_BLACKLIST) {
-      bool matches = matchesOUI(mac, blacklist.ouiList) ||
-                     matchesName(name, blacklist.nameList) ||
-                     matchesUUID(uuid, blacklist.uuidList) ||
-                     matchesPayload(payload, blacklist.payloadList);
-      return !matches;
+  // Write both lists, compiled, as one binary image (see filter_store.h)
+  template <typename Out>
+  void save(Out& out) const {
+    ReadGuard snap(*this);
+    saveConfig(out, snap->whitelist);
+    saveConfig(out, snap->blacklist);
+  }
+
+  // Replace all filters with a saved image instead of the built-in lists.
+  // The image is parsed into the draft and published only once all of it
+  // has been read; on failure the filters are unchanged and the caller
+  // falls back to begin().
+  template <typename In>
+  bool load(In& in) {
+    Edit edit(*this);
+    edit->whitelist = FilterConfig();
+    edit->blacklist = FilterConfig();
+    if (!loadConfig(in, edit->whitelist, BUILTIN_WHITELIST) ||
+        !loadConfig(in, edit->blacklist, BUILTIN_BLACKLIST) ||
+        in.remaining() != 0) {
+      return false;
     }
-    
+    edit->initialized = true;
+    edit.commit();
     return true;
   }
 
-  void printStatus() {
-    Serial.println("\n[FILTER-STATUS]");
-    Serial.printf("  Whitelist: %s (%d OUI, %d names, %d UUIDs, %d payloads)\n",
+  uint32_t revision() const {
+    ReadGuard snap(*this);
+    return snap->edits;
+  }
+
+  // addr is the raw little-endian address from the advertising report,
+  // view the parsed payload of the same report. Lock-free; safe on any task.
+  bool shouldShow(const uint8_t* addr, const AdView& view, uint8_t checked = 0) const {
+    ReadGuard snap(*this);
+    return snap->shouldShow(addr, view, checked);
+  }
+
+  // Raw-report fast path for the scan callback, see FilterSnapshot
+  uint8_t earlyCheck(const uint8_t* addr, bool addrFinal,
+                     const uint8_t* data, size_t len, bool usePayload) const {
+    ReadGuard snap(*this);
+    return snap->earlyCheck(addr, addrFinal, data, len, usePayload);
+  }
+
+  bool whitelistActive() const {
+    ReadGuard snap(*this);
+    return snap->whitelistActive();
+  }
+
+  size_t acceptList(uint64_t* macs, size_t max) const {
+    ReadGuard snap(*this);
+    return snap->acceptList(macs, max);
+  }
+
+  void printStatus(Print& out = Serial) const {
+    ReadGuard snap(*this);
+    const FilterConfig& whitelist = snap->whitelist;
+    const FilterConfig& blacklist = snap->blacklist;
+    out.println("\n[FILTER-STATUS]");
+    out.printf("  Whitelist: %s (%d OUI, %d names, %d UUIDs, %d payloads)\n",
                   whitelist.mode == FILTER_WHITELIST ? "ACTIVE" : "OFF",
-                  whitelist.ouiList.size(), whitelist.nameList.size(),
+                  whitelist.ouiTable.size(), whitelist.nameList.size(),
                   whitelist.uuidList.size(), whitelist.payloadList.size());
-    Serial.printf("  Blacklist: %s (%d OUI, %d names, %d UUIDs, %d payloads)\n",
+    out.printf("  Blacklist: %s (%d OUI, %d names, %d UUIDs, %d payloads)\n",
                   blacklist.mode == FILTER_BLACKLIST ? "ACTIVE" : "OFF",
-                  blacklist.ouiList.size(), blacklist.nameList.size(),
+                  blacklist.ouiTable.size(), blacklist.nameList.size(),
                   blacklist.uuidList.size(), blacklist.payloadList.size());
     
     // Show whitelist entries if any
     if (whitelist.mode == FILTER_WHITELIST) {
-      if (!whitelist.ouiList.empty()) {
-        Serial.println("\n  Whitelist OUI/MAC entries:");
-        for (size_t i = 0; i < whitelist.ouiList.size() && i < 10; i++) {
-          Serial.printf("    - %s\n", whitelist.ouiList[i].c_str());
+      if (!whitelist.ouiTable.empty()) {
+        out.println("\n  Whitelist OUI/MAC entries:");
+        for (size_t i = 0; i < whitelist.ouiTable.size() && i < 10; i++) {
+          char entry[18];
+          whitelist.ouiTable.entryText(i, entry);
+          out.printf("    - %s\n", entry);
         }
-        if (whitelist.ouiList.size() > 10) {
-          Serial.printf("    ... and %d more\n", whitelist.ouiList.size() - 10);
+        if (whitelist.ouiTable.size() > 10) {
+          out.printf("    ... and %d more\n", whitelist.ouiTable.size() - 10);
         }
       }
       
       if (!whitelist.nameList.empty()) {
-        Serial.println("\n  Whitelist name entries:");
+        out.println("\n  Whitelist name entries:");
         for (size_t i = 0; i < whitelist.nameList.size() && i < 5; i++) {
-          Serial.printf("    - %s\n", whitelist.nameList[i].c_str());
+          out.printf("    - %s\n", whitelist.nameList[i]);
         }
       }
       
       if (!whitelist.uuidList.empty()) {
-        Serial.println("\n  Whitelist UUID entries:");
+        out.println("\n  Whitelist UUID entries:");
         for (size_t i = 0; i < whitelist.uuidList.size() && i < 5; i++) {
-          Serial.printf("    - %s\n", whitelist.uuidList[i].c_str());
+          out.printf("    - %s\n", whitelist.uuidList[i]);
         }
       }
       
       if (!whitelist.payloadList.empty()) {
-        Serial.println("\n  Whitelist payload patterns:");
+        out.println("\n  Whitelist payload patterns:");
         for (size_t i = 0; i < whitelist.payloadList.size() && i < 5; i++) {
-          Serial.printf("    - %s\n", whitelist.payloadList[i].c_str());
+          out.printf("    - %s\n", whitelist.payloadList[i]);
         }
       }
     }
     
     // Show blacklist OUI entries if any
-    if (!blacklist.ouiList.empty()) {
-      Serial.println("\n  Blacklist OUI/MAC entries:");
-      for (size_t i = 0; i < blacklist.ouiList.size() && i < 10; i++) {
-        Serial.printf("    - %s\n", blacklist.ouiList[i].c_str());
+    if (!blacklist.ouiTable.empty()) {
+      out.println("\n  Blacklist OUI/MAC entries:");
+      for (size_t i = 0; i < blacklist.ouiTable.size() && i < 10; i++) {
+        char entry[18];
+        blacklist.ouiTable.entryText(i, entry);
+        out.printf("    - %s\n", entry);
       }
-      if (blacklist.ouiList.size() > 10) {
-        Serial.printf("    ... and %d more\n", blacklist.ouiList.size() - 10);
+      if (blacklist.ouiTable.size() > 10) {
+        out.printf("    ... and %d more\n", blacklist.ouiTable.size() - 10);
       }
     }
     
     // Show blacklist names if any
     if (!blacklist.nameList.empty()) {
-      Serial.println("\n  Blacklist name entries:");
+      out.println("\n  Blacklist name entries:");
       for (size_t i = 0; i < blacklist.nameList.size() && i < 5; i++) {
-        Serial.printf("    - %s\n", blacklist.nameList[i].c_str());
+        out.printf("    - %s\n", blacklist.nameList[i]);
       }
       if (blacklist.nameList.size() > 5) {
-        Serial.printf("    ... and %d more\n", blacklist.nameList.size() - 5);
+        out.printf("    ... and %d more\n", blacklist.nameList.size() - 5);
       }
     }
     
     if (!blacklist.payloadList.empty()) {
-      Serial.println("\n  Blacklist payload patterns:");
+      out.println("\n  Blacklist payload patterns:");
       for (size_t i = 0; i < blacklist.payloadList.size() && i < 5; i++) {
-        Serial.printf("    - %s\n", blacklist.payloadList[i].c_str());
+        out.printf("    - %s\n", blacklist.payloadList[i]);
       }
     }
     
-    Serial.println();
+    out.println();
   }
 
-  // Allow runtime modification
-  void addBlacklistOUI(const String& oui) {
-    blacklist.ouiList.push_back(oui);
-    blacklist.mode = FILTER_BLACKLIST;
+  // Allow runtime modification (each call publishes a new snapshot unless
+  // it is part of a beginEdit() group)
+  // OUI, full MAC or partial prefix; returns false if not valid hex
+  bool addBlacklistOUI(const String& oui) {
+    Edit edit(*this);
+    if (!edit->blacklist.ouiTable.add(oui.c_str())) return false;
+    edit->blacklist.mode = FILTER_BLACKLIST;
+    edit.commit();
+    return true;
   }
   
-  void addBlacklistName(const String& name) {
-    blacklist.nameList.push_back(name);
-    blacklist.mode = FILTER_BLACKLIST;
+  bool addBlacklistName(const String& name) {
+    Edit edit(*this);
+    if (!addName(edit->blacklist, name.c_str())) return false;
+    edit->blacklist.mode = FILTER_BLACKLIST;
+    edit.commit();
+    return true;
   }
   
-  void addBlacklistUUID(const String& uuid) {
-    blacklist.uuidList.push_back(uuid);
-    blacklist.mode = FILTER_BLACKLIST;
+  // 16-bit ("FD6F"), 32-bit or 128-bit UUID; returns false otherwise
+  bool addBlacklistUUID(const String& uuid) {
+    Edit edit(*this);
+    if (!addUUID(edit->blacklist, uuid.c_str())) return false;
+    edit->blacklist.mode = FILTER_BLACKLIST;
+    edit.commit();
+    return true;
   }
   
-  void addBlacklistPayload(const String& payload) {
-    blacklist.payloadList.push_back(payload);
-    blacklist.mode = FILTER_BLACKLIST;
+  // Hex byte pattern, e.g. "4C00"; returns false if not an even number of hex digits
+  bool addBlacklistPayload(const String& payload) {
+    Edit edit(*this);
+    if (!addPayload(edit->blacklist, payload.c_str())) return false;
+    edit->blacklist.mode = FILTER_BLACKLIST;
+    edit.commit();
+    return true;
   }
   
-  void addWhitelistOUI(const String& oui) {
-    whitelist.ouiList.push_back(oui);
-    whitelist.mode = FILTER_WHITELIST;
+  // OUI, full MAC or partial prefix; returns false if not valid hex
+  bool addWhitelistOUI(const String& oui) {
+    Edit edit(*this);
+    if (!edit->whitelist.ouiTable.add(oui.c_str())) return false;
+    edit->whitelist.mode = FILTER_WHITELIST;
+    edit.commit();
+    return true;
   }
   
-  void addWhitelistName(const String& name) {
-    whitelist.nameList.push_back(name);
-    whitelist.mode = FILTER_WHITELIST;
+  bool addWhitelistName(const String& name) {
+    Edit edit(*this);
+    if (!addName(edit->whitelist, name.c_str())) return false;
+    edit->whitelist.mode = FILTER_WHITELIST;
+    edit.commit();
+    return true;
   }
   
-  void addWhitelistUUID(const String& uuid) {
-    whitelist.uuidList.push_back(uuid);
-    whitelist.mode = FILTER_WHITELIST;
+  // 16-bit ("FD6F"), 32-bit or 128-bit UUID; returns false otherwise
+  bool addWhitelistUUID(const String& uuid) {
+    Edit edit(*this);
+    if (!addUUID(edit->whitelist, uuid.c_str())) return false;
+    edit->whitelist.mode = FILTER_WHITELIST;
+    edit.commit();
+    return true;
   }
   
-  void addWhitelistPayload(const String& payload) {
-    whitelist.payloadList.push_back(payload);
-    whitelist.mode = FILTER_WHITELIST;
+  // Hex byte pattern, e.g. "4C00"; returns false if not an even number of hex digits
+  bool addWhitelistPayload(const String& payload) {
+    Edit edit(*this);
+    if (!addPayload(edit->whitelist, payload.c_str())) return false;
+    edit->whitelist.mode = FILTER_WHITELIST;
+    edit.commit();
+    return true;
   }
   
-  void clearBlacklist() {
-    blacklist.ouiList.clear();
-    blacklist.nameList.clear();
-    blacklist.uuidList.clear();
-    blacklist.payloadList.clear();
-    blacklist.mode = FILTER_OFF;
-    Serial.println("[FILTER] Blacklist cleared");
+  void clearBlacklist(Print& out = Serial) {
+    Edit edit(*this);
+    edit->blacklist = FilterConfig();
+    edit.commit();
+    out.println("[FILTER] Blacklist cleared");
   }
   
-  void clearWhitelist() {
-    whitelist.ouiList.clear();
-    whitelist.nameList.clear();
-    whitelist.uuidList.clear();
-    whitelist.payloadList.clear();
-    whitelist.mode = FILTER_OFF;
-    Serial.println("[FILTER] Whitelist cleared");
+  void clearWhitelist(Print& out = Serial) {
+    Edit edit(*this);
+    edit->whitelist = FilterConfig();
+    edit.commit();
+    out.println("[FILTER] Whitelist cleared");
   }
   
-  void clearAllFilters() {
-    clearBlacklist();
-    clearWhitelist();
-    Serial.println("[FILTER] All filters cleared");
+  void clearAllFilters(Print& out = Serial) {
+    Edit edit(*this);   // both lists go in one snapshot
+    clearBlacklist(out);
+    clearWhitelist(out);
+    edit.commit();
+    out.println("[FILTER] All filters cleared");
   }
   
-  void disableFilters() {
-    blacklist.mode = FILTER_OFF;
-    whitelist.mode = FILTER_OFF;
-    Serial.println("[FILTER] All filters disabled");
+  void disableFilters(Print& out = Serial) {
+    Edit edit(*this);
+    edit->blacklist.mode = FILTER_OFF;
+    edit->whitelist.mode = FILTER_OFF;
+    edit.commit();
+    out.println("[FILTER] All filters disabled");
   }
   
-  void enableFilters() {
-    if (!blacklist.ouiList.empty()) {
-      blacklist.mode = FILTER_BLACKLIST;
-      Serial.println("[FILTER] Blacklist re-enabled");
+  void enableFilters(Print& out = Serial) {
+    Edit edit(*this);
+    if (!edit->blacklist.ouiTable.empty()) {
+      edit->blacklist.mode = FILTER_BLACKLIST;
+      out.println("[FILTER] Blacklist re-enabled");
     }
-    if (!whitelist.ouiList.empty()) {
-      whitelist.mode = FILTER_WHITELIST;
-      Serial.println("[FILTER] Whitelist re-enabled");
+    if (!edit->whitelist.ouiTable.empty()) {
+      edit->whitelist.mode = FILTER_WHITELIST;
+      out.println("[FILTER] Whitelist re-enabled");
     }
+    edit.commit();
   }
 };
 
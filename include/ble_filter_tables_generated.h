@@ -0,0 +1,107 @@
+/*
+ * Built-in Filter Tables
+ * GENERATED by scripts/gen_filter_tables.py from data/blacklist.txt and
+ * data/whitelist.txt - edit the data files, not this header.
+ *
+ * The OUI and MAC tables are sorted and constexpr, so they stay in flash
+ * and MacPrefixTable searches them in place.
+ */
+
+#ifndef BLE_FILTER_TABLES_GENERATED_H
+#define BLE_FILTER_TABLES_GENERATED_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct BuiltinFilterTable {
+  const uint32_t*    ouis;        // 24-bit OUIs, sorted
+  uint16_t           ouiCount;
+  const uint64_t*    macs;        // 48-bit addresses, sorted
+  uint16_t           macCount;
+  const char* const* prefixes;    // other prefix lengths, as hex text
+  uint16_t           prefixCount;
+  const char* const* names;
+  uint16_t           nameCount;
+  const char* const* uuids;
+  uint16_t           uuidCount;
+  const char* const* payloads;
+  uint16_t           payloadCount;
+};
+
+// data/blacklist.txt
+static constexpr uint32_t BUILTIN_BLACKLIST_OUIS[] = {
+  0x000000, 0x0016CB, 0x0017C9, 0x001907, 0x001A11, 0x001B63, 0x001D4F, 0x001E52,
+  0x001EC2, 0x001FF3, 0x00216A, 0x002191, 0x0021E9, 0x002312, 0x002332, 0x00234D,
+  0x00236C, 0x0023DF, 0x002436, 0x002500, 0x00254B, 0x00259C, 0x0025BC, 0x00264A,
+  0x0026B0, 0x0026B7, 0x0026BB, 0x003EE1, 0x006171, 0x008865, 0x00CDFE, 0x00F4B9,
+  0x00F76F, 0x040CCE, 0x041552, 0x04DB56, 0x04E536, 0x04F13E, 0x080007, 0x086698,
+  0x086D41, 0x0C3E9F, 0x0C74C2, 0x1040F3, 0x109ADD, 0x10DDB1, 0x14109F, 0x148FC6,
+  0x14BD61, 0x182032, 0x183451, 0x18AF8F, 0x18E7F4, 0x1C9148, 0x1CF29A, 0x2078F0,
+  0x20A2E4, 0x20C9D0, 0x24A074, 0x24AB81, 0x24F094, 0x280B5C, 0x283737, 0x285AEB,
+  0x286AB8, 0x28A02B, 0x28CFE9, 0x28E02C, 0x28E14C, 0x2C1F23, 0x2CB43A, 0x2CF0A2,
+  0x2CF0EE, 0x3010E4, 0x3090AB, 0x34159E, 0x3451C9, 0x34A395, 0x34C059, 0x34FCEF,
+  0x380F4A, 0x3C0754, 0x3C15C2, 0x3C5AB4, 0x3CE072, 0x403004, 0x40831D, 0x40A6D9,
+  0x40B4CD, 0x440010, 0x442A60, 0x44D884, 0x48437C, 0x48746E, 0x48A91C, 0x48BF6B,
+  0x48D705, 0x4C57CA, 0x4C8D79, 0x507AC5, 0x50EAD6, 0x542696, 0x546009, 0x54724F,
+  0x54E43A, 0x581FAA, 0x58404E, 0x5855CA, 0x58B035, 0x58CB52, 0x5C5948, 0x5C95AE,
+  0x5CF8A1, 0x5CF938, 0x600308, 0x60334B, 0x606944, 0x606BBD, 0x60F494, 0x60F81D,
+  0x60FACD, 0x64200C, 0x6476BA, 0x64E682, 0x685B35, 0x68967B, 0x68DBCA, 0x68FEF7,
+  0x6C4008, 0x6CADF8, 0x6CC26B, 0x701124, 0x70480F, 0x705681, 0x7073CB, 0x70CD60,
+  0x741BB2, 0x74E1B6, 0x74E2F5, 0x74E543, 0x789F70, 0x78A3E4, 0x78CA39, 0x78D6F0,
+  0x78D75F, 0x7C04D0, 0x7C11BE, 0x7C2F80, 0x7CBB8A, 0x7CC3A1, 0x7CD1C3, 0x804971,
+  0x80929F, 0x80BE05, 0x80E650, 0x80ED2C, 0x842999, 0x843835, 0x84788B, 0x8489AD,
+  0x84B153, 0x881FA1, 0x885395, 0x8863DF, 0x887556, 0x88C663, 0x8C006D, 0x8C2937,
+  0x8C5877, 0x8C7A15, 0x8C7C92, 0x8C8590, 0x8CFABA, 0x9027E4, 0x90840D, 0x908D6C,
+  0x90E7C4, 0x94E96A, 0x94F6A3, 0x9801A7, 0x9803D8, 0x985AEB, 0x98B8E3, 0x98CA33,
+  0x98D6BB, 0x98FE94, 0x9C04EB, 0x9C207B, 0x9C84BF, 0x9CE65E, 0xA002DC, 0xA0999B,
+  0xA0D795, 0xA45E60, 0xA4B197, 0xA4CF12, 0xA4D18C, 0xA85B78, 0xA88808, 0xA8BE27,
+  0xA8FAD8, 0xAC1F74, 0xAC293A, 0xAC3743, 0xAC3C0B, 0xAC6175, 0xAC87A3, 0xACBC32,
+  0xACCF5C, 0xB019C6, 0xB03495, 0xB065BD, 0xB4CEF6, 0xB4F0AB, 0xB8098A, 0xB841A4,
+  0xB8634D, 0xB8C75D, 0xB8E856, 0xB8F653, 0xBC3BAF, 0xBC4CC4, 0xBC52B7, 0xBC6C21,
+  0xBC9FEF, 0xBCC6DB, 0xC01ADA, 0xC0F2FB, 0xC42C03, 0xC4438F, 0xC4B301, 0xC82A14,
+  0xC869CD, 0xC88E12, 0xC8B5B7, 0xC8BCC8, 0xCC20E8, 0xCC25EF, 0xCC29F5, 0xCC3A61,
+  0xCC78AB, 0xD0034B, 0xD02598, 0xD0E140, 0xD0E782, 0xD4619D, 0xD4909C, 0xD49A20,
+  0xD4F513, 0xD8004D, 0xD81D72, 0xD83062, 0xD89695, 0xD8BB2C, 0xDC0C5C, 0xDC2B2A,
+  0xDC3CF6, 0xDC86D8, 0xDC9B9C, 0xDCA904, 0xE05F45, 0xE06678, 0xE0ACCB, 0xE0B6F5,
+  0xE0B9BA, 0xE0C767, 0xE48B7F, 0xE49A79, 0xE4C63D, 0xE4CE8F, 0xE8040B, 0xE80688,
+  0xE8802E, 0xE88D28, 0xEC3586, 0xF01898, 0xF02475, 0xF0989D, 0xF0B479, 0xF0C1F1,
+  0xF0D1A9, 0xF0DBE2, 0xF0DCE2, 0xF40F24, 0xF437B7, 0xF4F15A, 0xF4F5E8, 0xF4F951,
+  0xF81EDF, 0xF82793, 0xF88FCA, 0xFC253F, 0xFCC734, 0xFCE998,
+};
+
+static constexpr const char* BUILTIN_BLACKLIST_NAMES[] = {
+  "IPHONE", "IPAD", "MACBOOK", "AIRPODS", "APPLE", "WATCH", "PIXEL", "GOOGLE",
+  "NEST", "CHROMECAST", "ANDROID",
+};
+
+static constexpr const char* BUILTIN_BLACKLIST_UUIDS[] = {
+  "D0611E78",
+};
+
+static constexpr const char* BUILTIN_BLACKLIST_PAYLOADS[] = {
+  "4C00", "E000",
+};
+
+static constexpr BuiltinFilterTable BUILTIN_BLACKLIST = {
+  BUILTIN_BLACKLIST_OUIS, 294,
+  nullptr, 0,
+  nullptr, 0,
+  BUILTIN_BLACKLIST_NAMES, 11,
+  BUILTIN_BLACKLIST_UUIDS, 1,
+  BUILTIN_BLACKLIST_PAYLOADS, 2,
+};
+
+// data/whitelist.txt
+static constexpr BuiltinFilterTable BUILTIN_WHITELIST = {
+  nullptr, 0,
+  nullptr, 0,
+  nullptr, 0,
+  nullptr, 0,
+  nullptr, 0,
+  nullptr, 0,
+};
+
+// CRC-32 of the tables above
+#define BUILTIN_FILTER_TABLES_HASH 0x2B9B78E7u
+
+#endif // BLE_FILTER_TABLES_GENERATED_H
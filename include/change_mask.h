@@ -0,0 +1,300 @@
+/*
+ * Change Masks
+ * Field-aware fingerprints for deduplication: byte ranges of manufacturer
+ * or service data that rotate on every advertisement (Continuity status,
+ * Exposure Notification RPIs, Eddystone TLM counters) are left out, so a
+ * device is only reported as changed when something meaningful changed
+ */
+
+#ifndef CHANGE_MASK_H
+#define CHANGE_MASK_H
+
+#include <Arduino.h>
+#include <stdlib.h>
+#include "ad_parser.h"
+#include "ad_decoders.h"
+
+// Maximum number of change rules (built-in + user)
+#ifndef CHANGE_MASK_MAX_RULES
+#define CHANGE_MASK_MAX_RULES 16
+#endif
+
+#define CHANGE_RULE_COMPANY  0   // manufacturer data with this company ID
+#define CHANGE_RULE_SERVICE  1   // 16-bit service data with this UUID
+
+static_assert(CHANGE_RULE_COMPANY == AD_DECODE_COMPANY && CHANGE_RULE_SERVICE == AD_DECODE_SERVICE,
+              "change rules and decoders share the kind values");
+
+#define CHANGE_MATCH_ANY     0xFF
+#define CHANGE_RANGE_END     0xFF
+
+// Set of AD types, e.g. the ones ignored by change detection
+struct AdTypeMask {
+  uint32_t bits[8] = {};
+
+  void set(uint8_t type)       { bits[type >> 5] |= 1u << (type & 31); }
+  void reset(uint8_t type)     { bits[type >> 5] &= ~(1u << (type & 31)); }
+  bool has(uint8_t type) const { return bits[type >> 5] & (1u << (type & 31)); }
+
+  bool empty() const {
+    for (uint32_t b : bits) if (b) return false;
+    return true;
+  }
+};
+
+// Ignore bytes [start, end] of a field's data (offsets count from the first
+// byte after the AD type, so the company ID / UUID sits at 0-1). With
+// matchOffset set, the rule only applies when that byte equals matchValue
+// (e.g. an Eddystone frame type).
+struct ChangeRule {
+  uint8_t  kind;
+  uint16_t id;
+  uint8_t  matchOffset;
+  uint8_t  matchValue;
+  uint8_t  start;
+  uint8_t  end;
+};
+
+// When a change is worth reporting
+struct ChangePolicy {
+  uint8_t  rssiDelta = 10;   // dBm move since the last display (0 = ignore RSSI)
+  uint16_t holdMs = 0;       // minimum time between two CHANGED reports of a device
+};
+
+class ChangeMasks {
+private:
+  ChangeRule rules[CHANGE_MASK_MAX_RULES];
+  uint8_t count = 0;
+
+  bool applies(const ChangeRule& r, const AdField& f, const uint8_t* d) const {
+    if (f.len < 2) return false;
+    if (r.kind == CHANGE_RULE_COMPANY && f.type != AD_TYPE_MANUFACTURER_DATA) return false;
+    if (r.kind == CHANGE_RULE_SERVICE && f.type != AD_TYPE_SERVICE_DATA_16BIT) return false;
+    if (adRead16(d) != r.id) return false;
+    if (r.matchOffset != CHANGE_MATCH_ANY &&
+        (r.matchOffset >= f.len || d[r.matchOffset] != r.matchValue)) return false;
+    return true;
+  }
+
+public:
+  AdTypeMask ignoreTypes;   // whole AD structures left out of the fingerprint
+
+  ChangeMasks() { loadDefaults(); }
+
+  void loadDefaults() {
+    static const ChangeRule defaults[] = {
+      // Apple Continuity messages whose status, hashes and auth tags rotate
+      // (Proximity Pairing, Handoff, Nearby Action, Nearby Info, Find My);
+      // keep the message type/length. iBeacon (02) is left whole.
+      { CHANGE_RULE_COMPANY, 0x004C, 2, 0x07, 4, CHANGE_RANGE_END },
+      { CHANGE_RULE_COMPANY, 0x004C, 2, 0x0C, 4, CHANGE_RANGE_END },
+      { CHANGE_RULE_COMPANY, 0x004C, 2, 0x0F, 4, CHANGE_RANGE_END },
+      { CHANGE_RULE_COMPANY, 0x004C, 2, 0x10, 4, CHANGE_RANGE_END },
+      { CHANGE_RULE_COMPANY, 0x004C, 2, 0x12, 4, CHANGE_RANGE_END },
+      // Microsoft CDP beacon: salt and device hash rotate
+      { CHANGE_RULE_COMPANY, 0x0006, 2, 0x01, 6, CHANGE_RANGE_END },
+      // Exposure Notification: RPI and encrypted metadata rotate
+      { CHANGE_RULE_SERVICE, 0xFD6F, CHANGE_MATCH_ANY, 0, 2, CHANGE_RANGE_END },
+      // Eddystone TLM (battery, temperature, counters) and EID
+      { CHANGE_RULE_SERVICE, 0xFEAA, 2, 0x20, 3, CHANGE_RANGE_END },
+      { CHANGE_RULE_SERVICE, 0xFEAA, 2, 0x30, 4, CHANGE_RANGE_END },
+    };
+    count = 0;
+    for (const ChangeRule& r : defaults) add(r);
+  }
+
+  bool add(const ChangeRule& rule) {
+    if (count == CHANGE_MASK_MAX_RULES) return false;
+    rules[count++] = rule;
+    return true;
+  }
+
+  bool remove(uint8_t idx) {
+    if (idx >= count) return false;
+    for (uint8_t i = idx; i + 1 < count; i++) rules[i] = rules[i + 1];
+    count--;
+    return true;
+  }
+
+  void clear() { count = 0; }
+  uint8_t size() const { return count; }
+  const ChangeRule& rule(uint8_t idx) const { return rules[idx]; }
+
+  // Fingerprint of a parsed payload without ignored AD types and masked
+  // byte ranges. Bytes after the last parsed structure are always included.
+  uint32_t fingerprint(const AdView& view) const { return fingerprint(view, 0, view.len); }
+
+  // Same over the structures in payload bytes [begin, last), e.g. the
+  // advertisement or the scan response part of a paired report
+  uint32_t fingerprint(const AdView& view, uint8_t begin, uint8_t last) const {
+    if (count == 0 && ignoreTypes.empty()) return adHash32(view.data + begin, last - begin);
+
+    uint32_t h = AD_HASH_INIT;
+    size_t end = begin;
+    for (uint8_t i = 0; i < view.fieldCount; i++) {
+      const AdField& f = view.fields[i];
+      if (f.offset < begin + 2) continue;
+      if (f.offset >= last) break;
+      const uint8_t* d = view.data + f.offset;
+      end = f.offset + f.len;
+      if (ignoreTypes.has(f.type)) continue;
+
+      h = adHashUpdate(h, d - 2, 2);  // length and type bytes
+
+      const ChangeRule* matched[CHANGE_MASK_MAX_RULES];
+      uint8_t n = 0;
+      for (uint8_t r = 0; r < count; r++) {
+        if (applies(rules[r], f, d)) matched[n++] = &rules[r];
+      }
+      if (n == 0) {
+        h = adHashUpdate(h, d, f.len);
+        continue;
+      }
+
+      for (uint8_t b = 0; b < f.len; b++) {
+        bool masked = false;
+        for (uint8_t r = 0; r < n && !masked; r++) {
+          masked = b >= matched[r]->start && b <= matched[r]->end;
+        }
+        if (!masked) h = adHashUpdate(h, &d[b], 1);
+      }
+    }
+    if (end > last) end = last;
+    return adHashUpdate(h, view.data + end, last - end);
+  }
+
+  // Rule for a decoded field, e.g. "ibeacon.minor" (see ad_decoders.h)
+  static bool fromField(const char* name, ChangeRule& out) {
+    const AdDecoder* decoder;
+    const AdDecoderField* field;
+    if (!adFindField(name, decoder, field)) return false;
+    out.kind = decoder->kind;
+    out.id = decoder->id;
+    out.matchOffset = decoder->selectOffset == AD_DECODE_ANY ? CHANGE_MATCH_ANY : decoder->selectOffset;
+    out.matchValue = decoder->selectValue;
+    out.start = field->start;
+    out.end = field->len == AD_FIELD_TO_END ? CHANGE_RANGE_END : field->start + field->len - 1;
+    return true;
+  }
+
+  // Decoded field a rule covers exactly, or nullptr
+  static const char* fieldName(const ChangeRule& r, char* out, size_t size) {
+    for (uint8_t i = 0; i < AD_DECODER_COUNT; i++) {
+      ChangeRule f;
+      const AdDecoder& d = AD_DECODERS[i];
+      for (uint8_t j = 0; j < d.fieldCount; j++) {
+        char name[32];
+        snprintf(name, sizeof(name), "%s.%s", d.name, d.fields[j].name);
+        if (fromField(name, f) && f.kind == r.kind && f.id == r.id && f.start == r.start &&
+            f.end == r.end && f.matchOffset == r.matchOffset &&
+            (f.matchOffset == CHANGE_MATCH_ANY || f.matchValue == r.matchValue)) {
+          snprintf(out, size, "%s", name);
+          return out;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  // Parse "m 004C 4-", "u FEAA 3-9 @2=20": m = company ID, u = service
+  // UUID; range "N", "N-M" or "N-" (to the end of the field). A decoded
+  // field name ("gaen.rpi") stands for its byte range.
+  static bool parse(const char* text, ChangeRule& out) {
+    while (*text == ' ') text++;
+    if (strchr(text, '.') != nullptr) {
+      char name[32];
+      size_t n = strcspn(text, " ");
+      if (n >= sizeof(name) || text[n + strspn(text + n, " ")] != 0) return false;
+      memcpy(name, text, n);
+      name[n] = 0;
+      return fromField(name, out);
+    }
+    char kind = *text++;
+    if (kind == 'm' || kind == 'M') out.kind = CHANGE_RULE_COMPANY;
+    else if (kind == 'u' || kind == 'U') out.kind = CHANGE_RULE_SERVICE;
+    else return false;
+
+    char* end;
+    long id = strtol(text, &end, 16);
+    if (end == text || id < 0 || id > 0xFFFF) return false;
+    out.id = (uint16_t)id;
+    text = end;
+
+    long start = strtol(text, &end, 10);
+    if (end == text || start < 0 || start > 254) return false;
+    out.start = (uint8_t)start;
+    out.end = out.start;
+    text = end;
+    if (*text == '-') {
+      text++;
+      long last = strtol(text, &end, 10);
+      if (end == text) {
+        out.end = CHANGE_RANGE_END;
+      } else {
+        if (last < start || last > 254) return false;
+        out.end = (uint8_t)last;
+        text = end;
+      }
+    }
+
+    out.matchOffset = CHANGE_MATCH_ANY;
+    out.matchValue = 0;
+    while (*text == ' ') text++;
+    if (*text == '@') {
+      text++;
+      long off = strtol(text, &end, 10);
+      if (end == text || *end != '=' || off < 0 || off > 254) return false;
+      text = end + 1;
+      long value = strtol(text, &end, 16);
+      if (end == text || value < 0 || value > 0xFF) return false;
+      out.matchOffset = (uint8_t)off;
+      out.matchValue = (uint8_t)value;
+      text = end;
+    }
+    while (*text == ' ') text++;
+    return *text == 0;
+  }
+
+  // Same syntax as parse(); out must hold 32 bytes
+  static void format(const ChangeRule& r, char* out) {
+    int n = sprintf(out, "%c %04X %u", r.kind == CHANGE_RULE_COMPANY ? 'm' : 'u',
+                    r.id, r.start);
+    if (r.end == CHANGE_RANGE_END) n += sprintf(out + n, "-");
+    else if (r.end != r.start) n += sprintf(out + n, "-%u", r.end);
+    if (r.matchOffset != CHANGE_MATCH_ANY) {
+      sprintf(out + n, " @%u=%02X", r.matchOffset, r.matchValue);
+    }
+  }
+
+  void printStatus(const ChangePolicy& policy, Print& out = Serial) const {
+    out.println("\n[CHANGE-MASKS]");
+    if (policy.rssiDelta > 0) {
+      out.printf("  RSSI:     changes of more than %u dBm count\n", policy.rssiDelta);
+    } else {
+      out.println("  RSSI:     ignored");
+    }
+    out.printf("  Hold:     %u ms between CHANGED reports of one device\n", policy.holdMs);
+
+    out.print("  Ignored AD types:");
+    if (ignoreTypes.empty()) out.print(" (none)");
+    for (int t = 0; t < 256; t++) {
+      if (ignoreTypes.has(t)) out.printf(" 0x%02X", t);
+    }
+    out.println();
+
+    out.printf("  Rules (%u/%u, m = company ID, u = service UUID, byte offsets in the field):\n",
+                  count, CHANGE_MASK_MAX_RULES);
+    for (uint8_t i = 0; i < count; i++) {
+      char text[32];
+      char field[32];
+      format(rules[i], text);
+      if (fieldName(rules[i], field, sizeof(field))) {
+        out.printf("    %2u - %-20s (%s)\n", i + 1, text, field);
+      } else {
+        out.printf("    %2u - %s\n", i + 1, text);
+      }
+    }
+  }
+};
+
+#endif // CHANGE_MASK_H
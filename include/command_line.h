@@ -0,0 +1,63 @@
+/*
+ * Command Line
+ * Non-blocking line editor for the serial console. feed() takes one
+ * received character at a time (echo and backspace go to the given
+ * Print) and reports when Enter completes a line. Nothing here waits for
+ * input, so the command task can poll it without holding anything up.
+ */
+
+#ifndef COMMAND_LINE_H
+#define COMMAND_LINE_H
+
+#include <Arduino.h>
+
+#ifndef COMMAND_LINE_MAX
+#define COMMAND_LINE_MAX 128
+#endif
+
+class CommandLine {
+private:
+  char buf[COMMAND_LINE_MAX];
+  size_t len = 0;
+  bool afterCR = false;   // swallow the LF of a CRLF line ending
+  char* ready = buf;      // completed line (trimmed), valid until the next feed()
+
+public:
+  // Returns true when c completes a line; line() then holds it
+  bool feed(char c, Print& echo) {
+    bool lf = c == '\n';
+    if (lf && afterCR) {
+      afterCR = false;
+      return false;
+    }
+    afterCR = c == '\r';
+
+    if (lf || c == '\r') {
+      echo.println();
+      buf[len] = '\0';
+      len = 0;
+      for (ready = buf; *ready == ' '; ready++) {}
+      for (char* end = ready + strlen(ready); end > ready && end[-1] == ' '; ) *--end = '\0';
+      return true;
+    }
+
+    if (c == '\b' || c == 127) {
+      if (len > 0) {
+        len--;
+        echo.print("\b \b");
+      }
+      return false;
+    }
+
+    // Printable characters only; the rest of an over-long line is ignored
+    if (c >= 32 && c <= 126 && len < sizeof(buf) - 1) {
+      buf[len++] = c;
+      echo.write(c);
+    }
+    return false;
+  }
+
+  const char* line() const { return ready; }
+};
+
+#endif // COMMAND_LINE_H
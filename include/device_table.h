@@ -0,0 +1,201 @@
+/*
+ * Device Table
+ * Fixed-capacity hash table of tracked devices keyed on the binary
+ * address + address type, with least-recently-seen eviction
+ */
+
+#ifndef DEVICE_TABLE_H
+#define DEVICE_TABLE_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Maximum number of tracked devices (records are statically allocated)
+#ifndef DEVICE_TABLE_CAPACITY
+#define DEVICE_TABLE_CAPACITY 2048
+#endif
+
+#define DEVICE_NONE 0xFFFF
+
+struct DeviceKey {
+  uint8_t addr[6];   // little-endian, as delivered by the SoftDevice
+  uint8_t addrType;
+
+  bool operator==(const DeviceKey& other) const {
+    return addrType == other.addrType && memcmp(addr, other.addr, sizeof(addr)) == 0;
+  }
+};
+
+// Smallest power of two >= 2 * capacity, so the index stays at most half full
+static constexpr uint32_t deviceIndexSlots(uint32_t capacity, uint32_t slots = 1) {
+  return slots >= capacity * 2 ? slots : deviceIndexSlots(capacity, slots * 2);
+}
+
+template <typename T, uint16_t Capacity = DEVICE_TABLE_CAPACITY>
+class DeviceTable {
+  static_assert(Capacity > 0 && Capacity < DEVICE_NONE, "capacity must fit a uint16_t index");
+
+private:
+  static constexpr uint32_t SLOTS = deviceIndexSlots(Capacity);
+  static constexpr uint32_t MASK = SLOTS - 1;
+
+  struct Record {
+    DeviceKey key;
+    uint16_t newer;   // towards most recently seen
+    uint16_t older;   // towards least recently seen
+    T value;
+  };
+
+  Record records[Capacity];
+  uint16_t index[SLOTS];     // open addressing (linear probing) into records
+  uint16_t used = 0;         // records handed out so far (never shrinks until clear)
+  uint16_t freeList = DEVICE_NONE;  // removed records, chained through 'older'
+  uint16_t count = 0;
+  uint16_t newest = DEVICE_NONE;
+  uint16_t oldest = DEVICE_NONE;
+  uint32_t evicted = 0;
+
+  static uint32_t hashKey(const DeviceKey& key) {
+    uint32_t lo = (uint32_t)key.addr[0] | ((uint32_t)key.addr[1] << 8) |
+                  ((uint32_t)key.addr[2] << 16) | ((uint32_t)key.addr[3] << 24);
+    uint32_t hi = (uint32_t)key.addr[4] | ((uint32_t)key.addr[5] << 8) |
+                  ((uint32_t)key.addrType << 16);
+    uint32_t h = lo ^ (hi * 0x9E3779B1u);
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+  }
+
+  void unlink(uint16_t idx) {
+    Record& r = records[idx];
+    if (r.newer != DEVICE_NONE) records[r.newer].older = r.older; else newest = r.older;
+    if (r.older != DEVICE_NONE) records[r.older].newer = r.newer; else oldest = r.newer;
+  }
+
+  void linkNewest(uint16_t idx) {
+    Record& r = records[idx];
+    r.newer = DEVICE_NONE;
+    r.older = newest;
+    if (newest != DEVICE_NONE) records[newest].newer = idx;
+    newest = idx;
+    if (oldest == DEVICE_NONE) oldest = idx;
+  }
+
+  // Drop a record from the index, keeping probe chains intact (backward shift)
+  void removeFromIndex(uint16_t idx) {
+    uint32_t hole = hashKey(records[idx].key) & MASK;
+    while (index[hole] != idx) hole = (hole + 1) & MASK;
+
+    uint32_t j = hole;
+    while (true) {
+      j = (j + 1) & MASK;
+      if (index[j] == DEVICE_NONE) break;
+      uint32_t home = hashKey(records[index[j]].key) & MASK;
+      // Move the entry back if its home slot is not inside (hole, j]
+      bool movable = (hole <= j) ? (home <= hole || home > j)
+                                 : (home <= hole && home > j);
+      if (movable) {
+        index[hole] = index[j];
+        hole = j;
+      }
+    }
+    index[hole] = DEVICE_NONE;
+  }
+
+public:
+  DeviceTable() { clear(); }
+
+  // Record index for key, or DEVICE_NONE
+  uint16_t find(const DeviceKey& key) const {
+    uint32_t slot = hashKey(key) & MASK;
+    while (index[slot] != DEVICE_NONE) {
+      if (records[index[slot]].key == key) return index[slot];
+      slot = (slot + 1) & MASK;
+    }
+    return DEVICE_NONE;
+  }
+
+  // Add a new device (caller checked find() first). When the table is full
+  // the least recently seen device is evicted and its record reused.
+  uint16_t insert(const DeviceKey& key) {
+    uint16_t idx;
+    if (freeList != DEVICE_NONE) {
+      idx = freeList;
+      freeList = records[idx].older;
+    } else if (used < Capacity) {
+      idx = used++;
+    } else {
+      idx = oldest;
+      removeFromIndex(idx);
+      unlink(idx);
+      count--;
+      evicted++;
+    }
+
+    Record& r = records[idx];
+    r.key = key;
+    r.value = T();
+    linkNewest(idx);
+
+    uint32_t slot = hashKey(key) & MASK;
+    while (index[slot] != DEVICE_NONE) slot = (slot + 1) & MASK;
+    index[slot] = idx;
+    count++;
+    return idx;
+  }
+
+  // Forget a device (e.g. aged out); its record goes on the free list
+  void remove(uint16_t idx) {
+    removeFromIndex(idx);
+    unlink(idx);
+    records[idx].value = T();
+    records[idx].older = freeList;
+    freeList = idx;
+    count--;
+  }
+
+  // Mark a device as the most recently seen one
+  void touch(uint16_t idx) {
+    if (idx == newest) return;
+    unlink(idx);
+    linkNewest(idx);
+  }
+
+  void clear() {
+    memset(index, 0xFF, sizeof(index));
+    used = 0;
+    freeList = DEVICE_NONE;
+    count = 0;
+    newest = DEVICE_NONE;
+    oldest = DEVICE_NONE;
+  }
+
+  T& operator[](uint16_t idx) { return records[idx].value; }
+  const T& operator[](uint16_t idx) const { return records[idx].value; }
+  const DeviceKey& keyAt(uint16_t idx) const { return records[idx].key; }
+
+  // Walk from most to least recently seen: for (i = first(); i != DEVICE_NONE; i = next(i))
+  uint16_t first() const { return newest; }
+  uint16_t next(uint16_t idx) const { return records[idx].older; }
+
+  // Least recently seen device (next eviction / aging candidate)
+  uint16_t last() const { return oldest; }
+
+  // idx-th most recently seen device (0-based), or DEVICE_NONE
+  uint16_t nth(uint16_t n) const {
+    uint16_t idx = newest;
+    while (idx != DEVICE_NONE && n-- > 0) idx = records[idx].older;
+    return idx;
+  }
+
+  uint16_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  uint16_t capacity() const { return Capacity; }
+  uint32_t evictions() const { return evicted; }
+  void resetEvictions() { evicted = 0; }
+};
+
+#endif // DEVICE_TABLE_H
@@ -0,0 +1,173 @@
+/*
+ * Filter Arena
+ * Fixed static block that the compiled filter tables allocate from instead
+ * of the heap, so filter edits at runtime cannot fragment it. First fit
+ * with coalescing of neighbouring free blocks; allocations only happen
+ * while a filter edit is open (one task at a time, see
+ * ble_filter_config_builtin.h), so there is no lock. When the arena is
+ * full, allocations fall back to the heap and are counted as overflows.
+ */
+
+#ifndef FILTER_ARENA_H
+#define FILTER_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Both filter snapshots (live and standby) share the arena, so it needs
+// room for two copies of every table plus the growth of the one edited
+#ifndef FILTER_ARENA_SIZE
+#define FILTER_ARENA_SIZE 16384
+#endif
+
+static_assert(FILTER_ARENA_SIZE % 8 == 0, "FILTER_ARENA_SIZE must be a multiple of 8");
+
+class FilterArena {
+private:
+  struct Block {
+    uint32_t size;   // bytes including this header, multiple of 8
+    uint32_t used;
+  };
+
+  alignas(8) uint8_t pool[FILTER_ARENA_SIZE];
+  uint32_t inUse;      // bytes in allocated blocks, headers included
+  uint32_t peak;
+  uint32_t overflows;  // allocations that went to the heap
+  bool ready;
+
+  Block* at(uint32_t offset) { return (Block*)(pool + offset); }
+
+  void init() {
+    Block* b = at(0);
+    b->size = FILTER_ARENA_SIZE;
+    b->used = 0;
+    ready = true;
+  }
+
+  // Merge the free blocks that follow b into it
+  void coalesce(Block* b) {
+    uint32_t end = (uint32_t)((uint8_t*)b - pool) + b->size;
+    while (end < FILTER_ARENA_SIZE && !at(end)->used) {
+      b->size += at(end)->size;
+      end += at(end)->size;
+    }
+  }
+
+public:
+  // No constructor: a zeroed static instance is usable before any other
+  // static constructor runs (the filters allocate from theirs)
+
+  void* allocate(size_t bytes) {
+    if (!ready) init();
+    uint32_t need = (uint32_t)((bytes + sizeof(Block) + 7) & ~(size_t)7);
+    for (uint32_t offset = 0; offset < FILTER_ARENA_SIZE; offset += at(offset)->size) {
+      Block* b = at(offset);
+      if (b->used) continue;
+      coalesce(b);
+      if (b->size < need) continue;
+      if (b->size - need >= 2 * sizeof(Block)) {
+        Block* rest = at(offset + need);
+        rest->size = b->size - need;
+        rest->used = 0;
+        b->size = need;
+      }
+      b->used = 1;
+      inUse += b->size;
+      if (inUse > peak) peak = inUse;
+      return b + 1;
+    }
+    overflows++;
+    return malloc(bytes);
+  }
+
+  void release(void* p) {
+    if (p == nullptr) return;
+    if ((uint8_t*)p < pool || (uint8_t*)p >= pool + FILTER_ARENA_SIZE) {
+      free(p);   // an overflow allocation
+      return;
+    }
+    Block* b = (Block*)p - 1;
+    b->used = 0;
+    inUse -= b->size;
+    coalesce(b);
+  }
+
+  // Largest single allocation that would still fit (the fragmentation check)
+  uint32_t largestFree() {
+    if (!ready) init();
+    uint32_t largest = 0;
+    for (uint32_t offset = 0; offset < FILTER_ARENA_SIZE; offset += at(offset)->size) {
+      Block* b = at(offset);
+      if (b->used) continue;
+      coalesce(b);
+      if (b->size > largest) largest = b->size;
+    }
+    return largest > sizeof(Block) ? largest - sizeof(Block) : 0;
+  }
+
+  uint32_t size() const { return FILTER_ARENA_SIZE; }
+  uint32_t used() const { return inUse; }
+  uint32_t peakUsed() const { return peak; }
+  uint32_t overflowCount() const { return overflows; }
+};
+
+static inline FilterArena& filterArena() {
+  static FilterArena arena;
+  return arena;
+}
+
+// Standard allocator over the filter arena, for the table containers
+template <typename T>
+struct ArenaAllocator {
+  typedef T value_type;
+
+  ArenaAllocator() {}
+  template <typename U> ArenaAllocator(const ArenaAllocator<U>&) {}
+
+  T* allocate(size_t n) { return (T*)filterArena().allocate(n * sizeof(T)); }
+  void deallocate(T* p, size_t) { filterArena().release(p); }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>&, const ArenaAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>&, const ArenaAllocator<U>&) { return false; }
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// List of short strings packed back to back (NUL-terminated) in one
+// arena buffer, with an offset per entry
+class ArenaTextList {
+private:
+  ArenaVector<char> text;
+  ArenaVector<uint16_t> starts;
+
+public:
+  void push_back(const char* s, size_t len) {
+    starts.push_back((uint16_t)text.size());
+    text.insert(text.end(), s, s + len);
+    text.push_back('\0');
+  }
+
+  void push_back(const char* s) { push_back(s, strlen(s)); }
+
+  void reserve(size_t entries, size_t chars) {
+    starts.reserve(entries);
+    text.reserve(chars + entries);
+  }
+
+  void clear() {
+    text.clear();
+    starts.clear();
+  }
+
+  const char* operator[](size_t i) const { return text.data() + starts[i]; }
+  size_t size() const { return starts.size(); }
+  bool empty() const { return starts.empty(); }
+};
+
+#endif // FILTER_ARENA_H
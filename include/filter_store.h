@@ -0,0 +1,188 @@
+/*
+ * Filter Store
+ * Keeps the compiled filters in internal flash (LittleFS) as one binary
+ * image: sorted OUI/MAC tables, UUID sets and the Aho-Corasick automata
+ * exactly as they sit in RAM, plus the entry text for display. Boot reads
+ * the image straight back into the lookup structures - no text parsing,
+ * sorting or automaton construction, however long the lists are. The
+ * generated built-in OUI tables stay in program flash and are only
+ * referenced by a flag.
+ *
+ * File layout: FilterStoreHeader, then BLEFilter::save() output. The
+ * CRC-16 covers everything after the header. The header also records
+ * BUILTIN_FILTER_TABLES_HASH; an image saved with other built-in lists
+ * is not loaded, and boot rebuilds the filters from the current ones.
+ */
+
+#ifndef FILTER_STORE_H
+#define FILTER_STORE_H
+
+#include <Arduino.h>
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+#include "ble_filter_config_builtin.h"
+#include "binary_record.h"
+
+using namespace Adafruit_LittleFS_Namespace;
+
+#define FILTER_STORE_PATH     "/filters.bin"
+#define FILTER_STORE_TEMP     "/filters.tmp"
+#define FILTER_STORE_MAGIC    0x53464C42   // "BLFS"
+#define FILTER_STORE_VERSION  3            // bump when any saved layout changes
+
+struct FilterStoreHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t crc;
+  uint32_t length;   // bytes after the header
+  uint32_t tables;   // BUILTIN_FILTER_TABLES_HASH of the firmware that saved it
+};
+
+class FilterStore {
+private:
+  // Sizes and checksums an image without writing it
+  struct Measure {
+    uint32_t length = 0;
+    uint16_t crc = BIN_CRC16_INIT;
+    void put(const void* data, size_t len) {
+      crc = binCrc16Update(crc, (const uint8_t*)data, len);
+      length += len;
+    }
+  };
+
+  struct Writer {
+    File& file;
+    bool ok = true;
+    explicit Writer(File& f) : file(f) {}
+    void put(const void* data, size_t len) {
+      if (ok && len > 0) ok = file.write((const uint8_t*)data, len) == len;
+    }
+  };
+
+  struct Reader {
+    File& file;
+    uint32_t left;
+    Reader(File& f, uint32_t length) : file(f), left(length) {}
+    bool get(void* data, size_t len) {
+      if (len > left) return false;
+      if (len > 0 && file.read(data, len) != (int)len) return false;
+      left -= len;
+      return true;
+    }
+    size_t remaining() const { return left; }
+  };
+
+  bool mounted = false;
+  uint32_t savedBytes = 0;
+  uint32_t saveCount = 0;
+
+  // Check the length and the CRC of the body (header already read);
+  // leaves the file positioned at the start of the body
+  static bool verify(File& file, const FilterStoreHeader& header) {
+    if (header.length != file.size() - sizeof(header)) return false;
+
+    uint8_t chunk[64];
+    uint16_t crc = BIN_CRC16_INIT;
+    for (uint32_t left = header.length; left > 0; ) {
+      uint16_t n = left < sizeof(chunk) ? left : sizeof(chunk);
+      if (file.read(chunk, n) != n) return false;
+      crc = binCrc16Update(crc, chunk, n);
+      left -= n;
+    }
+    return crc == header.crc && file.seek(sizeof(header));
+  }
+
+public:
+  bool begin() {
+    mounted = InternalFS.begin();
+    return mounted;
+  }
+
+  bool available() const { return mounted; }
+
+  // Replace the filters with the stored image. Returns false (filters
+  // unchanged) if there is none, it does not verify, or it was saved with
+  // other built-in lists.
+  bool load(BLEFilter& filter, Print& out = Serial) {
+    if (!mounted || !InternalFS.exists(FILTER_STORE_PATH)) return false;
+
+    uint32_t started = millis();
+    File file(InternalFS);
+    if (!file.open(FILTER_STORE_PATH, FILE_O_READ)) return false;
+
+    FilterStoreHeader header;
+    const char* rejected = nullptr;
+    if (file.read(&header, sizeof(header)) != (int)sizeof(header) ||
+        header.magic != FILTER_STORE_MAGIC) {
+      rejected = "[ERROR] Stored filters are not a filter image - using built-ins";
+    } else if (header.version != FILTER_STORE_VERSION) {
+      rejected = "[FILTER] Stored filters use another file layout - rebuilding from built-ins";
+    } else if (header.tables != BUILTIN_FILTER_TABLES_HASH) {
+      rejected = "[FILTER] Built-in lists changed since the filters were saved - rebuilding";
+    }
+    if (rejected != nullptr) {
+      file.close();
+      out.println(rejected);
+      return false;
+    }
+
+    bool ok = verify(file, header);
+    if (ok) {
+      Reader in(file, header.length);
+      ok = filter.load(in);
+    }
+    file.close();
+
+    if (!ok) {
+      out.println("[ERROR] Stored filters are damaged - using built-ins");
+      return false;
+    }
+    savedBytes = sizeof(header) + header.length;
+    out.printf("[FILTER] Loaded stored filters (%lu bytes in %lu ms)\n",
+               (unsigned long)savedBytes, (unsigned long)(millis() - started));
+    return true;
+  }
+
+  // Write the current filters. The image goes to a temporary file that is
+  // renamed over the old one, so a reset mid-write keeps the previous set.
+  bool save(const BLEFilter& filter, Print& out = Serial) {
+    if (!mounted) return false;
+
+    Measure measure;
+    filter.save(measure);
+    FilterStoreHeader header = { FILTER_STORE_MAGIC, FILTER_STORE_VERSION,
+                                 measure.crc, measure.length, BUILTIN_FILTER_TABLES_HASH };
+
+    InternalFS.remove(FILTER_STORE_TEMP);
+    File file(InternalFS);
+    if (!file.open(FILTER_STORE_TEMP, FILE_O_WRITE)) {
+      out.println("[ERROR] Cannot create filter store file");
+      return false;
+    }
+    Writer writer(file);
+    writer.put(&header, sizeof(header));
+    filter.save(writer);
+    file.close();
+
+    if (!writer.ok || !InternalFS.rename(FILTER_STORE_TEMP, FILTER_STORE_PATH)) {
+      InternalFS.remove(FILTER_STORE_TEMP);
+      out.println("[ERROR] Saving filters failed (internal flash full?)");
+      return false;
+    }
+    savedBytes = sizeof(header) + measure.length;
+    saveCount++;
+    return true;
+  }
+
+  // Forget the stored filters; the next boot starts from the built-ins
+  bool erase() {
+    savedBytes = 0;
+    return mounted && (!InternalFS.exists(FILTER_STORE_PATH) ||
+                       InternalFS.remove(FILTER_STORE_PATH));
+  }
+
+  uint32_t imageBytes() const { return savedBytes; }
+  uint32_t saves() const { return saveCount; }
+};
+
+#endif // FILTER_STORE_H
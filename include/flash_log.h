@@ -0,0 +1,337 @@
+/*
+ * Flash Log
+ * Log-structured ring of binary report frames (docs/binary_protocol.md)
+ * in external flash, for surveys without a host attached. The report
+ * consumer appends frames to a RAM staging ring without blocking; the
+ * recorder task moves them into flash one whole 256-byte page at a time.
+ * Sectors are filled strictly in turn and the oldest is recycled when the
+ * flash is full, so every sector is erased once per pass (even wear) and
+ * no page is programmed twice.
+ *
+ * Sector layout: FlashLogHeader, then frames. Frames run on across page
+ * and sector boundaries; a partial page written on flush is padded with
+ * 0x00 (empty frames, which decoders skip). After a reset the newest
+ * sector is found by sequence number and writing resumes at its first
+ * blank page, behind an extra 0x00 so the frame cut off by the reset
+ * cannot swallow the next one.
+ *
+ * Flash is a driver with size(), read(), program() (one page) and
+ * eraseSector() - see qspi_flash.h.
+ */
+
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#define FLASH_LOG_PAGE    256
+#define FLASH_LOG_SECTOR  4096
+#define FLASH_LOG_MAGIC   0x474F4C42   // "BLOG"
+#define FLASH_LOG_START   0x01         // header flag: the log starts in this sector
+
+// RAM staging between the consumer and the recorder task (must be a power
+// of two). Rides out a sector erase at several hundred frames per second.
+#ifndef FLASH_LOG_STAGE_SIZE
+#define FLASH_LOG_STAGE_SIZE 8192
+#endif
+
+// A partly filled page is written after this long, bounding what a power
+// cut loses without padding out a page for every few frames
+#ifndef FLASH_LOG_IDLE_FLUSH_MS
+#define FLASH_LOG_IDLE_FLUSH_MS 30000
+#endif
+
+static_assert((FLASH_LOG_STAGE_SIZE & (FLASH_LOG_STAGE_SIZE - 1)) == 0,
+              "FLASH_LOG_STAGE_SIZE must be a power of two");
+
+struct FlashLogHeader {
+  uint32_t magic;
+  uint32_t seq;       // increases by one per sector written
+  uint32_t flags;     // FLASH_LOG_START
+  uint32_t reserved;
+};
+
+template <typename Flash>
+class FlashLog {
+private:
+  Flash& flash;
+
+  // Staging ring: appended by the report consumer, drained by the recorder
+  uint8_t stage[FLASH_LOG_STAGE_SIZE];
+  std::atomic<uint32_t> stageHead{0};
+  std::atomic<uint32_t> stageTail{0};
+
+  // Page being filled (recorder side, under the lock)
+  alignas(4) uint8_t page[FLASH_LOG_PAGE];
+  uint16_t pageFill = 0;
+  uint32_t pageStarted = 0;   // millis() of the first byte in the page
+
+  uint32_t sectorCount = 0;
+  bool haveHead = false;
+  uint32_t headIdx = 0;       // sector being written
+  uint32_t headSeq = 0;
+  uint32_t tailIdx = 0;       // oldest sector still in the log
+  uint32_t sectorsUsed = 0;   // tail .. head inclusive
+  uint32_t writeAddr = 0;     // next page to program
+  bool cut = false;           // resume behind a delimiter
+
+  TaskHandle_t recorderTask = NULL;
+  SemaphoreHandle_t lock = NULL;  // flash access: recorder vs. command task
+
+  // Statistics (this boot)
+  std::atomic<uint32_t> framesIn{0};
+  std::atomic<uint32_t> framesDropped{0};
+  uint32_t pagesWritten = 0;
+  uint32_t sectorsErased = 0;
+  uint32_t flashErrors = 0;
+
+  uint32_t sectorBase(uint32_t idx) const { return idx * FLASH_LOG_SECTOR; }
+
+  bool readHeader(uint32_t idx, FlashLogHeader& h) {
+    return flash.read(sectorBase(idx), &h, sizeof(h)) && h.magic == FLASH_LOG_MAGIC;
+  }
+
+  // Erase the next sector and put its header at the start of the page.
+  // start: a new log begins here (everything older is dropped).
+  void openSector(bool start) {
+    uint32_t idx = haveHead ? (headIdx + 1) % sectorCount : 0;
+    if (start) {
+      tailIdx = idx;
+      sectorsUsed = 0;
+    } else if (sectorsUsed == sectorCount) {
+      tailIdx = (tailIdx + 1) % sectorCount;   // full: recycle the oldest
+      sectorsUsed--;
+    } else if (sectorsUsed == 0) {
+      tailIdx = idx;
+    }
+
+    if (flash.eraseSector(sectorBase(idx))) sectorsErased++;
+    else flashErrors++;
+
+    headIdx = idx;
+    headSeq++;
+    haveHead = true;
+    sectorsUsed++;
+    writeAddr = sectorBase(idx);
+
+    FlashLogHeader h = { FLASH_LOG_MAGIC, headSeq, start ? (uint32_t)FLASH_LOG_START : 0, 0 };
+    memcpy(page, &h, sizeof(h));
+    pageFill = sizeof(h);
+  }
+
+  void startPage(uint32_t now) {
+    if (!haveHead || writeAddr >= sectorBase(headIdx) + FLASH_LOG_SECTOR) openSector(false);
+    if (cut) {
+      page[pageFill++] = 0x00;
+      cut = false;
+    }
+    pageStarted = now;
+  }
+
+  void programPage() {
+    memset(page + pageFill, 0x00, FLASH_LOG_PAGE - pageFill);
+    if (flash.program(writeAddr, page, FLASH_LOG_PAGE)) pagesWritten++;
+    else flashErrors++;
+    writeAddr += FLASH_LOG_PAGE;
+    pageFill = 0;
+  }
+
+  // Staged frames into pages; full pages go to flash
+  void drain(uint32_t now) {
+    uint32_t t = stageTail.load(std::memory_order_relaxed);
+    uint32_t h = stageHead.load(std::memory_order_acquire);
+    while (t != h) {
+      if (pageFill == 0) startPage(now);
+      uint32_t start = t & (FLASH_LOG_STAGE_SIZE - 1);
+      uint32_t n = FLASH_LOG_PAGE - pageFill;
+      if (n > h - t) n = h - t;
+      if (n > FLASH_LOG_STAGE_SIZE - start) n = FLASH_LOG_STAGE_SIZE - start;
+      memcpy(page + pageFill, &stage[start], n);
+      pageFill += n;
+      t += n;
+      stageTail.store(t, std::memory_order_release);
+      if (pageFill == FLASH_LOG_PAGE) programPage();
+    }
+  }
+
+  // Find the newest sector, the start of the log and the write position
+  void recover() {
+    FlashLogHeader h;
+    for (uint32_t i = 0; i < sectorCount; i++) {
+      if (readHeader(i, h) && (!haveHead || (int32_t)(h.seq - headSeq) > 0)) {
+        haveHead = true;
+        headIdx = i;
+        headSeq = h.seq;
+      }
+    }
+    if (!haveHead) return;
+
+    // Walk back over consecutive sequence numbers to the start of the log
+    readHeader(headIdx, h);
+    tailIdx = headIdx;
+    sectorsUsed = 1;
+    while (!(h.flags & FLASH_LOG_START) && sectorsUsed < sectorCount) {
+      uint32_t prev = (tailIdx + sectorCount - 1) % sectorCount;
+      uint32_t seq = h.seq;
+      if (!readHeader(prev, h) || h.seq != seq - 1) break;
+      tailIdx = prev;
+      sectorsUsed++;
+    }
+
+    // Resume at the first blank page of the newest sector
+    writeAddr = sectorBase(headIdx) + FLASH_LOG_SECTOR;
+    for (uint32_t p = 0; p < FLASH_LOG_SECTOR / FLASH_LOG_PAGE; p++) {
+      uint32_t addr = sectorBase(headIdx) + p * FLASH_LOG_PAGE;
+      if (!flash.read(addr, page, FLASH_LOG_PAGE)) break;
+      bool blank = true;
+      for (uint32_t i = 0; i < FLASH_LOG_PAGE && blank; i++) blank = page[i] == 0xFF;
+      if (blank) {
+        writeAddr = addr;
+        break;
+      }
+    }
+    cut = true;
+  }
+
+public:
+  explicit FlashLog(Flash& f) : flash(f) {}
+
+  // Find the end of the existing log. Returns false if there is no flash.
+  bool begin(TaskHandle_t recorder) {
+    if (lock == NULL) lock = xSemaphoreCreateMutex();
+    recorderTask = recorder;
+    if (!flash.begin() || flash.size() / FLASH_LOG_SECTOR < 2) return false;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    sectorCount = flash.size() / FLASH_LOG_SECTOR;
+    recover();
+    xSemaphoreGive(lock);
+    return true;
+  }
+
+  // Report consumer: queue one frame, or drop it whole if staging is full
+  bool append(const uint8_t* frame, size_t len) {
+    uint32_t h = stageHead.load(std::memory_order_relaxed);
+    uint32_t used = h - stageTail.load(std::memory_order_acquire);
+    if (len > FLASH_LOG_STAGE_SIZE - used) {
+      framesDropped++;
+      return false;
+    }
+    uint32_t start = h & (FLASH_LOG_STAGE_SIZE - 1);
+    size_t first = FLASH_LOG_STAGE_SIZE - start;
+    if (first > len) first = len;
+    memcpy(&stage[start], frame, first);
+    memcpy(&stage[0], frame + first, len - first);
+    stageHead.store(h + len, std::memory_order_release);
+    framesIn++;
+
+    // Wake the recorder once a page worth is waiting
+    if (recorderTask != NULL && used < FLASH_LOG_PAGE && used + len >= FLASH_LOG_PAGE) {
+      xTaskNotifyGive(recorderTask);
+    }
+    return true;
+  }
+
+  // Recorder task: write full pages, and a partial one once it is old
+  void service(uint32_t now) {
+    if (sectorCount == 0) return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    drain(now);
+    if (pageFill > 0 && now - pageStarted >= FLASH_LOG_IDLE_FLUSH_MS) programPage();
+    xSemaphoreGive(lock);
+  }
+
+  // Write everything staged, padding the last page
+  void flush() {
+    if (sectorCount == 0) return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    drain(millis());
+    if (pageFill > 0) programPage();
+    xSemaphoreGive(lock);
+  }
+
+  // Start an empty log in the next sector. Older sectors are left as they
+  // are and overwritten as recording goes on (no bulk erase).
+  void erase() {
+    if (sectorCount == 0) return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    drain(millis());
+    if (pageFill > 0) programPage();
+    openSector(true);
+    programPage();   // header on flash now, so the cut survives a reset
+    xSemaphoreGive(lock);
+  }
+
+  // Stream the log, oldest first, as one run of frames (sector headers
+  // left out). sink(const uint8_t*, size_t) returns false to stop.
+  // Recording may go on meanwhile; what arrives after the start is not
+  // included. Returns the bytes passed to sink.
+  template <typename Sink>
+  uint32_t dump(Sink sink) {
+    if (sectorCount == 0) return 0;
+    flush();
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t first = tailIdx, count = sectorsUsed, lastSeq = headSeq, end = writeAddr;
+    xSemaphoreGive(lock);
+
+    alignas(4) uint8_t buf[FLASH_LOG_PAGE];
+    uint32_t sent = 0;
+    for (uint32_t s = 0; s < count; s++) {
+      uint32_t idx = (first + s) % sectorCount;
+      uint32_t base = sectorBase(idx);
+      uint32_t stop = s == count - 1 ? end : base + FLASH_LOG_SECTOR;
+      for (uint32_t addr = base; addr < stop; addr += FLASH_LOG_PAGE) {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        bool ok = flash.read(addr, buf, FLASH_LOG_PAGE);
+        xSemaphoreGive(lock);
+        size_t skip = 0;
+        if (addr == base) {
+          // Recycled since the dump started - the rest is newer data
+          FlashLogHeader h;
+          memcpy(&h, buf, sizeof(h));
+          if (h.magic != FLASH_LOG_MAGIC || h.seq != lastSeq - (count - 1 - s)) return sent;
+          skip = sizeof(h);
+        }
+        if (!ok || !sink(buf + skip, FLASH_LOG_PAGE - skip)) return sent;
+        sent += FLASH_LOG_PAGE - skip;
+      }
+    }
+    return sent;
+  }
+
+  bool available() const { return sectorCount > 0; }
+  uint32_t capacity() const { return sectorCount * FLASH_LOG_SECTOR; }
+
+  // Flash taken by the log, including headers and padding
+  uint32_t used() const {
+    if (sectorsUsed == 0) return 0;
+    return (sectorsUsed - 1) * FLASH_LOG_SECTOR + (writeAddr - sectorBase(headIdx)) + pageFill;
+  }
+
+  uint32_t frames() const { return framesIn.load(); }
+  uint32_t dropped() const { return framesDropped.load(); }
+
+  void printStatus(Print& out) const {
+    out.println("\n[RECORDER-STATUS]");
+    if (sectorCount == 0) {
+      out.println("  No external flash found");
+      return;
+    }
+    uint32_t usedKb = used() / 1024, totalKb = capacity() / 1024;
+    out.printf("  Log:      %lu of %lu KB (%lu%%) in %lu sectors%s\n",
+               (unsigned long)usedKb, (unsigned long)totalKb,
+               (unsigned long)(totalKb ? usedKb * 100 / totalKb : 0), (unsigned long)sectorsUsed,
+               sectorsUsed == sectorCount ? ", oldest data being overwritten" : "");
+    out.printf("  Wear:     %lu sectors written since the log was first used (%lu passes)\n",
+               (unsigned long)headSeq, (unsigned long)(headSeq / sectorCount));
+    out.printf("  This boot: %lu frames staged, %lu dropped (staging full), %lu pages, "
+               "%lu sectors erased, %lu flash errors\n",
+               (unsigned long)framesIn.load(), (unsigned long)framesDropped.load(),
+               (unsigned long)pagesWritten, (unsigned long)sectorsErased,
+               (unsigned long)flashErrors);
+  }
+};
+
+#endif // FLASH_LOG_H
@@ -0,0 +1,102 @@
+/*
+ * Heap Monitor
+ * Heap watermark and fragmentation readout from newlib's mallinfo() and
+ * the heap region of the linker script, plus allocation counters when the
+ * build wraps malloc/free (-Wl,--wrap=... and HEAP_MONITOR_WRAP=1, see
+ * platformio.ini; the wrappers are in the sketch). Scanning allocates
+ * nothing once setup() is done: reports and devices live in fixed tables,
+ * filters in the filter arena. A counter that keeps moving, or free holes
+ * that keep growing over a long run, point at what broke that.
+ */
+
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <Arduino.h>
+#include <malloc.h>
+#include <atomic>
+#include "filter_arena.h"
+
+#ifndef HEAP_MONITOR_WRAP
+#define HEAP_MONITOR_WRAP 0
+#endif
+
+// Updated by the wrappers from any task
+struct HeapCounters {
+  std::atomic<uint32_t> allocs;     // malloc, calloc and realloc that returned a block
+  std::atomic<uint32_t> frees;      // free of a block, realloc(p, 0)
+  std::atomic<uint32_t> failures;   // returned NULL
+};
+
+static inline HeapCounters& heapCounters() {
+  static HeapCounters counters;   // zeroed before any constructor can allocate
+  return counters;
+}
+
+struct HeapUsage {
+  uint32_t region;      // heap between the static data and the main stack
+  uint32_t claimed;     // taken from the region so far - the high-water mark
+  uint32_t inUse;       // in allocated blocks
+  uint32_t holes;       // freed blocks below the mark (fragmentation)
+  uint32_t allocs;
+  uint32_t frees;
+  uint32_t failures;
+};
+
+class HeapMonitor {
+private:
+  uint32_t steadyAllocs = 0;   // counters when setup() was done
+  uint32_t steadyFrees = 0;
+  uint32_t steadyClaimed = 0;
+
+public:
+  static HeapUsage read() {
+    struct mallinfo mi = mallinfo();
+    HeapCounters& c = heapCounters();
+    HeapUsage u;
+    u.region = (uint32_t)dbgHeapTotal();
+    u.claimed = (uint32_t)mi.arena;
+    u.inUse = (uint32_t)mi.uordblks;
+    u.holes = (uint32_t)mi.fordblks;
+    u.allocs = c.allocs.load();
+    u.frees = c.frees.load();
+    u.failures = c.failures.load();
+    return u;
+  }
+
+  // Everything after this is steady state
+  void markSteadyState() {
+    HeapUsage u = read();
+    steadyAllocs = u.allocs;
+    steadyFrees = u.frees;
+    steadyClaimed = u.claimed;
+  }
+
+  void printStatus(Print& out) {
+    HeapUsage u = read();
+    FilterArena& arena = filterArena();
+    out.println("\n[HEAP-STATUS]");
+    out.printf("  Heap region:      %lu bytes\n", (unsigned long)u.region);
+    out.printf("  High-water mark:  %lu bytes (%lu at the end of setup, %lu never used)\n",
+               (unsigned long)u.claimed, (unsigned long)steadyClaimed,
+               (unsigned long)(u.region - u.claimed));
+    out.printf("  In use:           %lu bytes\n", (unsigned long)u.inUse);
+    out.printf("  Free holes:       %lu bytes below the mark (%lu%% fragmented)\n",
+               (unsigned long)u.holes,
+               (unsigned long)(u.claimed > 0 ? (uint64_t)u.holes * 100 / u.claimed : 0));
+#if HEAP_MONITOR_WRAP
+    out.printf("  Allocations:      %lu since boot, %lu since setup (%lu freed, %lu failed)\n",
+               (unsigned long)u.allocs, (unsigned long)(u.allocs - steadyAllocs),
+               (unsigned long)(u.frees - steadyFrees), (unsigned long)u.failures);
+    out.println("  (commands allocate briefly; scanning alone should add none)");
+#else
+    out.println("  Allocations:      not counted (build without HEAP_MONITOR_WRAP)");
+#endif
+    out.printf("  Filter arena:     %lu of %lu bytes (peak %lu, largest free %lu, %lu overflows to heap)\n",
+               (unsigned long)arena.used(), (unsigned long)arena.size(),
+               (unsigned long)arena.peakUsed(), (unsigned long)arena.largestFree(),
+               (unsigned long)arena.overflowCount());
+  }
+};
+
+#endif // HEAP_MONITOR_H
@@ -0,0 +1,34 @@
+/*
+ * Image I/O
+ * Helpers for writing lookup structures as a flat binary image and reading
+ * them straight back into place. Out needs put(const void*, size_t);
+ * In needs bool get(void*, size_t) and size_t remaining().
+ *
+ * Images use the device's own layout (little-endian, native struct
+ * padding) and are only meant to be read back by the same firmware.
+ */
+
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+template <typename Out, typename V, typename A>
+static inline void imagePutVector(Out& out, const std::vector<V, A>& v) {
+  uint16_t n = (uint16_t)v.size();
+  out.put(&n, sizeof(n));
+  out.put(v.data(), n * sizeof(V));
+}
+
+// Fails without allocating if the count does not fit the rest of the image
+template <typename In, typename V, typename A>
+static inline bool imageGetVector(In& in, std::vector<V, A>& v) {
+  uint16_t n;
+  if (!in.get(&n, sizeof(n)) || n * sizeof(V) > in.remaining()) return false;
+  v.resize(n);
+  return in.get(v.data(), n * sizeof(V));
+}
+
+#endif // IMAGE_IO_H
@@ -0,0 +1,189 @@
+/*
+ * IRK Resolver
+ * Resolves Resolvable Private Addresses against a small set of Identity
+ * Resolving Keys: an RPA belongs to a key when hash == ah(IRK, prand)
+ * (Core spec Vol 6 Part B 1.3.2.3, Vol 3 Part H 2.2.2). Results, misses
+ * included, are cached per address, so each RPA costs one AES block per
+ * key once per rotation instead of on every report.
+ *
+ * Cipher provides static bool encrypt(const uint8_t* key,
+ * const uint8_t* in, uint8_t* out) for one AES-128 block, most
+ * significant byte first (as the nRF ECB peripheral takes it).
+ * Not thread-safe; the caller serializes lookups and edits.
+ */
+
+#ifndef IRK_RESOLVER_H
+#define IRK_RESOLVER_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef IRK_MAX
+#define IRK_MAX 16
+#endif
+#ifndef IRK_CACHE_SLOTS
+#define IRK_CACHE_SLOTS 256   // direct-mapped, 8 bytes each
+#endif
+#define IRK_LABEL_MAX 16      // including the terminating NUL
+#define IRK_NONE      0xFF
+
+static_assert(IRK_MAX < IRK_NONE, "key index must fit a uint8_t");
+static_assert((IRK_CACHE_SLOTS & (IRK_CACHE_SLOTS - 1)) == 0,
+              "IRK_CACHE_SLOTS must be a power of two");
+
+// One known device. Resolved reports are filtered and tracked under the
+// identity address instead of the RPA they arrived with.
+struct IrkEntry {
+  uint8_t irk[16];            // most significant byte first
+  uint8_t identity[6];        // little-endian, like report addresses
+  uint8_t identityType;       // BLE_GAP_ADDR_TYPE_PUBLIC or _RANDOM_STATIC
+  char label[IRK_LABEL_MAX];
+};
+
+template <typename Cipher>
+class IrkResolver {
+private:
+  struct CacheSlot {
+    uint8_t addr[6];
+    uint8_t entry;        // index into entries, or IRK_NONE
+    uint8_t generation;   // stale unless equal to the resolver's
+  };
+
+  IrkEntry entries[IRK_MAX];
+  uint8_t count = 0;
+  CacheSlot cache[IRK_CACHE_SLOTS] = {};
+  uint8_t generation = 1;   // zeroed slots never match
+
+  uint32_t lookups = 0;
+  uint32_t hits = 0;
+  uint32_t resolvedCount = 0;
+  uint32_t blocks = 0;
+
+  static uint32_t slotOf(const uint8_t* addr) {
+    uint32_t h = 2166136261u;   // FNV-1a
+    for (int i = 0; i < 6; i++) h = (h ^ addr[i]) * 16777619u;
+    return h & (IRK_CACHE_SLOTS - 1);
+  }
+
+  // ah(k, r): the low 24 bits of e(k, 0^104 || prand) must equal the hash.
+  // The address is little-endian, so prand is addr[5..3], hash addr[2..0].
+  bool matches(const uint8_t* irk, const uint8_t* addr) {
+    uint8_t block[16] = {};
+    uint8_t out[16];
+    block[13] = addr[5];
+    block[14] = addr[4];
+    block[15] = addr[3];
+    blocks++;
+    if (!Cipher::encrypt(irk, block, out)) return false;
+    return out[15] == addr[0] && out[14] == addr[1] && out[13] == addr[2];
+  }
+
+  // A key or the list changed: every cached answer may be wrong now
+  void invalidate() {
+    if (++generation == 0) {
+      memset(cache, 0, sizeof(cache));
+      generation = 1;
+    }
+  }
+
+public:
+  // The identity of an RPA (little-endian address), or nullptr
+  const IrkEntry* resolve(const uint8_t* addr) {
+    if (count == 0 || (addr[5] & 0xC0) != 0x40) return nullptr;   // not an RPA
+    lookups++;
+
+    CacheSlot& slot = cache[slotOf(addr)];
+    if (slot.generation == generation && memcmp(slot.addr, addr, 6) == 0) {
+      hits++;
+      return slot.entry == IRK_NONE ? nullptr : &entries[slot.entry];
+    }
+
+    uint8_t found = IRK_NONE;
+    for (uint8_t i = 0; i < count && found == IRK_NONE; i++) {
+      if (matches(entries[i].irk, addr)) found = i;
+    }
+    memcpy(slot.addr, addr, 6);
+    slot.entry = found;
+    slot.generation = generation;
+    if (found == IRK_NONE) return nullptr;
+    resolvedCount++;
+    return &entries[found];
+  }
+
+  // Adds a key, or replaces the entry that already has it. Returns false
+  // when the list is full.
+  bool add(const IrkEntry& entry) {
+    uint8_t i = 0;
+    while (i < count && memcmp(entries[i].irk, entry.irk, 16) != 0) i++;
+    if (i == IRK_MAX) return false;
+    entries[i] = entry;
+    entries[i].label[IRK_LABEL_MAX - 1] = '\0';
+    if (i == count) count++;
+    invalidate();
+    return true;
+  }
+
+  bool remove(uint8_t i) {
+    if (i >= count) return false;
+    memmove(&entries[i], &entries[i + 1], (count - i - 1) * sizeof(IrkEntry));
+    count--;
+    invalidate();
+    return true;
+  }
+
+  void clear() {
+    count = 0;
+    invalidate();
+  }
+
+  // The key from the spec's ah() sample data (Vol 3 Part H D.7) must turn
+  // prand 0x708194 into hash 0x0DFBAA
+  static bool selfTest() {
+    static const uint8_t irk[16] = { 0xEC, 0x02, 0x34, 0xA3, 0x57, 0xC8, 0xAD, 0x05,
+                                     0x34, 0x10, 0x10, 0xA6, 0x0A, 0x39, 0x7D, 0x9B };
+    uint8_t block[16] = {};
+    uint8_t out[16];
+    block[13] = 0x70;
+    block[14] = 0x81;
+    block[15] = 0x94;
+    return Cipher::encrypt(irk, block, out) &&
+           out[13] == 0x0D && out[14] == 0xFB && out[15] == 0xAA;
+  }
+
+  // 32 hex digits, most significant first; ':', '-' and spaces are skipped
+  static bool parseKey(const char* text, uint8_t* irk) {
+    size_t n = 0;
+    for (const char* p = text; *p; p++) {
+      char c = *p;
+      uint8_t d;
+      if (c >= '0' && c <= '9')      d = c - '0';
+      else if (c >= 'A' && c <= 'F') d = c - 'A' + 10;
+      else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+      else if (c == ':' || c == '-' || c == ' ') continue;
+      else return false;
+      if (n == 32) return false;
+      irk[n / 2] = (n & 1) ? (uint8_t)(irk[n / 2] | d) : (uint8_t)(d << 4);
+      n++;
+    }
+    return n == 32;
+  }
+
+  // Stand-in identity when none is known: a static random address taken
+  // from the key, stable across rotations and resets
+  static void defaultIdentity(IrkEntry& entry) {
+    for (int i = 0; i < 6; i++) entry.identity[i] = entry.irk[15 - i];
+    entry.identity[5] |= 0xC0;
+    entry.identityType = 1;   // BLE_GAP_ADDR_TYPE_RANDOM_STATIC
+  }
+
+  uint8_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  const IrkEntry& operator[](uint8_t i) const { return entries[i]; }
+
+  uint32_t lookupCount() const { return lookups; }
+  uint32_t cacheHits() const { return hits; }
+  uint32_t resolved() const { return resolvedCount; }
+  uint32_t aesBlocks() const { return blocks; }
+};
+
+#endif // IRK_RESOLVER_H
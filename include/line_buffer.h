@@ -0,0 +1,95 @@
+/*
+ * Line Buffer
+ * Bounded text builder for one-line-per-device output (CSV / JSON lines),
+ * so a whole record goes out with a single write
+ */
+
+#ifndef LINE_BUFFER_H
+#define LINE_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+class LineBuffer {
+private:
+  char* buf;
+  size_t cap;       // one byte is always kept for the final newline
+  size_t used = 0;
+  bool overflow = false;
+
+public:
+  LineBuffer(char* buffer, size_t size) : buf(buffer), cap(size - 1) {}
+
+  void put(char c) {
+    if (used < cap) buf[used++] = c;
+    else overflow = true;
+  }
+
+  void puts(const char* s) {
+    while (*s) put(*s++);
+  }
+
+  void putf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + used, cap - used + 1, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n > cap - used) {
+      used = cap;
+      overflow = true;
+    } else {
+      used += n;
+    }
+  }
+
+  void putHex(const uint8_t* data, size_t len) {
+    static const char digits[] = "0123456789ABCDEF";
+    for (size_t i = 0; i < len; i++) {
+      put(digits[data[i] >> 4]);
+      put(digits[data[i] & 0x0F]);
+    }
+  }
+
+  // Quoted CSV field; embedded quotes doubled, non-printables as '?'
+  void putCsvString(const uint8_t* s, size_t len) {
+    put('"');
+    for (size_t i = 0; i < len; i++) {
+      char c = (char)s[i];
+      if (c == '"') put('"');
+      put((c >= 32 && c <= 126) ? c : '?');
+    }
+    put('"');
+  }
+
+  // Quoted JSON string with escapes
+  void putJsonString(const uint8_t* s, size_t len) {
+    put('"');
+    for (size_t i = 0; i < len; i++) {
+      uint8_t c = s[i];
+      if (c == '"' || c == '\\') {
+        put('\\');
+        put((char)c);
+      } else if (c >= 32 && c <= 126) {
+        put((char)c);
+      } else {
+        putf("\\u%04x", c);
+      }
+    }
+    put('"');
+  }
+
+  // Terminate with '\n' (always fits) and return the line length
+  size_t endLine() {
+    buf[used++] = '\n';
+    return used;
+  }
+
+  const char* data() const { return buf; }
+  size_t size() const { return used; }
+  bool truncated() const { return overflow; }
+};
+
+#endif // LINE_BUFFER_H
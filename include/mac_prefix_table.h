@@ -0,0 +1,201 @@
+/*
+ * MAC Prefix Table
+ * OUI / MAC filter patterns normalized once into packed binary form.
+ * Lookups take the raw little-endian address bytes from the SoftDevice
+ * and never allocate. Sorted tables generated at build time can be
+ * attached as-is and are searched in place (flash), next to the RAM
+ * tables holding runtime additions (in the filter arena).
+ */
+
+#ifndef MAC_PREFIX_TABLE_H
+#define MAC_PREFIX_TABLE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include "filter_arena.h"
+#include "image_io.h"
+
+class MacPrefixTable {
+private:
+  // A pattern is up to 12 hex digits, left-aligned in a 48-bit value
+  struct Prefix {
+    uint64_t value;
+    uint8_t  nibbles;   // 1-12
+  };
+
+  ArenaVector<uint32_t> ouis;      // 6-digit patterns, sorted
+  ArenaVector<uint64_t> macs;      // 12-digit patterns, sorted
+  ArenaVector<Prefix>   partials;  // any other length, checked linearly
+
+  // Attached built-in tables (sorted, not owned)
+  const uint32_t* romOuis = nullptr;
+  size_t romOuiCount = 0;
+  const uint64_t* romMacs = nullptr;
+  size_t romMacCount = 0;
+
+  template <typename V>
+  static bool insertSorted(ArenaVector<V>& list, V value) {
+    auto it = std::lower_bound(list.begin(), list.end(), value);
+    if (it != list.end() && *it == value) return false;  // duplicate
+    list.insert(it, value);
+    return true;
+  }
+
+  template <typename V>
+  static bool containsSorted(const ArenaVector<V>& list, V value) {
+    auto it = std::lower_bound(list.begin(), list.end(), value);
+    return it != list.end() && *it == value;
+  }
+
+  template <typename V>
+  static bool containsSorted(const V* list, size_t count, V value) {
+    return count > 0 && std::binary_search(list, list + count, value);
+  }
+
+  static void formatNibbles(uint64_t value, uint8_t nibbles, char* out) {
+    static const char digits[] = "0123456789ABCDEF";
+    char* p = out;
+    for (uint8_t i = 0; i < nibbles; i++) {
+      if (i > 0 && (i & 1) == 0) *p++ = ':';
+      *p++ = digits[(value >> (44 - 4 * i)) & 0xF];
+    }
+    *p = '\0';
+  }
+
+public:
+  // Address bytes (little-endian) as a 48-bit big-endian value
+  static uint64_t packAddress(const uint8_t* addr) {
+    return ((uint64_t)addr[5] << 40) | ((uint64_t)addr[4] << 32) |
+           ((uint64_t)addr[3] << 24) | ((uint64_t)addr[2] << 16) |
+           ((uint64_t)addr[1] << 8)  |  (uint64_t)addr[0];
+  }
+
+  // Parse "A4:CF:12", "a4-cf-12-34-56-78", "A4CF12" ... into a left-aligned
+  // value. Returns the number of hex digits, or 0 if the text is invalid.
+  static uint8_t parse(const char* text, uint64_t* value) {
+    uint64_t v = 0;
+    uint8_t nibbles = 0;
+    for (const char* p = text; *p; p++) {
+      char c = *p;
+      uint8_t d;
+      if (c >= '0' && c <= '9')      d = c - '0';
+      else if (c >= 'A' && c <= 'F') d = c - 'A' + 10;
+      else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+      else if (c == ':' || c == '-' || c == '.' || c == ' ') continue;
+      else return 0;
+      if (nibbles == 12) return 0;
+      v = (v << 4) | d;
+      nibbles++;
+    }
+    if (nibbles == 0) return 0;
+    *value = v << (4 * (12 - nibbles));
+    return nibbles;
+  }
+
+  // Returns false if the pattern is not a valid MAC/OUI prefix
+  bool add(const char* text) {
+    uint64_t value;
+    uint8_t nibbles = parse(text, &value);
+    if (nibbles == 0) return false;
+
+    if (nibbles == 12) {
+      if (!containsSorted(romMacs, romMacCount, value)) insertSorted(macs, value);
+    } else if (nibbles == 6) {
+      uint32_t oui = (uint32_t)(value >> 24);
+      if (!containsSorted(romOuis, romOuiCount, oui)) insertSorted(ouis, oui);
+    } else {
+      for (const auto& p : partials) {
+        if (p.value == value && p.nibbles == nibbles) return true;
+      }
+      partials.push_back({value, nibbles});
+    }
+    return true;
+  }
+
+  // Use sorted built-in tables in place; they must outlive the table
+  void attachBuiltin(const uint32_t* builtinOuis, size_t ouiCount,
+                     const uint64_t* builtinMacs, size_t macCount) {
+    romOuis = builtinOuis;
+    romOuiCount = builtinOuis ? ouiCount : 0;
+    romMacs = builtinMacs;
+    romMacCount = builtinMacs ? macCount : 0;
+  }
+
+  bool matches(const uint8_t* addr) const {
+    uint64_t mac = packAddress(addr);
+    uint32_t oui = (uint32_t)(mac >> 24);
+    if (!ouis.empty() && containsSorted(ouis, oui)) return true;
+    if (containsSorted(romOuis, romOuiCount, oui)) return true;
+    if (!macs.empty() && containsSorted(macs, mac)) return true;
+    if (containsSorted(romMacs, romMacCount, mac)) return true;
+    for (const auto& p : partials) {
+      uint8_t shift = 4 * (12 - p.nibbles);
+      if ((mac >> shift) == (p.value >> shift)) return true;
+    }
+    return false;
+  }
+
+  // Drops runtime entries and detaches the built-in tables
+  void clear() {
+    ouis.clear();
+    macs.clear();
+    partials.clear();
+    attachBuiltin(nullptr, 0, nullptr, 0);
+  }
+
+  // Binary image of the sorted RAM tables (see image_io.h); load() fills
+  // them in place without re-parsing or re-sorting. Attached built-in
+  // tables are not part of the image.
+  template <typename Out>
+  void save(Out& out) const {
+    imagePutVector(out, ouis);
+    imagePutVector(out, macs);
+    imagePutVector(out, partials);
+  }
+
+  template <typename In>
+  bool load(In& in) {
+    return imageGetVector(in, ouis) && imageGetVector(in, macs) &&
+           imageGetVector(in, partials);
+  }
+
+  bool empty() const { return size() == 0; }
+  size_t size() const {
+    return ouis.size() + romOuiCount + macs.size() + romMacCount + partials.size();
+  }
+  size_t fullMacCount() const { return macs.size() + romMacCount; }
+  // Full MAC i (runtime entries first), packed like packAddress()
+  uint64_t fullMac(size_t i) const {
+    return i < macs.size() ? macs[i] : romMacs[i - macs.size()];
+  }
+  size_t builtinCount() const { return romOuiCount + romMacCount; }
+
+  // Text form of entry i (full MACs, then OUIs, then partial prefixes;
+  // runtime entries before built-in ones); out needs room for 18 characters
+  void entryText(size_t i, char* out) const {
+    if (i < macs.size()) {
+      formatNibbles(macs[i], 12, out);
+      return;
+    }
+    i -= macs.size();
+    if (i < romMacCount) {
+      formatNibbles(romMacs[i], 12, out);
+      return;
+    }
+    i -= romMacCount;
+    if (i < ouis.size()) {
+      formatNibbles((uint64_t)ouis[i] << 24, 6, out);
+      return;
+    }
+    i -= ouis.size();
+    if (i < romOuiCount) {
+      formatNibbles((uint64_t)romOuis[i] << 24, 6, out);
+      return;
+    }
+    i -= romOuiCount;
+    formatNibbles(partials[i].value, partials[i].nibbles, out);
+  }
+};
+
+#endif // MAC_PREFIX_TABLE_H
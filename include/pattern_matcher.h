@@ -0,0 +1,195 @@
+/*
+ * Pattern Matcher
+ * Aho-Corasick automaton over raw bytes. All patterns are searched in a
+ * single pass, so per-advert cost does not grow with the pattern count.
+ * The trie lives in the filter arena.
+ */
+
+#ifndef PATTERN_MATCHER_H
+#define PATTERN_MATCHER_H
+
+#include <stdint.h>
+#include <string.h>
+#include "filter_arena.h"
+#include "image_io.h"
+
+class PatternMatcher {
+private:
+  static const uint16_t NONE = 0xFFFF;
+
+  struct Node {
+    uint16_t child;     // first child
+    uint16_t sibling;   // next child of the same parent
+    uint16_t fail;      // longest proper suffix that is also a trie node
+    uint8_t  byte;      // edge label from the parent
+    uint8_t  output;    // a pattern ends here (directly or via fail links)
+  };
+
+  ArenaVector<Node> nodes;     // node 0 is the root
+  uint16_t rootNext[256];      // root transitions, NONE if absent
+  bool foldCase;
+  size_t patternCount = 0;
+
+  uint8_t fold(uint8_t c) const {
+    return (foldCase && c >= 'a' && c <= 'z') ? (uint8_t)(c - 'a' + 'A') : c;
+  }
+
+  uint16_t findChild(uint16_t node, uint8_t c) const {
+    if (node == 0) return rootNext[c];
+    for (uint16_t n = nodes[node].child; n != NONE; n = nodes[n].sibling) {
+      if (nodes[n].byte == c) return n;
+    }
+    return NONE;
+  }
+
+  uint16_t addChild(uint16_t node, uint8_t c) {
+    Node n = { NONE, nodes[node].child, 0, c, 0 };
+    nodes.push_back(n);
+    uint16_t idx = (uint16_t)(nodes.size() - 1);
+    nodes[node].child = idx;
+    if (node == 0) rootNext[c] = idx;
+    return idx;
+  }
+
+  // Recompute failure links breadth-first. Only the links change when a
+  // pattern is added; the trie itself grows in place.
+  void linkFailures() {
+    ArenaVector<uint16_t> queue;
+    queue.reserve(nodes.size());
+
+    for (uint16_t n = nodes[0].child; n != NONE; n = nodes[n].sibling) {
+      nodes[n].fail = 0;
+      queue.push_back(n);
+    }
+
+    for (size_t head = 0; head < queue.size(); head++) {
+      uint16_t parent = queue[head];
+      for (uint16_t n = nodes[parent].child; n != NONE; n = nodes[n].sibling) {
+        uint16_t f = nodes[parent].fail;
+        uint16_t target;
+        while ((target = findChild(f, nodes[n].byte)) == NONE && f != 0) {
+          f = nodes[f].fail;
+        }
+        nodes[n].fail = (target == NONE || target == n) ? 0 : target;
+        nodes[n].output |= nodes[nodes[n].fail].output;
+        queue.push_back(n);
+      }
+    }
+  }
+
+public:
+  explicit PatternMatcher(bool caseInsensitive = false) : foldCase(caseInsensitive) {
+    clear();
+  }
+
+  // Add one pattern; returns false if empty or the automaton is full
+  bool add(const uint8_t* pattern, size_t len) {
+    if (len == 0 || nodes.size() + len >= NONE) return false;
+
+    uint16_t node = 0;
+    for (size_t i = 0; i < len; i++) {
+      uint8_t c = fold(pattern[i]);
+      uint16_t next = findChild(node, c);
+      node = (next != NONE) ? next : addChild(node, c);
+    }
+    nodes[node].output = 1;
+    patternCount++;
+    linkFailures();
+    return true;
+  }
+
+  bool add(const char* text) {
+    return add((const uint8_t*)text, strlen(text));
+  }
+
+  // True if any pattern occurs anywhere in data
+  bool matches(const uint8_t* data, size_t len) const {
+    if (patternCount == 0) return false;
+
+    uint16_t state = 0;
+    for (size_t i = 0; i < len; i++) {
+      uint8_t c = fold(data[i]);
+      uint16_t next;
+      while ((next = findChild(state, c)) == NONE && state != 0) {
+        state = nodes[state].fail;
+      }
+      state = (next == NONE) ? 0 : next;
+      if (nodes[state].output) return true;
+    }
+    return false;
+  }
+
+  void clear() {
+    nodes.clear();
+    Node root = { NONE, NONE, 0, 0, 0 };
+    nodes.push_back(root);
+    memset(rootNext, 0xFF, sizeof(rootNext));
+    patternCount = 0;
+  }
+
+  // Binary image of the compiled automaton (trie and failure links).
+  // load() restores it as-is, so nothing is rebuilt at boot.
+  template <typename Out>
+  void save(Out& out) const {
+    uint16_t patterns = (uint16_t)patternCount;
+    out.put(&patterns, sizeof(patterns));
+    imagePutVector(out, nodes);
+  }
+
+  template <typename In>
+  bool load(In& in) {
+    uint16_t patterns;
+    if (!in.get(&patterns, sizeof(patterns)) || !imageGetVector(in, nodes)) return false;
+
+    // Reject links that point outside the trie before anything follows them
+    size_t n = nodes.size();
+    bool valid = n > 0;
+    for (size_t i = 0; i < n && valid; i++) {
+      const Node& node = nodes[i];
+      valid = (node.child == NONE || node.child < n) &&
+              (node.sibling == NONE || node.sibling < n) && node.fail < n;
+    }
+    if (!valid) {
+      clear();
+      return false;
+    }
+
+    memset(rootNext, 0xFF, sizeof(rootNext));
+    for (uint16_t c = nodes[0].child; c != NONE; c = nodes[c].sibling) {
+      rootNext[nodes[c].byte] = c;
+    }
+    patternCount = patterns;
+    return true;
+  }
+
+  bool empty() const { return patternCount == 0; }
+  size_t size() const { return patternCount; }
+  size_t nodeCount() const { return nodes.size(); }
+};
+
+// Parse a hex string ("4C00", "4c 00 02 15") into bytes. Returns the byte
+// count, or 0 if the text is not an even number of hex digits.
+static inline size_t parseHexPattern(const char* text, uint8_t* out, size_t maxLen) {
+  size_t count = 0;
+  int high = -1;
+  for (const char* p = text; *p; p++) {
+    char c = *p;
+    int d;
+    if (c >= '0' && c <= '9')      d = c - '0';
+    else if (c >= 'A' && c <= 'F') d = c - 'A' + 10;
+    else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+    else if (c == ' ' || c == ':' || c == '-') continue;
+    else return 0;
+
+    if (high < 0) {
+      high = d;
+    } else {
+      if (count == maxLen) return 0;
+      out[count++] = (uint8_t)((high << 4) | d);
+      high = -1;
+    }
+  }
+  return (high < 0) ? count : 0;
+}
+
+#endif // PATTERN_MATCHER_H
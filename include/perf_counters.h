@@ -0,0 +1,221 @@
+/*
+ * Performance Counters
+ * Optional per-stage cycle accounting on the Cortex-M4 DWT cycle counter
+ * (CYCCNT, one tick per CPU clock - 64 per microsecond on the nRF52840).
+ * Built only with -DBLE_PERF=1, which the nrf52840_debug environment sets;
+ * otherwise the PERF_* macros expand to nothing and nothing here takes
+ * RAM or cycles.
+ *
+ * Each stage has a single writer (the scan callback or the report
+ * consumer). Other tasks print and reset the counters without locking,
+ * so a listing taken while scanning can be a report or two out of step.
+ */
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <Arduino.h>
+
+#ifndef BLE_PERF
+#define BLE_PERF 0
+#endif
+
+// Measured stages; nested ones (mac-format ... hex) are also part of "report"
+enum PerfStage {
+  PERF_CALLBACK,     // scan callback entry until the scanner is resumed
+  PERF_REPORT,       // consumer: one report end to end
+  PERF_FORMAT_MAC,   // address to text
+  PERF_PARSE,        // AD structure parse
+  PERF_FILTER,       // shouldShow()
+  PERF_DEDUP,        // device table lookup, signal update, change detection
+  PERF_RENDER,       // output formatting and queueing (all output modes)
+  PERF_HEX,          // hex conversion inside rendering
+  PERF_STAGE_COUNT
+};
+
+static const char* const PERF_STAGE_NAMES[PERF_STAGE_COUNT] = {
+  "callback", "report", "mac-format", "parse", "filter", "dedup", "render", "hex"
+};
+
+#if BLE_PERF
+
+// Log-linear histogram buckets: values below 8 exactly, then 4 buckets per
+// power of two, so a percentile is reported within 25%
+#define PERF_BUCKETS 124
+#define PERF_DEPTH_BINS 8
+
+static inline uint32_t perfCycles() { return DWT->CYCCNT; }
+
+struct PerfStat {
+  uint32_t count = 0;
+  uint32_t min = UINT32_MAX;
+  uint32_t max = 0;
+  uint64_t total = 0;
+  uint32_t buckets[PERF_BUCKETS] = {};
+
+  static uint8_t bucketOf(uint32_t v) {
+    if (v < 8) return (uint8_t)v;
+    uint8_t msb = 31 - __builtin_clz(v);
+    return (uint8_t)(8 + (msb - 3) * 4 + ((v >> (msb - 2)) & 3));
+  }
+
+  // Largest value that falls in bucket b
+  static uint32_t bucketTop(uint8_t b) {
+    if (b < 8) return b;
+    uint8_t msb = (b - 8) / 4 + 3;
+    uint8_t sub = (b - 8) % 4;
+    return (uint32_t)(((uint64_t)(4 + sub + 1) << (msb - 2)) - 1);
+  }
+
+  void add(uint32_t cycles) {
+    count++;
+    total += cycles;
+    if (cycles < min) min = cycles;
+    if (cycles > max) max = cycles;
+    buckets[bucketOf(cycles)]++;
+  }
+
+  // Upper bucket edge below which `perMille` of the samples fall
+  uint32_t percentile(uint32_t perMille) const {
+    uint64_t want = ((uint64_t)count * perMille + 999) / 1000;
+    uint64_t seen = 0;
+    for (uint8_t b = 0; b < PERF_BUCKETS; b++) {
+      seen += buckets[b];
+      if (seen >= want && seen > 0) return bucketTop(b) < max ? bucketTop(b) : max;
+    }
+    return max;
+  }
+};
+
+// Times one stage; records when stopped or when it goes out of scope
+class PerfTimer {
+private:
+  PerfStat* stat;
+  uint32_t start;
+public:
+  explicit PerfTimer(PerfStat& s) : stat(&s), start(perfCycles()) {}
+  ~PerfTimer() { stop(); }
+  void stop() {
+    if (stat == nullptr) return;
+    stat->add(perfCycles() - start);
+    stat = nullptr;
+  }
+};
+
+class PerfCounters {
+private:
+  PerfStat stages[PERF_STAGE_COUNT];
+
+  // Ring depth seen by the consumer when it wakes, in PERF_DEPTH_BINS bins
+  uint32_t depthBins[PERF_DEPTH_BINS] = {};
+  uint32_t depthSlots = 1;
+
+  // Reports per second over 1 s windows
+  uint32_t rateMin = UINT32_MAX;
+  uint32_t rateMax = 0;
+  uint32_t rateWindows = 0;
+  uint32_t windowStart = 0;
+  uint32_t windowReports = 0;
+  uint32_t startedMs = 0;
+  uint32_t startedReports = 0;
+  uint32_t lastReports = 0;
+
+public:
+  // Enable the cycle counter; ringSlots scales the depth histogram
+  void begin(uint32_t ringSlots, uint32_t now) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    depthSlots = ringSlots;
+    reset(now, 0);
+  }
+
+  void reset(uint32_t now, uint32_t reports) {
+    for (int i = 0; i < PERF_STAGE_COUNT; i++) stages[i] = PerfStat();
+    for (int i = 0; i < PERF_DEPTH_BINS; i++) depthBins[i] = 0;
+    rateMin = UINT32_MAX;
+    rateMax = 0;
+    rateWindows = 0;
+    windowStart = startedMs = now;
+    windowReports = startedReports = lastReports = reports;
+  }
+
+  PerfStat& stat(PerfStage stage) { return stages[stage]; }
+
+  void sampleDepth(uint32_t depth) {
+    uint32_t bin = depth * PERF_DEPTH_BINS / (depthSlots + 1);
+    depthBins[bin < PERF_DEPTH_BINS ? bin : PERF_DEPTH_BINS - 1]++;
+  }
+
+  // Call at least once a second with the running callback total
+  void sampleRate(uint32_t now, uint32_t reports) {
+    lastReports = reports;
+    uint32_t elapsed = now - windowStart;
+    if (elapsed < 1000) return;
+    uint32_t rate = (uint32_t)((uint64_t)(reports - windowReports) * 1000 / elapsed);
+    if (rate < rateMin) rateMin = rate;
+    if (rate > rateMax) rateMax = rate;
+    rateWindows++;
+    windowStart = now;
+    windowReports = reports;
+  }
+
+  void print(Print& out, uint32_t now) const {
+    uint32_t mhz = SystemCoreClock / 1000000;
+    uint32_t elapsed = now - startedMs;
+    uint32_t reports = lastReports - startedReports;
+    out.printf("\n[PERF] %lu reports in %lu.%lu s (cycles, %lu per us)\n",
+               (unsigned long)reports, (unsigned long)(elapsed / 1000),
+               (unsigned long)(elapsed % 1000 / 100), (unsigned long)mhz);
+    out.println("  Stage          count      min      avg      max      p99");
+    for (int i = 0; i < PERF_STAGE_COUNT; i++) {
+      const PerfStat& s = stages[i];
+      if (s.count == 0) {
+        out.printf("  %-10s %9s\n", PERF_STAGE_NAMES[i], "-");
+        continue;
+      }
+      out.printf("  %-10s %9lu %8lu %8lu %8lu %8lu\n", PERF_STAGE_NAMES[i],
+                 (unsigned long)s.count, (unsigned long)s.min,
+                 (unsigned long)(s.total / s.count), (unsigned long)s.max,
+                 (unsigned long)s.percentile(990));
+    }
+
+    if (rateWindows > 0) {
+      out.printf("  Reports/s: min %lu, avg %lu, max %lu (%lu one-second windows)\n",
+                 (unsigned long)rateMin,
+                 (unsigned long)(elapsed ? (uint64_t)reports * 1000 / elapsed : 0),
+                 (unsigned long)rateMax, (unsigned long)rateWindows);
+    } else {
+      out.println("  Reports/s: (less than a second measured)");
+    }
+
+    uint32_t wakes = 0;
+    for (int i = 0; i < PERF_DEPTH_BINS; i++) wakes += depthBins[i];
+    out.printf("  Queue depth at consumer wake-up (%lu wake-ups, %lu slots):\n",
+               (unsigned long)wakes, (unsigned long)depthSlots);
+    for (int i = 0; i < PERF_DEPTH_BINS; i++) {
+      // Depths d with d * BINS / (slots + 1) == i
+      uint32_t lo = (i * (depthSlots + 1) + PERF_DEPTH_BINS - 1) / PERF_DEPTH_BINS;
+      uint32_t hi = ((i + 1) * (depthSlots + 1) + PERF_DEPTH_BINS - 1) / PERF_DEPTH_BINS - 1;
+      uint32_t pct = wakes ? (uint32_t)((uint64_t)depthBins[i] * 100 / wakes) : 0;
+      char bar[21];
+      uint32_t n = pct / 5;
+      for (uint32_t j = 0; j < n; j++) bar[j] = '#';
+      bar[n] = '\0';
+      out.printf("    %2lu-%-2lu %8lu %3lu%% %s\n", (unsigned long)lo, (unsigned long)hi,
+                 (unsigned long)depthBins[i], (unsigned long)pct, bar);
+    }
+  }
+};
+
+#define PERF_SCOPE(perf, stage, name) PerfTimer name((perf).stat(stage))
+#define PERF_STOP(name)               name.stop()
+
+#else
+
+#define PERF_SCOPE(perf, stage, name)
+#define PERF_STOP(name)
+
+#endif // BLE_PERF
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,135 @@
+/*
+ * QSPI Flash
+ * Minimal blocking driver for the external QSPI NOR flash of boards whose
+ * variant defines the PIN_QSPI_* pins (XIAO nRF52840: 2 MB P25Q16H;
+ * Feather, ItsyBitsy and CLUE: 2 MB GD25Q16C), on the nrfx QSPI driver of
+ * the core. The size comes from the JEDEC ID. Reads use quad I/O, programs
+ * quad output; waits for programs and erases yield to other tasks.
+ *
+ * Buffers and addresses passed to read() and program() must be 4-byte
+ * aligned and lengths a multiple of 4 (QSPI EasyDMA).
+ */
+
+#ifndef QSPI_FLASH_H
+#define QSPI_FLASH_H
+
+#include <Arduino.h>
+
+#if defined(PIN_QSPI_SCK) && defined(PIN_QSPI_CS) && defined(PIN_QSPI_IO0) && \
+    defined(PIN_QSPI_IO1) && defined(PIN_QSPI_IO2) && defined(PIN_QSPI_IO3)
+#define QSPI_FLASH_AVAILABLE 1
+#include <nrfx_qspi.h>
+#else
+#define QSPI_FLASH_AVAILABLE 0
+#endif
+
+#define QSPI_FLASH_PAGE    256
+#define QSPI_FLASH_SECTOR  4096
+
+class QspiFlash {
+private:
+  uint32_t bytes = 0;
+
+#if QSPI_FLASH_AVAILABLE
+  static bool command(uint8_t opcode, nrf_qspi_cinstr_len_t length, const void* tx, void* rx,
+                      bool writeEnable) {
+    nrf_qspi_cinstr_conf_t c = {};
+    c.opcode = opcode;
+    c.length = length;
+    c.io2_level = true;   // keep /WP and /HOLD high for single-line commands
+    c.io3_level = true;
+    c.wipwait = true;
+    c.wren = writeEnable;
+    return nrfx_qspi_cinstr_xfer(&c, tx, rx) == NRFX_SUCCESS;
+  }
+
+  // Program and erase run in the flash after the QSPI transfer completes
+  static void waitReady() {
+    while (nrfx_qspi_mem_busy_check() == NRFX_ERROR_BUSY) delay(1);
+  }
+#endif
+
+public:
+  bool begin() {
+#if QSPI_FLASH_AVAILABLE
+    if (bytes > 0) return true;
+
+    nrfx_qspi_config_t cfg = {};
+    cfg.xip_offset = 0;
+    cfg.pins.sck_pin = (uint8_t)g_ADigitalPinMap[PIN_QSPI_SCK];
+    cfg.pins.csn_pin = (uint8_t)g_ADigitalPinMap[PIN_QSPI_CS];
+    cfg.pins.io0_pin = (uint8_t)g_ADigitalPinMap[PIN_QSPI_IO0];
+    cfg.pins.io1_pin = (uint8_t)g_ADigitalPinMap[PIN_QSPI_IO1];
+    cfg.pins.io2_pin = (uint8_t)g_ADigitalPinMap[PIN_QSPI_IO2];
+    cfg.pins.io3_pin = (uint8_t)g_ADigitalPinMap[PIN_QSPI_IO3];
+    cfg.prot_if.readoc = NRF_QSPI_READOC_READ4IO;
+    cfg.prot_if.writeoc = NRF_QSPI_WRITEOC_PP4O;
+    cfg.prot_if.addrmode = NRF_QSPI_ADDRMODE_24BIT;
+    cfg.prot_if.dpmconfig = false;
+    cfg.phy_if.sck_delay = 10;
+    cfg.phy_if.dpmen = false;
+    cfg.phy_if.spi_mode = NRF_QSPI_MODE_0;
+    cfg.phy_if.sck_freq = NRF_QSPI_FREQ_32MDIV2;   // 16 MHz
+    cfg.irq_priority = 7;
+    if (nrfx_qspi_init(&cfg, NULL, NULL) != NRFX_SUCCESS) return false;  // no handler: blocking
+
+    // JEDEC ID: manufacturer, type, capacity (log2 of the size in bytes)
+    uint8_t id[3] = {};
+    if (!command(0x9F, NRF_QSPI_CINSTR_LEN_4B, NULL, id, false) ||
+        id[0] == 0x00 || id[0] == 0xFF || id[2] < 16 || id[2] > 24) {
+      nrfx_qspi_uninit();
+      return false;
+    }
+
+    // Quad enable (status register 2, bit 1) - the same on both parts
+    uint8_t status[2] = { 0x00, 0x02 };
+    if (!command(0x01, NRF_QSPI_CINSTR_LEN_3B, status, NULL, true)) {
+      nrfx_qspi_uninit();
+      return false;
+    }
+    waitReady();
+
+    bytes = 1UL << id[2];
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  uint32_t size() const { return bytes; }
+
+  bool read(uint32_t addr, void* buf, size_t len) {
+#if QSPI_FLASH_AVAILABLE
+    return bytes > 0 && nrfx_qspi_read(buf, len, addr) == NRFX_SUCCESS;
+#else
+    (void)addr; (void)buf; (void)len;
+    return false;
+#endif
+  }
+
+  // One page at most, not crossing a page boundary, into erased flash
+  bool program(uint32_t addr, const void* buf, size_t len) {
+#if QSPI_FLASH_AVAILABLE
+    if (bytes == 0 || nrfx_qspi_write(buf, len, addr) != NRFX_SUCCESS) return false;
+    waitReady();
+    return true;
+#else
+    (void)addr; (void)buf; (void)len;
+    return false;
+#endif
+  }
+
+  // 4 KB sector containing addr; typically 40 ms, up to 300 ms
+  bool eraseSector(uint32_t addr) {
+#if QSPI_FLASH_AVAILABLE
+    if (bytes == 0 || nrfx_qspi_erase(NRF_QSPI_ERASE_LEN_4KB, addr) != NRFX_SUCCESS) return false;
+    waitReady();
+    return true;
+#else
+    (void)addr;
+    return false;
+#endif
+  }
+};
+
+#endif // QSPI_FLASH_H
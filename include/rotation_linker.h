@@ -0,0 +1,290 @@
+/*
+ * Rotation Linker
+ * Links a new private address to the device that went quiet just before
+ * it appeared, so address rotation (resolvable and non-resolvable private
+ * addresses) does not count as a new device. Random static addresses do
+ * not change while the device is powered and are left alone.
+ *
+ * Devices are indexed in small hash buckets keyed on the address type,
+ * the stable part of the advertisement - the change-masked fingerprint,
+ * which covers the AD layout, company ID, service UUIDs and TX power but
+ * not rotating bytes - and an 8 dB band of smoothed RSSI. Only devices
+ * with some stable content (a company ID, a service UUID or a name) take
+ * part; an empty advertisement says nothing about who sent it.
+ *
+ * On the new address's second report, once its first gap is known, a
+ * candidate is picked: it must have gone silent before the new address
+ * was first heard, within a few of its own advertising intervals, must be
+ * overdue by half an interval since (a live device would have been heard
+ * again), its smoothed RSSI must continue into the new address's, and the
+ * first gap must not be shorter than its interval. The link is pending
+ * until the new address has shown its own interval: it is made (the
+ * earlier record merged and freed) once the shortest gaps of both
+ * addresses agree within LINK_INTERVAL_MS; it is dropped if the earlier
+ * address is heard again, or if the intervals still disagree after
+ * LINK_CONFIRM_REPORTS reports. Until then both records stay as they are.
+ *
+ * Identical devices of one model share a signature; when two candidates
+ * fit about equally well nothing is linked, so counts err towards more
+ * devices rather than merging different ones.
+ */
+
+#ifndef ROTATION_LINKER_H
+#define ROTATION_LINKER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "device_table.h"
+#include "seen_devices.h"
+
+#define LINK_BUCKETS           128     // power of two
+#define LINK_WAYS              4
+#define LINK_WINDOW_MS         10000   // longest silence between the old address and the new
+#define LINK_MISSED_INTERVALS  4       // silence allowed, in the old address's intervals...
+#define LINK_SLACK_MS          500     // ...plus this
+#define LINK_RSSI_DB           8       // smoothed RSSI continuity
+#define LINK_MARGIN_DB         3       // a runner-up this close makes the link ambiguous
+#define LINK_BAND_SHIFT        3       // devices are bucketed by smoothed RSSI in 8 dB bands
+#define LINK_INTERVAL_MS       15      // shortest gaps agree: twice the 0-10 ms advertising delay, less a little
+#define LINK_CONFIRM_MIN       4       // reports of the new address before a link is made
+#define LINK_CONFIRM_REPORTS   12      // ...and after which a pending link is given up
+#define LINK_PENDING           32      // links waiting for confirmation
+
+static_assert((LINK_BUCKETS & (LINK_BUCKETS - 1)) == 0, "LINK_BUCKETS must be a power of two");
+
+// Folds the record of an earlier address into the device's current one
+static inline void mergeEarlierDevice(SeenDevice& dev, const SeenDevice& earlier) {
+  dev.signal.mergeEarlier(earlier.signal);
+  if (dev.name[0] == 0) memcpy(dev.name, earlier.name, SEEN_NAME_MAX);
+  if (dev.company == SEEN_ID_NONE) dev.company = earlier.company;
+  if (dev.service == SEEN_ID_NONE) dev.service = earlier.service;
+  if (earlier.epochReports > 0) {
+    if (earlier.epochMin < dev.epochMin) dev.epochMin = earlier.epochMin;
+    if (earlier.epochMax > dev.epochMax) dev.epochMax = earlier.epochMax;
+    uint32_t reports = (uint32_t)dev.epochReports + earlier.epochReports;
+    dev.epochReports = (uint16_t)(reports > 0xFFFF ? 0xFFFF : reports);
+  }
+}
+
+template <uint16_t Capacity>
+class RotationLinker {
+private:
+  typedef DeviceTable<SeenDevice, Capacity> Table;
+
+  // A candidate waiting for the new address to show its interval. Both
+  // records are named by key too, since either may be evicted meanwhile.
+  struct PendingLink {
+    DeviceKey key;          // new address
+    DeviceKey earlierKey;   // the device it may continue
+    uint16_t idx;
+    uint16_t earlier;
+    uint32_t earlierSeen;   // its lastSeen when picked; a newer report cancels
+  };
+
+  uint32_t sigs[LINK_BUCKETS * LINK_WAYS];
+  uint16_t idxs[LINK_BUCKETS * LINK_WAYS];   // device records, DEVICE_NONE if empty
+  PendingLink pending[LINK_PENDING];
+  uint8_t pendingCount = 0;
+  DeviceKey lastKey = {};                    // earlier address of the last link
+  uint32_t linkCount = 0;
+  uint32_t ambiguousCount = 0;
+  uint32_t rejectedCount = 0;
+
+  static uint32_t signature(const SeenDevice& dev, uint8_t addrType) {
+    return (dev.adHash ^ addrType) * 2654435761u;
+  }
+
+  static bool hasStableContent(const SeenDevice& dev) {
+    return dev.company != SEEN_ID_NONE || dev.service != SEEN_ID_NONE || dev.name[0] != 0;
+  }
+
+  static bool sameInterval(uint16_t a, uint16_t b) {
+    return a != 0 && b != 0 && abs((int)a - (int)b) <= LINK_INTERVAL_MS;
+  }
+
+  static int band(int rssi) { return (rssi + 128) >> LINK_BAND_SHIFT; }
+
+  static uint32_t bucketBase(uint32_t sig, int band) {
+    return (((sig + (uint32_t)band * 0x9E3779B9u) >> 16) & (LINK_BUCKETS - 1)) * LINK_WAYS;
+  }
+
+  // The record still holds a device with this signature, in this bucket's
+  // RSSI band (the one indexed, or a newer one just like it)
+  static bool current(const Table& table, uint16_t idx, uint32_t sig, uint32_t base) {
+    const DeviceKey& key = table.keyAt(idx);
+    return table.find(key) == idx && signature(table[idx], key.addrType) == sig &&
+           bucketBase(sig, band(table[idx].signal.rssi())) == base;
+  }
+
+  bool isPending(uint16_t earlier) const {
+    for (uint8_t i = 0; i < pendingCount; i++) {
+      if (pending[i].earlier == earlier) return true;
+    }
+    return false;
+  }
+
+  void dropPending(uint8_t i) {
+    pending[i] = pending[--pendingCount];
+  }
+
+  // Candidates are within LINK_RSSI_DB, so in the new address's band or
+  // a neighbouring one
+  void propose(const Table& table, uint16_t idx, uint32_t sig, uint32_t now) {
+    const SeenDevice& dev = table[idx];
+    uint32_t firstHeard = now - dev.signal.intervalMs;
+    int rssi = dev.signal.rssi();
+
+    int best = -1;   // slot in sigs/idxs
+    int bestDiff = 0x7FFF;
+    int runnerUp = 0x7FFF;
+    for (int b = band(rssi) - 1; b <= band(rssi) + 1; b++) {
+      uint32_t base = bucketBase(sig, b);
+      for (int w = 0; w < LINK_WAYS; w++) {
+        uint16_t other = idxs[base + w];
+        if (other == DEVICE_NONE || other == idx || sigs[base + w] != sig) continue;
+        if (!current(table, other, sig, base)) continue;
+
+        const SeenDevice& old = table[other];
+        uint16_t interval = old.signal.gapMinMs;
+        if (interval == 0) continue;   // no schedule to judge by yet
+        int32_t silence = (int32_t)(firstHeard - old.lastSeen);
+        if (silence < 0) continue;   // still heard after the new address appeared
+        if ((now - old.lastSeen) * 2 < 3u * interval) continue;   // not overdue yet
+        uint32_t limit = (uint32_t)interval * LINK_MISSED_INTERVALS + LINK_SLACK_MS;
+        if ((uint32_t)silence > limit || (uint32_t)silence > LINK_WINDOW_MS) continue;
+        if (dev.signal.intervalMs + LINK_INTERVAL_MS < interval) continue;   // faster schedule
+
+        int diff = abs(old.signal.rssi() - rssi);
+        if (diff > LINK_RSSI_DB) continue;
+        if (diff < bestDiff) {
+          runnerUp = bestDiff;
+          bestDiff = diff;
+          best = (int)(base + w);
+        } else if (diff < runnerUp) {
+          runnerUp = diff;
+        }
+      }
+    }
+
+    if (best < 0 || isPending(idxs[best])) return;
+    if (runnerUp - bestDiff < LINK_MARGIN_DB) {
+      ambiguousCount++;
+      return;
+    }
+    if (pendingCount == LINK_PENDING) {
+      rejectedCount++;   // the oldest waited longest and is the least likely
+      dropPending(0);
+    }
+    PendingLink& p = pending[pendingCount++];
+    p.key = table.keyAt(idx);
+    p.idx = idx;
+    p.earlier = idxs[best];
+    p.earlierKey = table.keyAt(p.earlier);
+    p.earlierSeen = table[p.earlier].lastSeen;
+  }
+
+  // A further report of an address with a pending link: make the link
+  // when the intervals agree, give it up when they cannot any more
+  uint16_t confirm(Table& table, uint16_t idx) {
+    for (uint8_t i = 0; i < pendingCount; i++) {
+      PendingLink& p = pending[i];
+      if (p.idx != idx || !(table.keyAt(idx) == p.key)) continue;
+
+      SeenDevice& dev = table[idx];
+      const SeenDevice& old = table[p.earlier];
+      if (table.find(p.earlierKey) != p.earlier || old.lastSeen != p.earlierSeen) {
+        rejectedCount++;   // the earlier address is still around, or gone from the table
+        dropPending(i);
+        return DEVICE_NONE;
+      }
+      if (dev.signal.count >= LINK_CONFIRM_MIN &&
+          sameInterval(dev.signal.gapMinMs, old.signal.gapMinMs)) {
+        uint16_t earlier = p.earlier;
+        lastKey = p.earlierKey;
+        mergeEarlierDevice(dev, old);
+        table.remove(earlier);
+        dropPending(i);
+        linkCount++;
+        return earlier;
+      }
+      if (dev.signal.count >= LINK_CONFIRM_REPORTS) {
+        rejectedCount++;
+        dropPending(i);
+      }
+      return DEVICE_NONE;
+    }
+    return DEVICE_NONE;
+  }
+
+public:
+  RotationLinker() { clear(); }
+
+  void clear() {
+    memset(idxs, 0xFF, sizeof(idxs));
+    pendingCount = 0;
+  }
+
+  // Private addresses (resolvable, non-resolvable) rotate
+  static bool rotates(uint8_t addrType) { return addrType == 2 || addrType == 3; }
+
+  // Call for every tracked report of a rotating address, after
+  // trackReport(). Returns the record of the earlier address that was
+  // merged into idx and removed, or DEVICE_NONE.
+  uint16_t track(Table& table, uint16_t idx, uint32_t now) {
+    const SeenDevice& dev = table[idx];
+    if (!hasStableContent(dev)) return DEVICE_NONE;
+    uint32_t sig = signature(dev, table.keyAt(idx).addrType);
+    uint16_t earlier = DEVICE_NONE;
+    if (dev.signal.count == 2) {
+      propose(table, idx, sig, now);
+    } else if (pendingCount > 0 && dev.signal.count <= LINK_CONFIRM_REPORTS) {
+      earlier = confirm(table, idx);
+    }
+
+    // Keep the device in its bucket. Replacement order: an empty or stale
+    // way, then a device quiet for longer than the window, then the most
+    // recently heard other device (a live one, not a candidate yet)
+    uint32_t base = bucketBase(sig, band(dev.signal.rssi()));
+    int victim = -1;
+    int rank = 0;
+    uint32_t victimQuiet = 0;
+    for (int w = 0; w < LINK_WAYS; w++) {
+      uint16_t other = idxs[base + w];
+      if (other == idx) {
+        if (sigs[base + w] == sig) return earlier;
+        victim = w;
+        rank = 3;
+        continue;
+      }
+      if (rank == 3) continue;
+      if (other == DEVICE_NONE || !current(table, other, sigs[base + w], base)) {
+        victim = w;
+        rank = 3;
+        continue;
+      }
+      uint32_t quiet = now - table[other].lastSeen;
+      if (quiet > LINK_WINDOW_MS) {
+        if (rank < 2) {
+          victim = w;
+          rank = 2;
+        }
+      } else if (rank < 2 && (victim < 0 || quiet < victimQuiet)) {
+        victim = w;
+        rank = 1;
+        victimQuiet = quiet;
+      }
+    }
+    sigs[base + victim] = sig;
+    idxs[base + victim] = idx;
+    return earlier;
+  }
+
+  // Address of the earlier record merged by the last link
+  const DeviceKey& lastLinkedKey() const { return lastKey; }
+
+  uint32_t linked() const { return linkCount; }
+  uint32_t ambiguous() const { return ambiguousCount; }
+  uint32_t rejected() const { return rejectedCount; }   // pending links given up
+};
+
+#endif // ROTATION_LINKER_H
@@ -0,0 +1,135 @@
+/*
+ * Scan Response Pairing
+ * With active scanning a scannable advertisement and its scan response
+ * arrive as two reports. The consumer holds a scannable advertisement for
+ * up to PAIR_HOLD_MS; when the scan response of the same address follows,
+ * its AD structures are appended and the pair goes through filtering,
+ * deduplication and output as one report (ADV_FLAG_SCAN_RESPONSE set,
+ * rspOffset marking where the response starts). Advertisements that get
+ * no response in time, and responses without a held advertisement, pass
+ * on alone. Consumer task only.
+ */
+
+#ifndef SCAN_PAIRING_H
+#define SCAN_PAIRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "adv_report_ring.h"
+
+#ifndef PAIR_SLOTS
+#define PAIR_SLOTS   8    // advertisements waiting for a response
+#endif
+#ifndef PAIR_HOLD_MS
+#define PAIR_HOLD_MS 20   // the response follows within a millisecond when it comes at all
+#endif
+
+typedef void (*ReportSink)(const AdvReport& report);
+
+class ScanPairer {
+private:
+  AdvReport slots[PAIR_SLOTS];
+  uint8_t order[PAIR_SLOTS];    // slots in use, oldest first
+  uint8_t count = 0;
+  uint32_t paired = 0;
+  uint32_t unanswered = 0;      // held advertisements passed on alone
+  uint32_t alone = 0;           // scan responses without a held advertisement
+
+  AdvReport& held(uint8_t i) { return slots[order[i]]; }
+
+  int findHeld(const AdvReport& r) {
+    for (uint8_t i = 0; i < count; i++) {
+      const AdvReport& h = held(i);
+      if (h.addrType == r.addrType && memcmp(h.addr, r.addr, sizeof(r.addr)) == 0) return i;
+    }
+    return -1;
+  }
+
+  void drop(uint8_t i) {
+    uint8_t slot = order[i];
+    count--;
+    memmove(&order[i], &order[i + 1], count - i);
+    order[count] = slot;   // free slots stay behind the used ones
+  }
+
+  void passOn(uint8_t i, ReportSink sink) {
+    unanswered++;
+    sink(held(i));
+    drop(i);
+  }
+
+  // End of the last well-formed AD structure, so the response is not
+  // hidden behind zero padding
+  static uint8_t structuresEnd(const AdvReport& r) {
+    uint16_t offset = 0;
+    while (offset + 1 < r.len && r.data[offset] != 0 &&
+           offset + 1 + r.data[offset] <= r.len) {
+      offset += 1 + r.data[offset];
+    }
+    return (uint8_t)offset;
+  }
+
+public:
+  ScanPairer() {
+    for (uint8_t i = 0; i < PAIR_SLOTS; i++) order[i] = i;
+  }
+
+  // Hand every report from the ring here; sink gets the reports to
+  // process, possibly a held one first
+  void push(const AdvReport& r, ReportSink sink) {
+    if (r.flags & ADV_FLAG_SCAN_RESPONSE) {
+      int i = findHeld(r);
+      if (i < 0) {
+        alone++;
+        sink(r);
+        return;
+      }
+      AdvReport& adv = held(i);
+      uint8_t end = structuresEnd(adv);
+      if ((uint16_t)end + r.len > ADV_REPORT_MAX_DATA) {
+        passOn(i, sink);   // does not fit (long extended data): both alone
+        alone++;
+        sink(r);
+        return;
+      }
+      memcpy(adv.data + end, r.data, r.len);
+      adv.len = end + r.len;
+      adv.rspOffset = end;
+      adv.flags |= ADV_FLAG_SCAN_RESPONSE | (r.flags & ADV_FLAG_TRUNCATED);
+      adv.flags &= r.flags | ~ADV_FLAG_CHECKED;   // checked only if both halves were
+      paired++;
+      sink(adv);
+      drop(i);
+      return;
+    }
+
+    if (!(r.flags & ADV_FLAG_SCANNABLE)) {
+      sink(r);
+      return;
+    }
+
+    // A newer advertisement of a held address: the old one got no answer
+    int i = findHeld(r);
+    if (i >= 0) passOn(i, sink);
+    if (count == PAIR_SLOTS) passOn(0, sink);
+    memcpy(&slots[order[count]], &r, offsetof(AdvReport, data) + r.len);
+    count++;
+  }
+
+  // Pass on advertisements held for PAIR_HOLD_MS without a response
+  void expire(uint32_t now, ReportSink sink) {
+    while (count > 0 && now - held(0).timestamp >= PAIR_HOLD_MS) passOn(0, sink);
+  }
+
+  void flush(ReportSink sink) {
+    while (count > 0) passOn(0, sink);
+  }
+
+  bool empty() const { return count == 0; }
+  uint32_t pairedCount() const { return paired; }
+  uint32_t unansweredCount() const { return unanswered; }
+  uint32_t aloneCount() const { return alone; }
+};
+
+#endif // SCAN_PAIRING_H
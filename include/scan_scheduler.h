@@ -0,0 +1,191 @@
+/*
+ * Scan Scheduler
+ * Picks scan interval/window and active/passive scanning from the observed
+ * report and new-device rates: active bursts while new addresses show up,
+ * a long passive window (or a duty-cycled low-power profile) otherwise
+ */
+
+#ifndef SCAN_SCHEDULER_H
+#define SCAN_SCHEDULER_H
+
+#include <Arduino.h>
+
+// Scan profiles (interval/window in 0.625 ms units)
+enum ScanProfile {
+  SCAN_PROFILE_ACTIVE,     // 50 ms / 50 ms, scan requests for names and scan responses
+  SCAN_PROFILE_PASSIVE,    // 1 s / 1 s, listen only - no scan request traffic
+  SCAN_PROFILE_LOW_POWER,  // 1 s / 30 ms, ~3% radio duty cycle for battery use
+  SCAN_PROFILE_COUNT
+};
+
+struct ScanParams {
+  const char* name;
+  uint16_t interval;
+  uint16_t window;
+  bool active;
+};
+
+static const ScanParams SCAN_PROFILES[SCAN_PROFILE_COUNT] = {
+  { "active",   80,   80,   true  },
+  { "passive",  1600, 1600, false },
+  { "lowpower", 1600, 48,   false },
+};
+
+// Scheduler modes (selected with the 'p' command)
+enum ScanMode {
+  SCAN_MODE_ACTIVE,          // fixed profiles
+  SCAN_MODE_PASSIVE,
+  SCAN_MODE_LOW_POWER,
+  SCAN_MODE_AUTO,            // active bursts on new devices, passive when quiet
+  SCAN_MODE_AUTO_LOW_POWER,  // active bursts on new devices, low-power when quiet
+  SCAN_MODE_COUNT
+};
+
+static const char* const SCAN_MODE_NAMES[SCAN_MODE_COUNT] = {
+  "active", "passive", "lowpower", "auto", "auto-lowpower"
+};
+
+// Default mode; battery deployments can build with
+// -DSCAN_DEFAULT_MODE=SCAN_MODE_AUTO_LOW_POWER
+#ifndef SCAN_DEFAULT_MODE
+#define SCAN_DEFAULT_MODE SCAN_MODE_AUTO
+#endif
+
+// Adaptive policy tuning
+#define SCHED_EVAL_MS        1000   // rate measurement period
+#define SCHED_BURST_MS       10000  // stay active this long after the last new device
+#define SCHED_CROWDED_RATE   200    // reports/s above which bursts are halved
+
+class ScanScheduler {
+private:
+  ScanMode mode = SCAN_DEFAULT_MODE;
+  ScanProfile profile = SCAN_PROFILE_ACTIVE;
+
+  // Rate measurement
+  uint32_t evalStart = 0;
+  uint32_t evalReports = 0;
+  uint32_t evalNew = 0;
+  uint32_t reportRate = 0;   // reports/s over the last period
+  uint32_t newRate = 0;      // new devices/s over the last period
+  uint32_t burstUntil = 0;
+
+  // Time accounting (only while the scanner runs)
+  bool running = false;
+  uint32_t segmentStart = 0;
+  uint32_t timeMs[SCAN_PROFILE_COUNT] = {};
+  uint32_t switches = 0;
+
+  static ScanProfile fixedProfile(ScanMode m) {
+    switch (m) {
+      case SCAN_MODE_PASSIVE:   return SCAN_PROFILE_PASSIVE;
+      case SCAN_MODE_LOW_POWER: return SCAN_PROFILE_LOW_POWER;
+      default:                  return SCAN_PROFILE_ACTIVE;
+    }
+  }
+
+  bool adaptive() const {
+    return mode == SCAN_MODE_AUTO || mode == SCAN_MODE_AUTO_LOW_POWER;
+  }
+
+  void account(uint32_t now) {
+    if (running) timeMs[profile] += now - segmentStart;
+    segmentStart = now;
+  }
+
+  bool switchTo(ScanProfile p, uint32_t now) {
+    if (p == profile) return false;
+    account(now);
+    profile = p;
+    switches++;
+    return true;
+  }
+
+public:
+  ScanScheduler() { profile = adaptive() ? SCAN_PROFILE_ACTIVE : fixedProfile(mode); }
+
+  // Change mode; returns true if the active profile changed
+  bool setMode(ScanMode m, uint32_t now) {
+    mode = m;
+    burstUntil = now + SCHED_BURST_MS;  // adaptive modes start with a burst
+    return switchTo(adaptive() ? SCAN_PROFILE_ACTIVE : fixedProfile(m), now);
+  }
+
+  // Scanner started/stopped - time is only charged while it runs.
+  // reports/newDevices are the running totals at that moment.
+  void start(uint32_t now, uint32_t reports, uint32_t newDevices) {
+    if (adaptive()) {
+      // Everything is new to a fresh scan - begin with a burst
+      burstUntil = now + SCHED_BURST_MS;
+      switchTo(SCAN_PROFILE_ACTIVE, now);
+    }
+    running = true;
+    segmentStart = now;
+    evalStart = now;
+    evalReports = reports;
+    evalNew = newDevices;
+  }
+
+  void stop(uint32_t now) {
+    account(now);
+    running = false;
+  }
+
+  // Call periodically while scanning with the running report and
+  // new-device totals. Returns true when the scan parameters must be
+  // re-applied.
+  bool update(uint32_t now, uint32_t reports, uint32_t newDevices) {
+    uint32_t elapsed = now - evalStart;
+    if (elapsed < SCHED_EVAL_MS) return false;
+
+    uint32_t newInPeriod = newDevices - evalNew;
+    reportRate = (reports - evalReports) * 1000 / elapsed;
+    newRate = newInPeriod * 1000 / elapsed;
+    evalStart = now;
+    evalReports = reports;
+    evalNew = newDevices;
+
+    if (!adaptive()) return false;
+
+    if (newInPeriod > 0) {
+      // Crowded air: scan requests cost the most here, keep bursts short
+      uint32_t burst = reportRate > SCHED_CROWDED_RATE ? SCHED_BURST_MS / 2 : SCHED_BURST_MS;
+      burstUntil = now + burst;
+    }
+
+    ScanProfile quiet = mode == SCAN_MODE_AUTO_LOW_POWER ? SCAN_PROFILE_LOW_POWER
+                                                         : SCAN_PROFILE_PASSIVE;
+    bool bursting = (int32_t)(burstUntil - now) > 0;
+    return switchTo(bursting ? SCAN_PROFILE_ACTIVE : quiet, now);
+  }
+
+  const ScanParams& params() const { return SCAN_PROFILES[profile]; }
+  ScanProfile currentProfile() const { return profile; }
+  ScanMode currentMode() const { return mode; }
+  const char* modeName() const { return SCAN_MODE_NAMES[mode]; }
+  uint32_t switchCount() const { return switches; }
+
+  void printStatus(uint32_t now, Print& out = Serial) {
+    account(now);
+    const ScanParams& p = params();
+    out.println("\n[SCAN-SCHEDULER]");
+    out.printf("  Mode:     %s\n", modeName());
+    out.printf("  Profile:  %s (interval %u.%u ms, window %u.%u ms, %s scan)\n",
+                  p.name, p.interval * 5 / 8, (p.interval * 50 / 8) % 10,
+                  p.window * 5 / 8, (p.window * 50 / 8) % 10,
+                  p.active ? "active" : "passive");
+    out.printf("  Rates:    %lu reports/s, %lu new devices/s (last measurement)\n",
+                  (unsigned long)reportRate, (unsigned long)newRate);
+    out.printf("  Switches: %lu\n", (unsigned long)switches);
+
+    uint32_t total = 0;
+    for (int i = 0; i < SCAN_PROFILE_COUNT; i++) total += timeMs[i];
+    out.println("  Time per profile:");
+    for (int i = 0; i < SCAN_PROFILE_COUNT; i++) {
+      out.printf("    %-9s %6lu s (%lu%%)\n", SCAN_PROFILES[i].name,
+                    (unsigned long)(timeMs[i] / 1000),
+                    (unsigned long)(total ? (uint64_t)timeMs[i] * 100 / total : 0));
+    }
+  }
+};
+
+#endif // SCAN_SCHEDULER_H
@@ -0,0 +1,173 @@
+/*
+ * Seen Devices
+ * Per-device record kept in the device table and the deduplication step
+ * that runs on every report that passed the filters: table lookup, TTL
+ * expiry, signal statistics, census counters and change detection. Shared
+ * by the firmware and the host benchmark (bench/), so both measure the
+ * same code.
+ */
+
+#ifndef SEEN_DEVICES_H
+#define SEEN_DEVICES_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include "adv_report_ring.h"
+#include "device_table.h"
+#include "ad_parser.h"
+#include "change_mask.h"
+#include "signal_stats.h"
+
+// Fixed 44-byte record (address lives in the table key): the payload is
+// kept as a fingerprint and the name as a prefix (enough to list devices
+// and to build a name filter, which matches substrings). With key and LRU
+// links a table entry is 56 bytes.
+#define SEEN_NAME_MAX 9
+#define SEEN_ID_NONE  0xFFFF
+
+struct SeenDevice {
+  uint32_t adHash = 0;        // masked fingerprint of the last displayed advertisement
+  uint32_t rspHash = 0;       // same for its scan response (0 = none heard yet)
+  uint32_t lastSeen = 0;      // millis()
+  uint16_t shownTick = 0;     // showTick() of the last display
+  int8_t rssi = 0;            // smoothed RSSI at the last display
+  char name[SEEN_NAME_MAX] = {};  // NUL-padded, not terminated when full
+  SignalStats signal;         // smoothed RSSI, range, report count and interval
+
+  // Census: identity hints and counters for the current epoch
+  uint16_t company = SEEN_ID_NONE;  // last manufacturer data company ID
+  uint16_t service = SEEN_ID_NONE;  // last first 16-bit service UUID
+  uint16_t epochReports = 0;
+  int8_t epochMin = 0;
+  int8_t epochMax = 0;
+};
+
+static_assert(sizeof(SeenDevice) == 44, "SeenDevice changed size: update the comment above and README");
+
+// 64 ms ticks (wraps after ~70 minutes, far beyond any hold time)
+static inline uint16_t showTick(uint32_t ms) { return (uint16_t)(ms >> 6); }
+
+// Remember a name prefix in a device record
+static inline void storeSeenName(SeenDevice& dev, const uint8_t* name, size_t len) {
+  if (len > SEEN_NAME_MAX) len = SEEN_NAME_MAX;
+  memcpy(dev.name, name, len);
+  memset(dev.name + len, 0, SEEN_NAME_MAX - len);
+}
+
+// Per-epoch census counters, O(1) per report
+static inline void countEpochReport(SeenDevice& dev, const AdvReport& report, const AdView& view) {
+  if (dev.epochReports == 0) {
+    dev.epochMin = dev.epochMax = report.rssi;
+  } else {
+    if (report.rssi < dev.epochMin) dev.epochMin = report.rssi;
+    if (report.rssi > dev.epochMax) dev.epochMax = report.rssi;
+  }
+  if (dev.epochReports < 0xFFFF) dev.epochReports++;
+  if (view.hasCompanyId()) dev.company = view.companyId();
+  if (view.uuid16Count > 0) dev.service = view.uuid16[0];
+}
+
+enum TrackResult : uint8_t {
+  TRACK_NEW,        // first report, or back after the TTL - display
+  TRACK_CHANGED,    // payload or smoothed RSSI changed - display
+  TRACK_REPEAT,     // deduplication off: known device, displayed anyway
+  TRACK_DUPLICATE,  // nothing changed - skip
+  TRACK_HELD        // changed again within the hold time - skip for now
+};
+
+// Settings for trackReport(); the command shell changes them while scanning
+struct TrackOptions {
+  const ChangeMasks* masks;
+  const ChangePolicy* policy;
+  bool dedup;        // false: every report is displayed
+  uint32_t ttlMs;    // forget devices unseen for longer (0 = never)
+};
+
+// Track one report under key (the report's address, or the identity of a
+// resolved private address) - one hash lookup. Signal statistics update on
+// each report; deduplication decides what gets displayed. idx is the
+// device's record afterwards; expired is set when an old record was
+// dropped first.
+template <uint16_t Capacity>
+static TrackResult trackReport(DeviceTable<SeenDevice, Capacity>& table, const DeviceKey& key,
+                               const AdvReport& report, const AdView& view,
+                               const TrackOptions& opt, uint16_t& idx, bool& expired) {
+  idx = table.find(key);
+  expired = false;
+  if (idx != DEVICE_NONE && opt.ttlMs > 0 &&
+      report.timestamp - table[idx].lastSeen > opt.ttlMs) {
+    // Back after being away longer than the TTL - report it as new
+    table.remove(idx);
+    expired = true;
+    idx = DEVICE_NONE;
+  }
+
+  bool hasRsp = report.flags & ADV_FLAG_SCAN_RESPONSE;
+  uint8_t advEnd = hasRsp ? report.rspOffset : report.len;
+
+  TrackResult result = TRACK_NEW;
+  if (idx != DEVICE_NONE) {
+    SeenDevice& dev = table[idx];
+    dev.signal.add(report.rssi, report.timestamp - dev.lastSeen);
+    dev.lastSeen = report.timestamp;
+    countEpochReport(dev, report, view);
+    table.touch(idx);
+    result = TRACK_REPEAT;
+
+    if (opt.dedup) {
+      // Device seen before - check if anything changed
+      // (the name is part of the payload, so the fingerprint covers it).
+      // The advertisement and the scan response are compared on their
+      // own, so a report missing one of them is not a change.
+      // RSSI changes are judged on the smoothed value, so single noisy
+      // samples do not trigger a reprint.
+      uint32_t adHash = advEnd > 0 ? opt.masks->fingerprint(view, 0, advEnd) : dev.adHash;
+      uint32_t rspHash = hasRsp ? opt.masks->fingerprint(view, advEnd, report.len) : dev.rspHash;
+      bool payloadChanged = dev.adHash != adHash || dev.rspHash != rspHash;
+      bool rssiSignificantChange = opt.policy->rssiDelta > 0 &&
+                                   abs(dev.rssi - dev.signal.rssi()) > opt.policy->rssiDelta;
+
+      if (!payloadChanged && !rssiSignificantChange) return TRACK_DUPLICATE;
+
+      // Changed again too soon - keep the old state so the change is
+      // reported once the hold time has passed
+      uint16_t sinceShown = showTick(report.timestamp) - dev.shownTick;
+      if ((uint32_t)sinceShown * 64 < opt.policy->holdMs) return TRACK_HELD;
+
+      // Something changed - update and display
+      if (view.nameLen() > 0) storeSeenName(dev, view.name(), view.nameLen());
+      dev.adHash = adHash;
+      dev.rspHash = rspHash;
+      result = TRACK_CHANGED;
+    }
+  } else {
+    // New device - add to tracking (evicts the least recently seen when full)
+    idx = table.insert(key);
+    SeenDevice& dev = table[idx];
+    storeSeenName(dev, view.name(), view.nameLen());
+    dev.adHash = advEnd > 0 ? opt.masks->fingerprint(view, 0, advEnd) : 0;
+    dev.rspHash = hasRsp ? opt.masks->fingerprint(view, advEnd, report.len) : 0;
+    dev.signal.add(report.rssi, 0);
+    dev.lastSeen = report.timestamp;
+    countEpochReport(dev, report, view);
+  }
+
+  SeenDevice& dev = table[idx];
+  dev.rssi = dev.signal.rssi();
+  dev.shownTick = showTick(report.timestamp);
+  return result;
+}
+
+// Track one report under its own address
+template <uint16_t Capacity>
+static TrackResult trackReport(DeviceTable<SeenDevice, Capacity>& table, const AdvReport& report,
+                               const AdView& view, const TrackOptions& opt,
+                               uint16_t& idx, bool& expired) {
+  DeviceKey key;
+  memcpy(key.addr, report.addr, sizeof(key.addr));
+  key.addrType = report.addrType;
+  return trackReport(table, key, report, view, opt, idx, expired);
+}
+
+#endif // SEEN_DEVICES_H
@@ -0,0 +1,425 @@
+/*
+ * Serial Record Writer
+ * Report output is staged one record at a time and queued in a fixed TX
+ * pool; a low-priority writer task drains it to Serial in large chunks.
+ * When the host falls behind, whole records are dropped instead of
+ * blocking the report consumer.
+ *
+ * Records are queued by output class and sent most urgent class first:
+ * console text (commands, summaries), then whitelist hits and new
+ * devices, then changed devices, then periodic refreshes. A record that
+ * has started is always finished. When the pool is full, a record evicts
+ * the oldest queued records of less urgent classes; changed and refresh
+ * records that waited longer than the latency budget are dropped when
+ * their turn comes, since a newer report says the same thing. Per class
+ * the writer measures the time from the report (the stamp given when the
+ * record is queued) to its last byte leaving.
+ *
+ * The staging buffer (beginRecord/endRecord) belongs to the report
+ * consumer; other tasks queue ready-made records with writeRecord(), or
+ * print through a RecordPrint.
+ */
+
+#ifndef SERIAL_WRITER_H
+#define SERIAL_WRITER_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// TX pool size
+#ifndef SERIAL_TX_FIFO_SIZE
+#define SERIAL_TX_FIFO_SIZE 16384
+#endif
+
+// Pool block size: records occupy whole blocks
+#ifndef SERIAL_TX_BLOCK_SIZE
+#define SERIAL_TX_BLOCK_SIZE 64
+#endif
+
+// Largest single record (a full human-format dump of a 255-byte
+// extended advertisement fits)
+#ifndef SERIAL_RECORD_MAX
+#define SERIAL_RECORD_MAX 4096
+#endif
+
+// Changed and refresh output older than this is dropped unsent (0 = never)
+#ifndef OUTPUT_LATENCY_BUDGET_MS
+#define OUTPUT_LATENCY_BUDGET_MS 2000
+#endif
+
+#define SERIAL_TX_BLOCKS (SERIAL_TX_FIFO_SIZE / SERIAL_TX_BLOCK_SIZE)
+
+static_assert(SERIAL_TX_FIFO_SIZE % SERIAL_TX_BLOCK_SIZE == 0,
+              "SERIAL_TX_FIFO_SIZE must be a multiple of SERIAL_TX_BLOCK_SIZE");
+static_assert(SERIAL_TX_BLOCKS < 0xFFFF, "too many TX blocks");
+static_assert(SERIAL_RECORD_MAX <= SERIAL_TX_FIFO_SIZE, "a record must fit the TX pool");
+
+// Output classes, most urgent first
+enum OutputClass : uint8_t {
+  OUT_CONSOLE,    // command responses, summaries, census
+  OUT_TARGET,     // whitelist hits and new devices
+  OUT_CHANGED,    // known devices that changed
+  OUT_REFRESH,    // repeats with deduplication off, signal table
+  OUT_CLASS_COUNT
+};
+
+// Latency from report to the last byte sent, per class
+struct OutputLatency {
+  uint32_t sent;        // records sent
+  uint32_t totalMs;     // summed latency of the sent records
+  uint32_t maxMs;       // worst latency since resetPeak()
+  uint32_t full;        // dropped: no room even after eviction
+  uint32_t evicted;     // dropped to make room for more urgent output
+  uint32_t late;        // dropped unsent: over the latency budget
+};
+
+class SerialRecordWriter : public Print {
+private:
+  static const uint16_t NONE = 0xFFFF;
+
+  // TX pool: a record is a chain of blocks; a queued record is named
+  // by its first block
+  uint8_t pool[SERIAL_TX_BLOCKS][SERIAL_TX_BLOCK_SIZE];
+  uint16_t nextBlock[SERIAL_TX_BLOCKS];   // chain within a record, or free list
+  uint16_t nextRecord[SERIAL_TX_BLOCKS];  // queue order, by first block
+  uint16_t recordLen[SERIAL_TX_BLOCKS];
+  uint32_t recordStamp[SERIAL_TX_BLOCKS];
+  uint16_t freeHead = 0;
+  std::atomic<uint32_t> usedBlocks{0};
+  uint16_t queueHead[OUT_CLASS_COUNT];
+  uint16_t queueTail[OUT_CLASS_COUNT];
+  std::atomic<uint32_t> queuedBlocks[OUT_CLASS_COUNT];
+
+  // Record being sent (owned by the writer task, off every queue)
+  uint16_t sending = NONE;
+  uint8_t sendingClass = OUT_CONSOLE;
+  uint16_t sendBlock = NONE;
+  uint16_t sendPos = 0;
+
+  // Staging buffer for the record being built
+  uint8_t record[SERIAL_RECORD_MAX];
+  size_t staged = 0;
+  bool inRecord = false;
+  bool overflow = false;
+  uint8_t stagedClass = OUT_CONSOLE;
+  uint32_t stagedStamp = 0;
+
+  Stream* out;
+  TaskHandle_t writerTask = NULL;
+  SemaphoreHandle_t lock = NULL;  // guards the pool and the queues
+  uint32_t budgetMs = OUTPUT_LATENCY_BUDGET_MS;
+
+  // Statistics
+  std::atomic<uint32_t> bytesOut{0};
+  uint32_t recordsOut = 0;
+  uint32_t recordsDropped = 0;    // staging overflows
+  uint32_t peakFill = 0;
+  OutputLatency latency[OUT_CLASS_COUNT];
+
+  void take() { if (lock != NULL) xSemaphoreTake(lock, portMAX_DELAY); }
+  void give() { if (lock != NULL) xSemaphoreGive(lock); }
+
+  static uint16_t blocksFor(size_t len) {
+    return (uint16_t)((len + SERIAL_TX_BLOCK_SIZE - 1) / SERIAL_TX_BLOCK_SIZE);
+  }
+
+  void freeBlock(uint16_t b) {
+    nextBlock[b] = freeHead;
+    freeHead = b;
+    usedBlocks.fetch_sub(1, std::memory_order_release);
+  }
+
+  void freeChain(uint16_t b) {
+    while (b != NONE) {
+      uint16_t next = nextBlock[b];
+      freeBlock(b);
+      b = next;
+    }
+  }
+
+  uint16_t popQueue(uint8_t cls) {
+    uint16_t r = queueHead[cls];
+    queueHead[cls] = nextRecord[r];
+    if (queueHead[cls] == NONE) queueTail[cls] = NONE;
+    queuedBlocks[cls].fetch_sub(blocksFor(recordLen[r]), std::memory_order_relaxed);
+    return r;
+  }
+
+  // Free the oldest queued record of the least urgent class below cls
+  bool evictBelow(uint8_t cls) {
+    for (uint8_t c = OUT_CLASS_COUNT - 1; c > cls; c--) {
+      if (queueHead[c] == NONE) continue;
+      freeChain(popQueue(c));
+      latency[c].evicted++;
+      return true;
+    }
+    return false;
+  }
+
+  // Copy a whole record into the pool, or drop it if it does not fit
+  bool enqueue(const uint8_t* data, size_t len, uint8_t cls, uint32_t stamp) {
+    if (len == 0) return true;
+    if (cls >= OUT_CLASS_COUNT) cls = OUT_CLASS_COUNT - 1;
+    uint16_t need = blocksFor(len);
+    take();
+    while (SERIAL_TX_BLOCKS - usedBlocks.load(std::memory_order_relaxed) < need) {
+      if (!evictBelow(cls)) {
+        latency[cls].full++;
+        give();
+        return false;
+      }
+    }
+
+    uint16_t first = freeHead;
+    uint16_t b = first;
+    for (uint16_t i = 0; i < need; i++) {
+      size_t n = len - (size_t)i * SERIAL_TX_BLOCK_SIZE;
+      if (n > SERIAL_TX_BLOCK_SIZE) n = SERIAL_TX_BLOCK_SIZE;
+      memcpy(pool[b], data + (size_t)i * SERIAL_TX_BLOCK_SIZE, n);
+      if (i + 1 < need) b = nextBlock[b];
+    }
+    freeHead = nextBlock[b];
+    nextBlock[b] = NONE;
+    uint32_t used = usedBlocks.fetch_add(need, std::memory_order_relaxed) + need;
+
+    recordLen[first] = (uint16_t)len;
+    recordStamp[first] = stamp;
+    nextRecord[first] = NONE;
+    if (queueTail[cls] == NONE) queueHead[cls] = first;
+    else nextRecord[queueTail[cls]] = first;
+    queueTail[cls] = first;
+    queuedBlocks[cls].fetch_add(need, std::memory_order_relaxed);
+
+    recordsOut++;
+    if (used * SERIAL_TX_BLOCK_SIZE > peakFill) peakFill = used * SERIAL_TX_BLOCK_SIZE;
+    if (writerTask != NULL) xTaskNotifyGive(writerTask);
+    give();
+    return true;
+  }
+
+  // Next record to send: most urgent class first, stale low-priority
+  // records dropped on the way
+  void selectNext(uint32_t now) {
+    for (uint8_t c = 0; c < OUT_CLASS_COUNT; c++) {
+      while (queueHead[c] != NONE) {
+        uint16_t r = queueHead[c];
+        if (c >= OUT_CHANGED && budgetMs != 0 && now - recordStamp[r] > budgetMs) {
+          freeChain(popQueue(c));
+          latency[c].late++;
+          continue;
+        }
+        sending = popQueue(c);
+        sendingClass = c;
+        sendBlock = sending;
+        sendPos = 0;
+        return;
+      }
+    }
+  }
+
+public:
+  explicit SerialRecordWriter(Stream& stream) : out(&stream) {
+    for (uint16_t b = 0; b < SERIAL_TX_BLOCKS; b++) {
+      nextBlock[b] = b + 1 < SERIAL_TX_BLOCKS ? b + 1 : NONE;
+    }
+    for (uint8_t c = 0; c < OUT_CLASS_COUNT; c++) {
+      queueHead[c] = queueTail[c] = NONE;
+      queuedBlocks[c].store(0, std::memory_order_relaxed);
+    }
+    memset(latency, 0, sizeof(latency));
+  }
+
+  // Attach the writer task (notified when records are queued)
+  void begin(TaskHandle_t task) {
+    if (lock == NULL) lock = xSemaphoreCreateMutex();
+    writerTask = task;
+  }
+
+  // Everything written between begin/endRecord() is queued as one unit;
+  // stamp is when the report behind it arrived
+  void beginRecord(OutputClass cls = OUT_CONSOLE, uint32_t stamp = millis()) {
+    staged = 0;
+    overflow = false;
+    inRecord = true;
+    stagedClass = cls;
+    stagedStamp = stamp;
+  }
+
+  bool endRecord() {
+    inRecord = false;
+    if (overflow) {
+      recordsDropped++;
+      return false;
+    }
+    return enqueue(record, staged, stagedClass, stagedStamp);
+  }
+
+  // Queue a ready-made record (binary frame, CSV/JSON line)
+  bool writeRecord(const uint8_t* data, size_t len, OutputClass cls = OUT_CONSOLE,
+                   uint32_t stamp = millis()) {
+    return enqueue(data, len, cls, stamp);
+  }
+
+  size_t write(uint8_t c) override {
+    return write(&c, 1);
+  }
+
+  size_t write(const uint8_t* data, size_t len) override {
+    if (!inRecord) return enqueue(data, len, OUT_CONSOLE, millis()) ? len : 0;
+    if (staged + len > sizeof(record)) {
+      overflow = true;
+      return 0;
+    }
+    memcpy(&record[staged], data, len);
+    staged += len;
+    return len;
+  }
+  using Print::write;
+
+  // Writer task side: push as much of the current record as the port
+  // accepts right now without blocking. Returns bytes written.
+  size_t pump() {
+    if (idle()) return 0;
+    int room = out->availableForWrite();
+    if (room <= 0) return 0;
+
+    take();
+    if (sending == NONE) selectNext(millis());
+    if (sending == NONE) {
+      give();
+      return 0;
+    }
+    uint16_t offset = sendPos % SERIAL_TX_BLOCK_SIZE;
+    size_t chunk = SERIAL_TX_BLOCK_SIZE - offset;
+    if (chunk > (size_t)(recordLen[sending] - sendPos)) chunk = recordLen[sending] - sendPos;
+    if (chunk > (size_t)room) chunk = room;
+    const uint8_t* data = &pool[sendBlock][offset];
+    give();
+
+    // Blocks of the record being sent are never touched by producers
+    size_t n = out->write(data, chunk);
+    if (n == 0) return 0;
+
+    take();
+    sendPos += n;
+    bool done = sendPos == recordLen[sending];
+    if (done || sendPos % SERIAL_TX_BLOCK_SIZE == 0) {
+      uint16_t b = sendBlock;
+      sendBlock = nextBlock[b];
+      freeBlock(b);
+    }
+    if (done) {
+      uint32_t age = millis() - recordStamp[sending];
+      OutputLatency& l = latency[sendingClass];
+      l.sent++;
+      l.totalMs += age;
+      if (age > l.maxMs) l.maxMs = age;
+      sending = NONE;
+    }
+    give();
+    bytesOut.fetch_add(n, std::memory_order_relaxed);
+    return n;
+  }
+
+  bool idle() const { return usedBlocks.load(std::memory_order_acquire) == 0; }
+  // Room for a record of class cls: free blocks plus those it may evict
+  uint32_t space(OutputClass cls = OUT_REFRESH) const {
+    uint32_t blocks = SERIAL_TX_BLOCKS - usedBlocks.load(std::memory_order_acquire);
+    for (uint8_t c = cls + 1; c < OUT_CLASS_COUNT; c++) {
+      blocks += queuedBlocks[c].load(std::memory_order_relaxed);
+    }
+    return blocks * SERIAL_TX_BLOCK_SIZE;
+  }
+
+  // Wait (from another task) until queued output has been sent
+  void waitIdle(uint32_t timeoutMs) {
+    unsigned long start = millis();
+    while (!idle() && millis() - start < timeoutMs) delay(5);
+  }
+
+  // Changed/refresh records waiting longer than this are dropped (0 = never)
+  void setLatencyBudget(uint32_t ms) { budgetMs = ms; }
+  uint32_t latencyBudget() const { return budgetMs; }
+
+  // Consistent copy of one class's latency counters
+  OutputLatency classLatency(OutputClass cls) {
+    take();
+    OutputLatency l = latency[cls];
+    give();
+    return l;
+  }
+
+  uint32_t bytesWritten() const { return bytesOut.load(std::memory_order_relaxed); }
+  uint32_t recordsWritten() const { return recordsOut; }
+  uint32_t droppedRecords() const {
+    uint32_t n = recordsDropped;
+    for (uint8_t c = 0; c < OUT_CLASS_COUNT; c++) {
+      n += latency[c].full + latency[c].evicted + latency[c].late;
+    }
+    return n;
+  }
+  uint32_t peakBytes() const { return peakFill; }
+  uint32_t fifoSize() const { return SERIAL_TX_FIFO_SIZE; }
+
+  // Only call while the report consumer is idle
+  void resetStats() {
+    take();
+    bytesOut.store(0, std::memory_order_relaxed);
+    recordsOut = 0;
+    recordsDropped = 0;
+    peakFill = 0;
+    memset(latency, 0, sizeof(latency));
+    give();
+  }
+
+  // Start a new peak measurement while output keeps flowing
+  void resetPeak() {
+    take();
+    peakFill = 0;
+    for (uint8_t c = 0; c < OUT_CLASS_COUNT; c++) latency[c].maxMs = 0;
+    give();
+  }
+};
+
+// Print front end for one task other than the report consumer (command
+// responses, status listings). Text is queued a line at a time, so it only
+// ever interleaves with report output between lines; when the pool is full
+// it waits a little for room instead of dropping the line.
+#ifndef RECORD_PRINT_LINE_MAX
+#define RECORD_PRINT_LINE_MAX 256
+#endif
+
+class RecordPrint : public Print {
+private:
+  SerialRecordWriter& sink;
+  uint8_t line[RECORD_PRINT_LINE_MAX];
+  size_t used = 0;
+  uint32_t waitMs;
+
+public:
+  explicit RecordPrint(SerialRecordWriter& writer, uint32_t maxWaitMs = 500)
+    : sink(writer), waitMs(maxWaitMs) {}
+
+  size_t write(uint8_t c) override {
+    line[used++] = c;
+    if (c == '\n' || used == sizeof(line)) sendPending();
+    return 1;
+  }
+
+  size_t write(const uint8_t* data, size_t len) override {
+    for (size_t i = 0; i < len; i++) write(data[i]);
+    return len;
+  }
+  using Print::write;
+
+  // Queue a partial line now (prompts, echoed keystrokes)
+  void sendPending() {
+    if (used == 0) return;
+    unsigned long start = millis();
+    while (sink.space(OUT_CONSOLE) < used && millis() - start < waitMs) delay(5);
+    sink.writeRecord(line, used);
+    used = 0;
+  }
+};
+
+#endif // SERIAL_WRITER_H
@@ -0,0 +1,86 @@
+/*
+ * Signal Statistics
+ * Per-device RSSI and advertising-interval estimators, integer-only and
+ * O(1) per report. Both are exponentially weighted moving averages with
+ * alpha = 1/2^SIGNAL_EWMA_SHIFT; the first samples use 1/n instead so a
+ * fresh device converges immediately rather than from zero.
+ */
+
+#ifndef SIGNAL_STATS_H
+#define SIGNAL_STATS_H
+
+#include <stdint.h>
+
+// Smoothing: alpha = 1/8 averages roughly the last 8 reports
+#ifndef SIGNAL_EWMA_SHIFT
+#define SIGNAL_EWMA_SHIFT 3
+#endif
+
+// Shortest advertising interval in the spec; shorter gaps are scan
+// responses or repeats on another channel, not the device's schedule
+#define SIGNAL_GAP_MIN_MS 20
+
+struct SignalStats {
+  int16_t  rssiQ4 = 0;       // smoothed RSSI, dBm in Q4 (1/16 dB)
+  int8_t   rssiMin = 0;
+  int8_t   rssiMax = 0;
+  uint16_t count = 0;        // reports, saturating
+  uint16_t intervalMs = 0;   // smoothed time between reports (0 = one report so far)
+  uint16_t gapMinMs = 0;     // shortest gap of at least SIGNAL_GAP_MIN_MS (0 = none yet):
+                             // close to the advertising interval, whatever is missed
+
+  // Divisor for the next sample after 'samples' earlier ones: 1/n warm-up,
+  // then the fixed alpha
+  static int32_t weight(uint16_t samples) {
+    return samples < (1 << SIGNAL_EWMA_SHIFT) ? samples + 1 : (1 << SIGNAL_EWMA_SHIFT);
+  }
+
+  // gapMs: time since the previous report of this device (ignored for the first)
+  void add(int8_t rssi, uint32_t gapMs) {
+    int16_t sample = (int16_t)(rssi * 16);
+    if (count == 0) {
+      rssiQ4 = sample;
+      rssiMin = rssiMax = rssi;
+      count = 1;
+      return;
+    }
+
+    rssiQ4 = (int16_t)(rssiQ4 + (sample - rssiQ4) / weight(count));
+    if (rssi < rssiMin) rssiMin = rssi;
+    if (rssi > rssiMax) rssiMax = rssi;
+
+    int32_t gap = gapMs > 0xFFFF ? 0xFFFF : (int32_t)gapMs;
+    uint16_t gaps = count - 1;   // interval samples so far
+    intervalMs = (uint16_t)(gaps == 0 ? gap : intervalMs + (gap - intervalMs) / weight(gaps));
+    if (gap >= SIGNAL_GAP_MIN_MS && (gapMinMs == 0 || gap < gapMinMs)) gapMinMs = (uint16_t)gap;
+    if (count < 0xFFFF) count++;
+  }
+
+  // Carry on from earlier statistics of the same advertiser (a new
+  // address): counts add up, the RSSI average is weighted by report count
+  // and the interval stays the earlier, longer-running estimate
+  void mergeEarlier(const SignalStats& earlier) {
+    if (earlier.count == 0) return;
+    if (count == 0) {
+      *this = earlier;
+      return;
+    }
+    int32_t total = (int32_t)earlier.count + count;
+    rssiQ4 = (int16_t)((earlier.rssiQ4 * (int32_t)earlier.count + rssiQ4 * (int32_t)count) / total);
+    if (earlier.rssiMin < rssiMin) rssiMin = earlier.rssiMin;
+    if (earlier.rssiMax > rssiMax) rssiMax = earlier.rssiMax;
+    if (earlier.intervalMs > 0) intervalMs = earlier.intervalMs;
+    if (earlier.gapMinMs > 0 && (gapMinMs == 0 || earlier.gapMinMs < gapMinMs)) {
+      gapMinMs = earlier.gapMinMs;
+    }
+    count = (uint16_t)(total > 0xFFFF ? 0xFFFF : total);
+  }
+
+  // Smoothed RSSI rounded to whole dBm
+  int8_t rssi() const { return (int8_t)((rssiQ4 + 8) >> 4); }
+
+  // Reports per 10 s from the smoothed interval (0 if unknown)
+  uint16_t ratePer10s() const { return intervalMs ? (uint16_t)(10000u / intervalMs) : 0; }
+};
+
+#endif // SIGNAL_STATS_H
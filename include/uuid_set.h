@@ -0,0 +1,123 @@
+/*
+ * UUID Set
+ * Service UUID filter patterns parsed once into 16/32/128-bit values and
+ * matched against every UUID an AdView collected (sets in the filter arena)
+ */
+
+#ifndef UUID_SET_H
+#define UUID_SET_H
+
+#include <stdint.h>
+#include <string.h>
+#include "filter_arena.h"
+#include "ad_parser.h"
+#include "image_io.h"
+
+class UuidSet {
+private:
+  struct Uuid128 { uint8_t bytes[16]; };  // little-endian, as in AD data
+
+  ArenaVector<uint16_t> set16;
+  ArenaVector<uint32_t> set32;
+  ArenaVector<Uuid128>  set128;
+
+  bool has16(uint16_t uuid) const {
+    for (uint16_t u : set16) if (u == uuid) return true;
+    return false;
+  }
+
+  bool has32(uint32_t uuid) const {
+    for (uint32_t u : set32) if (u == uuid) return true;
+    // 16-bit patterns also match the equivalent 32-bit alias
+    return (uuid >> 16) == 0 && has16((uint16_t)uuid);
+  }
+
+  // The lower 96 bits of the Bluetooth Base UUID
+  // 00000000-0000-1000-8000-00805F9B34FB, little-endian
+  static bool isBaseUuid(const uint8_t* u) {
+    static const uint8_t base[12] = { 0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00,
+                                      0x00, 0x80, 0x00, 0x10, 0x00, 0x00 };
+    return memcmp(u, base, sizeof(base)) == 0;
+  }
+
+public:
+  // "FD6F", "D0611E78" or a full 128-bit UUID (dashes optional).
+  // Returns false for any other length or non-hex text.
+  bool add(const char* text) {
+    uint8_t digits[32];
+    size_t n = 0;
+    for (const char* p = text; *p; p++) {
+      char c = *p;
+      uint8_t d;
+      if (c >= '0' && c <= '9')      d = c - '0';
+      else if (c >= 'A' && c <= 'F') d = c - 'A' + 10;
+      else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+      else if (c == '-' || c == ' ') continue;
+      else return false;
+      if (n == sizeof(digits)) return false;
+      digits[n++] = d;
+    }
+
+    uint32_t value = 0;
+    if (n == 4 || n == 8) {
+      for (size_t i = 0; i < n; i++) value = (value << 4) | digits[i];
+      if (n == 4) set16.push_back((uint16_t)value);
+      else set32.push_back(value);
+      return true;
+    }
+
+    if (n == 32) {
+      Uuid128 u;
+      for (size_t i = 0; i < 16; i++) {
+        u.bytes[15 - i] = (uint8_t)((digits[2 * i] << 4) | digits[2 * i + 1]);
+      }
+      set128.push_back(u);
+      return true;
+    }
+    return false;
+  }
+
+  bool matches(const AdView& view) const {
+    if (empty()) return false;
+
+    for (uint8_t i = 0; i < view.uuid16Count; i++) {
+      if (has32(view.uuid16[i])) return true;
+    }
+    for (uint8_t i = 0; i < view.uuid32Count; i++) {
+      if (has32(view.uuid32[i])) return true;
+    }
+    for (uint8_t i = 0; i < view.uuid128Count; i++) {
+      const uint8_t* u = view.uuid128At(i);
+      // A 128-bit form of a 16/32-bit UUID matches those patterns too;
+      // any other 128-bit UUID only matches a full 128-bit pattern
+      if (isBaseUuid(u) && has32(adRead32(u + 12))) return true;
+      for (const auto& p : set128) {
+        if (memcmp(p.bytes, u, 16) == 0) return true;
+      }
+    }
+    return false;
+  }
+
+  void clear() {
+    set16.clear();
+    set32.clear();
+    set128.clear();
+  }
+
+  template <typename Out>
+  void save(Out& out) const {
+    imagePutVector(out, set16);
+    imagePutVector(out, set32);
+    imagePutVector(out, set128);
+  }
+
+  template <typename In>
+  bool load(In& in) {
+    return imageGetVector(in, set16) && imageGetVector(in, set32) &&
+           imageGetVector(in, set128);
+  }
+
+  bool empty() const { return set16.empty() && set32.empty() && set128.empty(); }
+};
+
+#endif // UUID_SET_H
@@ -0,0 +1,212 @@
+"""
+Generate include/ble_filter_tables_generated.h from data/blacklist.txt and
+data/whitelist.txt.
+
+OUIs and full MAC addresses become sorted constexpr integer tables that the
+firmware searches in place (flash), so the complete lists cost no RAM and
+no startup parsing. Names, UUIDs, payload patterns and odd-length prefixes
+are emitted as string tables and compiled at boot.
+
+Runs as a PlatformIO pre-build script (extra_scripts = pre:...), or by hand:
+    python3 scripts/gen_filter_tables.py
+The header is only rewritten when its content changes.
+"""
+
+import os
+import re
+import sys
+import zlib
+
+SECTIONS = ("OUI", "NAME", "UUID", "PAYLOAD")
+LISTS = (("BLACKLIST", "blacklist.txt"), ("WHITELIST", "whitelist.txt"))
+OUTPUT = os.path.join("include", "ble_filter_tables_generated.h")
+
+
+class DataError(Exception):
+    pass
+
+
+def parse_file(path):
+    """Returns {section: [(line number, text), ...]} for one data file."""
+    entries = {s: [] for s in SECTIONS}
+    section = None
+    with open(path, encoding="utf-8") as f:
+        for number, line in enumerate(f, 1):
+            text = line.split("#", 1)[0].strip()
+            if not text:
+                continue
+            header = re.fullmatch(r"\[(\w+)\]", text)
+            if header:
+                section = header.group(1).upper()
+                if section not in SECTIONS:
+                    raise DataError("%s:%d: unknown section [%s]" % (path, number, section))
+                continue
+            if section is None:
+                raise DataError("%s:%d: entry before the first [SECTION]" % (path, number))
+            entries[section].append((number, text))
+    return entries
+
+
+def hex_digits(text, separators):
+    digits = "".join(c for c in text if c not in separators)
+    if not digits or not re.fullmatch(r"[0-9A-Fa-f]+", digits):
+        return None
+    return digits.upper()
+
+
+def build_list(path):
+    entries = parse_file(path)
+    ouis, macs, prefixes = set(), set(), []
+    names, uuids, payloads = [], [], []
+
+    # Same normalization as MacPrefixTable::parse / UuidSet::add / parseHexPattern
+    for number, text in entries["OUI"]:
+        digits = hex_digits(text, ":-. ")
+        if digits is None or len(digits) > 12:
+            raise DataError("%s:%d: not a MAC/OUI prefix: %s" % (path, number, text))
+        if len(digits) == 6:
+            ouis.add(int(digits, 16))
+        elif len(digits) == 12:
+            macs.add(int(digits, 16))
+        elif digits not in prefixes:
+            prefixes.append(digits)
+
+    for number, text in entries["NAME"]:
+        if text.upper() not in names:
+            names.append(text.upper())
+
+    for number, text in entries["UUID"]:
+        digits = hex_digits(text, "- ")
+        if digits is None or len(digits) not in (4, 8, 32):
+            raise DataError("%s:%d: UUID must be 4, 8 or 32 hex digits: %s" % (path, number, text))
+        if digits not in uuids:
+            uuids.append(digits)
+
+    for number, text in entries["PAYLOAD"]:
+        digits = hex_digits(text, ":- ")
+        if digits is None or len(digits) % 2 or len(digits) > 62:
+            raise DataError("%s:%d: payload must be whole hex bytes (max 31): %s" % (path, number, text))
+        if digits not in payloads:
+            payloads.append(digits)
+
+    return {
+        "ouis": sorted(ouis), "macs": sorted(macs), "prefixes": prefixes,
+        "names": names, "uuids": uuids, "payloads": payloads,
+    }
+
+
+def c_string(text):
+    return '"%s"' % text.replace("\\", "\\\\").replace('"', '\\"')
+
+
+def emit_array(out, ctype, name, values, fmt, per_line):
+    if not values:
+        return "nullptr"
+    out.append("static constexpr %s %s[] = {" % (ctype, name))
+    for i in range(0, len(values), per_line):
+        out.append("  " + ", ".join(fmt(v) for v in values[i:i + per_line]) + ",")
+    out.append("};")
+    out.append("")
+    return name
+
+
+def generate(project_dir):
+    out = [
+        "/*",
+        " * Built-in Filter Tables",
+        " * GENERATED by scripts/gen_filter_tables.py from data/blacklist.txt and",
+        " * data/whitelist.txt - edit the data files, not this header.",
+        " *",
+        " * The OUI and MAC tables are sorted and constexpr, so they stay in flash",
+        " * and MacPrefixTable searches them in place.",
+        " */",
+        "",
+        "#ifndef BLE_FILTER_TABLES_GENERATED_H",
+        "#define BLE_FILTER_TABLES_GENERATED_H",
+        "",
+        "#include <stdint.h>",
+        "#include <stddef.h>",
+        "",
+        "struct BuiltinFilterTable {",
+        "  const uint32_t*    ouis;        // 24-bit OUIs, sorted",
+        "  uint16_t           ouiCount;",
+        "  const uint64_t*    macs;        // 48-bit addresses, sorted",
+        "  uint16_t           macCount;",
+        "  const char* const* prefixes;    // other prefix lengths, as hex text",
+        "  uint16_t           prefixCount;",
+        "  const char* const* names;",
+        "  uint16_t           nameCount;",
+        "  const char* const* uuids;",
+        "  uint16_t           uuidCount;",
+        "  const char* const* payloads;",
+        "  uint16_t           payloadCount;",
+        "};",
+        "",
+    ]
+
+    for prefix, filename in LISTS:
+        path = os.path.join(project_dir, "data", filename)
+        tables = build_list(path) if os.path.exists(path) else build_list(os.devnull)
+        out.append("// data/%s" % filename)
+        refs = [
+            emit_array(out, "uint32_t", "BUILTIN_%s_OUIS" % prefix, tables["ouis"],
+                       lambda v: "0x%06X" % v, 8),
+            emit_array(out, "uint64_t", "BUILTIN_%s_MACS" % prefix, tables["macs"],
+                       lambda v: "0x%012XULL" % v, 4),
+            emit_array(out, "const char*", "BUILTIN_%s_PREFIXES" % prefix, tables["prefixes"],
+                       c_string, 8),
+            emit_array(out, "const char*", "BUILTIN_%s_NAMES" % prefix, tables["names"],
+                       c_string, 8),
+            emit_array(out, "const char*", "BUILTIN_%s_UUIDS" % prefix, tables["uuids"],
+                       c_string, 4),
+            emit_array(out, "const char*", "BUILTIN_%s_PAYLOADS" % prefix, tables["payloads"],
+                       c_string, 8),
+        ]
+        counts = [len(tables[k]) for k in ("ouis", "macs", "prefixes", "names", "uuids", "payloads")]
+        out.append("static constexpr BuiltinFilterTable BUILTIN_%s = {" % prefix)
+        for ref, count in zip(refs, counts):
+            out.append("  %s, %d," % (ref, count))
+        out.append("};")
+        out.append("")
+
+    # Stored filter images record this, so a firmware with other built-in
+    # lists does not boot into a copy of the old ones (see filter_store.h)
+    tables_hash = zlib.crc32("\n".join(out).encode("utf-8"))
+    out.append("// CRC-32 of the tables above")
+    out.append("#define BUILTIN_FILTER_TABLES_HASH 0x%08Xu" % tables_hash)
+    out.append("")
+    out.append("#endif // BLE_FILTER_TABLES_GENERATED_H")
+    return "\n".join(out) + "\n"
+
+
+def write_if_changed(path, content):
+    try:
+        with open(path, encoding="utf-8") as f:
+            if f.read() == content:
+                return False
+    except FileNotFoundError:
+        pass
+    with open(path, "w", encoding="utf-8", newline="\n") as f:
+        f.write(content)
+    return True
+
+
+def run(project_dir):
+    try:
+        content = generate(project_dir)
+    except DataError as e:
+        sys.stderr.write("gen_filter_tables: %s\n" % e)
+        sys.exit(1)
+    if write_if_changed(os.path.join(project_dir, OUTPUT), content):
+        print("gen_filter_tables: wrote %s" % OUTPUT)
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+except NameError:
+    env = None
+
+if env is not None:
+    run(env.subst("$PROJECT_DIR"))
+elif __name__ == "__main__":
+    run(os.path.dirname(os.path.dirname(os.path.abspath(sys.argv[0]))))
@@ -6,13 +6,35 @@
  * - Clean output without emojis
  * - Detailed beacon and payload information
  * - Whitelist/Blacklist filtering via text files
- * - Interactive command mode
+ * - Command shell that stays responsive while scanning
  * - Color-coded AD structures
  */
 
 #include <Arduino.h>
 #include <bluefruit.h>
-#include "ble_filter_config_builtin.h"  // Built-in filters, no filesystem needed
+#include <algorithm>
+#include "ble_filter_config_builtin.h"  // Built-in filters (first-boot default)
+#include "filter_store.h"               // Compiled filters persisted in internal flash
+#include "adv_report_ring.h"
+#include "adv_reassembly.h"
+#include "device_table.h"
+#include "ad_parser.h"
+#include "binary_record.h"
+#include "line_buffer.h"
+#include "serial_writer.h"
+#include "command_line.h"
+#include "scan_scheduler.h"
+#include "change_mask.h"
+#include "ad_decoders.h"
+#include "signal_stats.h"
+#include "seen_devices.h"
+#include "qspi_flash.h"
+#include "flash_log.h"
+#include "perf_counters.h"
+#include "heap_monitor.h"
+#include "irk_resolver.h"
+#include "rotation_linker.h"
+#include "scan_pairing.h"
 
 // Color configuration - Set to false if your terminal doesn't support ANSI colors
 #define ENABLE_COLORS true
@@ -51,57 +73,244 @@
   #define COLOR_BRIGHT_CYAN    ""
 #endif
 
-// BLE AD Type codes (from Bluetooth specification)
-#define AD_TYPE_FLAGS                    0x01
-#define AD_TYPE_16BIT_SERVICE_UUIDS      0x03
-#define AD_TYPE_COMPLETE_LOCAL_NAME      0x09
-#define AD_TYPE_TX_POWER                 0x0A
-#define AD_TYPE_SERVICE_DATA_16BIT       0x16
-#define AD_TYPE_MANUFACTURER_DATA        0xFF
-#define AD_TYPE_128BIT_SERVICE_UUIDS     0x07
-
-// Scan configuration
-static uint32_t g_scanTimeSeconds = 10;  // Default 10 seconds
-static bool g_autoScan = false;          // Manual mode by default
-static bool g_colorsEnabled = ENABLE_COLORS;  // Runtime color toggle
-static bool g_deduplication = true;      // Deduplication enabled by default
-
-// Statistics
+// Scan configuration (set by the command task, read by the scan and
+// consumer tasks)
+static volatile uint32_t g_scanTimeSeconds = 10;  // Default 10 seconds
+static volatile bool g_autoScan = false;          // Manual mode by default
+static volatile bool g_scanRequested = false;     // 's' command: one timed scan pending
+static volatile bool g_colorsEnabled = ENABLE_COLORS;  // Runtime color toggle
+static volatile bool g_deduplication = true;      // Deduplication enabled by default
+static volatile uint32_t g_deviceTtlSeconds = 60; // Forget devices unseen this long (0 = never)
+static volatile int8_t g_rssiFloor = -127;         // Stack drops weaker reports ('l' command, -127 = off)
+
+// Output modes (selected with the 'o' command)
+enum OutputMode {
+  OUTPUT_HUMAN,    // Banners, hex dump and AD structure breakdown
+  OUTPUT_BINARY,   // COBS-framed binary records (docs/binary_protocol.md)
+  OUTPUT_CSV,      // One CSV line per new/changed device
+  OUTPUT_JSON,     // One JSON object per line per new/changed device
+  OUTPUT_TOP,      // No per-report output; periodic top-N signal table
+  OUTPUT_CENSUS,   // No per-report output; sorted device census per epoch
+  OUTPUT_MODE_COUNT
+};
+static const char* const OUTPUT_MODE_NAMES[OUTPUT_MODE_COUNT] = {
+  "human", "binary", "csv", "json", "top", "census"
+};
+static const char* const OUTPUT_CLASS_NAMES[OUT_CLASS_COUNT] = {
+  "console", "target", "changed", "refresh"
+};
+static const char* const CSV_HEADER =
+  "timestamp_ms,mac,addr_type,rssi,event,name,company_id,uuid16,payload,identity,decoded\n";
+static volatile OutputMode g_outputMode = OUTPUT_HUMAN;
+
+// Bluetooth 5 extended advertising scan (selected with the 'e' command).
+// 2M is a secondary (AUX) PHY only, so it is received in both modes.
+enum ExtScanMode {
+  EXT_SCAN_OFF,    // legacy advertising only
+  EXT_SCAN_1M,     // extended advertising, 1M primary channels
+  EXT_SCAN_CODED,  // extended advertising, 1M + Coded (long range) primary
+  EXT_SCAN_MODE_COUNT
+};
+static const char* const EXT_SCAN_NAMES[EXT_SCAN_MODE_COUNT] = {
+  "off", "1m", "coded"
+};
+static ExtScanMode g_extScan = EXT_SCAN_OFF;
+
+// Statistics - running totals; summaries report the difference between
+// two snapshots so counters never need resetting while the radio runs
 static uint32_t g_scanCount = 0;
 static uint32_t g_deviceCount = 0;
 static uint32_t g_filteredCount = 0;
+static uint32_t g_rejectedEarlyCount = 0;   // filtered in the callback, never queued
 static uint32_t g_duplicateCount = 0;
+static uint32_t g_heldCount = 0;
+static uint32_t g_displayedCount = 0;
+static uint32_t g_newDeviceCount = 0;
+static uint32_t g_expiredCount = 0;
+static uint32_t g_rotationCount = 0;
+static uint32_t g_chainCount = 0;
+
+// Report pipeline: scan_callback only copies into the ring, the consumer
+// task does filtering, deduplication and output
+#define CONSUMER_STACK_SIZE 1024  // words
+static AdvReportRing g_reportRing;
+static AdvReassembler g_reassembler;  // chained extended advertisements (callback only)
+static ScanPairer g_pairer;           // advertisements waiting for their scan response (consumer only)
+static volatile bool g_pairScanResponses = false;  // active scanning: responses can follow
+static TaskHandle_t g_consumerTask = NULL;
+
+#if BLE_PERF
+static PerfCounters g_perf;  // per-stage cycle counts ('z' command)
+#endif
+
+// Report output: queued per record and drained to Serial by the writer task
+#define WRITER_STACK_SIZE 256  // words
+static SerialRecordWriter g_out(Serial);
+static TaskHandle_t g_writerTask = NULL;
+
+// Command shell: its own task reads the serial input a line at a time and
+// answers through g_console, which queues behind the report output
+#define COMMAND_STACK_SIZE 1024  // words
+static CommandLine g_commandLine;
+static RecordPrint g_console(g_out);
+static TaskHandle_t g_commandTask = NULL;
+
+// Scan loop output (scan banners, scanner messages): a RecordPrint keeps
+// one partial line, so each task that prints into the record stream has its own
+static RecordPrint g_scanConsole(g_out);
+
+// Recorder: the displayed reports as binary frames in external flash, for
+// surveys without a host (r command, see flash_log.h). An armed recorder
+// (marker file in internal flash) records from boot and does not wait
+// for the USB host.
+#define RECORDER_STACK_SIZE 256       // words
+#define RECORD_ARM_PATH     "/record.on"
+#define RECORD_HOST_WAIT_MS 3000      // armed: how long boot waits for a host
+#define RECORD_DUMP_STALL_MS 2000     // dump gives up when the host stops reading
+static QspiFlash g_flash;
+static FlashLog<QspiFlash> g_log(g_flash);
+static TaskHandle_t g_recorderTask = NULL;
+static volatile bool g_recording = false;
+
+// Heap watermark and allocation counts ('u' command, summaries)
+static HeapMonitor g_heapMonitor;
 
-// Device tracking for deduplication
-struct SeenDevice {
-  String mac;
-  String name;
-  String payload;
-  int rssi;
-  uint32_t lastSeen;
+#if HEAP_MONITOR_WRAP
+// The linker sends every malloc/free call here (-Wl,--wrap=...); a realloc
+// of an existing block counts as one free plus one allocation
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void  __real_free(void* ptr);
+
+static void* countAllocation(void* p) {
+  HeapCounters& c = heapCounters();
+  if (p != NULL) c.allocs.fetch_add(1);
+  else c.failures.fetch_add(1);
+  return p;
+}
+
+void* __wrap_malloc(size_t size) { return countAllocation(__real_malloc(size)); }
+void* __wrap_calloc(size_t count, size_t size) { return countAllocation(__real_calloc(count, size)); }
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  void* p = __real_realloc(ptr, size);
+  if (ptr != NULL && (size == 0 || p != NULL)) heapCounters().frees.fetch_add(1);
+  return size == 0 ? p : countAllocation(p);
+}
+
+void __wrap_free(void* ptr) {
+  if (ptr != NULL) heapCounters().frees.fetch_add(1);
+  __real_free(ptr);
+}
+}
+#endif
+
+// Commands that ask follow-up questions (b, w, i) take the answers from
+// the next lines
+enum ShellState {
+  SHELL_COMMAND,
+  SHELL_FILTER_KIND,    // b/w: which kind of entry
+  SHELL_FILTER_VALUE,   // b/w: the entry itself
+  SHELL_PICK_DEVICE,    // i: device number from the list
+  SHELL_PICK_ACTION     // i: what to filter for that device
 };
+#define PICK_LIST_MAX 20
+
+static ShellState g_shellState = SHELL_COMMAND;
+static bool g_shellWhitelist = false;          // b or w
+static char g_shellKind = 0;                   // b/w menu choice '1'-'5'
+static DeviceKey g_pickKeys[PICK_LIST_MAX];    // i: listed devices, most recent first
+static int g_pickCount = 0;
+static String g_pickMac;
+static String g_pickName;
+
+static const char BANNER[] =
+  "================================================================================";
 
-static std::vector<SeenDevice> g_seenDevices;
+// Device tracking for deduplication, signal statistics and the census
+// (SeenDevice and the dedup step live in seen_devices.h)
+static DeviceTable<SeenDevice, DEVICE_TABLE_CAPACITY> g_seenDevices;
+static RotationLinker<DEVICE_TABLE_CAPACITY> g_linker;  // random addresses across rotations
+static ChangeMasks g_changeMasks;    // what counts as a payload change
+static ChangePolicy g_changePolicy;  // when a change is worth reporting
+static SemaphoreHandle_t g_deviceLock = NULL;  // consumer vs. command-side access
+static volatile bool g_scannerRunning = false;  // devices only age while scanning
 
-// Filter instance
+// Scan interval/window and active/passive selection
+static ScanScheduler g_scheduler;
+static SemaphoreHandle_t g_scanLock = NULL;  // scanner start/stop/parameters (scan vs. command task)
+
+// Controller accept list: a whitelist of nothing but full MACs is handed
+// to the SoftDevice, each MAC as a public and a random static address
+#define ACCEPT_LIST_MACS (BLE_GAP_WHITELIST_ADDR_MAX_COUNT / 2)
+static ble_gap_addr_t g_acceptList[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+static uint8_t g_acceptCount = 0;   // entries in g_acceptList, 0 = accept all (under g_scanLock)
+
+// Filters: lookups from the consumer never lock; edits from the command
+// task publish a new compiled snapshot (see ble_filter_config_builtin.h)
 static BLEFilter g_filter;
+static FilterStore g_filterStore;
+static uint32_t g_filterSavedRevision = 0;  // g_filter.revision() last written to flash
+
+// Identity keys of known devices: their rotating private addresses are
+// filtered and tracked under one identity address (n command, see
+// irk_resolver.h). The consumer resolves under g_deviceLock; edits take it too.
+#define IRK_STORE_PATH  "/irks.bin"
+#define IRK_STORE_MAGIC 0x4B524942   // "BIRK"
+
+struct IrkStoreHeader {
+  uint32_t magic;
+  uint16_t count;
+  uint16_t crc;   // CRC-16 of the entries
+};
+
+// One AES-128 block on the ECB peripheral, which only the SoftDevice may
+// drive while it is enabled
+struct SoftDeviceEcb {
+  static bool encrypt(const uint8_t* key, const uint8_t* in, uint8_t* out) {
+    nrf_ecb_hal_data_t ecb;
+    memcpy(ecb.key, key, sizeof(ecb.key));
+    memcpy(ecb.cleartext, in, sizeof(ecb.cleartext));
+    if (sd_ecb_block_encrypt(&ecb) != NRF_SUCCESS) return false;
+    memcpy(out, ecb.ciphertext, sizeof(ecb.ciphertext));
+    return true;
+  }
+};
+
+static IrkResolver<SoftDeviceEcb> g_irks;
+static bool g_irkReady = false;   // AES self-test passed (needs the SoftDevice)
 
 // Forward declarations
-void processCommand();
+static void saveFilters(Print& out);
 void addToBlacklist();
 void addToWhitelist();
 void interactiveFilter();
 
-// Helper: Convert bytes to hex string
-static String toHex(const uint8_t* data, size_t len) {
+// Helper: Format a little-endian BLE address as AA:BB:CC:DD:EE:FF
+static void formatMac(const uint8_t* addr, char* out) {
+  sprintf(out, "%02X:%02X:%02X:%02X:%02X:%02X",
+          addr[5], addr[4], addr[3], addr[2], addr[1], addr[0]);
+}
+
+// Helper: Copy raw (unterminated) name bytes into a String
+static String nameToString(const uint8_t* name, size_t len) {
   String s;
-  s.reserve(len * 2);
+  s.reserve(len);
+  for (size_t i = 0; i < len; i++) s += (char)name[i];
+  return s;
+}
+
+static String seenName(const SeenDevice& dev) {
+  return nameToString((const uint8_t*)dev.name, strnlen(dev.name, SEEN_NAME_MAX));
+}
+
+// Helper: Print bytes as hex without building a String
+static void printHex(const uint8_t* data, size_t len) {
   for (size_t i = 0; i < len; i++) {
-    if (data[i] < 0x10) s += '0';
-    s += String(data[i], HEX);
+    g_out.printf("%02X", data[i]);
   }
-  s.toUpperCase();
-  return s;
 }
 
 // Helper: Get AD type name and color
@@ -109,6 +318,7 @@ static const char* getADTypeColor(uint8_t type) {
   switch (type) {
     case AD_TYPE_FLAGS:                return COLOR_CYAN;
     case AD_TYPE_COMPLETE_LOCAL_NAME:  return COLOR_BRIGHT_GREEN;
+    case AD_TYPE_BROADCAST_NAME:       return COLOR_BRIGHT_GREEN;
     case AD_TYPE_16BIT_SERVICE_UUIDS:  return COLOR_BRIGHT_BLUE;
     case AD_TYPE_128BIT_SERVICE_UUIDS: return COLOR_BLUE;
     case AD_TYPE_SERVICE_DATA_16BIT:   return COLOR_BRIGHT_MAGENTA;
@@ -136,480 +346,1371 @@ static const char* getADTypeName(uint8_t type) {
     case 0x14:                         return "List of 16-bit Solicitation UUIDs";
     case 0x19:                         return "Appearance";
     case 0x1A:                         return "Advertising Interval";
+    case AD_TYPE_BROADCAST_NAME:       return "Broadcast Name";
     default:                           return "Unknown Type";
   }
 }
 
 // Helper: Print hex dump with ASCII
 static void printHexDump(const uint8_t* data, size_t len, const char* label) {
-  Serial.println(label);
-  Serial.println("  Offset  Hex                                              ASCII");
-  Serial.println("  ------  -----------------------------------------------  ----------------");
+  static const char digits[] = "0123456789ABCDEF";
+  
+  g_out.println(label);
+  g_out.println("  Offset  Hex                                              ASCII");
+  g_out.println("  ------  -----------------------------------------------  ----------------");
   
   for (size_t i = 0; i < len; i += 16) {
-    Serial.printf("  0x%04X  ", i);
+    // Build the whole row, then write it once
+    char row[96];
+    int n = sprintf(row, "  0x%04X  ", (unsigned)i);
     
     // Hex values
     for (size_t j = 0; j < 16; j++) {
       if (i + j < len) {
-        Serial.printf("%02X ", data[i + j]);
+        row[n++] = digits[data[i + j] >> 4];
+        row[n++] = digits[data[i + j] & 0x0F];
       } else {
-        Serial.print("   ");
+        row[n++] = ' ';
+        row[n++] = ' ';
       }
-      if (j == 7) Serial.print(" ");
+      row[n++] = ' ';
+      if (j == 7) row[n++] = ' ';
     }
     
-    Serial.print(" ");
+    row[n++] = ' ';
     
     // ASCII
     for (size_t j = 0; j < 16 && i + j < len; j++) {
       uint8_t c = data[i + j];
-      Serial.write((c >= 32 && c <= 126) ? c : '.');
+      row[n++] = (c >= 32 && c <= 126) ? c : '.';
     }
     
-    Serial.println();
+    row[n++] = '\r';
+    row[n++] = '\n';
+    g_out.write((const uint8_t*)row, n);
+  }
+  g_out.println();
+}
+
+// Helper: Print the decoded fields of a known protocol, one per line
+static void printDecoded(uint8_t adType, const uint8_t* adData, size_t adDataLen, const char* color) {
+  const AdDecoder* decoder = adFindDecoder(adType, adData, adDataLen);
+  if (decoder == NULL) return;
+  g_out.printf("      %sDecoded (%s):%s\n", color, decoder->name, COLOR_RESET);
+  for (uint8_t i = 0; i < decoder->fieldCount; i++) {
+    const AdDecoderField& field = decoder->fields[i];
+    uint8_t n = adFieldLen(field, adDataLen);
+    if (n == 0) continue;
+    char value[96];
+    adFormatValue(field, adData + field.start, n, value, sizeof(value));
+    g_out.printf("        %-10s %s%s\n", field.name, value, field.rotating ? "  (rotating)" : "");
   }
-  Serial.println();
 }
 
 // Helper: Parse and print AD structures with color coding
-static void printADStructures(const uint8_t* payload, size_t len) {
-  Serial.println("\n[AD-STRUCTURES] Advertisement Data Structures:");
+static void printADStructures(const AdView& view) {
+  g_out.println("\n[AD-STRUCTURES] Advertisement Data Structures:");
   
 #if ENABLE_COLORS
-  Serial.println("  Legend:");
-  Serial.printf("    %sFlags%s | ", COLOR_CYAN, COLOR_RESET);
-  Serial.printf("%sName%s | ", COLOR_BRIGHT_GREEN, COLOR_RESET);
-  Serial.printf("%sUUIDs%s | ", COLOR_BRIGHT_BLUE, COLOR_RESET);
-  Serial.printf("%sService Data%s | ", COLOR_BRIGHT_MAGENTA, COLOR_RESET);
-  Serial.printf("%sMfg Data%s | ", COLOR_BRIGHT_YELLOW, COLOR_RESET);
-  Serial.printf("%sOther%s\n", COLOR_WHITE, COLOR_RESET);
+  g_out.println("  Legend:");
+  g_out.printf("    %sFlags%s | ", COLOR_CYAN, COLOR_RESET);
+  g_out.printf("%sName%s | ", COLOR_BRIGHT_GREEN, COLOR_RESET);
+  g_out.printf("%sUUIDs%s | ", COLOR_BRIGHT_BLUE, COLOR_RESET);
+  g_out.printf("%sService Data%s | ", COLOR_BRIGHT_MAGENTA, COLOR_RESET);
+  g_out.printf("%sMfg Data%s | ", COLOR_BRIGHT_YELLOW, COLOR_RESET);
+  g_out.printf("%sOther%s\n", COLOR_WHITE, COLOR_RESET);
 #else
-  Serial.println("  Types: Flags | Name | UUIDs | Service Data | Mfg Data | Other");
+  g_out.println("  Types: Flags | Name | UUIDs | Service Data | Mfg Data | Other");
 #endif
   
-  Serial.println("  ----------------");
+  g_out.println("  ----------------");
   
-  size_t offset = 0;
   int structNum = 1;
   
-  while (offset < len) {
-    if (len - offset < 2) break;
-    
-    uint8_t adLen = payload[offset];
-    if (adLen == 0) break;
-    
-    if (offset + adLen + 1 > len) break;
-    
-    uint8_t adType = payload[offset + 1];
-    const uint8_t* adData = &payload[offset + 2];
-    size_t adDataLen = adLen - 1;
+  for (uint8_t f = 0; f < view.fieldCount; f++) {
+    uint8_t adType = view.fields[f].type;
+    const uint8_t* adData = view.fieldData(f);
+    size_t adDataLen = view.fields[f].len;
     
     const char* color = getADTypeColor(adType);
     const char* typeName = getADTypeName(adType);
     
-    Serial.printf("  %s[%d] Type 0x%02X: %s (Length: %d bytes)%s\n",
+    g_out.printf("  %s[%d] Type 0x%02X: %s (Length: %d bytes)%s\n",
                   color, structNum++, adType, typeName, adDataLen, COLOR_RESET);
     
-    Serial.print("      Data: ");
+    g_out.print("      Data: ");
     
     switch (adType) {
       case AD_TYPE_FLAGS:
         if (adDataLen >= 1) {
           uint8_t flags = adData[0];
-          Serial.printf("%s0x%02X%s (", color, flags, COLOR_RESET);
+          g_out.printf("%s0x%02X%s (", color, flags, COLOR_RESET);
           bool first = true;
-          if (flags & 0x01) { Serial.print("LE Limited"); first = false; }
-          if (flags & 0x02) { if (!first) Serial.print(", "); Serial.print("LE General"); first = false; }
-          if (flags & 0x04) { if (!first) Serial.print(", "); Serial.print("BR/EDR Not Supported"); first = false; }
-          if (flags & 0x08) { if (!first) Serial.print(", "); Serial.print("LE+BR/EDR Controller"); first = false; }
-          if (flags & 0x10) { if (!first) Serial.print(", "); Serial.print("LE+BR/EDR Host"); }
-          Serial.println(")");
+          if (flags & 0x01) { g_out.print("LE Limited"); first = false; }
+          if (flags & 0x02) { if (!first) g_out.print(", "); g_out.print("LE General"); first = false; }
+          if (flags & 0x04) { if (!first) g_out.print(", "); g_out.print("BR/EDR Not Supported"); first = false; }
+          if (flags & 0x08) { if (!first) g_out.print(", "); g_out.print("LE+BR/EDR Controller"); first = false; }
+          if (flags & 0x10) { if (!first) g_out.print(", "); g_out.print("LE+BR/EDR Host"); }
+          g_out.println(")");
         }
         break;
         
       case AD_TYPE_COMPLETE_LOCAL_NAME:
       case 0x08:
-        Serial.printf("%s\"", color);
+      case AD_TYPE_BROADCAST_NAME:
+        g_out.printf("%s\"", color);
         for (size_t i = 0; i < adDataLen; i++) {
           char c = adData[i];
-          Serial.write((c >= 32 && c <= 126) ? c : '?');
+          g_out.write((c >= 32 && c <= 126) ? c : '?');
         }
-        Serial.printf("\"%s\n", COLOR_RESET);
+        g_out.printf("\"%s\n", COLOR_RESET);
         break;
         
       case AD_TYPE_16BIT_SERVICE_UUIDS:
       case 0x02:
-        Serial.printf("%s", color);
+        g_out.printf("%s", color);
         for (size_t i = 0; i < adDataLen; i += 2) {
           if (i + 1 < adDataLen) {
             uint16_t uuid = adData[i] | (adData[i+1] << 8);
-            Serial.printf("0x%04X", uuid);
-            if (i + 2 < adDataLen) Serial.print(", ");
+            g_out.printf("0x%04X", uuid);
+            if (i + 2 < adDataLen) g_out.print(", ");
           }
         }
-        Serial.printf("%s\n", COLOR_RESET);
+        g_out.printf("%s\n", COLOR_RESET);
         break;
         
       case AD_TYPE_128BIT_SERVICE_UUIDS:
       case 0x06:
-        Serial.printf("%s", color);
+        g_out.printf("%s", color);
         if (adDataLen >= 16) {
           for (int i = 15; i >= 0; i--) {
-            Serial.printf("%02X", adData[i]);
-            if (i == 12 || i == 10 || i == 8 || i == 6) Serial.print("-");
+            g_out.printf("%02X", adData[i]);
+            if (i == 12 || i == 10 || i == 8 || i == 6) g_out.print("-");
           }
         }
-        Serial.printf("%s\n", COLOR_RESET);
+        g_out.printf("%s\n", COLOR_RESET);
         break;
         
       case AD_TYPE_SERVICE_DATA_16BIT:
         if (adDataLen >= 2) {
           uint16_t uuid = adData[0] | (adData[1] << 8);
-          Serial.printf("%sUUID: 0x%04X, Data: %s%s\n",
-                       color, uuid, 
-                       toHex(adData + 2, adDataLen - 2).c_str(),
-                       COLOR_RESET);
+          g_out.printf("%sUUID: 0x%04X, Data: ", color, uuid);
+          printHex(adData + 2, adDataLen - 2);
+          g_out.printf("%s\n", COLOR_RESET);
+          printDecoded(adType, adData, adDataLen, color);
         }
         break;
         
       case AD_TYPE_MANUFACTURER_DATA:
         if (adDataLen >= 2) {
           uint16_t companyId = adData[0] | (adData[1] << 8);
-          Serial.printf("%sCompany: 0x%04X", color, companyId);
+          g_out.printf("%sCompany: 0x%04X", color, companyId);
           
-          switch (companyId) {
-            case 0x004C: Serial.print(" (Apple)"); break;
-            case 0x0075: Serial.print(" (Samsung)"); break;
-            case 0x00E0: Serial.print(" (Google)"); break;
-            case 0x0006: Serial.print(" (Microsoft)"); break;
-            case 0x0059: Serial.print(" (Nordic Semi)"); break;
-          }
+          const char* company = adCompanyName(companyId);
+          if (company != NULL) g_out.printf(" (%s)", company);
           
-          Serial.printf(", Data: %s%s\n",
-                       toHex(adData + 2, adDataLen - 2).c_str(),
-                       COLOR_RESET);
+          g_out.print(", Data: ");
+          printHex(adData + 2, adDataLen - 2);
+          g_out.printf("%s\n", COLOR_RESET);
+          printDecoded(adType, adData, adDataLen, color);
         }
         break;
         
       case AD_TYPE_TX_POWER:
         if (adDataLen >= 1) {
           int8_t power = (int8_t)adData[0];
-          Serial.printf("%s%d dBm%s\n", color, power, COLOR_RESET);
+          g_out.printf("%s%d dBm%s\n", color, power, COLOR_RESET);
         }
         break;
         
       default:
-        Serial.printf("%s%s%s\n", color, toHex(adData, adDataLen).c_str(), COLOR_RESET);
+        g_out.print(color);
+        printHex(adData, adDataLen);
+        g_out.printf("%s\n", COLOR_RESET);
         break;
     }
+  }
+  
+  if (view.malformed) {
+    g_out.println("  (payload truncated - malformed AD length)");
+  }
+  
+  g_out.println();
+}
+
+// Emit one report as a framed binary record with a single write
+static size_t encodeReportFrame(const AdvReport& report, const AdView& view, uint8_t event,
+                                uint8_t* frame) {
+  BinaryReport rec;
+  rec.timestamp = report.timestamp;
+  memcpy(rec.addr, report.addr, sizeof(rec.addr));
+  rec.addrType = report.addrType;
+  rec.rssi = report.rssi;
+  rec.txPower = view.hasTxPower() ? view.txPower() : report.txPower;
+  rec.flags = report.flags;
+  rec.event = event;
+  rec.len = report.len;
+  rec.data = report.data;
+  return binEncodeReport(rec, frame);
+}
+
+static void emitBinaryReport(const AdvReport& report, const AdView& view, uint8_t event,
+                             OutputClass cls) {
+  uint8_t frame[BIN_MAX_FRAME];
+  size_t frameLen = encodeReportFrame(report, view, event, frame);
+  g_out.writeRecord(frame, frameLen, cls, report.timestamp);
+}
+
+// Same frame into the flash log (dropped, and counted there, if staging is full)
+static void recordReport(const AdvReport& report, const AdView& view, uint8_t event) {
+  uint8_t frame[BIN_MAX_FRAME];
+  size_t frameLen = encodeReportFrame(report, view, event, frame);
+  g_log.append(frame, frameLen);
+}
+
+// Short address type names for the line-oriented formats
+static const char* addrTypeShortName(uint8_t type) {
+  switch (type) {
+    case BLE_GAP_ADDR_TYPE_PUBLIC:                        return "public";
+    case BLE_GAP_ADDR_TYPE_RANDOM_STATIC:                 return "static";
+    case BLE_GAP_ADDR_TYPE_RANDOM_PRIVATE_RESOLVABLE:     return "rpa";
+    case BLE_GAP_ADDR_TYPE_RANDOM_PRIVATE_NON_RESOLVABLE: return "nrpa";
+    default:                                              return "unknown";
+  }
+}
+
+static const char* const EVENT_NAMES[] = { "report", "new", "changed" };
+
+static const char* phyName(uint8_t phy) {
+  switch (phy) {
+    case BLE_GAP_PHY_1MBPS: return "1M";
+    case BLE_GAP_PHY_2MBPS: return "2M";
+    case BLE_GAP_PHY_CODED: return "Coded";
+    default:                return "none";
+  }
+}
+
+// Decoded fields of every known structure: a JSON array of objects, or
+// one CSV column ("ibeacon uuid=... major=1;gaen rpi=...").
+// Consumer task only: the buffers are static to keep them off its stack.
+static void putDecoded(LineBuffer& line, const AdView& view, bool json) {
+  static char text[256];
+  LineBuffer csv(text, sizeof(text));
+  bool any = false;
+  for (uint8_t f = 0; f < view.fieldCount; f++) {
+    const uint8_t* d = view.fieldData(f);
+    uint8_t len = view.fields[f].len;
+    const AdDecoder* decoder = adFindDecoder(view.fields[f].type, d, len);
+    if (decoder == NULL) continue;
     
-    offset += adLen + 1;
+    if (json) line.putf("%s{\"proto\":\"%s\"", any ? "," : ",\"decoded\":[", decoder->name);
+    else csv.putf("%s%s", any ? ";" : "", decoder->name);
+    any = true;
+    for (uint8_t i = 0; i < decoder->fieldCount; i++) {
+      const AdDecoderField& field = decoder->fields[i];
+      uint8_t n = adFieldLen(field, len);
+      if (n == 0) continue;
+      static char value[96];
+      size_t valueLen = adFormatValue(field, d + field.start, n, value, sizeof(value));
+      if (!json) {
+        csv.putf(" %s=%s", field.name, value);
+      } else if (adValueIsNumber(field.format)) {
+        line.putf(",\"%s\":%s", field.name, value);
+      } else {
+        line.putf(",\"%s\":", field.name);
+        line.putJsonString((const uint8_t*)value, valueLen);
+      }
+    }
+    if (json) line.put('}');
+  }
+  if (json && any) line.put(']');
+  if (!json && any) line.putCsvString((const uint8_t*)csv.data(), csv.size());
+}
+
+// Emit one report as a single CSV or JSON line with a single write;
+// identity is the known device behind a resolved private address, or NULL.
+// Consumer task only (static line buffer).
+static void emitTextLine(const AdvReport& report, const AdView& view, uint8_t event, bool json,
+                         const IrkEntry* identity, OutputClass cls) {
+  static char buf[1024];
+  LineBuffer line(buf, sizeof(buf));
+  char macStr[18];
+  formatMac(report.addr, macStr);
+  
+  if (json) {
+    line.putf("{\"ts\":%lu,\"mac\":\"%s\",\"type\":\"%s\",\"rssi\":%d,\"event\":\"%s\"",
+              (unsigned long)report.timestamp, macStr, addrTypeShortName(report.addrType),
+              report.rssi, EVENT_NAMES[event]);
+    if (view.nameLen() > 0) {
+      line.puts(",\"name\":");
+      line.putJsonString(view.name(), view.nameLen());
+    }
+    if (view.hasCompanyId()) {
+      line.putf(",\"company\":\"%04X\"", view.companyId());
+    }
+    if (view.uuid16Count > 0) {
+      line.puts(",\"uuid16\":[");
+      for (uint8_t i = 0; i < view.uuid16Count; i++) {
+        line.putf("%s\"%04X\"", i ? "," : "", view.uuid16[i]);
+      }
+      line.put(']');
+    }
+    if (report.flags & ADV_FLAG_EXTENDED) {
+      line.putf(",\"phy\":\"%s/%s\"", phyName(report.primaryPhy), phyName(report.secondaryPhy));
+    }
+    if (report.flags & ADV_FLAG_SCAN_RESPONSE) {
+      line.putf(",\"rsp_offset\":%u", report.rspOffset);
+    }
+    if (identity != NULL) {
+      line.puts(",\"identity\":");
+      line.putJsonString((const uint8_t*)identity->label, strlen(identity->label));
+    }
+    putDecoded(line, view, true);
+    line.puts(",\"payload\":\"");
+    {
+      PERF_SCOPE(g_perf, PERF_HEX, hexTimer);
+      line.putHex(report.data, report.len);
+    }
+    line.puts("\"}");
+  } else {
+    line.putf("%lu,%s,%s,%d,%s,", (unsigned long)report.timestamp, macStr,
+              addrTypeShortName(report.addrType), report.rssi, EVENT_NAMES[event]);
+    if (view.nameLen() > 0) line.putCsvString(view.name(), view.nameLen());
+    line.put(',');
+    if (view.hasCompanyId()) line.putf("%04X", view.companyId());
+    line.put(',');
+    for (uint8_t i = 0; i < view.uuid16Count; i++) {
+      line.putf("%s%04X", i ? ";" : "", view.uuid16[i]);
+    }
+    line.put(',');
+    {
+      PERF_SCOPE(g_perf, PERF_HEX, hexTimer);
+      line.putHex(report.data, report.len);
+    }
+    line.put(',');
+    if (identity != NULL) {
+      line.putCsvString((const uint8_t*)identity->label, strlen(identity->label));
+    }
+    line.put(',');
+    putDecoded(line, view, false);
   }
   
-  Serial.println();
+  size_t n = line.endLine();
+  g_out.writeRecord((const uint8_t*)line.data(), n, cls, report.timestamp);
 }
 
-// BLE scan callback
-void scan_callback(ble_gap_evt_adv_report_t* report) {
-  g_deviceCount++;
+// Filter, deduplicate and print one report (runs on the consumer task)
+static void processReport(const AdvReport& report) {
+  PERF_SCOPE(g_perf, PERF_REPORT, reportTimer);
   
   // Gather device information
   char macStr[18];
-  sprintf(macStr, "%02X:%02X:%02X:%02X:%02X:%02X",
-          report->peer_addr.addr[5], report->peer_addr.addr[4],
-          report->peer_addr.addr[3], report->peer_addr.addr[2],
-          report->peer_addr.addr[1], report->peer_addr.addr[0]);
-  String mac = macStr;
-  
-  int rssi = report->rssi;
-  
-  // Parse advertisement data
-  uint8_t* payload = report->data.p_data;
-  uint8_t len = report->data.len;
-  
-  // Extract name, UUID, and payload for filtering
-  String name = "";
-  String uuid = "";
-  String payloadHex = toHex(payload, len);
-  
-  // Quick parse for name and UUID
-  size_t offset = 0;
-  while (offset < len) {
-    if (len - offset < 2) break;
-    uint8_t adLen = payload[offset];
-    if (adLen == 0) break;
-    if (offset + adLen + 1 > len) break;
-    
-    uint8_t adType = payload[offset + 1];
-    const uint8_t* adData = &payload[offset + 2];
-    size_t adDataLen = adLen - 1;
-    
-    if (adType == AD_TYPE_COMPLETE_LOCAL_NAME || adType == 0x08) {
-      name = "";
-      for (size_t i = 0; i < adDataLen; i++) {
-        name += (char)adData[i];
-      }
-    } else if (adType == AD_TYPE_16BIT_SERVICE_UUIDS && adDataLen >= 2) {
-      uint16_t svcUuid = adData[0] | (adData[1] << 8);
-      char uuidBuf[8];
-      sprintf(uuidBuf, "%04X", svcUuid);
-      uuid = uuidBuf;
-    }
-    
-    offset += adLen + 1;
+  PERF_SCOPE(g_perf, PERF_FORMAT_MAC, macTimer);
+  formatMac(report.addr, macStr);
+  PERF_STOP(macTimer);
+  
+  int rssi = report.rssi;
+  
+  // Parse advertisement data once - filter, dedup and printer share the view
+  const uint8_t* payload = report.data;
+  uint8_t len = report.len;
+  
+  AdView view;
+  PERF_SCOPE(g_perf, PERF_PARSE, parseTimer);
+  parseAdvertisement(payload, len, view);
+  PERF_STOP(parseTimer);
+  const uint8_t* name = view.name();
+  uint8_t nameLen = view.nameLen();
+  
+  // Known device behind a resolvable private address: filter and track it
+  // under its identity address (cached, so once per address rotation)
+  const IrkEntry* identity = NULL;
+  if (g_irkReady && report.addrType == BLE_GAP_ADDR_TYPE_RANDOM_PRIVATE_RESOLVABLE) {
+    identity = g_irks.resolve(report.addr);
   }
+  DeviceKey key;
+  memcpy(key.addr, identity ? identity->identity : report.addr, sizeof(key.addr));
+  key.addrType = identity ? identity->identityType : report.addrType;
   
   // Apply filter
-  if (!g_filter.shouldShow(mac, name, uuid, payloadHex)) {
+  PERF_SCOPE(g_perf, PERF_FILTER, filterTimer);
+  // What the callback checked holds for the identity too: it only checks
+  // addresses that are not resolved
+  bool show = g_filter.shouldShow(key.addr, view, report.flags & ADV_FLAG_CHECKED);
+  PERF_STOP(filterTimer);
+  if (!show) {
     g_filteredCount++;
-    Bluefruit.Scanner.resume();
     return;
   }
   
-  // Deduplication check
-  if (g_deduplication) {
-    bool isNewOrChanged = true;
-    
-    for (auto& dev : g_seenDevices) {
-      if (dev.mac == mac) {
-        // Device seen before - check if anything changed
-        bool nameChanged = (dev.name != name && name.length() > 0);
-        bool payloadChanged = (dev.payload != payloadHex);
-        bool rssiSignificantChange = abs(dev.rssi - rssi) > 10;  // >10 dBm change
-        
-        if (!nameChanged && !payloadChanged && !rssiSignificantChange) {
-          // Nothing changed - skip display
-          isNewOrChanged = false;
-          dev.lastSeen = millis();
-        } else {
-          // Something changed - update and display
-          if (nameChanged) dev.name = name;
-          if (payloadChanged) dev.payload = payloadHex;
-          dev.rssi = rssi;
-          dev.lastSeen = millis();
-        }
-        break;
-      }
-    }
-    
-    // New device - add to tracking
-    if (isNewOrChanged && g_seenDevices.size() < 100) {  // Limit to 100 devices
-      bool found = false;
-      for (const auto& dev : g_seenDevices) {
-        if (dev.mac == mac) {
-          found = true;
-          break;
-        }
-      }
-      
-      if (!found) {
-        SeenDevice newDev;
-        newDev.mac = mac;
-        newDev.name = name;
-        newDev.payload = payloadHex;
-        newDev.rssi = rssi;
-        newDev.lastSeen = millis();
-        g_seenDevices.push_back(newDev);
-      }
-    }
-    
-    if (!isNewOrChanged) {
-      g_duplicateCount++;
-      Bluefruit.Scanner.resume();
-      return;
-    }
+  // Track every device; deduplication decides what gets displayed
+  PERF_SCOPE(g_perf, PERF_DEDUP, dedupTimer);
+  bool dedup = g_deduplication;
+  TrackOptions track = { &g_changeMasks, &g_changePolicy, dedup, g_deviceTtlSeconds * 1000 };
+  uint16_t idx;
+  bool expired;
+  TrackResult result = trackReport(g_seenDevices, key, report, view, track, idx, expired);
+  if (expired) g_expiredCount++;
+  // A rotating address that continues a device gone quiet just before
+  // takes over its record, so the rotation is not another unique device
+  if (identity == NULL && RotationLinker<DEVICE_TABLE_CAPACITY>::rotates(report.addrType) &&
+      g_linker.track(g_seenDevices, idx, report.timestamp) != DEVICE_NONE) {
+    g_rotationCount++;
+  }
+  if (result == TRACK_DUPLICATE) {
+    g_duplicateCount++;
+    return;
+  }
+  if (result == TRACK_HELD) {
+    g_heldCount++;
+    return;
   }
+  if (result == TRACK_NEW) g_newDeviceCount++;
   
-  // Print device header
-  Serial.println();
-  for (int i = 0; i < 80; i++) Serial.print("=");
-  Serial.println();
+  SeenDevice& dev = g_seenDevices[idx];
+  bool isNew = result == TRACK_NEW || !dedup;
+  uint8_t event = !dedup ? BIN_EVENT_REPORT : (isNew ? BIN_EVENT_NEW : BIN_EVENT_CHANGED);
+  PERF_STOP(dedupTimer);
   
-  // Check if device is new or changed
-  bool isNew = true;
-  for (const auto& dev : g_seenDevices) {
-    if (dev.mac == mac && dev.lastSeen < millis() - 1000) {  // Seen more than 1 sec ago
-      isNew = false;
-      break;
+  // Recorder: the same reports the display gets, whatever the output mode
+  if (g_recording) recordReport(report, view, event);
+  
+  // Aggregate modes: counters only, the consumer prints the table/census
+  if (g_outputMode == OUTPUT_TOP || g_outputMode == OUTPUT_CENSUS) return;
+  
+  g_displayedCount++;
+  PERF_SCOPE(g_perf, PERF_RENDER, renderTimer);
+  
+  // Send order: whitelist hits (every report shown while a whitelist is
+  // active) and new devices go ahead of changes, changes ahead of repeats
+  OutputClass cls = OUT_REFRESH;
+  if (result == TRACK_NEW || g_filter.whitelistActive()) {
+    cls = OUT_TARGET;
+  } else if (result == TRACK_CHANGED) {
+    cls = OUT_CHANGED;
+  }
+  
+  if (g_outputMode != OUTPUT_HUMAN) {
+    if (g_outputMode == OUTPUT_BINARY) {
+      emitBinaryReport(report, view, event, cls);
+    } else {
+      emitTextLine(report, view, event, g_outputMode == OUTPUT_JSON, identity, cls);
     }
+    return;
   }
   
+  // Print device header - the whole dump is queued (or dropped) as one record
+  g_out.beginRecord(cls, report.timestamp);
+  g_out.println();
+  g_out.println(BANNER);
+  
   if (isNew) {
-    Serial.println("[BLE-DEVICE] NEW Device Detected");
+    g_out.println("[BLE-DEVICE] NEW Device Detected");
   } else {
-    Serial.println("[BLE-DEVICE] CHANGED Device Detected");
+    g_out.println("[BLE-DEVICE] CHANGED Device Detected");
   }
   
-  for (int i = 0; i < 80; i++) Serial.print("=");
-  Serial.println();
+  g_out.println(BANNER);
   
   // Basic information
-  Serial.println("\n[BASIC-INFO]");
-  Serial.printf("  MAC Address:  %s\n", mac.c_str());
-  Serial.printf("  RSSI:         %d dBm\n", rssi);
-  Serial.printf("  Address Type: ");
+  g_out.println("\n[BASIC-INFO]");
+  g_out.printf("  MAC Address:  %s\n", macStr);
+  g_out.printf("  RSSI:         %d dBm (avg %d, range %d..%d over %u reports)\n", rssi,
+               dev.signal.rssi(), dev.signal.rssiMin, dev.signal.rssiMax, dev.signal.count);
+  g_out.printf("  Address Type: ");
   
-  switch (report->peer_addr.addr_type) {
+  switch (report.addrType) {
     case BLE_GAP_ADDR_TYPE_PUBLIC:
-      Serial.println("Public");
+      g_out.println("Public");
       break;
     case BLE_GAP_ADDR_TYPE_RANDOM_STATIC:
-      Serial.println("Random Static");
+      g_out.println("Random Static");
       break;
     case BLE_GAP_ADDR_TYPE_RANDOM_PRIVATE_RESOLVABLE:
-      Serial.println("Random Private Resolvable");
+      g_out.println("Random Private Resolvable");
       break;
     case BLE_GAP_ADDR_TYPE_RANDOM_PRIVATE_NON_RESOLVABLE:
-      Serial.println("Random Private Non-Resolvable");
+      g_out.println("Random Private Non-Resolvable");
       break;
     default:
-      Serial.println("Unknown");
+      g_out.println("Unknown");
+  }
+  
+  if (identity != NULL) {
+    char identityStr[18];
+    formatMac(identity->identity, identityStr);
+    g_out.printf("  Identity:     %s (%s, resolved with its IRK)\n", identity->label, identityStr);
   }
   
-  if (name.length() > 0) {
-    Serial.printf("  Device Name:  %s\n", name.c_str());
+  if (nameLen > 0) {
+    g_out.print("  Device Name:  ");
+    g_out.write(name, nameLen);
+    g_out.println();
+  }
+  
+  if (report.flags & ADV_FLAG_EXTENDED) {
+    g_out.printf("  Advertising:  Extended (%s primary, %s secondary PHY)\n",
+                 phyName(report.primaryPhy), phyName(report.secondaryPhy));
+  }
+  
+  if (report.flags & ADV_FLAG_SCAN_RESPONSE) {
+    if (report.rspOffset > 0) {
+      g_out.printf("  Scan Resp.:   %d bytes, after %d bytes of advertisement\n",
+                   len - report.rspOffset, report.rspOffset);
+    } else {
+      g_out.println("  Scan Resp.:   only (its advertisement was not heard)");
+    }
   }
   
   // Raw Advertisement Payload
-  Serial.println("\n[RAW-PAYLOAD]");
-  Serial.printf("  Total Length: %d bytes\n", len);
-  printHexDump(payload, len, "  Complete Advertisement:");
+  g_out.println("\n[RAW-PAYLOAD]");
+  g_out.printf("  Total Length: %d bytes%s\n", len,
+               (report.flags & ADV_FLAG_TRUNCATED) ? " (truncated)" : "");
+  {
+    PERF_SCOPE(g_perf, PERF_HEX, hexTimer);
+    printHexDump(payload, len, "  Complete Advertisement:");
+  }
   
   // Parse and display AD structures with colors
-  printADStructures(payload, len);
+  printADStructures(view);
   
   // Footer
-  for (int i = 0; i < 80; i++) Serial.print("=");
-  Serial.println("\n");
-  
-  // Resume scanning
-  Bluefruit.Scanner.resume();
+  g_out.println(BANNER);
+  g_out.println();
+  g_out.endRecord();
 }
 
-// Process user commands
-void processCommand() {
-  Serial.println();
-  Serial.println("================================================================================");
-  Serial.println("[COMMAND] Enter command:");
-  Serial.println("  Scanning:");
-  Serial.println("    s [seconds]  - Scan for N seconds (e.g., 's 30' for 30 sec scan)");
-  Serial.println("    a [seconds]  - Auto-scan mode: continuous scanning");
-  Serial.println("    m            - Manual mode (wait for command between scans)");
-  Serial.println("  Filters:");
-  Serial.println("    f            - Show filter status");
-  Serial.println("    b            - Add to blacklist (hide devices)");
-  Serial.println("    w            - Add to whitelist (only show devices)");
-  Serial.println("    x            - Clear all filters");
-  Serial.println("    i            - Interactive filter from last scan");
-  Serial.println("  Settings:");
-  Serial.println("    c            - Toggle colors on/off");
-  Serial.println("    d            - Toggle deduplication on/off");
-  Serial.println("    h            - Show this help");
-  Serial.println("================================================================================");
-  Serial.print("> ");
+// Recorder task: moves staged frames to flash a page at a time; sector
+// erases happen here, never on the consumer
+static void recorder_task(void* arg) {
+  (void)arg;
   
-  // Clear any pending input
-  while (Serial.available()) {
-    Serial.read();
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+    g_log.service(millis());
   }
+}
+
+// Writer task: drains queued report output to Serial in large chunks
+static void serial_writer_task(void* arg) {
+  (void)arg;
   
-  // Wait for complete command line (until Enter is pressed)
-  String cmd = "";
   while (true) {
-    if (Serial.available()) {
-      char c = Serial.read();
-      
-      // Enter key pressed - process command
-      if (c == '\n' || c == '\r') {
-        Serial.println();  // Echo newline
-        break;
-      }
-      
-      // Backspace handling
-      if (c == '\b' || c == 127) {
-        if (cmd.length() > 0) {
-          cmd.remove(cmd.length() - 1);
-          Serial.write('\b');
-          Serial.write(' ');
-          Serial.write('\b');
-        }
-        continue;
-      }
-      
-      // Add character to command
-      if (c >= 32 && c <= 126) {  // Printable characters only
-        cmd += c;
-        Serial.write(c);  // Echo character
-      }
+    if (g_out.idle()) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    if (g_out.pump() == 0) {
+      vTaskDelay(1);  // host not reading - let the FIFO absorb output
     }
+  }
+}
+
+// Forget devices not seen for g_deviceTtlSeconds so they are reported as
+// new when they return. The LRU order makes this O(expired devices).
+static void expireDevices(uint32_t now) {
+  if (g_deviceTtlSeconds == 0) return;
+  uint32_t ttlMs = g_deviceTtlSeconds * 1000;
+  
+  uint16_t idx;
+  while ((idx = g_seenDevices.last()) != DEVICE_NONE &&
+         now - g_seenDevices[idx].lastSeen > ttlMs) {
+    g_seenDevices.remove(idx);
+    g_expiredCount++;
+  }
+}
+
+// Signal table ('o top'): strongest and most frequently advertising
+// devices among those heard in the last period
+#define TOP_TABLE_ROWS  8
+#define TOP_REPORT_MS   5000
+
+static uint32_t topKeyRssi(const SeenDevice& dev) { return (uint32_t)(dev.signal.rssiQ4 + 0x8000); }
+static uint32_t topKeyRate(const SeenDevice& dev) { return dev.signal.ratePer10s(); }
+
+// Indices of the up to TOP_TABLE_ROWS active devices with the largest key,
+// best first - one pass over the table
+static int selectTop(uint32_t (*keyOf)(const SeenDevice&), uint32_t sinceMs, uint16_t* out) {
+  uint32_t keys[TOP_TABLE_ROWS];
+  int n = 0;
+  for (uint16_t i = g_seenDevices.first(); i != DEVICE_NONE; i = g_seenDevices.next(i)) {
+    const SeenDevice& dev = g_seenDevices[i];
+    if ((int32_t)(dev.lastSeen - sinceMs) < 0) break;  // LRU order: the rest is older
+    uint32_t key = keyOf(dev);
+    if (n == TOP_TABLE_ROWS && key <= keys[n - 1]) continue;
+    int pos = n < TOP_TABLE_ROWS ? n++ : n - 1;
+    while (pos > 0 && keys[pos - 1] < key) {
+      keys[pos] = keys[pos - 1];
+      out[pos] = out[pos - 1];
+      pos--;
+    }
+    keys[pos] = key;
+    out[pos] = i;
+  }
+  return n;
+}
+
+static void printTopRows(const char* title, const uint16_t* rows, int n) {
+  g_out.printf("  %s\n", title);
+  g_out.println("    #  MAC                Name       RSSI  min  max  reports  rate/s");
+  for (int r = 0; r < n; r++) {
+    const SeenDevice& dev = g_seenDevices[rows[r]];
+    char macStr[18];
+    formatMac(g_seenDevices.keyAt(rows[r]).addr, macStr);
+    uint16_t rate = dev.signal.ratePer10s();
+    g_out.printf("   %2d  %s  %-9.*s  %4d %4d %4d  %7u  %3u.%u\n", r + 1, macStr,
+                 (int)strnlen(dev.name, SEEN_NAME_MAX), dev.name, dev.signal.rssi(),
+                 dev.signal.rssiMin, dev.signal.rssiMax, dev.signal.count,
+                 rate / 10, rate % 10);
+  }
+}
+
+static void printSignalTable(uint32_t now) {
+  uint32_t since = now - TOP_REPORT_MS;
+  uint16_t byRssi[TOP_TABLE_ROWS];
+  uint16_t byRate[TOP_TABLE_ROWS];
+  int n = selectTop(topKeyRssi, since, byRssi);
+  selectTop(topKeyRate, since, byRate);
+  
+  int active = 0;
+  for (uint16_t i = g_seenDevices.first(); i != DEVICE_NONE; i = g_seenDevices.next(i)) {
+    if ((int32_t)(g_seenDevices[i].lastSeen - since) < 0) break;
+    active++;
+  }
+  
+  g_out.beginRecord(OUT_REFRESH, now);
+  g_out.printf("\n[TOP] %lu ms: %d devices heard in the last %d s (%u tracked)\n",
+               (unsigned long)now, active, TOP_REPORT_MS / 1000, (unsigned)g_seenDevices.size());
+  if (n > 0) {
+    printTopRows("By RSSI (smoothed):", byRssi, n);
+    printTopRows("By report rate:", byRate, n);
+  }
+  g_out.endRecord();
+}
+
+// Device census ('o census'): at the end of each epoch/scan the consumer
+// lists every device heard in it, most reports first, and resets the
+// epoch counters. The loop task requests it and waits until it is queued.
+#define CENSUS_WAIT_MS 5000
+
+static volatile bool g_censusRequested = false;
+static uint32_t g_censusLabel = 0;          // epoch/scan number in the heading
+static uint32_t g_censusStart = 0;          // millis() the epoch began
+static uint16_t g_censusOrder[DEVICE_TABLE_CAPACITY];
+
+static bool censusBefore(uint16_t a, uint16_t b) {
+  const SeenDevice& da = g_seenDevices[a];
+  const SeenDevice& db = g_seenDevices[b];
+  if (da.epochReports != db.epochReports) return da.epochReports > db.epochReports;
+  return da.signal.rssiQ4 > db.signal.rssiQ4;
+}
+
+// The census can be far larger than the TX pool: wait for the writer to make
+// room for the next record instead of dropping it
+static void waitOutputRoom(uint32_t deadline) {
+  while (g_out.space(OUT_CONSOLE) < SERIAL_RECORD_MAX && (int32_t)(deadline - millis()) > 0) {
+    vTaskDelay(1);
+  }
+}
+
+static void printCensus(uint32_t now) {
+  uint16_t n = 0;
+  uint32_t reports = 0;
+  for (uint16_t i = g_seenDevices.first(); i != DEVICE_NONE; i = g_seenDevices.next(i)) {
+    if (g_seenDevices[i].epochReports == 0) continue;
+    g_censusOrder[n++] = i;
+    reports += g_seenDevices[i].epochReports;
+  }
+  std::sort(g_censusOrder, g_censusOrder + n, censusBefore);
+  
+  uint32_t deadline = now + CENSUS_WAIT_MS;
+  waitOutputRoom(deadline);
+  g_out.beginRecord();
+  g_out.printf("\n[CENSUS] #%lu: %u devices, %lu reports in %lu s\n",
+               (unsigned long)g_censusLabel, n, (unsigned long)reports,
+               (unsigned long)((now - g_censusStart) / 1000));
+  g_out.println("     #  MAC                Type     Name       Company  Service  Reports  RSSI min/avg/max");
+  
+  for (uint16_t r = 0; r < n; r++) {
+    SeenDevice& dev = g_seenDevices[g_censusOrder[r]];
+    char macStr[18];
+    char company[5] = "-";
+    char service[5] = "-";
+    formatMac(g_seenDevices.keyAt(g_censusOrder[r]).addr, macStr);
+    if (dev.company != SEEN_ID_NONE) snprintf(company, sizeof(company), "%04X", dev.company);
+    if (dev.service != SEEN_ID_NONE) snprintf(service, sizeof(service), "%04X", dev.service);
+    g_out.printf("  %4u  %s  %-7s  %-9.*s  %-7s  %-7s  %7u  %4d/%d/%d\n", r + 1, macStr,
+                 addrTypeShortName(g_seenDevices.keyAt(g_censusOrder[r]).addrType),
+                 (int)strnlen(dev.name, SEEN_NAME_MAX), dev.name, company, service,
+                 dev.epochReports, dev.epochMin, dev.signal.rssi(), dev.epochMax);
+    dev.epochReports = 0;
+    
+    // Keep each record well inside the staging buffer
+    if ((r + 1) % 32 == 0 && r + 1 < n) {
+      g_out.endRecord();
+      waitOutputRoom(deadline);
+      g_out.beginRecord();
+    }
+  }
+  g_out.println("[CENSUS] end");
+  g_out.endRecord();
+  g_censusStart = now;
+}
+
+// Called by the loop task when an epoch or scan closes
+static void runCensus(uint32_t label) {
+  if (g_outputMode != OUTPUT_CENSUS) return;
+  g_censusLabel = label;
+  g_censusRequested = true;
+  xTaskNotifyGive(g_consumerTask);
+  unsigned long start = millis();
+  while (g_censusRequested && millis() - start < CENSUS_WAIT_MS * 2) {
     delay(10);
   }
+}
+
+// Consumer task: drains the report ring whenever the callback signals it,
+// and ages the device table at least once a second
+static void report_consumer_task(void* arg) {
+  (void)arg;
+  uint32_t lastTopTable = 0;
   
-  cmd.trim();
+  while (true) {
+    uint32_t woken = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(g_pairer.empty() ? 1000 : PAIR_HOLD_MS));
+#if BLE_PERF
+    if (woken) g_perf.sampleDepth(g_reportRing.depth());
+    g_perf.sampleRate(millis(), g_deviceCount);
+#else
+    (void)woken;
+#endif
+    
+    const AdvReport* report;
+    while ((report = g_reportRing.peek()) != NULL) {
+      xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+      if (g_pairScanResponses) g_pairer.push(*report, processReport);
+      else processReport(*report);
+      xSemaphoreGive(g_deviceLock);
+      g_reportRing.release();
+    }
+    
+    if (!g_pairer.empty()) {
+      xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+      if (g_pairScanResponses) g_pairer.expire(millis(), processReport);
+      else g_pairer.flush(processReport);
+      xSemaphoreGive(g_deviceLock);
+    }
+    
+    if (g_scannerRunning) {
+      uint32_t now = millis();
+      xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+      expireDevices(now);
+      if (g_outputMode == OUTPUT_TOP && now - lastTopTable >= TOP_REPORT_MS) {
+        printSignalTable(now);
+        lastTopTable = now;
+      }
+      xSemaphoreGive(g_deviceLock);
+    }
+    
+    if (g_censusRequested) {
+      xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+      printCensus(millis());
+      xSemaphoreGive(g_deviceLock);
+      g_censusRequested = false;
+    }
+  }
+}
+
+static_assert(EARLY_ADDR_CHECKED == ADV_FLAG_ADDR_CHECKED &&
+              EARLY_PAYLOAD_CHECKED == ADV_FLAG_PAYLOAD_CHECKED,
+              "early filter results travel in the report flags");
+
+// Copy one (possibly reassembled) report into the ring
+static void queueReport(const ble_gap_evt_adv_report_t* report, const uint8_t* data,
+                        uint16_t len, bool truncated) {
+  g_deviceCount++;
   
-  if (cmd.length() == 0) {
-    Serial.println("(no command)");
+  // Fast path: what the filters can decide from the address and raw bytes
+  // is dropped here, before it costs a ring slot and a parse. An address
+  // that may resolve to an identity is filtered under that identity later;
+  // a half of a scan response pair only together with the other half.
+  uint8_t addrType = report->peer_addr.addr_type;
+  bool addrFinal = !(g_irkReady && addrType == BLE_GAP_ADDR_TYPE_RANDOM_PRIVATE_RESOLVABLE);
+  bool paired = g_pairScanResponses && (report->type.scannable || report->type.scan_response);
+  uint8_t early = g_filter.earlyCheck(report->peer_addr.addr, addrFinal, data,
+                                      len > ADV_REPORT_MAX_DATA ? ADV_REPORT_MAX_DATA : len, !paired);
+  if (early & EARLY_REJECT) {
+    g_rejectedEarlyCount++;
     return;
   }
   
-  // Parse command
-  char cmdChar = cmd.charAt(0);
-  String args = "";
-  if (cmd.length() > 1) {
-    args = cmd.substring(1);
-    args.trim();
+  AdvReport* slot = g_reportRing.reserve();
+  if (slot == NULL) return;
+  
+  slot->timestamp = millis();
+  memcpy(slot->addr, report->peer_addr.addr, sizeof(slot->addr));
+  slot->addrType = addrType;
+  slot->rssi = report->rssi;
+  slot->txPower = report->tx_power;
+  slot->flags = (report->type.connectable   ? ADV_FLAG_CONNECTABLE   : 0) |
+                (report->type.scannable     ? ADV_FLAG_SCANNABLE     : 0) |
+                (report->type.directed      ? ADV_FLAG_DIRECTED      : 0) |
+                (report->type.scan_response ? ADV_FLAG_SCAN_RESPONSE : 0) |
+                (report->type.extended_pdu  ? ADV_FLAG_EXTENDED      : 0);
+  slot->primaryPhy = report->primary_phy;
+  slot->secondaryPhy = report->secondary_phy;
+  if (len > ADV_REPORT_MAX_DATA) {
+    len = ADV_REPORT_MAX_DATA;
+    truncated = true;
+  }
+  if (truncated) slot->flags |= ADV_FLAG_TRUNCATED;
+  slot->flags |= early & ADV_FLAG_CHECKED;   // the consumer skips what was checked here
+  slot->len = len;
+  slot->rspOffset = 0;
+  memcpy(slot->data, data, len);
+  
+  g_reportRing.commit();
+  xTaskNotifyGive(g_consumerTask);
+}
+
+// BLE scan callback - copy the raw report and hand the radio back at once
+void scan_callback(ble_gap_evt_adv_report_t* report) {
+  PERF_SCOPE(g_perf, PERF_CALLBACK, callbackTimer);
+  uint8_t status = report->type.status;
+  bool complete = status == BLE_GAP_ADV_DATA_STATUS_COMPLETE;
+  
+  // Chained extended advertisement: collect fragments until the last one
+  AdvChain* chain = NULL;
+  if (report->type.extended_pdu) {
+    const ble_gap_addr_t& peer = report->peer_addr;
+    chain = g_reassembler.find(peer.addr, peer.addr_type, report->set_id, report->data_id);
+    if (chain == NULL && status == BLE_GAP_ADV_DATA_STATUS_INCOMPLETE_MORE_DATA) {
+      chain = g_reassembler.open(peer.addr, peer.addr_type, report->set_id,
+                                 report->data_id, millis());
+    }
   }
   
-  // Flag to indicate if we should scan after this command
-  bool shouldScan = false;
+  if (chain == NULL) {
+    queueReport(report, report->data.p_data, report->data.len, !complete);
+  } else {
+    AdvReassembler::append(chain, report->data.p_data, report->data.len);
+    if (status != BLE_GAP_ADV_DATA_STATUS_INCOMPLETE_MORE_DATA) {
+      // Last fragment (or the controller gave up on the chain)
+      g_chainCount++;
+      queueReport(report, chain->data, chain->len, chain->overflow || !complete);
+      AdvReassembler::release(chain);
+    }
+  }
   
-  switch (cmdChar) {
-    case 's':
-    case 'S':
-      // Scan command
-      if (args.length() > 0) {
-        int duration = args.toInt();
-        if (duration > 0 && duration <= 300) {
-          g_scanTimeSeconds = duration;
-          Serial.printf("[CMD] Will scan for %d seconds\n", g_scanTimeSeconds);
-          shouldScan = true;
-        } else {
-          Serial.println("[ERROR] Invalid duration (1-300 seconds)");
-        }
-      } else {
-        Serial.printf("[CMD] Will scan for %d seconds (default)\n", g_scanTimeSeconds);
-        shouldScan = true;
-      }
-      g_autoScan = false;
-      break;
-      
-    case 'a':
-    case 'A':
-      // Auto-scan mode
-      if (args.length() > 0) {
-        int duration = args.toInt();
-        if (duration > 0 && duration <= 300) {
-          g_scanTimeSeconds = duration;
-        }
-      }
-      g_autoScan = true;
-      shouldScan = true;
-      Serial.printf("[CMD] Auto-scan mode enabled (%d seconds per scan)\n", g_scanTimeSeconds);
-      Serial.println("[CMD] Press 'm' to stop auto-scanning");
-      break;
-      
-    case 'm':
-    case 'M':
-      // Manual mode
-      g_autoScan = false;
-      Serial.println("[CMD] Manual mode enabled (wait for command between scans)");
-      break;
+  // Resume scanning (also fetches the next fragment of a chain)
+  PERF_STOP(callbackTimer);
+  Bluefruit.Scanner.resume();
+}
+
+// Scheduler profile, PHYs and accept list into the scanner parameters
+static void configureScanner(Print& out) {
+  const ScanParams& p = g_scheduler.params();
+  uint16_t window = p.window;
+  // Scanning two primary PHYs needs interval >= 2 * window
+  if (g_extScan == EXT_SCAN_CODED && window > p.interval / 2) window = p.interval / 2;
+  
+  Bluefruit.Scanner.setInterval(p.interval, window);
+  Bluefruit.Scanner.useActiveScan(p.active);
+  g_pairScanResponses = p.active;
+  
+  ble_gap_scan_params_t* params = Bluefruit.Scanner.getParams();
+  params->extended = g_extScan != EXT_SCAN_OFF;
+  params->scan_phys = g_extScan == EXT_SCAN_CODED ? (BLE_GAP_PHY_1MBPS | BLE_GAP_PHY_CODED)
+                                                  : BLE_GAP_PHY_1MBPS;
+  
+  // The whitelist can only be replaced while the scanner is stopped
+  const ble_gap_addr_t* accept[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+  for (uint8_t i = 0; i < g_acceptCount; i++) accept[i] = &g_acceptList[i];
+  if (g_acceptCount > 0 && sd_ble_gap_whitelist_set(accept, g_acceptCount) != NRF_SUCCESS) {
+    out.println("[ERROR] Controller rejected the accept list - filtering in software");
+    g_acceptCount = 0;
+  }
+  if (g_acceptCount == 0) sd_ble_gap_whitelist_set(NULL, 0);
+  params->filter_policy = g_acceptCount > 0 ? BLE_GAP_SCAN_FP_WHITELIST : BLE_GAP_SCAN_FP_ACCEPT_ALL;
+}
+
+// Start the configured scanner (until stopped). Every start goes through
+// here, so a rejected extended scan falls back to legacy scanning on any
+// path. Returns whether the radio is scanning.
+static bool startScanning(Print& out) {
+  if (Bluefruit.Scanner.start(0)) return true;
+  if (g_extScan != EXT_SCAN_OFF) {
+    // The SoftDevice rejects extended scanning without an extended-size report buffer
+    out.println("[ERROR] Extended scanning not accepted - falling back to legacy scanning");
+    g_extScan = EXT_SCAN_OFF;
+    configureScanner(out);
+    if (Bluefruit.Scanner.start(0)) return true;
+  }
+  out.println("[ERROR] Scanner did not start - scanning stopped");
+  return false;
+}
+
+// Push the scheduler's profile to the scanner. Parameters only take effect
+// when scanning starts, so a running scanner is briefly restarted.
+static void applyScanParams(bool restart, Print& out) {
+  if (restart) Bluefruit.Scanner.stop();
+  configureScanner(out);
+  if (restart) g_scannerRunning = startScanning(out);
+}
+
+// Recompute the controller accept list after a filter or identity key
+// change; the scanner restarts only if the list is different. Private
+// addresses of devices with identity keys never match it, so there is
+// none while keys are loaded.
+static void refreshAcceptList(Print& out) {
+  uint64_t macs[ACCEPT_LIST_MACS];
+  size_t count = g_irks.size() > 0 ? 0 : g_filter.acceptList(macs, ACCEPT_LIST_MACS);
+  ble_gap_addr_t list[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+  memset(list, 0, sizeof(list));
+  uint8_t n = 0;
+  for (size_t i = 0; i < count; i++) {
+    for (uint8_t type = BLE_GAP_ADDR_TYPE_PUBLIC; type <= BLE_GAP_ADDR_TYPE_RANDOM_STATIC; type++) {
+      list[n].addr_type = type;
+      for (int b = 0; b < 6; b++) list[n].addr[b] = (uint8_t)(macs[i] >> (8 * b));
+      n++;
+    }
+  }
+  
+  xSemaphoreTake(g_scanLock, portMAX_DELAY);
+  if (n != g_acceptCount || memcmp(list, g_acceptList, n * sizeof(list[0])) != 0) {
+    memcpy(g_acceptList, list, sizeof(list));
+    g_acceptCount = n;
+    applyScanParams(g_scannerRunning, out);
+    if (g_acceptCount > 0) {
+      out.printf("[INFO] Whitelist of %u MACs filtered by the controller\n", (unsigned)count);
+    } else {
+      out.println("[INFO] Whitelist filtered in software");
+    }
+  }
+  xSemaphoreGive(g_scanLock);
+}
+
+static void startScanner() {
+  xSemaphoreTake(g_scanLock, portMAX_DELAY);
+  g_scheduler.start(millis(), g_deviceCount, g_newDeviceCount);
+  g_reassembler.clear();
+  configureScanner(g_scanConsole);
+  g_scannerRunning = startScanning(g_scanConsole);
+  xSemaphoreGive(g_scanLock);
+}
+
+static void stopScanner() {
+  xSemaphoreTake(g_scanLock, portMAX_DELAY);
+  Bluefruit.Scanner.stop();
+  g_scannerRunning = false;
+  g_scheduler.stop(millis());
+  xSemaphoreGive(g_scanLock);
+}
+
+// Let the scheduler react to the report and new-device rates
+static void updateScanSchedule() {
+  xSemaphoreTake(g_scanLock, portMAX_DELAY);
+  if (g_scheduler.update(millis(), g_deviceCount, g_newDeviceCount)) {
+    applyScanParams(true, g_scanConsole);
+  }
+  xSemaphoreGive(g_scanLock);
+}
+
+// Wait until the consumer has handled every queued report
+static void drainReports(uint32_t timeoutMs) {
+  unsigned long start = millis();
+  while (!g_reportRing.empty() && millis() - start < timeoutMs) {
+    delay(10);
+  }
+}
+
+// Snapshot of the running totals, taken at the start and end of a scan or epoch
+struct ScanStats {
+  uint32_t callbacks;
+  uint32_t dropped;
+  uint32_t filtered;
+  uint32_t rejectedEarly;
+  uint32_t duplicates;
+  uint32_t held;
+  uint32_t displayed;
+  uint32_t newDevices;
+  uint32_t evicted;
+  uint32_t expired;
+  uint32_t rotations;
+  uint32_t pairs;
+  uint32_t unanswered;
+  uint32_t responsesAlone;
+  uint32_t chains;
+  uint32_t chainsAbandoned;
+  uint32_t outBytes;
+  uint32_t outRecords;
+  uint32_t outDropped;
+  uint32_t outSent[OUT_CLASS_COUNT];
+  uint32_t outLatencyMs[OUT_CLASS_COUNT];
+  uint32_t outShed;
+  uint32_t heapAllocs;
+};
+
+static ScanStats captureStats() {
+  ScanStats s;
+  s.callbacks = g_deviceCount;
+  s.dropped = g_reportRing.droppedCount();
+  s.filtered = g_filteredCount;
+  s.rejectedEarly = g_rejectedEarlyCount;
+  s.duplicates = g_duplicateCount;
+  s.held = g_heldCount;
+  s.displayed = g_displayedCount;
+  s.newDevices = g_newDeviceCount;
+  s.evicted = g_seenDevices.evictions();
+  s.expired = g_expiredCount;
+  s.rotations = g_rotationCount;
+  s.pairs = g_pairer.pairedCount();
+  s.unanswered = g_pairer.unansweredCount();
+  s.responsesAlone = g_pairer.aloneCount();
+  s.chains = g_chainCount;
+  s.chainsAbandoned = g_reassembler.abandonedCount();
+  s.outBytes = g_out.bytesWritten();
+  s.outRecords = g_out.recordsWritten();
+  s.outDropped = g_out.droppedRecords();
+  s.outShed = 0;
+  for (uint8_t c = 0; c < OUT_CLASS_COUNT; c++) {
+    OutputLatency l = g_out.classLatency((OutputClass)c);
+    s.outSent[c] = l.sent;
+    s.outLatencyMs[c] = l.totalMs;
+    s.outShed += l.late + l.evicted;
+  }
+  s.heapAllocs = heapCounters().allocs.load();
+  return s;
+}
+
+// Devices seen at or after 'sinceMs' (walks the MRU end of the table only)
+static uint32_t countActiveDevices(unsigned long sinceMs) {
+  uint32_t active = 0;
+  xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+  for (uint16_t i = g_seenDevices.first(); i != DEVICE_NONE; i = g_seenDevices.next(i)) {
+    if ((int32_t)(g_seenDevices[i].lastSeen - sinceMs) < 0) break;
+    active++;
+  }
+  xSemaphoreGive(g_deviceLock);
+  return active;
+}
+
+static void resetDevices() {
+  xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+  g_seenDevices.clear();
+  g_linker.clear();
+  g_censusStart = millis();
+  xSemaphoreGive(g_deviceLock);
+}
+
+// Queue a summary covering [from, to] behind the report output, so it never
+// splits a record while the scanner keeps running
+static void printSummary(const char* heading, const ScanStats& from, const ScanStats& to,
+                         unsigned long sinceMs) {
+  static char buf[1536];
+  LineBuffer out(buf, sizeof(buf));
+  
+  out.putf("\n[SUMMARY] %s\n", heading);
+  out.putf("  Total callbacks:  %lu\n", (unsigned long)(to.callbacks - from.callbacks));
+  out.putf("  Dropped (queue):  %lu (peak depth %lu/%d)\n",
+           (unsigned long)(to.dropped - from.dropped),
+           (unsigned long)g_reportRing.peakDepth(), ADV_RING_SLOTS);
+  out.putf("  Rejected early:   %lu (address or raw payload, never queued)\n",
+           (unsigned long)(to.rejectedEarly - from.rejectedEarly));
+  out.putf("  Filtered out:     %lu\n", (unsigned long)(to.filtered - from.filtered));
+  // What the stack drops never reaches the callback, so it is not counted
+  if (g_acceptCount > 0) {
+    out.putf("  Stack filters:    controller whitelist (%u addresses)\n", (unsigned)g_acceptCount);
+  }
+  if (g_rssiFloor > -127) {
+    out.putf("  Stack filters:    RSSI floor %d dBm\n", g_rssiFloor);
+  }
+  if (g_extScan != EXT_SCAN_OFF) {
+    out.putf("  Extended chains:  %lu reassembled (%lu abandoned)\n",
+             (unsigned long)(to.chains - from.chains),
+             (unsigned long)(to.chainsAbandoned - from.chainsAbandoned));
+  }
+  if (g_pairScanResponses) {
+    out.putf("  Scan responses:   %lu paired (%lu advertisements without, %lu responses alone)\n",
+             (unsigned long)(to.pairs - from.pairs),
+             (unsigned long)(to.unanswered - from.unanswered),
+             (unsigned long)(to.responsesAlone - from.responsesAlone));
+  }
+  out.putf("  Scan profile:     %s (%s schedule, %lu switches total)\n",
+           g_scheduler.params().name, g_scheduler.modeName(),
+           (unsigned long)g_scheduler.switchCount());
+  out.putf("  Serial output:    %lu bytes, %lu records (%lu dropped, peak %lu/%lu bytes buffered)\n",
+           (unsigned long)(to.outBytes - from.outBytes),
+           (unsigned long)(to.outRecords - from.outRecords),
+           (unsigned long)(to.outDropped - from.outDropped),
+           (unsigned long)g_out.peakBytes(), (unsigned long)g_out.fifoSize());
+  out.puts("  Output latency:  ");
+  for (uint8_t c = OUT_TARGET; c < OUT_CLASS_COUNT; c++) {
+    uint32_t sent = to.outSent[c] - from.outSent[c];
+    uint32_t avg = sent > 0 ? (to.outLatencyMs[c] - from.outLatencyMs[c]) / sent : 0;
+    out.putf(" %s %lu (avg %lu, max %lu ms)%s", OUTPUT_CLASS_NAMES[c], (unsigned long)sent,
+             (unsigned long)avg, (unsigned long)g_out.classLatency((OutputClass)c).maxMs,
+             c + 1 < OUT_CLASS_COUNT ? "," : "\n");
+  }
+  if (to.outShed != from.outShed) {
+    out.putf("  Output shed:      %lu records (over the %lu ms budget or evicted by more urgent output)\n",
+             (unsigned long)(to.outShed - from.outShed), (unsigned long)g_out.latencyBudget());
+  }
+  HeapUsage heap = HeapMonitor::read();
+#if HEAP_MONITOR_WRAP
+  out.putf("  Heap:             %lu allocations, %lu bytes in use (high-water %lu/%lu bytes)\n",
+           (unsigned long)(to.heapAllocs - from.heapAllocs), (unsigned long)heap.inUse,
+           (unsigned long)heap.claimed, (unsigned long)heap.region);
+#else
+  out.putf("  Heap:             %lu bytes in use (high-water %lu/%lu bytes)\n",
+           (unsigned long)heap.inUse, (unsigned long)heap.claimed, (unsigned long)heap.region);
+#endif
+  
+  uint32_t displayed = to.displayed - from.displayed;
+  if (g_deduplication) {
+    uint32_t newDevices = to.newDevices - from.newDevices;
+    out.putf("  Duplicates:       %lu (%lu changes held back)\n",
+             (unsigned long)(to.duplicates - from.duplicates),
+             (unsigned long)(to.held - from.held));
+    out.putf("  Displayed:        %lu (%lu new, %lu changed)\n", (unsigned long)displayed,
+             (unsigned long)newDevices, (unsigned long)(displayed - newDevices));
+    out.putf("  Unique devices:   %lu (evicted %lu, expired %lu, capacity %u)\n",
+             (unsigned long)g_seenDevices.size(),
+             (unsigned long)(to.evicted - from.evicted),
+             (unsigned long)(to.expired - from.expired),
+             (unsigned)g_seenDevices.capacity());
+    out.putf("  Rotations:        %lu linked to an earlier address (%lu ambiguous, %lu unconfirmed total)\n",
+             (unsigned long)(to.rotations - from.rotations), (unsigned long)g_linker.ambiguous(),
+             (unsigned long)g_linker.rejected());
+    out.putf("  Active devices:   %lu (seen in this period)\n",
+             (unsigned long)countActiveDevices(sinceMs));
+  } else {
+    out.putf("  Displayed:        %lu\n", (unsigned long)displayed);
+  }
+  
+  size_t n = out.endLine();
+  if (!g_out.writeRecord((const uint8_t*)out.data(), n)) {
+    // Pool full of console output - let it drain rather than lose the summary
+    g_out.waitIdle(1000);
+    g_out.writeRecord((const uint8_t*)out.data(), n);
+  }
+}
+
+// Command help, printed at startup and by 'h'
+static void printHelp() {
+  g_console.println();
+  g_console.println("================================================================================");
+  g_console.println("[COMMAND] Commands (accepted at any time, also while scanning):");
+  g_console.println("  Scanning:");
+  g_console.println("    s [seconds]  - Scan for N seconds (e.g., 's 30' for 30 sec scan)");
+  g_console.println("    a [seconds]  - Auto-scan mode: continuous scanning, summary every N sec");
+  g_console.println("    m            - Manual mode (stops auto-scanning)");
+  g_console.println("  Filters:");
+  g_console.println("    f [reset]    - Show filter status / restore built-in filters");
+  g_console.println("    b            - Add to blacklist (hide devices)");
+  g_console.println("    w            - Add to whitelist (only show devices)");
+  g_console.println("    x            - Clear all filters");
+  g_console.println("    i            - Interactive filter from last scan");
+  g_console.println("    l [dBm]      - RSSI floor: drop weaker reports in the stack (-127 = off)");
+  g_console.println("  Output:");
+  g_console.println("    q [ms]       - Output latency per class / drop changes older than MS unsent (0 = never)");
+  g_console.println("  Settings:");
+  g_console.println("    c            - Toggle colors on/off");
+  g_console.println("    d [-XX|+XX]  - Toggle deduplication / ignore or track AD type XX");
+  g_console.println("    k [...]      - Change masks: k add m 0075 6-9, k add ibeacon.minor, k del N, k rssi N, k hold MS, k reset");
+  g_console.println("    o [mode]     - Output mode: human, binary, csv, json, top, census (no arg = next)");
+  g_console.println("    t [seconds]  - Forget devices unseen for N sec (0 = never)");
+  g_console.println("    p [mode]     - Scan schedule: auto, auto-lowpower, active, passive, lowpower");
+  g_console.println("    e [mode]     - Extended advertising: off, 1m, coded (no arg = next)");
+  g_console.println("    z [reset]    - Cycle counters per pipeline stage (debug build)");
+  g_console.println("    u            - Memory: heap high-water mark, fragmentation, allocations");
+  g_console.println("    n [...]      - Identity keys: n add <IRK> [MAC] [label], n del N, n clear");
+  g_console.println("  Recording:");
+  g_console.println("    r [on|off]   - Recorder status / record reports to flash (kept across resets)");
+  g_console.println("    r dump       - Send the log as binary frames; r erase - start an empty log");
+  g_console.println("    h            - Show this help");
+  g_console.println("  Menus (b, w, i) are answered with a number or value and Enter.");
+  g_console.println("================================================================================");
+}
+
+// Recorder arming survives resets as a marker file next to the filters
+static bool setRecordArmed(bool armed) {
+  if (!g_filterStore.available()) return false;
+  if (!armed) return !InternalFS.exists(RECORD_ARM_PATH) || InternalFS.remove(RECORD_ARM_PATH);
+  File file(InternalFS);
+  if (!file.open(RECORD_ARM_PATH, FILE_O_WRITE)) return false;
+  file.close();
+  return true;
+}
+
+// Queue one chunk of a log dump, waiting while the host catches up
+static bool writeDumpChunk(const uint8_t* data, size_t len) {
+  uint32_t start = millis();
+  while (g_out.space(OUT_CONSOLE) < len) {
+    if (millis() - start > RECORD_DUMP_STALL_MS) return false;
+    delay(1);
+  }
+  return g_out.writeRecord(data, len);
+}
+
+// Identity keys are kept in their own file next to the filters. Only the
+// command task edits the entries, so it reads them without the lock.
+static bool saveIdentities() {
+  if (!g_filterStore.available()) return false;
+  IrkStoreHeader header = { IRK_STORE_MAGIC, g_irks.size(), BIN_CRC16_INIT };
+  for (uint8_t i = 0; i < g_irks.size(); i++) {
+    header.crc = binCrc16Update(header.crc, (const uint8_t*)&g_irks[i], sizeof(IrkEntry));
+  }
+  InternalFS.remove(IRK_STORE_PATH);
+  File file(InternalFS);
+  if (!file.open(IRK_STORE_PATH, FILE_O_WRITE)) return false;
+  bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+  for (uint8_t i = 0; i < g_irks.size() && ok; i++) {
+    ok = file.write((const uint8_t*)&g_irks[i], sizeof(IrkEntry)) == sizeof(IrkEntry);
+  }
+  file.close();
+  return ok;
+}
+
+// Boot only, before the consumer runs
+static void loadIdentities() {
+  if (!g_filterStore.available() || !InternalFS.exists(IRK_STORE_PATH)) return;
+  File file(InternalFS);
+  if (!file.open(IRK_STORE_PATH, FILE_O_READ)) return;
+  IrkStoreHeader header;
+  bool ok = file.read(&header, sizeof(header)) == (int)sizeof(header) &&
+            header.magic == IRK_STORE_MAGIC && header.count <= IRK_MAX;
+  uint16_t crc = BIN_CRC16_INIT;
+  for (uint16_t i = 0; ok && i < header.count; i++) {
+    IrkEntry entry;
+    ok = file.read(&entry, sizeof(entry)) == (int)sizeof(entry);
+    crc = binCrc16Update(crc, (const uint8_t*)&entry, sizeof(entry));
+    if (ok) g_irks.add(entry);
+  }
+  file.close();
+  if (!ok || crc != header.crc) {
+    g_irks.clear();
+    Serial.println("[ERROR] Stored identity keys are damaged - ignored");
+    return;
+  }
+  Serial.printf("[IRK] Loaded %u identity keys\n", (unsigned)g_irks.size());
+}
+
+// The key itself is secret; the listing shows its first and last bytes only
+static void printIdentities() {
+  xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+  uint32_t lookups = g_irks.lookupCount(), hits = g_irks.cacheHits();
+  uint32_t resolved = g_irks.resolved(), blocks = g_irks.aesBlocks();
+  xSemaphoreGive(g_deviceLock);
+  
+  g_console.printf("[IRK] %u of %d identity keys%s\n", (unsigned)g_irks.size(), IRK_MAX,
+                   g_irkReady ? "" : " (AES unavailable - not resolving)");
+  for (uint8_t i = 0; i < g_irks.size(); i++) {
+    const IrkEntry& e = g_irks[i];
+    char identityStr[18];
+    formatMac(e.identity, identityStr);
+    g_console.printf("  %2u. %-15s %s (%s)  key %02X%02X...%02X%02X\n", (unsigned)(i + 1), e.label,
+                     identityStr, addrTypeShortName(e.identityType),
+                     e.irk[0], e.irk[1], e.irk[14], e.irk[15]);
+  }
+  g_console.printf("  RPA lookups: %lu (%lu cached, %lu resolved, %lu AES blocks)\n",
+                   (unsigned long)lookups, (unsigned long)hits,
+                   (unsigned long)resolved, (unsigned long)blocks);
+}
+
+// Least free stack of each task since it started ('u' command)
+static void printTaskStacks(Print& out) {
+  struct { const char* name; TaskHandle_t task; uint16_t words; } tasks[] = {
+    { "report",   g_consumerTask, CONSUMER_STACK_SIZE },
+    { "writer",   g_writerTask,   WRITER_STACK_SIZE },
+    { "cmd",      g_commandTask,  COMMAND_STACK_SIZE },
+    { "recorder", g_recorderTask, RECORDER_STACK_SIZE },
+  };
+  out.print("  Stack headroom:  ");
+  for (size_t i = 0; i < sizeof(tasks) / sizeof(tasks[0]); i++) {
+    if (tasks[i].task == NULL) continue;
+    out.printf(" %s %lu/%u", tasks[i].name,
+               (unsigned long)uxTaskGetStackHighWaterMark(tasks[i].task), tasks[i].words);
+  }
+  out.println(" words unused");
+}
+
+// Process one command line
+static void processCommand(const String& cmd) {
+  if (cmd.length() == 0) return;
+  
+  // Parse command
+  char cmdChar = cmd.charAt(0);
+  String args = "";
+  if (cmd.length() > 1) {
+    args = cmd.substring(1);
+    args.trim();
+  }
+  
+  switch (cmdChar) {
+    case 's':
+    case 'S':
+      // Timed scan, run by the loop task; ends auto-scanning first
+      if (args.length() > 0) {
+        int duration = args.toInt();
+        if (duration <= 0 || duration > 300) {
+          g_console.println("[ERROR] Invalid duration (1-300 seconds)");
+          break;
+        }
+        g_scanTimeSeconds = duration;
+      }
+      g_console.printf("[CMD] Will scan for %lu seconds\n", (unsigned long)g_scanTimeSeconds);
+      if (g_autoScan) {
+        g_console.println("[CMD] Auto-scan stops first");
+      }
+      g_autoScan = false;
+      g_scanRequested = true;
+      break;
+      
+    case 'a':
+    case 'A':
+      // Auto-scan mode (a new period also applies to a running auto-scan)
+      if (args.length() > 0) {
+        int duration = args.toInt();
+        if (duration > 0 && duration <= 300) {
+          g_scanTimeSeconds = duration;
+        }
+      }
+      g_scanRequested = false;
+      g_autoScan = true;
+      g_console.printf("[CMD] Auto-scan mode enabled (summary every %lu seconds)\n",
+                       (unsigned long)g_scanTimeSeconds);
+      g_console.println("[CMD] Press 'm' to stop auto-scanning");
+      break;
+      
+    case 'm':
+    case 'M':
+      // Manual mode
+      if (g_autoScan) {
+        g_console.println("[CMD] Stopping auto-scan");
+      }
+      g_autoScan = false;
+      g_console.println("[CMD] Manual mode enabled (scan with 's')");
+      break;
       
     case 'f':
     case 'F':
-      // Show filter status
-      g_filter.printStatus();
+      // Show filter status; "f reset" goes back to the built-in lists
+      if (args == "reset") {
+        g_filter.beginEdit();   // one snapshot: never briefly unfiltered
+        g_filter.clearAllFilters(g_console);
+        g_filter.begin(g_console);
+        g_filter.commitEdit();
+        g_console.println("[CMD] Filters reset to the built-in lists");
+      } else if (args.length() > 0) {
+        g_console.println("[ERROR] Usage: f [reset]");
+        break;
+      }
+      g_filter.printStatus(g_console);
+      if (g_filterStore.available()) {
+        g_console.printf("  Stored in flash: %lu bytes (%s)\n\n",
+                         (unsigned long)g_filterStore.imageBytes(), FILTER_STORE_PATH);
+      } else {
+        g_console.println("  Stored in flash: no (filesystem unavailable)\n");
+      }
       break;
       
     case 'b':
@@ -627,8 +1728,8 @@ void processCommand() {
     case 'x':
     case 'X':
       // Clear filters
-      g_filter.clearAllFilters();
-      Serial.println("[CMD] All filters cleared");
+      g_filter.clearAllFilters(g_console);
+      g_console.println("[CMD] All filters cleared");
       break;
       
     case 'i':
@@ -642,374 +1743,734 @@ void processCommand() {
       // Toggle colors
 #if ENABLE_COLORS
       g_colorsEnabled = !g_colorsEnabled;
-      Serial.printf("[CMD] Colors %s\n", g_colorsEnabled ? "ENABLED" : "DISABLED");
-      Serial.println("[INFO] Note: Color toggle only affects future output");
+      g_console.printf("[CMD] Colors %s\n", g_colorsEnabled ? "ENABLED" : "DISABLED");
+      g_console.println("[INFO] Note: Color toggle only affects future output");
 #else
-      Serial.println("[INFO] Colors are disabled at compile-time");
-      Serial.println("[INFO] Set ENABLE_COLORS to true and recompile to use colors");
+      g_console.println("[INFO] Colors are disabled at compile-time");
+      g_console.println("[INFO] Set ENABLE_COLORS to true and recompile to use colors");
 #endif
       break;
       
     case 'd':
     case 'D':
+      // "d -XX" / "d +XX": ignore / track changes in AD type 0xXX
+      if (args.length() > 0) {
+        char op = args.charAt(0);
+        char* end = NULL;
+        long type = strtol(args.c_str() + 1, &end, 16);
+        if ((op != '-' && op != '+') || end == args.c_str() + 1 || *end != 0 ||
+            type < 0 || type > 0xFF) {
+          g_console.println("[ERROR] Usage: d -XX (ignore AD type XX) or d +XX (track it again)");
+          break;
+        }
+        xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+        if (op == '-') g_changeMasks.ignoreTypes.set((uint8_t)type);
+        else g_changeMasks.ignoreTypes.reset((uint8_t)type);
+        xSemaphoreGive(g_deviceLock);
+        g_console.print("[CMD] Change detection ignores AD types:");
+        if (g_changeMasks.ignoreTypes.empty()) g_console.print(" (none)");
+        for (int t = 0; t < 256; t++) {
+          if (g_changeMasks.ignoreTypes.has(t)) g_console.printf(" 0x%02X", t);
+        }
+        g_console.println();
+        g_console.println("[INFO] Tracked devices may be reported as changed once");
+        break;
+      }
+      
       // Toggle deduplication
       g_deduplication = !g_deduplication;
-      Serial.printf("[CMD] Deduplication %s\n", g_deduplication ? "ENABLED" : "DISABLED");
+      g_console.printf("[CMD] Deduplication %s\n", g_deduplication ? "ENABLED" : "DISABLED");
       if (g_deduplication) {
-        Serial.println("[INFO] Only new devices or changed data will be displayed");
+        g_console.println("[INFO] Only new devices or changed data will be displayed");
+      } else {
+        g_console.println("[INFO] All detected devices will be displayed");
+      }
+      break;
+      
+    case 'o':
+    case 'O': {
+      // Select output mode by name, or cycle to the next one
+      int mode = -1;
+      if (args.length() > 0) {
+        args.toLowerCase();
+        for (int i = 0; i < OUTPUT_MODE_COUNT; i++) {
+          if (String(OUTPUT_MODE_NAMES[i]).startsWith(args)) {
+            mode = i;
+            break;
+          }
+        }
+        if (mode < 0) {
+          g_console.printf("[ERROR] Unknown output mode: '%s'\n", args.c_str());
+          break;
+        }
+      } else {
+        mode = (g_outputMode + 1) % OUTPUT_MODE_COUNT;
+      }
+      g_outputMode = (OutputMode)mode;
+      g_console.printf("[CMD] Output mode: %s\n", OUTPUT_MODE_NAMES[g_outputMode]);
+      if (g_outputMode == OUTPUT_BINARY) {
+        g_console.println("[INFO] Reports are COBS frames with 0x00 delimiters (see docs/binary_protocol.md)");
+      } else if (g_outputMode == OUTPUT_CSV) {
+        g_console.print(CSV_HEADER);
+      } else if (g_outputMode == OUTPUT_TOP) {
+        g_console.printf("[INFO] Per-report output off; top %d devices by RSSI and report rate every %d s\n",
+                         TOP_TABLE_ROWS, TOP_REPORT_MS / 1000);
+      } else if (g_outputMode == OUTPUT_CENSUS) {
+        g_console.println("[INFO] Per-report output off; device census at the end of each scan/epoch");
+      }
+      break;
+    }
+      
+    case 't':
+    case 'T':
+      // Device memory for deduplication across epochs
+      if (args.length() > 0) {
+        int ttl = args.toInt();
+        if ((ttl > 0 || args == "0") && ttl <= 3600) {
+          g_deviceTtlSeconds = ttl;
+        } else {
+          g_console.println("[ERROR] Invalid time (0-3600 seconds)");
+          break;
+        }
+      }
+      if (g_deviceTtlSeconds > 0) {
+        g_console.printf("[CMD] Devices unseen for %lu seconds are forgotten\n",
+                         (unsigned long)g_deviceTtlSeconds);
+      } else {
+        g_console.println("[CMD] Devices are never forgotten (until the table is full)");
+      }
+      break;
+      
+    case 'l':
+    case 'L':
+      // RSSI floor, applied by the Bluefruit scanner before the callback
+      if (args.length() > 0) {
+        int floor = args.toInt();
+        if ((floor < 0 || args == "0") && floor >= -127) {
+          g_rssiFloor = (int8_t)floor;
+          Bluefruit.Scanner.filterRssi(g_rssiFloor);
+        } else {
+          g_console.println("[ERROR] Invalid RSSI floor (-127 to 0 dBm)");
+          break;
+        }
+      }
+      if (g_rssiFloor > -127) {
+        g_console.printf("[CMD] Reports below %d dBm are dropped by the stack\n", g_rssiFloor);
+      } else {
+        g_console.println("[CMD] No RSSI floor (all reports are received)");
+      }
+      break;
+      
+    case 'q':
+    case 'Q':
+      // Latency budget of the output scheduler (see serial_writer.h)
+      if (args.length() > 0) {
+        long budget = args.toInt();
+        if (budget < 0 || (budget == 0 && args != "0")) {
+          g_console.println("[ERROR] Invalid latency budget (milliseconds, 0 = never drop)");
+          break;
+        }
+        g_out.setLatencyBudget((uint32_t)budget);
+      }
+      if (g_out.latencyBudget() > 0) {
+        g_console.printf("[CMD] Changed and refresh output older than %lu ms is dropped unsent\n",
+                         (unsigned long)g_out.latencyBudget());
       } else {
-        Serial.println("[INFO] All detected devices will be displayed");
+        g_console.println("[CMD] Output is never dropped for its age");
+      }
+      for (uint8_t c = OUT_TARGET; c < OUT_CLASS_COUNT; c++) {
+        OutputLatency l = g_out.classLatency((OutputClass)c);
+        g_console.printf("  %-8s %lu sent (avg %lu, max %lu ms), dropped %lu full, %lu evicted, %lu late\n",
+                         OUTPUT_CLASS_NAMES[c], (unsigned long)l.sent,
+                         (unsigned long)(l.sent > 0 ? l.totalMs / l.sent : 0),
+                         (unsigned long)l.maxMs, (unsigned long)l.full,
+                         (unsigned long)l.evicted, (unsigned long)l.late);
+      }
+      break;
+      
+    case 'p':
+    case 'P': {
+      // Scan schedule: show status, or select a mode by name
+      int mode = -1;
+      if (args.length() > 0) {
+        args.toLowerCase();
+        for (int i = 0; i < SCAN_MODE_COUNT; i++) {
+          if (args == SCAN_MODE_NAMES[i]) {  // exact match wins ("auto" vs "auto-lowpower")
+            mode = i;
+            break;
+          }
+          if (mode < 0 && String(SCAN_MODE_NAMES[i]).startsWith(args)) mode = i;
+        }
+        if (mode < 0) {
+          g_console.printf("[ERROR] Unknown scan mode: '%s'\n", args.c_str());
+          break;
+        }
+      }
+      xSemaphoreTake(g_scanLock, portMAX_DELAY);
+      if (mode >= 0) {
+        g_scheduler.setMode((ScanMode)mode, millis());
+        applyScanParams(g_scannerRunning, g_console);
+        g_console.printf("[CMD] Scan schedule: %s\n", g_scheduler.modeName());
+      }
+      g_scheduler.printStatus(millis(), g_console);
+      xSemaphoreGive(g_scanLock);
+      break;
+    }
+      
+    case 'e':
+    case 'E': {
+      // Extended advertising / Coded PHY scanning
+      int mode = -1;
+      if (args.length() > 0) {
+        args.toLowerCase();
+        for (int i = 0; i < EXT_SCAN_MODE_COUNT; i++) {
+          if (args == EXT_SCAN_NAMES[i]) {
+            mode = i;
+            break;
+          }
+        }
+        if (mode < 0) {
+          g_console.printf("[ERROR] Unknown extended scan mode: '%s'\n", args.c_str());
+          break;
+        }
+      } else {
+        mode = (g_extScan + 1) % EXT_SCAN_MODE_COUNT;
+      }
+      xSemaphoreTake(g_scanLock, portMAX_DELAY);
+      g_extScan = (ExtScanMode)mode;
+      applyScanParams(g_scannerRunning, g_console);
+      xSemaphoreGive(g_scanLock);
+      // A rejected start has fallen back to legacy scanning
+      g_console.printf("[CMD] Extended advertising scan: %s\n", EXT_SCAN_NAMES[g_extScan]);
+      if (g_extScan == EXT_SCAN_CODED) {
+        g_console.println("[INFO] Scanning 1M and Coded PHY primary channels (window capped at interval/2)");
+      }
+      break;
+    }
+      
+    case 'k':
+    case 'K': {
+      // Change masks and significant-change policy (the consumer applies
+      // them per report, so edits happen under the device lock)
+      String sub = args;
+      String rest = "";
+      int space = args.indexOf(' ');
+      if (space > 0) {
+        sub = args.substring(0, space);
+        rest = args.substring(space + 1);
+        rest.trim();
       }
+      sub.toLowerCase();
+      
+      if (sub == "add") {
+        ChangeRule rule;
+        if (!ChangeMasks::parse(rest.c_str(), rule)) {
+          g_console.println("[ERROR] Usage: k add <m|u> <ID hex> <from>[-[to]] [@<offset>=<hex>] | k add <proto>.<field>");
+          break;
+        }
+        xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+        bool added = g_changeMasks.add(rule);
+        xSemaphoreGive(g_deviceLock);
+        if (!added) {
+          g_console.printf("[ERROR] Rule table full (%d rules)\n", CHANGE_MASK_MAX_RULES);
+          break;
+        }
+        g_console.println("[CMD] Change rule added");
+      } else if (sub == "del") {
+        int n = rest.toInt();
+        xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+        bool removed = g_changeMasks.remove(n - 1);
+        xSemaphoreGive(g_deviceLock);
+        if (!removed) {
+          g_console.println("[ERROR] Invalid rule number");
+          break;
+        }
+        g_console.printf("[CMD] Change rule %d removed\n", n);
+      } else if (sub == "rssi") {
+        int delta = rest.toInt();
+        if ((delta <= 0 && rest != "0") || delta > 100) {
+          g_console.println("[ERROR] Invalid RSSI threshold (0-100 dBm, 0 = ignore RSSI)");
+          break;
+        }
+        g_changePolicy.rssiDelta = delta;
+      } else if (sub == "hold") {
+        int ms = rest.toInt();
+        if ((ms <= 0 && rest != "0") || ms > 60000) {
+          g_console.println("[ERROR] Invalid hold time (0-60000 ms)");
+          break;
+        }
+        g_changePolicy.holdMs = ms;
+      } else if (sub == "reset") {
+        xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+        g_changeMasks.loadDefaults();
+        xSemaphoreGive(g_deviceLock);
+        g_console.println("[CMD] Built-in change rules restored");
+      } else if (sub == "clear") {
+        xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+        g_changeMasks.clear();
+        xSemaphoreGive(g_deviceLock);
+        g_console.println("[CMD] All change rules removed");
+      } else if (sub.length() > 0) {
+        g_console.printf("[ERROR] Unknown change mask command: '%s'\n", sub.c_str());
+        break;
+      }
+      if (sub.length() > 0 && sub != "rssi" && sub != "hold") {
+        g_console.println("[INFO] Tracked devices may be reported as changed once");
+      }
+      g_changeMasks.printStatus(g_changePolicy, g_console);
       break;
+    }
+      
+    case 'z':
+    case 'Z':
+      // Per-stage cycle counters (built with BLE_PERF, see perf_counters.h)
+#if BLE_PERF
+      if (args == "reset") {
+        g_perf.reset(millis(), g_deviceCount);
+        g_console.println("[CMD] Performance counters reset");
+        break;
+      } else if (args.length() > 0) {
+        g_console.println("[ERROR] Usage: z [reset]");
+        break;
+      }
+      g_perf.print(g_console, millis());
+#else
+      g_console.println("[INFO] Performance counters are not built in (use the nrf52840_debug environment)");
+#endif
+      break;
+      
+    case 'u':
+    case 'U':
+      // Heap watermark and filter arena (see heap_monitor.h), task stacks
+      g_heapMonitor.printStatus(g_console);
+      printTaskStacks(g_console);
+      break;
+      
+    case 'r':
+    case 'R': {
+      // Flash recorder (see flash_log.h)
+      args.toLowerCase();
+      if (!g_log.available()) {
+        g_console.println("[ERROR] No external flash on this board - recording unavailable");
+        break;
+      }
+      if (args.length() == 0) {
+        g_console.printf("[RECORD] Recording: %s\n", g_recording ? "ON" : "OFF");
+        g_log.printStatus(g_console);
+      } else if (args == "on") {
+        g_recording = true;
+        if (!setRecordArmed(true)) {
+          g_console.println("[ERROR] Cannot store the recorder setting - recording until reset only");
+        }
+        g_autoScan = true;
+        g_console.println("[RECORD] Recording ON, scanning continuously");
+        g_console.println("[INFO] Also after a reset: boot starts scanning and recording without a host");
+      } else if (args == "off") {
+        g_recording = false;
+        setRecordArmed(false);
+        g_log.flush();
+        g_console.printf("[RECORD] Recording OFF (%lu KB in the log)\n",
+                         (unsigned long)(g_log.used() / 1024));
+      } else if (args == "dump") {
+        // Nothing else may write while frames stream out
+        if (g_autoScan || g_scannerRunning) {
+          g_console.println("[ERROR] Stop scanning first ('m')");
+          break;
+        }
+        g_console.printf("[RECORD] Dumping %lu KB of binary frames (docs/binary_protocol.md)\n",
+                         (unsigned long)(g_log.used() / 1024));
+        g_console.sendPending();
+        static const uint8_t delimiter = 0x00;   // the text line must not join the first frame
+        writeDumpChunk(&delimiter, 1);
+        uint32_t started = millis();
+        uint32_t sent = g_log.dump(writeDumpChunk);
+        g_out.waitIdle(RECORD_DUMP_STALL_MS);
+        g_console.printf("\n[RECORD] Dump complete: %lu bytes in %lu ms\n",
+                         (unsigned long)sent, (unsigned long)(millis() - started));
+      } else if (args == "erase") {
+        g_log.erase();
+        g_console.println("[RECORD] Log erased (old sectors are reused as recording goes on)");
+      } else {
+        g_console.println("[ERROR] Usage: r [on|off|dump|erase]");
+      }
+      break;
+    }
+      
+    case 'n':
+    case 'N': {
+      // Identity keys (IRKs) of known devices, see irk_resolver.h
+      String sub = args;
+      String rest = "";
+      int space = args.indexOf(' ');
+      if (space > 0) {
+        sub = args.substring(0, space);
+        rest = args.substring(space + 1);
+        rest.trim();
+      }
+      sub.toLowerCase();
+      
+      if (sub.length() == 0) {
+        printIdentities();
+        break;
+      } else if (sub == "add") {
+        // <IRK> [identity MAC] [label]
+        IrkEntry entry = {};
+        String keyText = rest;
+        String more = "";
+        space = rest.indexOf(' ');
+        if (space > 0) {
+          keyText = rest.substring(0, space);
+          more = rest.substring(space + 1);
+          more.trim();
+        }
+        if (!IrkResolver<SoftDeviceEcb>::parseKey(keyText.c_str(), entry.irk)) {
+          g_console.println("[ERROR] Usage: n add <IRK, 32 hex digits MSB first> [identity MAC] [label]");
+          break;
+        }
+        
+        String macText = more;
+        space = more.indexOf(' ');
+        if (space > 0) macText = more.substring(0, space);
+        uint64_t mac;
+        if (macText.length() > 0 && MacPrefixTable::parse(macText.c_str(), &mac) == 12) {
+          for (int i = 0; i < 6; i++) entry.identity[i] = (uint8_t)(mac >> (8 * i));
+          // Static random addresses have both top bits set; everything else is taken as public
+          entry.identityType = (entry.identity[5] & 0xC0) == 0xC0 ? BLE_GAP_ADDR_TYPE_RANDOM_STATIC
+                                                                  : BLE_GAP_ADDR_TYPE_PUBLIC;
+          more = space > 0 ? more.substring(space + 1) : String("");
+          more.trim();
+        } else {
+          IrkResolver<SoftDeviceEcb>::defaultIdentity(entry);
+        }
+        if (more.length() > 0) {
+          strncpy(entry.label, more.c_str(), IRK_LABEL_MAX - 1);
+        } else {
+          snprintf(entry.label, sizeof(entry.label), "irk-%02X%02X", entry.irk[0], entry.irk[1]);
+        }
+        
+        xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+        bool added = g_irks.add(entry);
+        xSemaphoreGive(g_deviceLock);
+        if (!added) {
+          g_console.printf("[ERROR] Identity key list full (%d keys)\n", IRK_MAX);
+          break;
+        }
+        char identityStr[18];
+        formatMac(entry.identity, identityStr);
+        g_console.printf("[CMD] Identity key added: %s tracked as %s\n", entry.label, identityStr);
+        g_console.println("[INFO] Filter on that address to match all of its private addresses");
+      } else if (sub == "del") {
+        int n = rest.toInt();
+        xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+        bool removed = n > 0 && g_irks.remove((uint8_t)(n - 1));
+        xSemaphoreGive(g_deviceLock);
+        if (!removed) {
+          g_console.println("[ERROR] Invalid key number");
+          break;
+        }
+        g_console.printf("[CMD] Identity key %d removed\n", n);
+      } else if (sub == "clear") {
+        xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+        g_irks.clear();
+        xSemaphoreGive(g_deviceLock);
+        g_console.println("[CMD] All identity keys removed");
+      } else {
+        g_console.println("[ERROR] Usage: n [add <IRK> [identity MAC] [label] | del N | clear]");
+        break;
+      }
+      if (!saveIdentities()) {
+        g_console.println("[ERROR] Cannot store identity keys - kept until reset only");
+      }
+      g_console.println("[INFO] Devices already listed under a private address keep that entry until it expires");
+      break;
+    }
       
     case 'h':
     case 'H':
-      // Show help - just show menu again
+      printHelp();
       break;
       
     default:
-      Serial.printf("[ERROR] Unknown command: '%c'\n", cmdChar);
-      Serial.println("[CMD] Type 'h' for help");
+      g_console.printf("[ERROR] Unknown command: '%c'\n", cmdChar);
+      g_console.println("[CMD] Type 'h' for help");
       break;
   }
   
-  // Set global flag for loop to check
-  if (!shouldScan) {
-    g_autoScan = false;  // Ensure we stay in manual mode
-    g_scanTimeSeconds = 0;  // Signal to loop not to scan
+  g_console.println();
+}
+
+// Persist the current filters so runtime edits survive a power cycle
+static void saveFilters(Print& out) {
+  g_filterSavedRevision = g_filter.revision();
+  if (!g_filterStore.available()) return;
+  if (g_filterStore.save(g_filter, out)) {
+    out.printf("[FILTER] Saved to flash (%lu bytes)\n",
+               (unsigned long)g_filterStore.imageBytes());
   }
-  
-  Serial.println();
 }
 
-// Add to blacklist interactively
+// Blacklist/whitelist menu: what kind of entry to add (answered on the next line)
+static void startFilterPrompt(bool whitelist) {
+  g_shellWhitelist = whitelist;
+  if (whitelist) {
+    g_console.println("\n[WHITELIST] Add filter to ONLY show matching devices");
+    g_console.println("  WARNING: Whitelist hides everything except matches!");
+  } else {
+    g_console.println("\n[BLACKLIST] Add filter to hide devices");
+  }
+  g_console.println("  1 - Add MAC address (exact match)");
+  g_console.println("  2 - Add OUI (MAC prefix, first 3 bytes)");
+  g_console.println("  3 - Add device name (partial match)");
+  g_console.println("  4 - Add UUID (exact match)");
+  g_console.println("  5 - Add payload hex pattern (partial match in raw data)");
+  g_console.println("  0 - Cancel");
+  g_console.print("> ");
+  g_shellState = SHELL_FILTER_KIND;
+}
+
 void addToBlacklist() {
-  Serial.println("\n[BLACKLIST] Add filter to hide devices");
-  Serial.println("  1 - Add MAC address (exact match)");
-  Serial.println("  2 - Add OUI (MAC prefix, first 3 bytes)");
-  Serial.println("  3 - Add device name (partial match)");
-  Serial.println("  4 - Add UUID (partial match)");
-  Serial.println("  5 - Add payload hex pattern (partial match in raw data)");
-  Serial.println("  0 - Cancel");
-  Serial.print("> ");
-  
-  // Clear input buffer
-  while (Serial.available()) Serial.read();
-  
-  // Wait for single character choice
-  while (!Serial.available()) delay(10);
-  char choiceChar = Serial.read();
-  Serial.println(choiceChar);  // Echo
-  
-  String choice = String(choiceChar);
-  
+  startFilterPrompt(false);
+}
+
+void addToWhitelist() {
+  startFilterPrompt(true);
+}
+
+static void filterKindAnswer(const String& choice) {
+  g_shellState = SHELL_COMMAND;
   if (choice == "0") {
-    Serial.println("[CMD] Cancelled");
+    g_console.println("[CMD] Cancelled");
     return;
   }
-  
-  if (choice != "1" && choice != "2" && choice != "3" && choice != "4" && choice != "5") {
-    Serial.println("[ERROR] Invalid choice");
+  if (choice.length() != 1 || choice.charAt(0) < '1' || choice.charAt(0) > '5') {
+    g_console.println("[ERROR] Invalid choice");
     return;
   }
+  g_shellKind = choice.charAt(0);
+  g_console.print("Enter value: ");
+  g_shellState = SHELL_FILTER_VALUE;
+}
+
+static void filterValueAnswer(const String& answer) {
+  g_shellState = SHELL_COMMAND;
+  bool whitelist = g_shellWhitelist;
+  const char* list = whitelist ? "WHITELIST" : "BLACKLIST";
   
-  // Clear any remaining input
-  delay(100);
-  while (Serial.available()) Serial.read();
-  
-  Serial.print("Enter value: ");
-  
-  // Read full line for value
-  String value = "";
-  while (true) {
-    if (Serial.available()) {
-      char c = Serial.read();
-      
-      if (c == '\n' || c == '\r') {
-        Serial.println();
-        break;
-      }
-      
-      if (c == '\b' || c == 127) {
-        if (value.length() > 0) {
-          value.remove(value.length() - 1);
-          Serial.write('\b');
-          Serial.write(' ');
-          Serial.write('\b');
-        }
-        continue;
-      }
-      
-      if (c >= 32 && c <= 126) {
-        value += c;
-        Serial.write(c);
-      }
-    }
-    delay(10);
-  }
-  
-  value.trim();
+  String value = answer;
   value.toUpperCase();
-  
   if (value.length() == 0) {
-    Serial.println("[ERROR] Empty value");
+    g_console.println("[ERROR] Empty value");
     return;
   }
   
-  if (choice == "1") {
+  if (g_shellKind == '1') {
     // Full MAC address
-    g_filter.addBlacklistOUI(value);
-    Serial.printf("[BLACKLIST] Added MAC: %s\n", value.c_str());
-  } else if (choice == "2") {
+    if (!(whitelist ? g_filter.addWhitelistOUI(value) : g_filter.addBlacklistOUI(value))) {
+      g_console.println("[ERROR] Not a valid MAC/OUI (hex digits, e.g. A4:CF:12)");
+      return;
+    }
+    g_console.printf("[%s] Added MAC: %s\n", list, value.c_str());
+  } else if (g_shellKind == '2') {
     // OUI (should be format XX:XX:XX)
     if (value.length() < 8) {
-      Serial.println("[ERROR] OUI must be format XX:XX:XX (e.g., A4:CF:12)");
+      g_console.println("[ERROR] OUI must be format XX:XX:XX (e.g., A4:CF:12)");
       return;
     }
-    g_filter.addBlacklistOUI(value.substring(0, 8));
-    Serial.printf("[BLACKLIST] Added OUI: %s\n", value.substring(0, 8).c_str());
-  } else if (choice == "3") {
+    value = value.substring(0, 8);
+    if (!(whitelist ? g_filter.addWhitelistOUI(value) : g_filter.addBlacklistOUI(value))) {
+      g_console.println("[ERROR] Not a valid MAC/OUI (hex digits, e.g. A4:CF:12)");
+      return;
+    }
+    g_console.printf("[%s] Added OUI: %s\n", list, value.c_str());
+  } else if (g_shellKind == '3') {
     // Device name
-    g_filter.addBlacklistName(value);
-    Serial.printf("[BLACKLIST] Added name: %s\n", value.c_str());
-  } else if (choice == "4") {
+    if (whitelist) g_filter.addWhitelistName(value);
+    else g_filter.addBlacklistName(value);
+    g_console.printf("[%s] Added name: %s\n", list, value.c_str());
+  } else if (g_shellKind == '4') {
     // UUID
-    g_filter.addBlacklistUUID(value);
-    Serial.printf("[BLACKLIST] Added UUID: %s\n", value.c_str());
-  } else if (choice == "5") {
+    if (!(whitelist ? g_filter.addWhitelistUUID(value) : g_filter.addBlacklistUUID(value))) {
+      g_console.println("[ERROR] UUID must be 4, 8 or 32 hex digits (e.g., FD6F)");
+      return;
+    }
+    g_console.printf("[%s] Added UUID: %s\n", list, value.c_str());
+  } else {
     // Payload hex pattern
-    g_filter.addBlacklistPayload(value);
-    Serial.printf("[BLACKLIST] Added payload pattern: %s\n", value.c_str());
+    if (!(whitelist ? g_filter.addWhitelistPayload(value) : g_filter.addBlacklistPayload(value))) {
+      g_console.println("[ERROR] Payload pattern must be whole hex bytes (e.g., 4C00)");
+      return;
+    }
+    g_console.printf("[%s] Added payload pattern: %s\n", list, value.c_str());
   }
   
-  Serial.println("[BLACKLIST] Filter added successfully");
-  Serial.println("[INFO] New filter will apply to next scan");
+  g_console.printf("[%s] Filter added successfully\n", list);
+  g_console.println(whitelist ? "[INFO] ONLY matching devices are shown from now on"
+                              : "[INFO] Filter applies to reports from now on");
 }
 
-// Add to whitelist interactively
-void addToWhitelist() {
-  Serial.println("\n[WHITELIST] Add filter to ONLY show matching devices");
-  Serial.println("  WARNING: Whitelist hides everything except matches!");
-  Serial.println("  1 - Add MAC address (exact match)");
-  Serial.println("  2 - Add OUI (MAC prefix, first 3 bytes)");
-  Serial.println("  3 - Add device name (partial match)");
-  Serial.println("  4 - Add UUID (partial match)");
-  Serial.println("  5 - Add payload hex pattern (partial match in raw data)");
-  Serial.println("  0 - Cancel");
-  Serial.print("> ");
-  
-  // Clear input buffer
-  while (Serial.available()) Serial.read();
-  
-  // Wait for single character choice
-  while (!Serial.available()) delay(10);
-  char choiceChar = Serial.read();
-  Serial.println(choiceChar);  // Echo
-  
-  String choice = String(choiceChar);
+// Interactive filter from last scan: list devices, answer with a number
+void interactiveFilter() {
+  // Most recently seen devices first. Keys are kept so the selection still
+  // resolves if the consumer ages devices out before the answer arrives.
+  char names[PICK_LIST_MAX][SEEN_NAME_MAX];
+  uint32_t total;
+  g_pickCount = 0;
+  xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+  for (uint16_t i = g_seenDevices.first(); i != DEVICE_NONE && g_pickCount < PICK_LIST_MAX;
+       i = g_seenDevices.next(i)) {
+    g_pickKeys[g_pickCount] = g_seenDevices.keyAt(i);
+    memcpy(names[g_pickCount], g_seenDevices[i].name, SEEN_NAME_MAX);
+    g_pickCount++;
+  }
+  total = g_seenDevices.size();
+  xSemaphoreGive(g_deviceLock);
   
-  if (choice == "0") {
-    Serial.println("[CMD] Cancelled");
+  if (g_pickCount == 0) {
+    g_console.println("[ERROR] No devices from last scan. Run a scan first.");
     return;
   }
   
-  if (choice != "1" && choice != "2" && choice != "3" && choice != "4" && choice != "5") {
-    Serial.println("[ERROR] Invalid choice");
+  g_console.println("\n[INTERACTIVE] Select device to filter:");
+  for (int n = 0; n < g_pickCount; n++) {
+    char macStr[18];
+    formatMac(g_pickKeys[n].addr, macStr);
+    g_console.printf("  %2d - %s", n + 1, macStr);
+    if (names[n][0] != 0) {
+      g_console.printf(" (%.*s)", (int)strnlen(names[n], SEEN_NAME_MAX), names[n]);
+    }
+    g_console.println();
+  }
+  if (total > PICK_LIST_MAX) {
+    g_console.printf("  ... and %d more\n", (int)(total - PICK_LIST_MAX));
+  }
+  
+  g_console.println("  0 - Cancel");
+  g_console.print("Select device number: ");
+  g_shellState = SHELL_PICK_DEVICE;
+}
+
+static void pickDeviceAnswer(const String& choice) {
+  g_shellState = SHELL_COMMAND;
+  int idx = choice.toInt();
+  if (idx == 0) {
+    g_console.println("[CMD] Cancelled");
     return;
   }
   
-  // Clear any remaining input
-  delay(100);
-  while (Serial.available()) Serial.read();
+  if (idx < 1 || idx > g_pickCount) {
+    g_console.println("[ERROR] Invalid selection");
+    return;
+  }
   
-  Serial.print("Enter value: ");
+  const DeviceKey& key = g_pickKeys[idx - 1];
+  xSemaphoreTake(g_deviceLock, portMAX_DELAY);
+  uint16_t devIdx = g_seenDevices.find(key);
+  if (devIdx != DEVICE_NONE) g_pickName = seenName(g_seenDevices[devIdx]);
+  xSemaphoreGive(g_deviceLock);
   
-  // Read full line for value
-  String value = "";
-  while (true) {
-    if (Serial.available()) {
-      char c = Serial.read();
-      
-      if (c == '\n' || c == '\r') {
-        Serial.println();
-        break;
-      }
-      
-      if (c == '\b' || c == 127) {
-        if (value.length() > 0) {
-          value.remove(value.length() - 1);
-          Serial.write('\b');
-          Serial.write(' ');
-          Serial.write('\b');
-        }
-        continue;
-      }
-      
-      if (c >= 32 && c <= 126) {
-        value += c;
-        Serial.write(c);
-      }
-    }
-    delay(10);
+  if (devIdx == DEVICE_NONE) {
+    g_console.println("[ERROR] Device has expired since the list was shown");
+    return;
   }
   
-  value.trim();
-  value.toUpperCase();
-  
-  if (value.length() == 0) {
-    Serial.println("[ERROR] Empty value");
+  char macStr[18];
+  formatMac(key.addr, macStr);
+  g_pickMac = macStr;
+  
+  g_console.println("\n[FILTER] What to filter?");
+  g_console.println("  1 - Hide this exact MAC");
+  g_console.println("  2 - Hide this OUI (all devices with same prefix)");
+  if (g_pickName.length() > 0) {
+    g_console.printf("  3 - Hide all devices named '%s'\n", g_pickName.c_str());
+  }
+  g_console.println("  4 - ONLY show this exact MAC (whitelist)");
+  g_console.println("  5 - ONLY show this OUI (whitelist)");
+  g_console.println("  0 - Cancel");
+  g_console.print("> ");
+  g_shellState = SHELL_PICK_ACTION;
+}
+
+static void pickActionAnswer(const String& choice) {
+  g_shellState = SHELL_COMMAND;
+  if (choice == "0") {
+    g_console.println("[CMD] Cancelled");
     return;
   }
   
+  const String& devMac = g_pickMac;
+  const String& devName = g_pickName;
   if (choice == "1") {
-    g_filter.addWhitelistOUI(value);
-    Serial.printf("[WHITELIST] Added MAC: %s\n", value.c_str());
+    g_filter.addBlacklistOUI(devMac);
+    g_console.printf("[BLACKLIST] Hiding MAC: %s\n", devMac.c_str());
   } else if (choice == "2") {
-    if (value.length() < 8) {
-      Serial.println("[ERROR] OUI must be format XX:XX:XX (e.g., A4:CF:12)");
-      return;
-    }
-    g_filter.addWhitelistOUI(value.substring(0, 8));
-    Serial.printf("[WHITELIST] Added OUI: %s\n", value.substring(0, 8).c_str());
-  } else if (choice == "3") {
-    g_filter.addWhitelistName(value);
-    Serial.printf("[WHITELIST] Added name: %s\n", value.c_str());
+    String oui = devMac.substring(0, 8);
+    g_filter.addBlacklistOUI(oui);
+    g_console.printf("[BLACKLIST] Hiding OUI: %s\n", oui.c_str());
+  } else if (choice == "3" && devName.length() > 0) {
+    g_filter.addBlacklistName(devName);
+    g_console.printf("[BLACKLIST] Hiding name: %s\n", devName.c_str());
   } else if (choice == "4") {
-    g_filter.addWhitelistUUID(value);
-    Serial.printf("[WHITELIST] Added UUID: %s\n", value.c_str());
+    g_filter.addWhitelistOUI(devMac);
+    g_console.printf("[WHITELIST] ONLY showing MAC: %s\n", devMac.c_str());
   } else if (choice == "5") {
-    // Payload hex pattern
-    g_filter.addWhitelistPayload(value);
-    Serial.printf("[WHITELIST] Added payload pattern: %s\n", value.c_str());
+    String oui = devMac.substring(0, 8);
+    g_filter.addWhitelistOUI(oui);
+    g_console.printf("[WHITELIST] ONLY showing OUI: %s\n", oui.c_str());
+  } else {
+    g_console.println("[ERROR] Invalid choice");
+    return;
   }
   
-  Serial.println("[WHITELIST] Filter added successfully");
-  Serial.println("[INFO] ONLY matching devices will be shown in next scan");
+  g_console.println("[FILTER] Applied successfully");
+  g_console.println("[INFO] Filter applies to reports from now on");
 }
 
-// Interactive filter from last scan
-void interactiveFilter() {
-  if (g_seenDevices.empty()) {
-    Serial.println("[ERROR] No devices from last scan. Run a scan first.");
-    return;
+// Run one completed input line in the context of the current prompt
+static void handleCommandLine(const char* text) {
+  String line = text;
+  switch (g_shellState) {
+    case SHELL_COMMAND:      processCommand(line);    break;
+    case SHELL_FILTER_KIND:  filterKindAnswer(line);  break;
+    case SHELL_FILTER_VALUE: filterValueAnswer(line); break;
+    case SHELL_PICK_DEVICE:  pickDeviceAnswer(line);  break;
+    case SHELL_PICK_ACTION:  pickActionAnswer(line);  break;
   }
   
-  Serial.println("\n[INTERACTIVE] Select device to filter:");
-  for (size_t i = 0; i < g_seenDevices.size() && i < 20; i++) {
-    Serial.printf("  %2d - %s", (int)(i + 1), g_seenDevices[i].mac.c_str());
-    if (g_seenDevices[i].name.length() > 0) {
-      Serial.printf(" (%s)", g_seenDevices[i].name.c_str());
-    }
-    Serial.println();
+  // Any filter edit above is written to flash once, when the command is done
+  if (g_filter.revision() != g_filterSavedRevision) {
+    saveFilters(g_console);
   }
+  refreshAcceptList(g_console);
   
-  if (g_seenDevices.size() > 20) {
-    Serial.printf("  ... and %d more\n", (int)(g_seenDevices.size() - 20));
-  }
-  
-  Serial.println("  0 - Cancel");
-  Serial.print("Select device number: ");
-  
-  // Clear input buffer
-  while (Serial.available()) Serial.read();
+  if (g_shellState == SHELL_COMMAND) g_console.print("> ");
+}
+
+// Command task: polls the serial input without blocking and runs each
+// completed line, so commands work while the scanner keeps running
+static void command_task(void* arg) {
+  (void)arg;
+  printHelp();
+  g_console.print("> ");
   
-  // Read device selection
-  String choice = "";
   while (true) {
-    if (Serial.available()) {
-      char c = Serial.read();
-      
-      if (c == '\n' || c == '\r') {
-        Serial.println();
-        break;
-      }
-      
-      if (c == '\b' || c == 127) {
-        if (choice.length() > 0) {
-          choice.remove(choice.length() - 1);
-          Serial.write('\b');
-          Serial.write(' ');
-          Serial.write('\b');
-        }
-        continue;
-      }
-      
-      if (c >= '0' && c <= '9') {
-        choice += c;
-        Serial.write(c);
+    while (Serial.available()) {
+      if (g_commandLine.feed((char)Serial.read(), g_console)) {
+        handleCommandLine(g_commandLine.line());
       }
     }
+    g_console.sendPending();
     delay(10);
   }
-  
-  int idx = choice.toInt();
-  if (idx == 0) {
-    Serial.println("[CMD] Cancelled");
-    return;
-  }
-  
-  if (idx < 1 || idx > (int)g_seenDevices.size()) {
-    Serial.println("[ERROR] Invalid selection");
-    return;
-  }
-  
-  SeenDevice& dev = g_seenDevices[idx - 1];
-  
-  Serial.println("\n[FILTER] What to filter?");
-  Serial.println("  1 - Hide this exact MAC");
-  Serial.println("  2 - Hide this OUI (all devices with same prefix)");
-  if (dev.name.length() > 0) {
-    Serial.printf("  3 - Hide all devices named '%s'\n", dev.name.c_str());
-  }
-  Serial.println("  4 - ONLY show this exact MAC (whitelist)");
-  Serial.println("  5 - ONLY show this OUI (whitelist)");
-  Serial.println("  0 - Cancel");
-  Serial.print("> ");
-  
-  // Clear input buffer
-  while (Serial.available()) Serial.read();
-  
-  // Wait for single character choice
-  while (!Serial.available()) delay(10);
-  char filterChoiceChar = Serial.read();
-  Serial.println(filterChoiceChar);  // Echo
-  
-  String filterChoice = String(filterChoiceChar);
-  
-  if (filterChoice == "0") {
-    Serial.println("[CMD] Cancelled");
-    return;
-  }
-  
-  if (filterChoice == "1") {
-    g_filter.addBlacklistOUI(dev.mac);
-    Serial.printf("[BLACKLIST] Hiding MAC: %s\n", dev.mac.c_str());
-  } else if (filterChoice == "2") {
-    String oui = dev.mac.substring(0, 8);
-    g_filter.addBlacklistOUI(oui);
-    Serial.printf("[BLACKLIST] Hiding OUI: %s\n", oui.c_str());
-  } else if (filterChoice == "3" && dev.name.length() > 0) {
-    g_filter.addBlacklistName(dev.name);
-    Serial.printf("[BLACKLIST] Hiding name: %s\n", dev.name.c_str());
-  } else if (filterChoice == "4") {
-    g_filter.addWhitelistOUI(dev.mac);
-    Serial.printf("[WHITELIST] ONLY showing MAC: %s\n", dev.mac.c_str());
-  } else if (filterChoice == "5") {
-    String oui = dev.mac.substring(0, 8);
-    g_filter.addWhitelistOUI(oui);
-    Serial.printf("[WHITELIST] ONLY showing OUI: %s\n", oui.c_str());
-  } else {
-    Serial.println("[ERROR] Invalid choice");
-    return;
-  }
-  
-  Serial.println("[FILTER] Applied successfully");
-  Serial.println("[INFO] Filter will take effect in next scan");
 }
 
 void setup() {
   Serial.begin(115200);
-  while (!Serial) delay(10);
+  
+  // An armed recorder runs unattended: give a host a moment, not forever
+  bool fsMounted = g_filterStore.begin();
+  bool recordArmed = fsMounted && InternalFS.exists(RECORD_ARM_PATH);
+  uint32_t waitStart = millis();
+  while (!Serial && (!recordArmed || millis() - waitStart < RECORD_HOST_WAIT_MS)) delay(10);
   delay(1000);
   
   Serial.println();
@@ -1019,36 +2480,85 @@ void setup() {
   Serial.println("================================================================================");
   Serial.println();
   
-  // Initialize filter system
+  // Initialize filter system: stored filters if present, else the built-ins
+  // (written to flash once so later boots skip building them)
   Serial.println("[FILTER] Initializing filter system...");
-  if (g_filter.begin()) {
+  if (!fsMounted) {
+    Serial.println("[ERROR] Internal filesystem unavailable - filter changes will not be kept");
+  }
+  if (g_filterStore.load(g_filter, Serial)) {
+    g_filterSavedRevision = g_filter.revision();
+    g_filter.printStatus();
+  } else if (g_filter.begin()) {
+    saveFilters(Serial);
     g_filter.printStatus();
   } else {
     Serial.println("[FILTER] Running without filters (showing all devices)");
   }
+  loadIdentities();
   
   // Initialize Bluefruit
   Serial.println("[BLE] Initializing Bluefruit...");
   Bluefruit.begin();
   Bluefruit.setName("nRF52_Scanner");
   
+  // RPA resolution runs on the SoftDevice's AES block; check it once
+  g_irkReady = IrkResolver<SoftDeviceEcb>::selfTest();
+  if (!g_irkReady) {
+    Serial.println("[ERROR] AES self-test failed - private addresses will not be resolved");
+  }
+  
   // Set max power for scanning
   Bluefruit.setTxPower(8);  // 8 dBm max for nRF52840
   
+  // Start report consumer and output writer before the scanner can produce anything
+#if BLE_PERF
+  g_perf.begin(ADV_RING_SLOTS, millis());
+#endif
+  g_deviceLock = xSemaphoreCreateMutex();
+  g_scanLock = xSemaphoreCreateMutex();
+  xTaskCreate(serial_writer_task, "writer", WRITER_STACK_SIZE, NULL,
+              TASK_PRIO_LOW, &g_writerTask);
+  g_out.begin(g_writerTask);
+  xTaskCreate(report_consumer_task, "report", CONSUMER_STACK_SIZE, NULL,
+              TASK_PRIO_LOW, &g_consumerTask);
+  xTaskCreate(recorder_task, "recorder", RECORDER_STACK_SIZE, NULL,
+              TASK_PRIO_LOW, &g_recorderTask);
+  if (g_log.begin(g_recorderTask)) {
+    Serial.printf("[RECORD] Flash log: %lu of %lu KB used\n",
+                  (unsigned long)(g_log.used() / 1024), (unsigned long)(g_log.capacity() / 1024));
+    if (recordArmed) {
+      g_recording = true;
+      g_autoScan = true;
+      Serial.println("[RECORD] Recorder armed - recording and scanning continuously ('r off' to stop)");
+    }
+  } else if (recordArmed) {
+    Serial.println("[ERROR] Recorder armed but no external flash found");
+  }
+  
   // Configure scanner
   Bluefruit.Scanner.setRxCallback(scan_callback);
   Bluefruit.Scanner.restartOnDisconnect(true);
-  Bluefruit.Scanner.setInterval(80, 80);     // Fast: 50ms interval, 50ms window
-  Bluefruit.Scanner.filterRssi(-127);        // Show ALL devices (no RSSI filter)
-  Bluefruit.Scanner.useActiveScan(true);     // Active scan for more data
+  Bluefruit.Scanner.filterRssi(g_rssiFloor); // No floor by default ('l' command)
+  configureScanner(Serial);                  // Interval/window/active from the scheduler
+  refreshAcceptList(Serial);                 // Whitelist of full MACs to the controller
   // Note: No UUID filter by default
   
   Serial.println("[BLE] Scanner initialized successfully");
   Serial.printf("[CONFIG] Default Scan Time: %d seconds\n", g_scanTimeSeconds);
-  Serial.printf("[CONFIG] Scan Settings: Fast (50ms interval, 50ms window)\n");
-  Serial.printf("[CONFIG] RSSI Filter: DISABLED (shows all devices)\n");
-  Serial.printf("[CONFIG] Mode: %s\n", g_autoScan ? "Auto-scan" : "Manual (interactive)");
+  Serial.printf("[CONFIG] Scan Schedule: %s (change with 'p' command)\n", g_scheduler.modeName());
+  Serial.printf("[CONFIG] Extended Advertising: %s (change with 'e' command)\n", EXT_SCAN_NAMES[g_extScan]);
+  Serial.printf("[CONFIG] RSSI Filter: DISABLED (set a floor with 'l' command)\n");
+  Serial.printf("[CONFIG] Output Latency Budget: %d ms (change with 'q' command)\n",
+                OUTPUT_LATENCY_BUDGET_MS);
+  Serial.printf("[CONFIG] Mode: %s\n", g_autoScan ? "Auto-scan" : "Manual (scan with 's')");
   Serial.printf("[CONFIG] Deduplication: %s\n", g_deduplication ? "ENABLED" : "DISABLED");
+  Serial.printf("[CONFIG] Device Memory: %lu seconds (change with 't' command)\n",
+                (unsigned long)g_deviceTtlSeconds);
+  Serial.printf("[CONFIG] Output Mode: %s (change with 'o' command)\n", OUTPUT_MODE_NAMES[g_outputMode]);
+#if BLE_PERF
+  Serial.println("[CONFIG] Performance Counters: ON (show with 'z' command)");
+#endif
 #if ENABLE_COLORS
   Serial.printf("[CONFIG] Colors: %s (toggle with 'c' command)\n", g_colorsEnabled ? "ENABLED" : "DISABLED");
 #else
@@ -1063,105 +2573,135 @@ void setup() {
   
   for (int i = 0; i < 80; i++) Serial.print("-");
   Serial.println("\n");
+  
+  // From here on commands are read by their own task; loop() only runs scans
+  xTaskCreate(command_task, "cmd", COMMAND_STACK_SIZE, NULL, TASK_PRIO_LOW, &g_commandTask);
+  
+  // All tasks, tables and filters are in place; scanning allocates nothing
+  g_heapMonitor.markSteadyState();
 }
 
-void loop() {
-  // In manual mode, wait for command
-  if (!g_autoScan) {
-    processCommand();
-    
-    // Check if we should scan (scanTimeSeconds will be 0 if command doesn't want to scan)
-    if (g_scanTimeSeconds == 0) {
-      g_scanTimeSeconds = 10;  // Reset to default for next time
-      return;  // Don't scan, wait for next command
-    }
-  }
-  
+// One manual scan: fresh device state, radio on for g_scanTimeSeconds
+static void runTimedScan() {
+  uint32_t seconds = g_scanTimeSeconds;  // 's N' during the scan applies to the next one
   g_scanCount++;
-  g_deviceCount = 0;
-  g_filteredCount = 0;
-  g_duplicateCount = 0;
   
   // Clear seen devices at start of each scan for fresh tracking
-  g_seenDevices.clear();
+  resetDevices();
+  g_reportRing.resetPeak();
+  g_out.resetPeak();
   
-  Serial.printf("\n[SCAN] Starting scan #%lu (%lu seconds)...\n", 
-                (unsigned long)g_scanCount, (unsigned long)g_scanTimeSeconds);
+  g_scanConsole.printf("\n[SCAN] Starting scan #%lu (%lu seconds)...\n",
+                       (unsigned long)g_scanCount, (unsigned long)seconds);
   if (g_deduplication) {
-    Serial.println("[INFO] Deduplication enabled - only new/changed devices shown");
+    g_scanConsole.println("[INFO] Deduplication enabled - only new/changed devices shown");
   }
   
+  ScanStats start = captureStats();
   unsigned long scanStart = millis();
   
-  // Start scanning (0 = continuous until stopped)
-  Bluefruit.Scanner.start(0);
+  startScanner();
   
   // Let it scan for the configured duration
   // Process in small chunks to allow resume() to work properly
-  unsigned long scanDuration = 0;
-  while (scanDuration < g_scanTimeSeconds * 1000) {
+  while (millis() - scanStart < seconds * 1000) {
     delay(100);  // Small delay to let callbacks process
-    scanDuration = millis() - scanStart;
-    
-    // In auto mode, check for 'm' to stop
-    if (g_autoScan && Serial.available()) {
-      char c = Serial.read();
-      if (c == 'm' || c == 'M') {
-        Bluefruit.Scanner.stop();
-        g_autoScan = false;
-        Serial.println("\n[CMD] Auto-scan stopped - returning to manual mode");
-        return;
-      }
-    }
+    updateScanSchedule();
   }
   
-  // Stop scanning
-  Bluefruit.Scanner.stop();
-  
-  scanDuration = (millis() - scanStart) / 1000;
+  // Stop scanning and let the consumer and writer catch up before reporting
+  stopScanner();
+  drainReports(1000);
+  runCensus(g_scanCount);
+  g_out.waitIdle(2000);
   
-  Serial.printf("\n[SUMMARY] Scan #%lu complete (took %lu seconds)\n", 
-                (unsigned long)g_scanCount, (unsigned long)scanDuration);
-  Serial.printf("  Total callbacks:  %lu\n", (unsigned long)g_deviceCount);
-  Serial.printf("  Filtered out:     %lu\n", (unsigned long)g_filteredCount);
-  
-  if (g_deduplication) {
-    Serial.printf("  Duplicates:       %lu\n", (unsigned long)g_duplicateCount);
-    Serial.printf("  Displayed:        %lu (new or changed)\n", 
-                  (unsigned long)(g_deviceCount - g_filteredCount - g_duplicateCount));
-    Serial.printf("  Unique devices:   %lu\n", (unsigned long)g_seenDevices.size());
-  } else {
-    Serial.printf("  Displayed:        %lu\n", 
-                  (unsigned long)(g_deviceCount - g_filteredCount));
-  }
-  Serial.println();
+  char heading[64];
+  snprintf(heading, sizeof(heading), "Scan #%lu complete (took %lu seconds)",
+           (unsigned long)g_scanCount, (unsigned long)((millis() - scanStart) / 1000));
+  printSummary(heading, start, captureStats(), scanStart);
+  g_out.waitIdle(2000);
   
   // Print filter status every 5 scans
   if (g_scanCount % 5 == 0) {
-    g_filter.printStatus();
+    g_filter.printStatus(g_scanConsole);
   }
   
-  // In auto mode, brief pause then continue
-  if (g_autoScan) {
-    Serial.println("[AUTO] Auto-scan mode: Starting next scan in 3 seconds...");
-    Serial.println("       (Send 'm' to stop)");
-    for (int i = 0; i < 80; i++) Serial.print("-");
-    Serial.println();
+  // The closing rule as one record
+  char rule[82];
+  memset(rule, '-', 80);
+  rule[80] = '\n';
+  rule[81] = 0;
+  g_scanConsole.print(rule);
+}
+
+// Auto-scan: the radio never stops. Every g_scanTimeSeconds closes a
+// reporting epoch; device state carries over and ages out instead.
+static void runContinuousScan() {
+  resetDevices();
+  g_reportRing.resetPeak();
+  g_out.resetPeak();
+  
+  g_scanConsole.printf("\n[SCAN] Continuous scanning (summary every %lu seconds)...\n",
+                       (unsigned long)g_scanTimeSeconds);
+  if (g_deduplication && g_deviceTtlSeconds > 0) {
+    g_scanConsole.printf("[INFO] Devices unseen for %lu seconds are reported as new when they return\n",
+                         (unsigned long)g_deviceTtlSeconds);
+  }
+  g_scanConsole.println("       (Send 'm' to stop)");
+  
+  ScanStats epochStats = captureStats();
+  unsigned long epochStart = millis();
+  
+  startScanner();
+  
+  while (true) {
+    delay(100);
+    updateScanSchedule();
     
-    unsigned long pauseStart = millis();
-    while (millis() - pauseStart < 3000) {
-      if (Serial.available()) {
-        char c = Serial.read();
-        if (c == 'm' || c == 'M') {
-          g_autoScan = false;
-          Serial.println("\n[CMD] Auto-scan stopped - returning to manual mode");
-          return;
-        }
-      }
-      delay(100);
+    bool stop = !g_autoScan;  // cleared by the 'm' (or 's') command
+    
+    if (!stop && millis() - epochStart < g_scanTimeSeconds * 1000) continue;
+    
+    if (stop) {
+      stopScanner();
+      drainReports(1000);
     }
+    
+    // Close the epoch; the next one starts from the same snapshot so no
+    // report falls between two summaries
+    ScanStats now = captureStats();
+    unsigned long nowMs = millis();
+    g_scanCount++;
+    runCensus(g_scanCount);
+    
+    char heading[64];
+    snprintf(heading, sizeof(heading), "Epoch #%lu (%lu seconds%s)",
+             (unsigned long)g_scanCount, (unsigned long)((nowMs - epochStart) / 1000),
+             stop ? ", scanner stopped" : ", scanner running");
+    printSummary(heading, epochStats, now, epochStart);
+    
+    epochStats = now;
+    epochStart = nowMs;
+    g_reportRing.resetPeak();
+    g_out.resetPeak();
+    
+    if (stop) {
+      g_out.waitIdle(2000);
+      g_scanConsole.println("\n[CMD] Auto-scan stopped - returning to manual mode");
+      return;
+    }
+  }
+}
+
+// Scans run here; the command task only sets the flags that start and
+// stop them
+void loop() {
+  if (g_autoScan) {
+    runContinuousScan();
+  } else if (g_scanRequested) {
+    g_scanRequested = false;
+    runTimedScan();
   } else {
-    for (int i = 0; i < 80; i++) Serial.print("-");
-    Serial.println();
+    delay(20);
   }
 }
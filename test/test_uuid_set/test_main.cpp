@@ -0,0 +1,84 @@
+/*
+ * UuidSet matching (pio test -e native)
+ * Builds advertisements with 16-bit and 128-bit service UUID lists and
+ * checks which filter patterns match them.
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "uuid_set.h"
+
+static uint8_t g_payload[31];
+static AdView g_view;
+
+// One "complete list of 128-bit service UUIDs" structure, uuid in the
+// usual big-endian text order
+static const AdView& advertise128(const char* uuid) {
+  uint8_t bytes[16];
+  for (int i = 0, n = 0; uuid[i] && n < 32; i++) {
+    char c = uuid[i];
+    if (c == '-') continue;
+    uint8_t d = c <= '9' ? c - '0' : (c & ~0x20) - 'A' + 10;
+    if (n % 2 == 0) bytes[n / 2] = (uint8_t)(d << 4);
+    else bytes[n / 2] |= d;
+    n++;
+  }
+  g_payload[0] = 17;
+  g_payload[1] = AD_TYPE_128BIT_SERVICE_UUIDS;
+  for (int i = 0; i < 16; i++) g_payload[2 + i] = bytes[15 - i];
+  g_view = AdView();
+  parseAdvertisement(g_payload, 18, g_view);
+  return g_view;
+}
+
+static const AdView& advertise16(uint16_t uuid) {
+  const uint8_t payload[] = { 3, AD_TYPE_16BIT_SERVICE_UUIDS, (uint8_t)uuid, (uint8_t)(uuid >> 8) };
+  memcpy(g_payload, payload, sizeof(payload));
+  g_view = AdView();
+  parseAdvertisement(g_payload, sizeof(payload), g_view);
+  return g_view;
+}
+
+static void test_16bit_pattern_matches_16bit_uuid() {
+  UuidSet set;
+  TEST_ASSERT_TRUE(set.add("FD6F"));
+  TEST_ASSERT_TRUE(set.matches(advertise16(0xFD6F)));
+  TEST_ASSERT_FALSE(set.matches(advertise16(0xFD6E)));
+}
+
+static void test_16bit_pattern_matches_base_uuid_form() {
+  UuidSet set;
+  TEST_ASSERT_TRUE(set.add("FD6F"));
+  TEST_ASSERT_TRUE(set.matches(advertise128("0000FD6F-0000-1000-8000-00805F9B34FB")));
+}
+
+static void test_16bit_pattern_ignores_vendor_uuid_with_same_top_bits() {
+  UuidSet set;
+  TEST_ASSERT_TRUE(set.add("FD6F"));
+  TEST_ASSERT_FALSE(set.matches(advertise128("0000FD6F-1234-5678-9ABC-DEF012345678")));
+}
+
+static void test_32bit_pattern_ignores_vendor_uuid_with_same_top_bits() {
+  UuidSet set;
+  TEST_ASSERT_TRUE(set.add("D0611E78"));
+  TEST_ASSERT_TRUE(set.matches(advertise128("D0611E78-0000-1000-8000-00805F9B34FB")));
+  TEST_ASSERT_FALSE(set.matches(advertise128("D0611E78-BBB2-4591-A43E-2F52C1D5E6F1")));
+}
+
+static void test_128bit_pattern_matches_only_itself() {
+  UuidSet set;
+  TEST_ASSERT_TRUE(set.add("0000FD6F-1234-5678-9ABC-DEF012345678"));
+  TEST_ASSERT_TRUE(set.matches(advertise128("0000FD6F-1234-5678-9ABC-DEF012345678")));
+  TEST_ASSERT_FALSE(set.matches(advertise128("0000FD6F-0000-1000-8000-00805F9B34FB")));
+  TEST_ASSERT_FALSE(set.matches(advertise16(0xFD6F)));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_16bit_pattern_matches_16bit_uuid);
+  RUN_TEST(test_16bit_pattern_matches_base_uuid_form);
+  RUN_TEST(test_16bit_pattern_ignores_vendor_uuid_with_same_top_bits);
+  RUN_TEST(test_32bit_pattern_ignores_vendor_uuid_with_same_top_bits);
+  RUN_TEST(test_128bit_pattern_matches_only_itself);
+  return UNITY_END();
+}